@@ -0,0 +1,40 @@
+/*
+ * Home Accessory Architect
+ *
+ * Copyright 2019-2020 José Antonio Jiménez Campos (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * FreeRTOS settings for HAA, esp-open-rtos defaults are used for the rest
+ */
+
+#ifndef __HAA_FREERTOS_CONFIG_H__
+#define __HAA_FREERTOS_CONFIG_H__
+
+// adv_button starts evaluation from GPIO interrupts
+#define INCLUDE_xTimerPendFunctionCall              1
+
+#ifdef TASK_STATS
+// Run time stats for libs/task_stats, counted with CPU cycle counter
+#define configUSE_TRACE_FACILITY                    1
+#define configGENERATE_RUN_TIME_STATS               1
+#define INCLUDE_uxTaskGetStackHighWaterMark         1
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE()            ({ uint32_t ccount; __asm__ __volatile__ ("rsr %0, ccount" : "=a" (ccount)); ccount; })
+#endif  // TASK_STATS
+
+#include_next <FreeRTOSConfig.h>
+
+#endif  // __HAA_FREERTOS_CONFIG_H__
@@ -57,4 +57,16 @@
     .value = HOMEKIT_FLOAT_(_value), \
     ##__VA_ARGS__
 
+#define HOMEKIT_CHARACTERISTIC_MIAU_KWH HOMEKIT_MIAU_UUID("E863F10C")
+#define HOMEKIT_DECLARE_CHARACTERISTIC_MIAU_KWH(_value, ...) \
+    .type = HOMEKIT_CHARACTERISTIC_MIAU_KWH, \
+    .description = "Energy", \
+    .format = homekit_format_float, \
+    .permissions = homekit_permissions_paired_read \
+                | homekit_permissions_notify, \
+    .min_value = (float[]) {0}, \
+    .max_value = (float[]) {1000000}, \
+    .value = HOMEKIT_FLOAT_(_value), \
+    ##__VA_ARGS__
+
 #endif  // __HAA_EXTRA_CHARACTERISTICS__
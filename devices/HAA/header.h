@@ -57,19 +57,20 @@
 #define PING_TASK_SIZE                      (configMINIMAL_STACK_SIZE * 2)
 #define AUTOSWITCH_TASK_SIZE                (configMINIMAL_STACK_SIZE * 2)
 #define AUTOOFF_SETTER_TASK_SIZE            (configMINIMAL_STACK_SIZE * 2)
-#define AUTODIMMER_TASK_SIZE                (configMINIMAL_STACK_SIZE * 1)
 #define IR_TX_TASK_SIZE                     (configMINIMAL_STACK_SIZE * 4)
 #define UART_ACTION_TASK_SIZE               (configMINIMAL_STACK_SIZE * 2)
 #define HTTP_GET_TASK_SIZE                  (configMINIMAL_STACK_SIZE * 2)
 #define DELAYED_SENSOR_START_TASK_SIZE      (configMINIMAL_STACK_SIZE * 2)
+#define METRICS_TASK_SIZE                   (configMINIMAL_STACK_SIZE * 3)     // vsnprintf, socket write and stats structs
 
 // Task Priorities
 #define INITIAL_SETUP_TASK_PRIORITY         (tskIDLE_PRIORITY + 0)
-#define AUTODIMMER_TASK_PRIORITY            (tskIDLE_PRIORITY + 1)
 #define PING_TASK_PRIORITY                  (tskIDLE_PRIORITY + 0)
-#define IR_TX_TASK_PRIORITY                 (configMAX_PRIORITIES - 1)
+#define IR_TX_TASK_PRIORITY                 (tskIDLE_PRIORITY + 1)
+#define IR_TX_CPU_TASK_PRIORITY             (configMAX_PRIORITIES - 1)     // Carrier generated by CPU
 #define UART_ACTION_TASK_PRIORITY           (tskIDLE_PRIORITY + 6)
 #define HTTP_GET_TASK_PRIORITY              (tskIDLE_PRIORITY + 1)
+#define METRICS_TASK_PRIORITY               (tskIDLE_PRIORITY + 0)
 
 // Button Events
 #define SINGLEPRESS_EVENT                   0
@@ -93,8 +94,11 @@
 #define INVERTED                            "i"
 #define BUTTON_FILTER                       "f"
 #define PWM_FREQ                            "q"
+#define LED_STRIP_PIXELS                    "lp"
+#define LED_STRIP_TYPE                      "ly"
 #define ENABLE_HOMEKIT_SERVER               "h"
 #define ALLOW_INSECURE_CONNECTIONS          "u"
+#define METRICS_PORT                        "mp"
 #define UART_CONFIG_ARRAY                   "r"
 #define UART_CONFIG_ENABLE                  "n"
 #define UART_CONFIG_STOPBITS                "b"
@@ -132,6 +136,9 @@
 #define PING_POLL_PERIOD_DEFAULT            4.9
 #define BUTTON_PRESS_TYPE                   "t"
 #define PULLUP_RESISTOR                     "p"
+#define BUTTON_DOUBLEPRESS_TIME             "dt"
+#define BUTTON_LONGPRESS_TIME               "lt"
+#define BUTTON_SPECULATIVE                  "sp"
 #define VALUE                               "v"
 #define MANAGE_OTHERS_ACC_ARRAY             "m"
 #define ACCESSORY_INDEX                     "g"
@@ -190,6 +197,30 @@
 #define TH_SENSOR_TEMP_OFFSET               ch_group->num[3]
 #define HUMIDITY_OFFSET                     "h"
 #define TH_SENSOR_HUM_OFFSET                ch_group->num[4]
+#define TEMPERATURE_SENSOR_INDEX            "si"
+#define TH_SENSOR_INDEX                     ch_group->num[10]
+
+#define ADC_SAMPLES                         "as"
+#define ADC_SAMPLES_DEFAULT                 8
+#define ADC_EMA_SHIFT                       "ae"
+#define ADC_EMA_SHIFT_DEFAULT               2
+#define NTC_BETA                            "nb"
+#define NTC_BETA_DEFAULT                    3350
+#define NTC_R0                              "nr"
+#define NTC_R0_DEFAULT                      10000
+#define NTC_SERIES_RESISTOR                 "ns"
+#define NTC_SERIES_RESISTOR_DEFAULT         32000
+#define NTC_STEINHART_HART_ARRAY            "nh"
+#define NTC_ADC_TOP                         (ADC_SENSOR_RANGE * 3.3f)
+#define NTC_TEMP_CORRECTION                 (-15)
+
+#define SENSOR_FILTER_MEDIAN                "sm"
+#define SENSOR_FILTER_AVERAGE               "sa"
+#define SENSOR_FILTER_MIN_INTERVAL          "sv"
+#define SENSOR_FILTER_TEMP_STEP             "sr"
+#define SENSOR_FILTER_TEMP_MIN_DELTA        "sd"
+#define SENSOR_FILTER_HUM_STEP              "hr"
+#define SENSOR_FILTER_HUM_MIN_DELTA         "hd"
 
 #define LIGHTBULB_PWM_GPIO_R                "r"
 #define LIGHTBULB_PWM_GPIO_G                "g"
@@ -203,12 +234,18 @@
 #define LIGHTBULB_FACTOR_W                  "fw"
 #define LIGHTBULB_FACTOR_CW                 "fcw"
 #define LIGHTBULB_FACTOR_WW                 "fww"
+#define LIGHTBULB_STRIP_SEGMENT             "ls"
+#define LIGHTBULB_STRIP_EFFECT              "lx"
+#define LIGHTBULB_CHANNELS                  (ADV_PWM_MAX_CHANNELS + (LED_STRIP_MAX_SEGMENTS * 4))
 #define RGBW_PERIOD                         10
 #define RGBW_STEP                           "st"
 #define RGBW_STEP_DEFAULT                   1024
-#define PWM_SCALE                           (UINT16_MAX - 1)
-#define COLOR_TEMP_MIN                      71
-#define COLOR_TEMP_MAX                      400
+#define LIGHTBULB_FADE_DURATION             "fd"
+#define LIGHTBULB_FADE_DURATION_DEFAULT     (PWM_SCALE / RGBW_STEP_DEFAULT * RGBW_PERIOD)
+#define LIGHTBULB_FADE_DURATION_MAX         3600000     // ms, fade is timed in us
+#define LIGHTBULB_FADE_CURVE                "ec"     // LIGHTBULB_FADE_* in lightbulb_math.h
+#define LIGHTBULB_GAMMA                     "gm"
+#define PWM_SCALE                           LIGHTBULB_PWM_SCALE
 #define LIGHTBULB_BRIGHTNESS_UP             0
 #define LIGHTBULB_BRIGHTNESS_DOWN           1
 #define AUTODIMMER_DELAY                    500
@@ -216,13 +253,9 @@
 #define AUTODIMMER_TASK_DELAY_DEFAULT       1000
 #define AUTODIMMER_TASK_STEP                "e"
 #define AUTODIMMER_TASK_STEP_DEFAULT        20
-
-#define CW_RED                              52200
-#define CW_GREEN                            56000
-#define CW_BLUE                             PWM_SCALE
-#define WW_RED                              PWM_SCALE
-#define WW_GREEN                            40400
-#define WW_BLUE                             15600
+#define AUTODIMMER_CYCLES                   4
+#define AUTODIMMER_PHASE_RAMP               0
+#define AUTODIMMER_PHASE_HOLD               1
 
 #define GARAGE_DOOR_OPENED                  0
 #define GARAGE_DOOR_CLOSED                  1
@@ -242,6 +275,8 @@
 #define GARAGE_DOOR_HAS_F3                  ch_group->num[5]
 #define GARAGE_DOOR_HAS_F4                  ch_group->num[6]
 #define GARAGE_DOOR_HAS_F5                  ch_group->num[7]
+#define GARAGE_DOOR_START_TIME              ch_group->num[8]    // GARAGE_DOOR_CURRENT_TIME when door started to move
+#define GARAGE_DOOR_POLL_PERIOD_MS          1000
 
 #define WINDOW_COVER_CLOSING                0
 #define WINDOW_COVER_OPENING                1
@@ -260,12 +295,13 @@
 #define WINDOW_COVER_CORRECTION_DEFAULT     0
 #define WINDOW_COVER_POLL_PERIOD_MS         333
 #define WINDOW_COVER_MARGIN_SYNC            15
-#define WINDOW_COVER_STEP_TIME(x)           ((100.0 / (x)) * (WINDOW_COVER_POLL_PERIOD_MS / 1000.0))
-#define WINDOW_COVER_STEP_TIME_UP           ch_group->num[0]
-#define WINDOW_COVER_STEP_TIME_DOWN         ch_group->num[1]
+#define WINDOW_COVER_SPEED(x)               (100.0 / (x))   // Percent per second
+#define WINDOW_COVER_SPEED_UP               ch_group->num[0]
+#define WINDOW_COVER_SPEED_DOWN             ch_group->num[1]
 #define WINDOW_COVER_POSITION               ch_group->num[2]
 #define WINDOW_COVER_REAL_POSITION          ch_group->num[3]
 #define WINDOW_COVER_CORRECTION             ch_group->num[4]
+#define WINDOW_COVER_START_POSITION         ch_group->num[5]
 #define WINDOW_COVER_CH_CURRENT_POSITION    ch_group->ch0
 #define WINDOW_COVER_CH_TARGET_POSITION     ch_group->ch1
 #define WINDOW_COVER_CH_STATE               ch_group->ch2
@@ -283,6 +319,18 @@
 #define PM_VOLTAGE_OFFSET                   "vo"
 #define PM_CURRENT_FACTOR                   "cf"
 #define PM_CURRENT_OFFSET                   "co"
+#define PM_POWER_FACTOR                     "pf"
+#define PM_POWER_OFFSET                     "po"
+#define PM_SENSOR_GPIO_ARRAY                "pg"    // [CF, CF1, SEL] for HLW8012 and BL0937
+#define PM_SENSOR_SEL_INVERTED              "pi"
+#define PM_SENSOR_UART                      "pu"    // For CSE7766, RX at 4800 8E1, only UART0 has RX
+#define PM_SENSOR_UART_DEFAULT              0
+#define PM_ENERGY_SAVE_PERIOD_MS            1800000
+#define PM_ENERGY_SAVE_MIN_WH               1
+#define PM_VOLTAGE_STEP                     0.1f
+#define PM_CURRENT_STEP                     0.001f
+#define PM_POWER_STEP                       0.1f
+#define PM_ENERGY_STEP                      0.001f  // kWh
 
 #define MAX_ACTIONS                         32      // from 0 to (MAX_ACTIONS - 1)
 #define MAX_WILDCARD_ACTIONS                3       // from 0 to (MAX_WILDCARD_ACTIONS - 1)
@@ -364,6 +412,19 @@
 #define WIFI_STATUS_CONNECTED               3
 #define WIFI_WATCHDOG_POLL_PERIOD_MS        6000
 
+// Metrics
+#define METRICS_ACTION_COPY                 0
+#define METRICS_ACTION_RELAY                1
+#define METRICS_ACTION_ACC_MANAGER          2
+#define METRICS_ACTION_SYSTEM               3
+#define METRICS_ACTION_UART                 4
+#define METRICS_ACTION_HTTP                 5
+#define METRICS_ACTION_IR_TX                6
+#define METRICS_ACTION_WILDCARD             7
+#define METRICS_ACTION_TYPES                8
+#define METRICS_BUFFER_SIZE                 160
+#define METRICS_RECV_TIMEOUT_MS             2000
+
 #define ACCESSORIES_WITHOUT_BRIDGE          4   // Max number of accessories before using a bridge
 
 #define MS_TO_TICK(x)                       ((x) / portTICK_PERIOD_MS)
@@ -371,7 +432,6 @@
 #define MIN(x, y)                           (((x) < (y)) ? (x) : (y))
 #define MAX(x, y)                           (((x) > (y)) ? (x) : (y))
 
-#define KELVIN_TO_CELSIUS(x)                ((x) - 273.15)
 
 #define DEBUG(cond, message, ...)           if (cond) printf("%s: " message "\n", __func__, ##__VA_ARGS__);
 #define INFO(cond, message, ...)            if (cond) printf(message "\n", ##__VA_ARGS__);
@@ -381,6 +441,10 @@
 #define INFO2(message, ...)                 INFO(log_output, message, ##__VA_ARGS__);
 #define ERROR2(message, ...)                ERROR(log_output, message, ##__VA_ARGS__);
 
+#ifdef HEAP_STATS
+#define FREEHEAP()                          heap_stats_print()
+#else
 #define FREEHEAP()                          printf("Free Heap: %d\n", xPortGetFreeHeapSize())
+#endif  // HEAP_STATS
 
 #endif // __HAA_HEADER_H__
@@ -19,6 +19,7 @@
 //#include <stdio.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdarg.h>
 #include <esp/uart.h>
 //#include <esp8266.h>
 //#include <FreeRTOS.h>
@@ -43,10 +44,16 @@
 #include <adv_button.h>
 #include <ping.h>
 
-#include <multipwm/multipwm.h>
+#include <adv_pwm.h>
+#include <ir_tx.h>
+#include <led_strip.h>
 
 #include <dht.h>
-#include <ds18b20/ds18b20.h>
+#include <ds18b20_bus.h>
+#include <adc_sensor.h>
+#include <sensor_filter.h>
+#include <power_monitor.h>
+#include <lightbulb_math.h>
 
 #include <cJSON.h>
 
@@ -57,6 +64,26 @@
 #include "header.h"
 #include "types.h"
 
+#ifdef LATENCY_TRACE
+#include <latency_trace.h>
+#else
+#define LATENCY_TRACE_MARK(point, arg)
+#endif  // LATENCY_TRACE
+
+#ifdef PROFILER
+#include <profiler.h>
+#endif  // PROFILER
+
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG      HEAP_STATS_ACCESSORIES
+#include <heap_stats.h>
+#endif  // HEAP_STATS
+
+#ifdef TASK_STATS
+#define TASK_STATS_HOOK_DELETE
+#include <task_stats.h>
+#endif  // TASK_STATS
+
 uint8_t wifi_status = WIFI_STATUS_CONNECTED;
 uint8_t wifi_channel = 0;
 int8_t setup_mode_toggle_counter = INT8_MIN;
@@ -71,6 +98,9 @@ bool enable_homekit_server = true;
 bool allow_insecure = false;
 bool log_output = false;
 
+uint16_t metrics_port = 0;
+haa_metrics_t haa_metrics;
+
 bool uart_action_is_running = false;
 bool ir_tx_is_running = false;
 uint8_t ir_tx_freq = 13;
@@ -81,10 +111,18 @@ char* ir_protocol = NULL;
 bool setpwm_is_running = false;
 bool setpwm_bool_semaphore = true;
 ETSTimer* pwm_timer;
-pwm_info_t* pwm_info;
-uint16_t multipwm_duty[MULTIPWM_MAX_CHANNELS];
+uint16_t pwm_duty[LIGHTBULB_CHANNELS];
+uint16_t pwm_level[LIGHTBULB_CHANNELS];          // Before gamma
+uint16_t pwm_level_from[LIGHTBULB_CHANNELS];
 uint16_t pwm_freq = 0;
 
+// LED strip segments use lightbulb channels after PWM ones
+uint16_t led_strip_pixels = 0;
+uint8_t led_strip_type = LED_STRIP_TYPE_GRB;
+uint8_t led_strip_next_channel = ADV_PWM_MAX_CHANNELS;
+bool led_strip_effect_is_running = false;
+ETSTimer *led_strip_timer = NULL;
+
 char name_value[11];
 char serial_value[13];
 
@@ -95,17 +133,29 @@ bool ping_is_running = false;
 last_state_t* last_states = NULL;
 ch_group_t* ch_groups = NULL;
 lightbulb_group_t* lightbulb_groups = NULL;
+adc_group_t* adc_groups = NULL;
+sensor_filter_group_t* sensor_filter_groups = NULL;
 ping_input_t* ping_inputs = NULL;
 
 #ifdef HAA_DEBUG
 ETSTimer free_heap_timer;
 uint32_t free_heap = 0;
+#ifdef HEAP_STATS
+uint32_t min_free_heap = UINT32_MAX;
+#endif  // HEAP_STATS
 void free_heap_watchdog() {
     uint32_t new_free_heap = xPortGetFreeHeapSize();
     if (new_free_heap != free_heap) {
         free_heap = new_free_heap;
         INFO2("Free Heap: %d", free_heap);
     }
+    
+#ifdef HEAP_STATS
+    if (new_free_heap < min_free_heap) {
+        min_free_heap = new_free_heap;
+        heap_stats_print();
+    }
+#endif  // HEAP_STATS
 }
 #endif  // HAA_DEBUG
 
@@ -180,6 +230,26 @@ lightbulb_group_t *lightbulb_group_find(homekit_characteristic_t *ch) {
     return lightbulb_group;
 }
 
+sensor_filter_group_t *sensor_filter_group_find(ch_group_t *ch_group) {
+    sensor_filter_group_t *sensor_filter_group = sensor_filter_groups;
+    while (sensor_filter_group &&
+           sensor_filter_group->ch_group != ch_group) {
+        sensor_filter_group = sensor_filter_group->next;
+    }
+
+    return sensor_filter_group;
+}
+
+adc_group_t *adc_group_find(ch_group_t *ch_group) {
+    adc_group_t *adc_group = adc_groups;
+    while (adc_group &&
+           adc_group->ch_group != ch_group) {
+        adc_group = adc_group->next;
+    }
+
+    return adc_group;
+}
+
 void led_task(void *pvParameters) {
     const uint8_t times = (int) pvParameters;
     
@@ -217,13 +287,12 @@ void wifi_watchdog() {
         if (wifi_status == WIFI_STATUS_CONNECTING) {
             wifi_status = WIFI_STATUS_PRECONNECTED;
             INFO2("WiFi connected");
+            haa_metrics.wifi_reconnects++;
             homekit_mdns_announce();
             
         } else if (wifi_status == WIFI_STATUS_PRECONNECTED) {
             wifi_status = WIFI_STATUS_CONNECTED;
             wifi_channel = sdk_wifi_get_channel();
-            INFO2("mDNS reannounced");
-            homekit_mdns_announce();
         }
         
     } else {
@@ -231,6 +300,7 @@ void wifi_watchdog() {
         led_blink(8);
         ERROR2("WiFi disconnected");
 
+        haa_metrics.wifi_disconnects++;
         wifi_status = WIFI_STATUS_DISCONNECTED;
         
         wifi_config_reset();
@@ -448,6 +518,8 @@ void hkc_group_notify(ch_group_t *ch_group) {
 }
 
 void hkc_setter(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     INFO2("Setter");
     ch->value = value;
     hkc_group_notify(ch_group_find(ch));
@@ -467,6 +539,8 @@ void do_wildcard_actions(ch_group_t *ch_group, uint8_t index, const float action
 
 // --- ON
 void hkc_on_setter(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         if (ch->value.bool_value != value.bool_value) {
@@ -528,6 +602,8 @@ void on_timer_worker(void *args) {
 
 // --- LOCK MECHANISM
 void hkc_lock_setter(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         if (ch->value.int_value != value.int_value) {
@@ -569,6 +645,8 @@ void hkc_lock_status_setter(homekit_characteristic_t *ch, const homekit_value_t
 
 // --- BUTTON EVENT
 void button_event(const uint8_t gpio, void *args, const uint8_t event_type) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     homekit_characteristic_t *ch = args;
     
     ch_group_t *ch_group = ch_group_find(ch);
@@ -685,6 +763,8 @@ void sensor_status_0(const uint8_t gpio, void *args, const uint8_t type) {
 
 // --- WATER VALVE
 void hkc_valve_setter(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         if (ch->value.int_value != value.int_value) {
@@ -875,6 +955,8 @@ void process_th(void *args) {
 }
 
 void update_th(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         led_blink(1);
@@ -989,82 +1071,23 @@ void th_input_temp(const uint8_t gpio, void *args, const uint8_t type) {
 }
 
 // --- TEMPERATURE
-void temperature_timer_worker(void *args) {
-    INFO2("Read TH sensor");
-    float taylor_log(float x) {
-        // https://stackoverflow.com/questions/46879166/finding-the-natural-logarithm-of-a-number-using-taylor-series-in-c
-        if (x <= 0.0) {
-            return x;
-        }
-        
-        float z = (x + 1) / (x - 1);
-        const float step = ((x - 1) * (x - 1)) / ((x + 1) * (x + 1));
-        float totalValue = 0;
-        float powe = 1;
-        for (uint8_t i = 0; i < 10; i++) {
-            z *= step;
-            const float y = (1 / powe) * z;
-            totalValue = totalValue + y;
-            powe = powe + 2;
-        }
-        
-        totalValue *= 2;
-        
-        return totalValue;
-    }
-    
-    ch_group_t *ch_group = args;
-    
-    float humidity_value, temperature_value;
-    bool get_temp = false;
-    
-    if (TH_SENSOR_TYPE != 3 && TH_SENSOR_TYPE < 5) {
-        dht_sensor_type_t current_sensor_type = DHT_TYPE_DHT22; // TH_SENSOR_TYPE == 2
-        
-        if (TH_SENSOR_TYPE == 1) {
-            current_sensor_type = DHT_TYPE_DHT11;
-        } else if (TH_SENSOR_TYPE == 4) {
-            current_sensor_type = DHT_TYPE_SI7021;
-        }
-        
-        get_temp = dht_read_float_data(current_sensor_type, TH_SENSOR_GPIO, &humidity_value, &temperature_value);
-        
-    } else if (TH_SENSOR_TYPE == 3) {
-        ds18b20_addr_t ds18b20_addr[1];
-        
-        if (ds18b20_scan_devices(TH_SENSOR_GPIO, ds18b20_addr, 1) == 1) {
-            float temps[1];
-            ds18b20_measure_and_read_multi(TH_SENSOR_GPIO, ds18b20_addr, 1, temps);
-            temperature_value = temps[0];
-            humidity_value = 0.0;
-            get_temp = true;
-        }
-        
-    } else {
-        float adc = sdk_system_adc_read();
-        if (TH_SENSOR_TYPE == 5) {
-            // https://github.com/arendst/Tasmota/blob/7177c7d8e003bb420d8cae39f544c2b8a9af09fe/tasmota/xsns_02_analog.ino#L201
-            temperature_value = KELVIN_TO_CELSIUS(3350 / (3350 / 298.15 + taylor_log(((32000 * adc) / ((1024 * 3.3) - adc)) / 10000))) - 15;
-            
-        } else if (TH_SENSOR_TYPE == 6) {
-            temperature_value = adc;
-            
-        } else {    // TH_SENSOR_TYPE == 7
-            temperature_value = 1024 - adc;
-        }
-        
-        if (TH_SENSOR_HUM_OFFSET != 0.000000f) {
-            temperature_value *= TH_SENSOR_HUM_OFFSET;
-        }
-        
-        get_temp = true;
+bool temperature_filter(ch_group_t *ch_group, const uint8_t index, float *value) {
+    sensor_filter_group_t *sensor_filter_group = sensor_filter_group_find(ch_group);
+    if (!sensor_filter_group) {
+        return true;
     }
     
+    return sensor_filter_process(&sensor_filter_group->sensor_filters[index], *value, xTaskGetTickCount() * portTICK_PERIOD_MS, value);
+}
+
+void temperature_publish(ch_group_t *ch_group, bool get_temp, float temperature_value, float humidity_value) {
     /*
      * Only for tests. Keep comment for releases
      */
     //get_temp = true; temperature_value = 21;
     
+    bool changed = false;
+    
     if (get_temp) {
         if (ch_group->ch0) {
             temperature_value += TH_SENSOR_TEMP_OFFSET;
@@ -1076,8 +1099,10 @@ void temperature_timer_worker(void *args) {
             
             INFO2("TEMP %g", temperature_value);
             
-            if (temperature_value != ch_group->ch0->value.float_value) {
+            if (temperature_filter(ch_group, 0, &temperature_value) &&
+                temperature_value != ch_group->ch0->value.float_value) {
                 ch_group->ch0->value = HOMEKIT_FLOAT(temperature_value);
+                changed = true;
                 
                 if (ch_group->ch5) {
                     update_th(ch_group->ch0, ch_group->ch0->value);
@@ -1097,8 +1122,10 @@ void temperature_timer_worker(void *args) {
 
             INFO2("HUM %g", humidity_value);
             
-            if (humidity_value != ch_group->ch1->value.float_value) {
+            if (temperature_filter(ch_group, 1, &humidity_value) &&
+                humidity_value != ch_group->ch1->value.float_value) {
                 ch_group->ch1->value = HOMEKIT_FLOAT(humidity_value);
+                changed = true;
                 
                 do_wildcard_actions(ch_group, 1, humidity_value);
             }
@@ -1110,6 +1137,7 @@ void temperature_timer_worker(void *args) {
         
         if (ch_group->ch6) {
             TH_SENSOR_ERROR_COUNT++;
+            haa_metrics.sensor_errors++;
 
             if ((uint8_t) TH_SENSOR_ERROR_COUNT > TH_SENSOR_MAX_ALLOWED_ERRORS) {
                 ERROR2("Turning off TH...");
@@ -1122,222 +1150,381 @@ void temperature_timer_worker(void *args) {
                 }
                 
                 update_th(ch_group->ch2, HOMEKIT_UINT8(0));
+                changed = true;
+                
+                sensor_filter_group_t *sensor_filter_group = sensor_filter_group_find(ch_group);
+                if (sensor_filter_group) {
+                    sensor_filter_reset(&sensor_filter_group->sensor_filters[0]);
+                    sensor_filter_reset(&sensor_filter_group->sensor_filters[1]);
+                }
             }
 
         }
     }
     
-    hkc_group_notify(ch_group);
+    // Unchanged values are not notified
+    if (changed) {
+        hkc_group_notify(ch_group);
+    }
 }
 
-// --- LIGHTBULBS
-// https://gist.github.com/rasod/42eab9206e28ca91c8d9f926fa71a938
-float white_factor(const float r, const float g, const uint16_t b, const float w_r, const float w_g, const float w_b, const float rgb_min, const float rgb_max) {
-    float r_f = 1;
-    float g_f = 1;
-    float b_f = 1;
-    float w_f = 0;
-    
-    if (rgb_max >= 1) {
-        const float w_min = MIN(MIN(w_r, w_g), w_b);
+void temperature_dht_done(bool result, int16_t humidity, int16_t temperature, void *args) {
+    temperature_publish((ch_group_t *) args, result, (float) temperature / 10, (float) humidity / 10);
+}
 
-        if (w_r > w_min) {
-            r_f = (r - rgb_min) / (w_g - w_min);
-        }
+void temperature_ds18b20_done(bool result, float temperature, void *args) {
+    temperature_publish((ch_group_t *) args, result, temperature, 0);
+}
 
-        if (w_g > w_min) {
-            g_f = (g - rgb_min) / (w_g - w_min);
+void temperature_timer_worker(void *args) {
+    INFO2("Read TH sensor");
+    ch_group_t *ch_group = args;
+    
+    float humidity_value, temperature_value;
+    bool get_temp = false;
+    
+    if (TH_SENSOR_TYPE != 3 && TH_SENSOR_TYPE < 5) {
+        dht_sensor_type_t current_sensor_type = DHT_TYPE_DHT22; // TH_SENSOR_TYPE == 2
+        
+        if (TH_SENSOR_TYPE == 1) {
+            current_sensor_type = DHT_TYPE_DHT11;
+        } else if (TH_SENSOR_TYPE == 4) {
+            current_sensor_type = DHT_TYPE_SI7021;
+        }
+        
+        // Result is published by temperature_dht_done() when all bits are captured
+        if (dht_read_async(current_sensor_type, TH_SENSOR_GPIO, temperature_dht_done, ch_group)) {
+            return;
         }
         
-        if (w_b > w_min) {
-            b_f = (b - rgb_min) / (w_b - w_min);
+    } else if (TH_SENSOR_TYPE == 3) {
+        // Result is published by temperature_ds18b20_done() when bus conversion ends
+        if (ds18b20_bus_read(TH_SENSOR_GPIO, TH_SENSOR_INDEX, temperature_ds18b20_done, ch_group)) {
+            return;
         }
+        
+    } else {
+        adc_group_t *adc_group = adc_group_find(ch_group);
+        if (!adc_group) {
+            // Not allocated by th_sensor_adc()
+            temperature_publish(ch_group, false, 0, 0);
+            return;
+        }
+        
+        uint16_t samples[ADC_SENSOR_MAX_SAMPLES];
+        for (uint8_t i = 0; i < adc_group->samples; i++) {
+            samples[i] = sdk_system_adc_read();
+        }
+        
+        const uint16_t adc = adc_sensor_filter(&adc_group->adc_sensor, adc_sensor_median(samples, adc_group->samples));
+        
+        if (TH_SENSOR_TYPE == 5) {
+            temperature_value = (adc_sensor_lut_lookup(adc_group->lut, adc) * 0.01f) + NTC_TEMP_CORRECTION;
+            
+        } else if (TH_SENSOR_TYPE == 6) {
+            temperature_value = (adc + (ADC_SENSOR_ONE >> 1)) >> ADC_SENSOR_FRAC_BITS;
+            
+        } else {    // TH_SENSOR_TYPE == 7
+            temperature_value = ADC_SENSOR_RANGE - ((adc + (ADC_SENSOR_ONE >> 1)) >> ADC_SENSOR_FRAC_BITS);
+        }
+        
+        if (TH_SENSOR_HUM_OFFSET != 0.000000f) {
+            temperature_value *= TH_SENSOR_HUM_OFFSET;
+        }
+        
+        get_temp = true;
+    }
+    
+    temperature_publish(ch_group, get_temp, temperature_value, humidity_value);
+}
 
-        w_f = MIN(MAX(0, MIN(MIN(r_f, g_f), b_f)), 1);
+// --- POWER MONITOR
+bool power_monitor_update(ch_group_t *ch_group, homekit_characteristic_t *ch, const float value, const float step, const int8_t wildcard_index) {
+    const float rounded = roundf(value / step) * step;
+    if (rounded == ch->value.float_value) {
+        return false;
+    }
+    
+    ch->value = HOMEKIT_FLOAT(rounded);
+    
+    if (wildcard_index >= 0) {
+        do_wildcard_actions(ch_group, wildcard_index, rounded);
     }
+    
+    return true;
+}
 
-    if (w_r > 0) {
-        r_f = r / w_r;
+void power_monitor_timer_worker(void *args) {
+    pm_group_t *pm_group = args;
+    ch_group_t *ch_group = pm_group->ch_group;
+    power_monitor_values_t values;
+    
+    if (!power_monitor_read(pm_group->power_monitor, &values)) {
+        ERROR2("PM sensor");
+        haa_metrics.sensor_errors++;
+        return;
     }
     
-    if (w_g > 0) {
-        g_f = g / w_g;
+    bool changed = power_monitor_update(ch_group, ch_group->ch1, values.voltage, PM_VOLTAGE_STEP, 0);
+    changed |= power_monitor_update(ch_group, ch_group->ch2, values.current, PM_CURRENT_STEP, 1);
+    changed |= power_monitor_update(ch_group, ch_group->ch3, values.power, PM_POWER_STEP, 2);
+    const uint32_t energy_wh = values.energy / POWER_MONITOR_MWS_PER_WH;
+    const float energy_kwh = (energy_wh + ((float) (values.energy % POWER_MONITOR_MWS_PER_WH) / POWER_MONITOR_MWS_PER_WH)) / 1000;
+    changed |= power_monitor_update(ch_group, ch_group->ch4, energy_kwh, PM_ENERGY_STEP, -1);
+    
+    if (changed) {
+        hkc_group_notify(ch_group);
     }
     
-    if (w_b > 0) {
-        b_f = b / w_b;
+    // Energy is kept in RAM and saved to flash from time to time
+    const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+    if ((now_ms - pm_group->energy_saved_ms) >= PM_ENERGY_SAVE_PERIOD_MS &&
+        (energy_wh - pm_group->energy_saved) >= PM_ENERGY_SAVE_MIN_WH) {
+        INFO2("Saving energy %i Wh", energy_wh);
+        
+        if (sysparam_set_int32(pm_group->energy_id, energy_wh) == SYSPARAM_OK) {
+            pm_group->energy_saved = energy_wh;
+        } else {
+            ERROR2("Flash saving energy");
+        }
+        
+        pm_group->energy_saved_ms = now_ms;
     }
-
-    return MIN(MAX(0, MIN(MIN(MIN(r_f, g_f), b_f), w_f)), 1);
 }
 
-//https://github.com/espressif/esp-idf/examples/peripherals/rmt/led_strip/main/led_strip_main.c
+// --- LIGHTBULBS
+// Color math is integer in lightbulb_math, ESP8266 has no FPU
 void hsi2rgbw(uint16_t h, uint16_t s, uint16_t v, lightbulb_group_t *lightbulb_group) {
-    h %= 360; // h -> [0,360]
-    const uint32_t rgb_max = v * (PWM_SCALE / 100.00f);
-    const uint32_t rgb_min = rgb_max * (100 - s) / 100.0f;
+    lightbulb_rgbw_t rgbw;
+    lightbulb_hsi2rgbw(h, s, v, &rgbw);
+    
+    lightbulb_group->target_r  = lightbulb_factor_scale(lightbulb_group->factor_r,  rgbw.r);
+    lightbulb_group->target_g  = lightbulb_factor_scale(lightbulb_group->factor_g,  rgbw.g);
+    lightbulb_group->target_b  = lightbulb_factor_scale(lightbulb_group->factor_b,  rgbw.b);
+    lightbulb_group->target_w  = lightbulb_factor_scale(lightbulb_group->factor_w,  rgbw.w);
+    lightbulb_group->target_cw = lightbulb_factor_scale(lightbulb_group->factor_cw, rgbw.cw);
+    lightbulb_group->target_ww = lightbulb_factor_scale(lightbulb_group->factor_ww, rgbw.ww);
+}
 
-    const uint32_t i = h / 60;
-    const uint32_t diff = h % 60;
+void led_strip_effect_worker() {
+    led_strip_show();
+}
 
-    const uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+// New duties are applied by PWM ISR at next period start, output is not stopped
+void pwm_set_all() {
+    for (uint8_t i = 0; i < adv_pwm_channels(); i++) {
+        adv_pwm_set_duty(i, pwm_duty[i]);
+    }
+    adv_pwm_update();
+    
+    if (led_strip_next_channel > ADV_PWM_MAX_CHANNELS) {
+        lightbulb_group_t *lightbulb_group = lightbulb_groups;
+        while (lightbulb_group) {
+            if (lightbulb_group->strip_segment != 255) {
+                led_strip_color_t color;
+                color.r = pwm_duty[lightbulb_group->pwm_r] >> 8;
+                color.g = pwm_duty[lightbulb_group->pwm_g] >> 8;
+                color.b = pwm_duty[lightbulb_group->pwm_b] >> 8;
+                color.w = (lightbulb_group->pwm_w != 255) ? (pwm_duty[lightbulb_group->pwm_w] >> 8) : 0;
+                led_strip_set_color(lightbulb_group->strip_segment, color);
+            }
+            
+            lightbulb_group = lightbulb_group->next;
+        }
+        
+        led_strip_show();
+        
+        // Effects keep running after fade ends
+        const bool has_effects = led_strip_has_running_effects();
+        if (has_effects != led_strip_effect_is_running) {
+            led_strip_effect_is_running = has_effects;
+            if (has_effects) {
+                sdk_os_timer_arm(led_strip_timer, LED_STRIP_EFFECT_FRAME_MS, true);
+            } else {
+                sdk_os_timer_disarm(led_strip_timer);
+            }
+        }
+    }
+}
 
-    uint32_t r, g, b;
+void lightbulb_fade_channel(const uint8_t channel, const uint16_t target, const uint32_t eased, const bool gamma) {
+    if (channel != 255) {
+        const int32_t from = pwm_level_from[channel];
+        pwm_level[channel] = from + (((int64_t) (target - from) * eased) >> 16);
+        pwm_duty[channel] = gamma ? lightbulb_gamma(pwm_level[channel]) : pwm_level[channel];
+    }
+}
+
+// All channels of a group use same eased progress, so they reach targets at same time
+void lightbulb_fade_apply(lightbulb_group_t *lightbulb_group, const uint32_t eased) {
+    lightbulb_fade_channel(lightbulb_group->pwm_r, lightbulb_group->target_r, eased, lightbulb_group->gamma);
+    lightbulb_fade_channel(lightbulb_group->pwm_g, lightbulb_group->target_g, eased, lightbulb_group->gamma);
+    lightbulb_fade_channel(lightbulb_group->pwm_b, lightbulb_group->target_b, eased, lightbulb_group->gamma);
+    lightbulb_fade_channel(lightbulb_group->pwm_w, lightbulb_group->target_w, eased, lightbulb_group->gamma);
+    lightbulb_fade_channel(lightbulb_group->pwm_cw, lightbulb_group->target_cw, eased, lightbulb_group->gamma);
+    lightbulb_fade_channel(lightbulb_group->pwm_ww, lightbulb_group->target_ww, eased, lightbulb_group->gamma);
+}
+
+void lightbulb_fade_start(lightbulb_group_t *lightbulb_group, const uint32_t duration_ms) {
+    const uint8_t channels[] = {
+        lightbulb_group->pwm_r,
+        lightbulb_group->pwm_g,
+        lightbulb_group->pwm_b,
+        lightbulb_group->pwm_w,
+        lightbulb_group->pwm_cw,
+        lightbulb_group->pwm_ww
+    };
     
-    INFO2("light switch %i", i);
-    switch (i) {
-        case 0:
-            r = rgb_max;
-            g = rgb_min + rgb_adj;
-            b = rgb_min;
-            break;
-        case 1:
-            r = rgb_max - rgb_adj;
-            g = rgb_max;
-            b = rgb_min;
-            break;
-        case 2:
-            r = rgb_min;
-            g = rgb_max;
-            b = rgb_min + rgb_adj;
-            break;
-        case 3:
-            r = rgb_min;
-            g = rgb_max - rgb_adj;
-            b = rgb_max;
-            break;
-        case 4:
-            r = rgb_min + rgb_adj;
-            g = rgb_min;
-            b = rgb_max;
-            break;
-        default:    // case 5:
-            r = rgb_max;
-            g = rgb_min;
-            b = rgb_max - rgb_adj;
-            break;
+    for (uint8_t i = 0; i < sizeof(channels); i++) {
+        if (channels[i] != 255) {
+            pwm_level_from[channels[i]] = pwm_level[channels[i]];
+        }
     }
+    
+    lightbulb_group->fade_start = sdk_system_get_time();
+    lightbulb_group->fade_duration = duration_ms * 1000;
+    lightbulb_group->is_fading = true;
+    
+    if (!setpwm_is_running) {
+        setpwm_is_running = true;
+        sdk_os_timer_arm(pwm_timer, RGBW_PERIOD, true);
+    }
+}
 
-    float cw_f = white_factor(r, g, b, CW_RED, CW_GREEN, CW_BLUE, rgb_min, rgb_max);
-    float ww_f = white_factor(r, g, b, WW_RED, WW_GREEN, WW_BLUE, rgb_min, rgb_max);
+void lightbulb_group_set_targets(ch_group_t *ch_group, lightbulb_group_t *lightbulb_group) {
+    if (lightbulb_group->pwm_r != 255) {            // RGB, RGB-W, RGB-CW-WW, RGB-W-CW-WW
+        hsi2rgbw(ch_group->ch2->value.float_value, ch_group->ch3->value.float_value, ch_group->ch1->value.int_value, lightbulb_group);
+        
+    } else if (lightbulb_group->pwm_b != 255) {     // Custom Color Temperature
+        const uint16_t target_color = lightbulb_color_temp(ch_group->ch2->value.int_value);
+        
+        lightbulb_group->target_w = lightbulb_factor_scale(lightbulb_group->factor_w, target_color * ch_group->ch1->value.int_value / 100);
+        lightbulb_group->target_b = lightbulb_factor_scale(lightbulb_group->factor_b, (PWM_SCALE - target_color) * ch_group->ch1->value.int_value / 100);
+        
+    } else {                                        // One Color Dimmer
+        lightbulb_group->target_w = lightbulb_factor_scale(lightbulb_group->factor_w, PWM_SCALE * ch_group->ch1->value.int_value / 100);
+    }
+}
 
-    const float white_f = ww_f - cw_f;
-    if (white_f > 1) {
-        cw_f /= white_f;
-        ww_f /= white_f;
+// Current brightness while autodimmer is ramping to 100%
+uint8_t autodimmer_brightness(lightbulb_group_t *lightbulb_group) {
+    if (lightbulb_group->autodimmer_phase == AUTODIMMER_PHASE_RAMP && lightbulb_group->is_fading) {
+        const uint32_t elapsed = sdk_system_get_time() - lightbulb_group->fade_start;
+        if (elapsed < lightbulb_group->fade_duration) {
+            return lightbulb_group->autodimmer_from + (((uint64_t) (100 - lightbulb_group->autodimmer_from) * elapsed) / lightbulb_group->fade_duration);
+        }
     }
     
-    const uint32_t cw = cw_f * PWM_SCALE;
-    const uint32_t ww = ww_f * PWM_SCALE;
+    return 100;
+}
+
+void autodimmer_ramp(ch_group_t *ch_group, lightbulb_group_t *lightbulb_group) {
+    lightbulb_group->autodimmer_phase = AUTODIMMER_PHASE_RAMP;
+    lightbulb_group->autodimmer_from = ch_group->ch1->value.int_value;
+    
+    // Same speed as old autodimmer_task: autodimmer_task_step % every autodimmer_task_delay
+    const uint32_t duration = (uint32_t) (100 - lightbulb_group->autodimmer_from) * lightbulb_group->autodimmer_task_delay / lightbulb_group->autodimmer_task_step;
+    
+    ch_group->ch1->value.int_value = 100;
+    lightbulb_group_set_targets(ch_group, lightbulb_group);
+    lightbulb_fade_start(lightbulb_group, duration);
+}
+
+void autodimmer_stop(ch_group_t *ch_group, lightbulb_group_t *lightbulb_group) {
+    // Brightness is frozen where ramp is now
+    ch_group->ch1->value.int_value = autodimmer_brightness(lightbulb_group);
+    lightbulb_group->autodimmer = 0;
+    
+    lightbulb_group_set_targets(ch_group, lightbulb_group);
+    lightbulb_fade_start(lightbulb_group, 0);
+    
+    INFO2("AUTODimmer stopped");
+    
+    hkc_group_notify(ch_group);
     
-    lightbulb_group->target_r  = lightbulb_group->factor_r  * ((r  > PWM_SCALE) ? PWM_SCALE : r);
-    lightbulb_group->target_g  = lightbulb_group->factor_g  * ((g  > PWM_SCALE) ? PWM_SCALE : g);
-    lightbulb_group->target_b  = lightbulb_group->factor_b  * ((b  > PWM_SCALE) ? PWM_SCALE : b);
-    lightbulb_group->target_w  = lightbulb_group->factor_w  * ((rgb_min > PWM_SCALE) ? PWM_SCALE : rgb_min);
-    lightbulb_group->target_cw = lightbulb_group->factor_cw * ((cw > PWM_SCALE) ? PWM_SCALE : cw);
-    lightbulb_group->target_ww = lightbulb_group->factor_ww * ((ww > PWM_SCALE) ? PWM_SCALE : ww);
+    save_states_callback();
 }
 
-void multipwm_set_all() {
-    multipwm_stop(pwm_info);
-    for (uint8_t i = 0; i < pwm_info->channels; i++) {
-        multipwm_set_duty(pwm_info, i, multipwm_duty[i]);
+// Called by rgbw_set_timer_worker() when a fade of an autodimmer ends
+void autodimmer_next(ch_group_t *ch_group, lightbulb_group_t *lightbulb_group) {
+    if (lightbulb_group->autodimmer_phase == AUTODIMMER_PHASE_RAMP) {
+        // Double wait when brightness is 100%, targets are not changed
+        lightbulb_group->autodimmer_phase = AUTODIMMER_PHASE_HOLD;
+        lightbulb_fade_start(lightbulb_group, lightbulb_group->autodimmer_task_delay * 2);
+        
+    } else {
+        lightbulb_group->autodimmer--;
+        if (lightbulb_group->autodimmer > 0) {
+            // Jump to lowest brightness and ramp again
+            ch_group->ch1->value.int_value = lightbulb_group->autodimmer_task_step;
+            lightbulb_group_set_targets(ch_group, lightbulb_group);
+            lightbulb_fade_apply(lightbulb_group, LIGHTBULB_FADE_ONE);
+            
+            autodimmer_ramp(ch_group, lightbulb_group);
+            
+        } else {
+            INFO2("AUTODimmer stopped");
+            
+            save_states_callback();
+        }
     }
-    multipwm_start(pwm_info);
+    
+    hkc_group_notify(ch_group);
 }
 
 void rgbw_set_timer_worker() {
     if (!setpwm_bool_semaphore) {
         setpwm_bool_semaphore = true;
         
-        uint8_t channels_to_set = pwm_info->channels;
-        lightbulb_group_t *lightbulb_group = lightbulb_groups;
+        // Progress comes from elapsed time, so a missed tick does not make a fade longer
+        const uint32_t now = sdk_system_get_time();
+        bool is_fading = false;
         
-        while (setpwm_is_running && lightbulb_group) {
-            if (lightbulb_group->pwm_r != 255) {
-                if (lightbulb_group->target_r - multipwm_duty[lightbulb_group->pwm_r] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_r] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_r] - lightbulb_group->target_r >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_r] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_r] = lightbulb_group->target_r;
-                    channels_to_set--;
-                }
-            }
-            
-            if (lightbulb_group->pwm_g != 255) {
-                if (lightbulb_group->target_g - multipwm_duty[lightbulb_group->pwm_g] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_g] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_g] - lightbulb_group->target_g >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_g] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_g] = lightbulb_group->target_g;
-                    channels_to_set--;
-                }
-            }
-            
-            if (lightbulb_group->pwm_b != 255) {
-                if (lightbulb_group->target_b - multipwm_duty[lightbulb_group->pwm_b] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_b] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_b] - lightbulb_group->target_b >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_b] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_b] = lightbulb_group->target_b;
-                    channels_to_set--;
-                }
-            }
-            
-            if (lightbulb_group->pwm_w != 255) {
-                if (lightbulb_group->target_w - multipwm_duty[lightbulb_group->pwm_w] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_w] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_w] - lightbulb_group->target_w >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_w] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_w] = lightbulb_group->target_w;
-                    channels_to_set--;
-                }
-            }
-            
-            if (lightbulb_group->pwm_cw != 255) {
-                if (lightbulb_group->target_cw - multipwm_duty[lightbulb_group->pwm_cw] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_cw] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_cw] - lightbulb_group->target_cw >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_cw] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_cw] = lightbulb_group->target_cw;
-                    channels_to_set--;
+        lightbulb_group_t *lightbulb_group = lightbulb_groups;
+        while (lightbulb_group) {
+            if (lightbulb_group->is_fading) {
+                uint32_t progress = LIGHTBULB_FADE_ONE;
+                const uint32_t elapsed = now - lightbulb_group->fade_start;
+                if (elapsed < lightbulb_group->fade_duration) {
+                    progress = ((uint64_t) elapsed << 16) / lightbulb_group->fade_duration;
                 }
-            }
-            
-            if (lightbulb_group->pwm_ww != 255) {
-                if (lightbulb_group->target_ww - multipwm_duty[lightbulb_group->pwm_ww] >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_ww] += lightbulb_group->step;
-                } else if (multipwm_duty[lightbulb_group->pwm_ww] - lightbulb_group->target_ww >= lightbulb_group->step) {
-                    multipwm_duty[lightbulb_group->pwm_ww] -= lightbulb_group->step;
-                } else {
-                    multipwm_duty[lightbulb_group->pwm_ww] = lightbulb_group->target_ww;
-                    channels_to_set--;
+                
+                uint8_t fade_curve = lightbulb_group->fade_curve;
+                if (lightbulb_group->autodimmer > 0) {
+                    fade_curve = LIGHTBULB_FADE_LINEAR;
                 }
-            }
-            
-            //INFO2("RGBW-CW-WW -> %i, %i, %i, %i, %i, %i", multipwm_duty[lightbulb_group->pwm_r], multipwm_duty[lightbulb_group->pwm_g], multipwm_duty[lightbulb_group->pwm_b], multipwm_duty[lightbulb_group->pwm_w], multipwm_duty[lightbulb_group->pwm_cw], multipwm_duty[lightbulb_group->pwm_ww]);
-
-            if (channels_to_set == 0) {
-                setpwm_is_running = false;
-                sdk_os_timer_disarm(pwm_timer);
                 
-                if (log_output) {
-                    printf("Color fixed\n");
-                    for (uint8_t i = 0; i < pwm_info->channels; i++) {
-                        printf("PWM Ch %i = %i\n", i, multipwm_duty[i]);
+                lightbulb_fade_apply(lightbulb_group, lightbulb_fade_ease(fade_curve, progress));
+                
+                //INFO2("RGBW-CW-WW -> %i, %i, %i, %i, %i, %i", pwm_duty[lightbulb_group->pwm_r], pwm_duty[lightbulb_group->pwm_g], pwm_duty[lightbulb_group->pwm_b], pwm_duty[lightbulb_group->pwm_w], pwm_duty[lightbulb_group->pwm_cw], pwm_duty[lightbulb_group->pwm_ww]);
+                
+                if (progress == LIGHTBULB_FADE_ONE) {
+                    lightbulb_group->is_fading = false;
+                    
+                    if (lightbulb_group->autodimmer > 0) {
+                        autodimmer_next(ch_group_find(lightbulb_group->ch0), lightbulb_group);
                     }
                 }
+                
+                is_fading |= lightbulb_group->is_fading;
             }
             
             lightbulb_group = lightbulb_group->next;
         }
         
-        multipwm_set_all();
+        pwm_set_all();
+        
+        if (!is_fading) {
+            setpwm_is_running = false;
+            sdk_os_timer_disarm(pwm_timer);
+            
+            if (log_output) {
+                printf("Color fixed\n");
+                for (uint8_t i = 0; i < adv_pwm_channels(); i++) {
+                    printf("PWM Ch %i = %i\n", i, pwm_duty[i]);
+                }
+            }
+        }
 
         setpwm_bool_semaphore = false;
     } else {
@@ -1346,6 +1533,8 @@ void rgbw_set_timer_worker() {
 }
 
 void hkc_rgbw_setter(homekit_characteristic_t *ch, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch);
     if (ch_group->ch_sec && !ch_group->ch_sec->value.bool_value) {
         hkc_group_notify(ch_group);
@@ -1353,6 +1542,9 @@ void hkc_rgbw_setter(homekit_characteristic_t *ch, const homekit_value_t value)
     } else if (ch != ch_group->ch0 || value.bool_value != ch_group->ch0->value.bool_value) {
         lightbulb_group_t *lightbulb_group = lightbulb_group_find(ch_group->ch0);
         
+        // Any new value set from outside stops autodimmer
+        lightbulb_group->autodimmer = 0;
+        
         ch->value = value;
         
         if (ch_group->ch0->value.bool_value) {
@@ -1365,30 +1557,9 @@ void hkc_rgbw_setter(homekit_characteristic_t *ch, const homekit_value_t value)
                 setup_mode_toggle_upcount();
             }
             
-            if (lightbulb_group->pwm_r != 255) {            // RGB, RGB-W, RGB-CW-WW, RGB-W-CW-WW
-                hsi2rgbw(ch_group->ch2->value.float_value, ch_group->ch3->value.float_value, ch_group->ch1->value.int_value, lightbulb_group);
-                
-            } else if (lightbulb_group->pwm_b != 255) {     // Custom Color Temperature
-                uint16_t target_color = 0;
-                
-                if (ch_group->ch2->value.int_value >= COLOR_TEMP_MAX - 5) {
-                    target_color = PWM_SCALE;
-                    
-                } else if (ch_group->ch2->value.int_value > COLOR_TEMP_MIN + 1) { // Conversion based on @seritos curve
-                    target_color = PWM_SCALE * (((0.09 + sqrt(0.18 + (0.1352 * (ch_group->ch2->value.int_value - COLOR_TEMP_MIN - 1)))) / 0.0676) - 1) / 100;
-                }
-                
-                const uint32_t w = lightbulb_group->factor_w * target_color * ch_group->ch1->value.int_value / 100;
-                const uint32_t b = lightbulb_group->factor_b * (PWM_SCALE - target_color) * ch_group->ch1->value.int_value / 100;
-                lightbulb_group->target_w = ((w > PWM_SCALE) ? PWM_SCALE : w);
-                lightbulb_group->target_b = ((b > PWM_SCALE) ? PWM_SCALE : b);
-                
-            } else {                                        // One Color Dimmer
-                const uint32_t w = lightbulb_group->factor_w * PWM_SCALE * ch_group->ch1->value.int_value / 100;
-                lightbulb_group->target_w = ((w > PWM_SCALE) ? PWM_SCALE : w);
-            }
+            lightbulb_group_set_targets(ch_group, lightbulb_group);
+            
         } else {
-            lightbulb_group->autodimmer = 0;
             lightbulb_group->target_r = 0;
             lightbulb_group->target_g = 0;
             lightbulb_group->target_b = 0;
@@ -1402,9 +1573,8 @@ void hkc_rgbw_setter(homekit_characteristic_t *ch, const homekit_value_t value)
         led_blink(1);
         INFO2("Target RGBW = %i, %i, %i, %i, %i, %i", lightbulb_group->target_r, lightbulb_group->target_g, lightbulb_group->target_b, lightbulb_group->target_w, lightbulb_group->target_cw, lightbulb_group->target_ww);
         
-        if (lightbulb_group->is_pwm && !setpwm_is_running) {
-            setpwm_is_running = true;
-            sdk_os_timer_arm(pwm_timer, RGBW_PERIOD, true);
+        if (lightbulb_group->is_pwm) {
+            lightbulb_fade_start(lightbulb_group, lightbulb_group->fade_time);
         }
         
         do_actions(ch_group, (uint8_t) ch_group->ch0->value.bool_value);
@@ -1446,39 +1616,6 @@ void rgbw_brightness(const uint8_t gpio, void *args, const uint8_t type) {
     }
 }
 
-void autodimmer_task(void *args) {
-    INFO2("AUTODimmer started");
-    
-    homekit_characteristic_t *ch = args;
-    ch_group_t *ch_group = ch_group_find(ch);
-    lightbulb_group_t *lightbulb_group = lightbulb_group_find(ch_group->ch0);
-    
-    lightbulb_group->autodimmer = 4 * 100 / lightbulb_group->autodimmer_task_step;
-    while(lightbulb_group->autodimmer > 0) {
-        lightbulb_group->autodimmer--;
-        if (ch_group->ch1->value.int_value < 100) {
-            if (ch_group->ch1->value.int_value + lightbulb_group->autodimmer_task_step < 100) {
-                ch_group->ch1->value.int_value += lightbulb_group->autodimmer_task_step;
-            } else {
-                ch_group->ch1->value.int_value = 100;
-            }
-        } else {
-            ch_group->ch1->value.int_value = lightbulb_group->autodimmer_task_step;
-        }
-        hkc_rgbw_setter(ch_group->ch1, ch_group->ch1->value);
-        
-        vTaskDelay(MS_TO_TICK(lightbulb_group->autodimmer_task_delay));
-        
-        if (ch_group->ch1->value.int_value == 100) {    // Double wait when brightness is 100%
-            vTaskDelay(MS_TO_TICK(lightbulb_group->autodimmer_task_delay));
-        }
-    }
-    
-    INFO2("AUTODimmer stopped");
-    
-    vTaskDelete(NULL);
-}
-
 void no_autodimmer_called(void *args) {
     homekit_characteristic_t *ch0 = args;
     lightbulb_group_t *lightbulb_group = lightbulb_group_find(ch0);
@@ -1491,14 +1628,18 @@ void autodimmer_call(homekit_characteristic_t *ch0, const homekit_value_t value)
     if (lightbulb_group->autodimmer_task_step == 0 || (value.bool_value && lightbulb_group->autodimmer == 0)) {
         hkc_rgbw_setter(ch0, value);
     } else if (lightbulb_group->autodimmer > 0) {
-        lightbulb_group->autodimmer = 0;
+        autodimmer_stop(ch_group_find(ch0), lightbulb_group);
     } else {
-        lightbulb_group->autodimmer = 0;
         ch_group_t *ch_group = ch_group_find(ch0);
         if (lightbulb_group->armed_autodimmer) {
             lightbulb_group->armed_autodimmer = false;
             sdk_os_timer_disarm(ch_group->timer);
-            xTaskCreate(autodimmer_task, "autodimmer_task", AUTODIMMER_TASK_SIZE, (void *) ch0, AUTODIMMER_TASK_PRIORITY, NULL);
+            
+            INFO2("AUTODimmer started");
+            
+            lightbulb_group->autodimmer = AUTODIMMER_CYCLES;
+            autodimmer_ramp(ch_group, lightbulb_group);
+            hkc_group_notify(ch_group);
         } else {
             sdk_os_timer_arm(ch_group->timer, AUTODIMMER_DELAY, 0);
             lightbulb_group->armed_autodimmer = true;
@@ -1506,7 +1647,67 @@ void autodimmer_call(homekit_characteristic_t *ch0, const homekit_value_t value)
     }
 }
 
+// --- TIME BASED POSITIONS
+// Positions are calculated from time since motion started, so timer ticks only
+// set how often they are updated. Last tick is armed to end just on target.
+float motion_elapsed_time(ch_group_t *ch_group) {
+    return (sdk_system_get_time() - ch_group->motion_start) * 0.000001f;
+}
+
+void motion_timer_schedule(ch_group_t *ch_group, const uint32_t period_ms, const float remaining_time) {
+    sdk_os_timer_disarm(ch_group->timer);
+    
+    const float remaining_ms = remaining_time * 1000;
+    if (remaining_ms < period_ms) {
+        // Less than one tick would be armed as 0 ticks
+        uint32_t delay_ms = (remaining_ms > 0 ? (uint32_t) remaining_ms : 0) + 1;
+        if (delay_ms < portTICK_PERIOD_MS) {
+            delay_ms = portTICK_PERIOD_MS;
+        }
+        
+        sdk_os_timer_arm(ch_group->timer, delay_ms, 0);
+    } else {
+        sdk_os_timer_arm(ch_group->timer, period_ms, 1);
+    }
+}
+
 // --- GARAGE DOOR
+void garage_door_update_time(ch_group_t *ch_group) {
+    if (ch_group->ch0->value.int_value == GARAGE_DOOR_OPENING) {
+        GARAGE_DOOR_CURRENT_TIME = GARAGE_DOOR_START_TIME + motion_elapsed_time(ch_group);
+    } else if (ch_group->ch0->value.int_value == GARAGE_DOOR_CLOSING) {
+        GARAGE_DOOR_CURRENT_TIME = GARAGE_DOOR_START_TIME - (motion_elapsed_time(ch_group) * GARAGE_DOOR_CLOSE_TIME_FACTOR);
+    } else {
+        return;
+    }
+    
+    // Door does not move beyond its ends, even if timer was halted while it was moving
+    if (GARAGE_DOOR_CURRENT_TIME < 0) {
+        GARAGE_DOOR_CURRENT_TIME = 0;
+    } else if (GARAGE_DOOR_CURRENT_TIME > GARAGE_DOOR_WORKING_TIME) {
+        GARAGE_DOOR_CURRENT_TIME = GARAGE_DOOR_WORKING_TIME;
+    }
+}
+
+// Seconds until door reaches its end, or until timer must halt
+float garage_door_remaining_time(ch_group_t *ch_group) {
+    if (ch_group->ch0->value.int_value == GARAGE_DOOR_OPENING) {
+        float end_time = GARAGE_DOOR_WORKING_TIME;
+        if (GARAGE_DOOR_HAS_F2 == 0) {
+            end_time -= GARAGE_DOOR_TIME_MARGIN;
+        }
+        
+        return end_time - GARAGE_DOOR_CURRENT_TIME;
+    }
+    
+    float end_time = 0;
+    if (GARAGE_DOOR_HAS_F3 == 0) {
+        end_time = GARAGE_DOOR_TIME_MARGIN;
+    }
+    
+    return (GARAGE_DOOR_CURRENT_TIME - end_time) / GARAGE_DOOR_CLOSE_TIME_FACTOR;
+}
+
 void garage_door_stop(const uint8_t gpio, void *args, const uint8_t type) {
     homekit_characteristic_t *ch0 = args;
     ch_group_t *ch_group = ch_group_find(ch0);
@@ -1515,6 +1716,7 @@ void garage_door_stop(const uint8_t gpio, void *args, const uint8_t type) {
         led_blink(1);
         INFO2("GD stop");
         
+        garage_door_update_time(ch_group);
         ch0->value.int_value = GARAGE_DOOR_STOPPED;
         
         sdk_os_timer_disarm(ch_group->timer);
@@ -1546,11 +1748,17 @@ void garage_door_sensor(const uint8_t gpio, void *args, const uint8_t type) {
     led_blink(1);
     INFO2("GD sensor: %i", type);
     
+    // Position reached with previous motion, if any
+    garage_door_update_time(ch_group);
+    
     ch->value.int_value = type;
     
     if (type > 1) {
         ch_group->ch1->value.int_value = type - 2;
-        sdk_os_timer_arm(ch_group->timer, 1000, 1);
+        
+        GARAGE_DOOR_START_TIME = GARAGE_DOOR_CURRENT_TIME;
+        ch_group->motion_start = sdk_system_get_time();
+        motion_timer_schedule(ch_group, GARAGE_DOOR_POLL_PERIOD_MS, garage_door_remaining_time(ch_group));
     } else {
         ch_group->ch1->value.int_value = type;
         sdk_os_timer_disarm(ch_group->timer);
@@ -1572,6 +1780,8 @@ void garage_door_sensor(const uint8_t gpio, void *args, const uint8_t type) {
 }
 
 void hkc_garage_door_setter(homekit_characteristic_t *ch1, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch1);
     if ((!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) && !ch_group->ch2->value.bool_value) {
         uint8_t current_door_state = ch_group->ch0->value.int_value;
@@ -1616,31 +1826,79 @@ void garage_door_timer_worker(void *args) {
         }
     }
     
-    if (ch0->value.int_value == GARAGE_DOOR_OPENING) {
-        GARAGE_DOOR_CURRENT_TIME++;
-
-        if (GARAGE_DOOR_CURRENT_TIME >= GARAGE_DOOR_WORKING_TIME - GARAGE_DOOR_TIME_MARGIN && GARAGE_DOOR_HAS_F2 == 0) {
+    garage_door_update_time(ch_group);
+    
+    if (garage_door_remaining_time(ch_group) > 0) {
+        motion_timer_schedule(ch_group, GARAGE_DOOR_POLL_PERIOD_MS, garage_door_remaining_time(ch_group));
+        
+    } else if (ch0->value.int_value == GARAGE_DOOR_OPENING) {
+        if (GARAGE_DOOR_HAS_F2 == 0) {
             sdk_os_timer_disarm(ch_group->timer);
             garage_door_sensor(0, ch0, GARAGE_DOOR_OPENED);
-            
-        } else if (GARAGE_DOOR_CURRENT_TIME >= GARAGE_DOOR_WORKING_TIME && GARAGE_DOOR_HAS_F2 == 1) {
+        } else {
             halt_timer();
         }
         
     } else {    // GARAGE_DOOR_CLOSING
-        GARAGE_DOOR_CURRENT_TIME -= GARAGE_DOOR_CLOSE_TIME_FACTOR;
-        
-        if (GARAGE_DOOR_CURRENT_TIME <= GARAGE_DOOR_TIME_MARGIN && GARAGE_DOOR_HAS_F3 == 0) {
+        if (GARAGE_DOOR_HAS_F3 == 0) {
             sdk_os_timer_disarm(ch_group->timer);
             garage_door_sensor(0, ch0, GARAGE_DOOR_CLOSED);
-            
-        } else if (GARAGE_DOOR_CURRENT_TIME <= 0 && GARAGE_DOOR_HAS_F3 == 1) {
+        } else {
             halt_timer();
         }
     }
 }
 
 // --- WINDOW COVER
+void window_cover_update_position(ch_group_t *ch_group) {
+    if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_CLOSING) {
+        WINDOW_COVER_POSITION = WINDOW_COVER_START_POSITION - (motion_elapsed_time(ch_group) * WINDOW_COVER_SPEED_DOWN);
+    } else if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_OPENING) {
+        WINDOW_COVER_POSITION = WINDOW_COVER_START_POSITION + (motion_elapsed_time(ch_group) * WINDOW_COVER_SPEED_UP);
+    } else {
+        return;
+    }
+    
+    if (WINDOW_COVER_POSITION > 0 && WINDOW_COVER_POSITION < 100) {
+        WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION / (1 + ((100 - WINDOW_COVER_POSITION) * WINDOW_COVER_CORRECTION * 0.0002));
+    } else {
+        WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION;
+    }
+}
+
+uint8_t window_cover_margin(ch_group_t *ch_group) {
+    // Used as covering offset to add extra time when target position completely closed or opened
+    if (WINDOW_COVER_CH_TARGET_POSITION->value.int_value == 0 || WINDOW_COVER_CH_TARGET_POSITION->value.int_value == 100) {
+        return WINDOW_COVER_MARGIN_SYNC;
+    }
+    
+    return 0;
+}
+
+void window_cover_timer_schedule(ch_group_t *ch_group) {
+    float target = WINDOW_COVER_CH_TARGET_POSITION->value.int_value;
+    if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_CLOSING) {
+        target -= window_cover_margin(ch_group);
+    } else {
+        target += window_cover_margin(ch_group);
+    }
+    
+    // Inverse of real position correction
+    if (target > 0 && target < 100) {
+        const float correction = WINDOW_COVER_CORRECTION * 0.0002;
+        target = target * (1 + (100 * correction)) / (1 + (target * correction));
+    }
+    
+    float remaining_time;
+    if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_CLOSING) {
+        remaining_time = (WINDOW_COVER_POSITION - target) / WINDOW_COVER_SPEED_DOWN;
+    } else {
+        remaining_time = (target - WINDOW_COVER_POSITION) / WINDOW_COVER_SPEED_UP;
+    }
+    
+    motion_timer_schedule(ch_group, WINDOW_COVER_POLL_PERIOD_MS, remaining_time);
+}
+
 void normalize_position(homekit_characteristic_t *ch) {
     ch_group_t *ch_group = ch_group_find(ch);
     
@@ -1660,10 +1918,12 @@ void normalize_position(homekit_characteristic_t *ch) {
 void window_cover_stop(homekit_characteristic_t *ch) {
     ch_group_t *ch_group = ch_group_find(ch);
     
+    sdk_os_timer_disarm(ch_group->timer);
+    window_cover_update_position(ch_group);
+    
     led_blink(1);
     INFO2("WC Stopped at %f, real %f", WINDOW_COVER_POSITION, WINDOW_COVER_REAL_POSITION);
     
-    sdk_os_timer_disarm(ch_group->timer);
     normalize_position(ch);
     
     WINDOW_COVER_CH_CURRENT_POSITION->value.int_value = WINDOW_COVER_REAL_POSITION;
@@ -1701,13 +1961,17 @@ void window_cover_obstruction(const uint8_t gpio, void *args, const uint8_t type
 }
 
 void hkc_window_cover_setter(homekit_characteristic_t *ch1, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch1);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         led_blink(1);
         INFO2("Setter WC: Current: %i, Target: %i", WINDOW_COVER_CH_CURRENT_POSITION->value.int_value, value.int_value);
         
         ch1->value = value;
-
+        
+        // Position reached with previous motion, if any
+        window_cover_update_position(ch_group);
         normalize_position(ch1);
         
         if (value.int_value < WINDOW_COVER_CH_CURRENT_POSITION->value.int_value) {
@@ -1719,11 +1983,11 @@ void hkc_window_cover_setter(homekit_characteristic_t *ch1, const homekit_value_
                 do_actions(ch_group, WINDOW_COVER_CLOSING);
             }
             
-            if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_STOP) {
-                sdk_os_timer_arm(ch_group->timer, WINDOW_COVER_POLL_PERIOD_MS, 1);
-            }
-            
             WINDOW_COVER_CH_STATE->value.int_value = WINDOW_COVER_CLOSING;
+            
+            WINDOW_COVER_START_POSITION = WINDOW_COVER_POSITION;
+            ch_group->motion_start = sdk_system_get_time();
+            window_cover_timer_schedule(ch_group);
 
         } else if (value.int_value > WINDOW_COVER_CH_CURRENT_POSITION->value.int_value) {
 
@@ -1734,11 +1998,11 @@ void hkc_window_cover_setter(homekit_characteristic_t *ch1, const homekit_value_
                 do_actions(ch_group, WINDOW_COVER_OPENING);
             }
             
-            if (WINDOW_COVER_CH_STATE->value.int_value == WINDOW_COVER_STOP) {
-                sdk_os_timer_arm(ch_group->timer, WINDOW_COVER_POLL_PERIOD_MS, 1);
-            }
-            
             WINDOW_COVER_CH_STATE->value.int_value = WINDOW_COVER_OPENING;
+            
+            WINDOW_COVER_START_POSITION = WINDOW_COVER_POSITION;
+            ch_group->motion_start = sdk_system_get_time();
+            window_cover_timer_schedule(ch_group);
 
         } else {
             window_cover_stop(ch1);
@@ -1755,10 +2019,7 @@ void window_cover_timer_worker(void *args) {
     homekit_characteristic_t *ch0 = args;
     ch_group_t *ch_group = ch_group_find(ch0);
     
-    uint8_t margin = 0;     // Used as covering offset to add extra time when target position completely closed or opened
-    if (WINDOW_COVER_CH_TARGET_POSITION->value.int_value == 0 || WINDOW_COVER_CH_TARGET_POSITION->value.int_value == 100) {
-        margin = WINDOW_COVER_MARGIN_SYNC;
-    }
+    const uint8_t margin = window_cover_margin(ch_group);
     
     void normalize_current_position() {
         if (WINDOW_COVER_POSITION < 0) {
@@ -1778,32 +2039,24 @@ void window_cover_timer_worker(void *args) {
 
     switch (WINDOW_COVER_CH_STATE->value.int_value) {
         case WINDOW_COVER_CLOSING:
-            WINDOW_COVER_POSITION -= WINDOW_COVER_STEP_TIME_DOWN;
-            if (WINDOW_COVER_POSITION > 0) {
-                WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION / (1 + ((100 - WINDOW_COVER_POSITION) * WINDOW_COVER_CORRECTION * 0.0002));
-            } else {
-                WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION;
-            }
-            
+            window_cover_update_position(ch_group);
             normalize_current_position();
 
             if ((WINDOW_COVER_CH_TARGET_POSITION->value.int_value - margin) >= WINDOW_COVER_REAL_POSITION) {
                 window_cover_stop(ch0);
+            } else {
+                window_cover_timer_schedule(ch_group);
             }
             break;
             
         case WINDOW_COVER_OPENING:
-            WINDOW_COVER_POSITION += WINDOW_COVER_STEP_TIME_UP;
-            if (WINDOW_COVER_POSITION < 100) {
-                WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION / (1 + ((100 - WINDOW_COVER_POSITION) * WINDOW_COVER_CORRECTION * 0.0002));
-            } else {
-                WINDOW_COVER_REAL_POSITION = WINDOW_COVER_POSITION;
-            }
-        
+            window_cover_update_position(ch_group);
             normalize_current_position();
             
             if ((WINDOW_COVER_CH_TARGET_POSITION->value.int_value + margin) <= WINDOW_COVER_REAL_POSITION) {
                 window_cover_stop(ch0);
+            } else {
+                window_cover_timer_schedule(ch_group);
             }
             break;
             
@@ -1815,6 +2068,8 @@ void window_cover_timer_worker(void *args) {
 
 // --- FAN
 void hkc_fan_setter(homekit_characteristic_t *ch0, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch0);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         if (ch0->value.bool_value != value.bool_value) {
@@ -1849,6 +2104,8 @@ void hkc_fan_setter(homekit_characteristic_t *ch0, const homekit_value_t value)
 }
 
 void hkc_fan_speed_setter(homekit_characteristic_t *ch1, const homekit_value_t value) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_SETTER, 0);
+    
     ch_group_t *ch_group = ch_group_find(ch1);
     if (!ch_group->ch_sec || ch_group->ch_sec->value.bool_value) {
         if (ch1->value.float_value != value.float_value) {
@@ -2282,6 +2539,11 @@ void digstate_0(const uint8_t gpio, void *args, const uint8_t type) {
     }
 }
 
+#ifdef HEAP_STATS
+#undef HEAP_STATS_TAG
+#define HEAP_STATS_TAG      HEAP_STATS_ACTIONS
+#endif  // HEAP_STATS
+
 // --- AUTO-OFF
 void hkc_autooff_setter_task(void *pvParameters) {
     autooff_setter_params_t *autooff_setter_params = pvParameters;
@@ -2323,6 +2585,7 @@ void http_get_task(void *pvParameters) {
     while(action_http) {
         if (action_http->action == action_task->action) {
             INFO2("HTTP/TCP Action %s:%i", action_http->host, action_http->port_n);
+            haa_metrics.actions[METRICS_ACTION_HTTP]++;
             
             const struct addrinfo hints = {
                 .ai_family = AF_UNSPEC,
@@ -2419,6 +2682,8 @@ void ir_tx_task(void *pvParameters) {
     
     while(action_ir_tx) {
         if (action_ir_tx->action == action_task->action) {
+            haa_metrics.actions[METRICS_ACTION_IR_TX]++;
+            
             uint16_t *ir_code = NULL;
             uint16_t ir_code_len = 0;
             
@@ -2570,44 +2835,68 @@ void ir_tx_task(void *pvParameters) {
             }
             
             // IR TRANSMITTER
-            uint32_t start;
-            const bool ir_true = true ^ ir_tx_inv;
-            const bool ir_false = false ^ ir_tx_inv;
-            
             do {
                 vTaskDelay(MS_TO_TICK(100));
             } while (ir_tx_is_running);
             
             ir_tx_is_running = true;
             
-            for (uint8_t r = 0; r < action_ir_tx->repeats; r++) {
-                for (uint16_t i = 0; i < ir_code_len; i++) {
-                    if (ir_code[i] > 0) {
-                        if (i & 1) {    // Space
-                            gpio_write(ir_tx_gpio, ir_false);
-                            sdk_os_delay_us(ir_code[i]);
-                        } else {        // Mark
-                            start = sdk_system_get_time();
-                            while ((sdk_system_get_time() - start) < ir_code[i]) {
-                                gpio_write(ir_tx_gpio, ir_true);
-                                sdk_os_delay_us(freq);
-                                gpio_write(ir_tx_gpio, ir_false);
-                                sdk_os_delay_us(freq);
-                            }
-                        }
-                    }
-                }
-                
-                gpio_write(ir_tx_gpio, ir_false);
-                
-                INFO2("IR %i sent", r);
+            int ir_result = -1;
+            if (adv_pwm_channels() == 0) {
+                ir_result = ir_tx_send(ir_tx_gpio, ir_tx_inv, ir_code, ir_code_len, freq, action_ir_tx->repeats, action_ir_tx->pause);
+            }
+            
+            if (ir_result == 0) {
+                INFO2("IR sent %i", action_ir_tx->repeats);
                 
                 if (action_ir_tx->pause > 0) {
-                    sdk_os_delay_us(action_ir_tx->pause);
+                    vTaskDelay(MS_TO_TICK(action_ir_tx->pause / 1000) + 1);
                 } else {
                     vTaskDelay(MS_TO_TICK(100));
                 }
                 
+            } else if (ir_result == -2) {
+                ERROR2("IR send timeout");
+                
+            } else {
+                // FRC1 timer is used by PWM or profiler, so carrier is generated by CPU
+                vTaskPrioritySet(NULL, IR_TX_CPU_TASK_PRIORITY);
+                
+                uint32_t start;
+                const bool ir_true = true ^ ir_tx_inv;
+                const bool ir_false = false ^ ir_tx_inv;
+                
+                for (uint8_t r = 0; r < action_ir_tx->repeats; r++) {
+                    for (uint16_t i = 0; i < ir_code_len; i++) {
+                        if (ir_code[i] > 0) {
+                            if (i & 1) {    // Space
+                                gpio_write(ir_tx_gpio, ir_false);
+                                sdk_os_delay_us(ir_code[i]);
+                            } else {        // Mark
+                                start = sdk_system_get_time();
+                                while ((sdk_system_get_time() - start) < ir_code[i]) {
+                                    gpio_write(ir_tx_gpio, ir_true);
+                                    sdk_os_delay_us(freq);
+                                    gpio_write(ir_tx_gpio, ir_false);
+                                    sdk_os_delay_us(freq);
+                                }
+                            }
+                        }
+                    }
+                    
+                    gpio_write(ir_tx_gpio, ir_false);
+                    
+                    INFO2("IR %i sent", r);
+                    
+                    if (action_ir_tx->pause > 0) {
+                        sdk_os_delay_us(action_ir_tx->pause);
+                    } else {
+                        vTaskDelay(MS_TO_TICK(100));
+                    }
+                    
+                }
+                
+                vTaskPrioritySet(NULL, IR_TX_TASK_PRIORITY);
             }
             
             ir_tx_is_running = false;
@@ -2632,6 +2921,7 @@ void uart_action_task(void *pvParameters) {
     while (action_uart) {
         if (action_uart->action == action_task->action) {
             INFO2("UART Action");
+            haa_metrics.actions[METRICS_ACTION_UART]++;
             
             while (uart_action_is_running) {
                 vTaskDelay(MS_TO_TICK(200));
@@ -2673,6 +2963,8 @@ void autoswitch_task(void *pvParameters) {
 }
 
 void do_actions(ch_group_t *ch_group, uint8_t action) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_ACTIONS, action);
+    
     INFO2("Exec action %i", action);
     
     // Copy actions
@@ -2681,6 +2973,7 @@ void do_actions(ch_group_t *ch_group, uint8_t action) {
         if (action_copy->action == action) {
             action = action_copy->new_action;
             action_copy = NULL;
+            haa_metrics.actions[METRICS_ACTION_COPY]++;
         } else {
             action_copy = action_copy->next;
         }
@@ -2691,7 +2984,9 @@ void do_actions(ch_group_t *ch_group, uint8_t action) {
     while(action_relay) {
         if (action_relay->action == action) {
             gpio_write(action_relay->gpio, action_relay->value);
+            LATENCY_TRACE_MARK(LATENCY_TRACE_GPIO, action_relay->gpio);
             INFO2("DigO GPIO %i -> %i", action_relay->gpio, action_relay->value);
+            haa_metrics.actions[METRICS_ACTION_RELAY]++;
             
             if (action_relay->inching > 0) {
                 autoswitch_params_t *autoswitch_params = malloc(sizeof(autoswitch_params_t));
@@ -2711,6 +3006,8 @@ void do_actions(ch_group_t *ch_group, uint8_t action) {
         if (action_acc_manager->action == action) {
             ch_group_t *ch_group = ch_group_find_by_acc(action_acc_manager->accessory);
             if (ch_group) {
+                haa_metrics.actions[METRICS_ACTION_ACC_MANAGER]++;
+
                 if (action_acc_manager->is_kill_switch) {
                     INFO2("Kill Sw Manager %i -> %.2f", action_acc_manager->accessory, action_acc_manager->value);
                     
@@ -2872,6 +3169,7 @@ void do_actions(ch_group_t *ch_group, uint8_t action) {
     while(action_system) {
         if (action_system->action == action) {
             INFO2("Sys Action %i", action_system->value);
+            haa_metrics.actions[METRICS_ACTION_SYSTEM]++;
             
             char *ota = NULL;
             
@@ -2951,11 +3249,17 @@ void do_wildcard_actions(ch_group_t *ch_group, uint8_t index, const float action
         if (ch_group->last_wildcard_action[index] != last_value || last_wildcard_action->repeat) {
             ch_group->last_wildcard_action[index] = last_value;
             INFO2("Wilcard Action %i %.2f", index, last_value);
+            haa_metrics.actions[METRICS_ACTION_WILDCARD]++;
             do_actions(ch_group, last_wildcard_action->target_action);
         }
     }
 }
 
+#ifdef HEAP_STATS
+#undef HEAP_STATS_TAG
+#define HEAP_STATS_TAG      HEAP_STATS_ACCESSORIES
+#endif  // HEAP_STATS
+
 // --- IDENTIFY
 void identify(homekit_value_t _value) {
     led_blink(6);
@@ -2976,6 +3280,211 @@ void delayed_sensor_starter_task(void *args) {
     vTaskDelete(NULL);
 }
 
+// --- METRICS
+static const char *metrics_action_names[METRICS_ACTION_TYPES] = {
+    "copy",
+    "relay",
+    "acc_manager",
+    "system",
+    "uart",
+    "http",
+    "ir_tx",
+    "wildcard",
+};
+
+static void metrics_send(const int s, char *buffer, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, METRICS_BUFFER_SIZE, format, args);
+    va_end(args);
+    
+    if (len >= METRICS_BUFFER_SIZE) {
+        len = METRICS_BUFFER_SIZE - 1;
+    }
+    
+    if (len > 0) {
+        write(s, buffer, len);
+    }
+}
+
+// Prometheus text format, one line per write to keep buffer small
+static void metrics_send_all(const int s, char *buffer) {
+    homekit_metrics_t hk_metrics;
+    homekit_get_metrics(&hk_metrics);
+    
+    metrics_send(s, buffer, "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nConnection: close\r\n\r\n");
+    
+    metrics_send(s, buffer, "haa_info{version=\"%s\",name=\"%s\"} 1\n", FIRMWARE_VERSION, name_value);
+    metrics_send(s, buffer, "haa_uptime_seconds %u\n", xTaskGetTickCount() / (1000 / portTICK_PERIOD_MS));
+    
+    for (uint8_t i = 0; i < HOMEKIT_METRICS_ENDPOINTS; i++) {
+        metrics_send(s, buffer, "haa_homekit_requests_total{endpoint=\"%s\"} %u\n", homekit_metrics_endpoint_name(i), hk_metrics.requests[i]);
+    }
+    
+    metrics_send(s, buffer, "haa_homekit_clients %u\n", hk_metrics.clients);
+    metrics_send(s, buffer, "haa_homekit_clients_rejected_total %u\n", hk_metrics.clients_rejected);
+    
+    metrics_send(s, buffer, "haa_homekit_pair_verify_started_total %u\n", hk_metrics.pair_verify_started);
+    uint32_t pair_verify_count = 0;
+    for (uint8_t i = 0; i < HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS; i++) {
+        pair_verify_count += hk_metrics.pair_verify_buckets[i];
+        if (i < HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS - 1) {
+            metrics_send(s, buffer, "haa_homekit_pair_verify_ms_bucket{le=\"%u\"} %u\n", homekit_metrics_pair_verify_bucket_ms[i], pair_verify_count);
+        } else {
+            metrics_send(s, buffer, "haa_homekit_pair_verify_ms_bucket{le=\"+Inf\"} %u\n", pair_verify_count);
+        }
+    }
+    metrics_send(s, buffer, "haa_homekit_pair_verify_ms_sum %u\n", hk_metrics.pair_verify_sum_ms);
+    metrics_send(s, buffer, "haa_homekit_pair_verify_ms_count %u\n", hk_metrics.pair_verify_ok);
+    metrics_send(s, buffer, "haa_homekit_pair_verify_last_ms %u\n", hk_metrics.pair_verify_last_ms);
+    metrics_send(s, buffer, "haa_homekit_pair_verify_max_ms %u\n", hk_metrics.pair_verify_max_ms);
+    
+    metrics_send(s, buffer, "haa_homekit_notifications_total{result=\"sent\"} %u\n", hk_metrics.notifications_sent);
+    metrics_send(s, buffer, "haa_homekit_notifications_total{result=\"coalesced\"} %u\n", hk_metrics.notifications_coalesced);
+    metrics_send(s, buffer, "haa_homekit_notifications_total{result=\"dropped\"} %u\n", hk_metrics.notifications_dropped);
+    
+    for (uint8_t i = 0; i < METRICS_ACTION_TYPES; i++) {
+        metrics_send(s, buffer, "haa_actions_total{type=\"%s\"} %u\n", metrics_action_names[i], haa_metrics.actions[i]);
+    }
+    
+    metrics_send(s, buffer, "haa_sensor_errors_total %u\n", haa_metrics.sensor_errors);
+    metrics_send(s, buffer, "haa_button_evaluations_total %u\n", adv_button_get_evaluations());
+    
+    if (adv_pwm_channels() > 0) {
+        adv_pwm_isr_stats_t pwm_isr_stats;
+        adv_pwm_get_isr_stats(&pwm_isr_stats);
+        metrics_send(s, buffer, "haa_pwm_periods_total %u\n", pwm_isr_stats.periods);
+        metrics_send(s, buffer, "haa_pwm_isr_cycles_per_period %u\n", pwm_isr_stats.last_cycles);
+        metrics_send(s, buffer, "haa_pwm_isr_max_cycles_per_period %u\n", pwm_isr_stats.max_cycles);
+    }
+    
+    metrics_send(s, buffer, "haa_wifi_disconnects_total %u\n", haa_metrics.wifi_disconnects);
+    metrics_send(s, buffer, "haa_wifi_reconnects_total %u\n", haa_metrics.wifi_reconnects);
+    metrics_send(s, buffer, "haa_wifi_channel %u\n", wifi_channel);
+    
+#ifdef HEAP_STATS
+    heap_stats_t heap_stats;
+    heap_stats_get(&heap_stats);
+    
+    for (uint8_t i = 0; i < HEAP_STATS_TAG_COUNT; i++) {
+        const char *tag = heap_stats_tag_name(i);
+        metrics_send(s, buffer, "haa_heap_used_bytes{tag=\"%s\"} %u\n", tag, heap_stats.tag[i].current);
+        metrics_send(s, buffer, "haa_heap_peak_bytes{tag=\"%s\"} %u\n", tag, heap_stats.tag[i].peak);
+        metrics_send(s, buffer, "haa_heap_failed_total{tag=\"%s\"} %u\n", tag, heap_stats.tag[i].failed);
+    }
+    
+    metrics_send(s, buffer, "haa_heap_free_bytes %u\n", heap_stats.free_heap);
+    metrics_send(s, buffer, "haa_heap_min_free_bytes %u\n", heap_stats.min_free_heap);
+    metrics_send(s, buffer, "haa_heap_largest_free_block_bytes %u\n", heap_stats.largest_free_block);
+    metrics_send(s, buffer, "haa_heap_fragmentation_percent %u\n", heap_stats.fragmentation);
+#else
+    metrics_send(s, buffer, "haa_heap_free_bytes %u\n", xPortGetFreeHeapSize());
+#endif  // HEAP_STATS
+    
+#ifdef TASK_STATS
+    task_stats_entry_t task_entry;
+    for (uint8_t i = 0; task_stats_get(i, &task_entry); i++) {
+        metrics_send(s, buffer, "haa_task_running{task=\"%s\"} %u\n", task_entry.name, task_entry.running);
+        metrics_send(s, buffer, "haa_task_cpu_permille{task=\"%s\"} %u\n", task_entry.name, task_entry.cpu_permille);
+        metrics_send(s, buffer, "haa_task_stack_free_min_bytes{task=\"%s\"} %u\n", task_entry.name, task_entry.stack_free_min);
+        metrics_send(s, buffer, "haa_task_stack_low{task=\"%s\"} %u\n", task_entry.name, task_entry.stack_low);
+    }
+    
+    metrics_send(s, buffer, "haa_tasks_untracked %u\n", task_stats_untracked());
+#endif  // TASK_STATS
+}
+
+#ifdef PROFILER
+// First GET /profile starts sampling, next one stops it and sends histogram to UDP logger port
+static void metrics_profiler(const int s, char *buffer) {
+    metrics_send(s, buffer, "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    
+    profiler_info_t info;
+    profiler_get_info(&info);
+    
+    if (info.running) {
+        profiler_stop();
+        profiler_get_info(&info);
+        const int sent = profiler_send();
+        INFO2("Profiler stopped");
+        metrics_send(s, buffer, "Profiler stopped: %u samples, %u entries, %u dropped, %i sent to UDP %u\n",
+                     info.samples, info.entries, info.dropped, sent, PROFILER_UDP_PORT);
+        
+    } else if (adv_pwm_channels() > 0) {
+        metrics_send(s, buffer, "Profiler not available with PWM\n");
+        
+    } else if (ir_tx_sending()) {
+        metrics_send(s, buffer, "Profiler not available while sending IR\n");
+        
+    } else if (profiler_start(PROFILER_DEFAULT_HZ) == 0) {
+        INFO2("Profiler started");
+        metrics_send(s, buffer, "Profiler started at %u Hz\n", PROFILER_DEFAULT_HZ);
+        
+    } else {
+        metrics_send(s, buffer, "Profiler start failed\n");
+    }
+}
+#endif  // PROFILER
+
+void metrics_task() {
+    struct sockaddr_in serv_addr;
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&serv_addr, 0, sizeof(serv_addr));
+    serv_addr.sin_family = AF_INET;
+    serv_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    serv_addr.sin_port = htons(metrics_port);
+    
+    if (listen_fd < 0 ||
+        bind(listen_fd, (struct sockaddr*) &serv_addr, sizeof(serv_addr)) != 0 ||
+        listen(listen_fd, 2) != 0) {
+        ERROR2("Metrics server port %i", metrics_port);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        vTaskDelete(NULL);
+    }
+    
+    INFO2("Metrics server port %i", metrics_port);
+    
+    char *buffer = malloc(METRICS_BUFFER_SIZE);
+    
+    for (;;) {
+        int s = accept(listen_fd, (struct sockaddr *) NULL, (socklen_t *) NULL);
+        if (s < 0) {
+            vTaskDelay(MS_TO_TICK(500));
+            continue;
+        }
+        
+        // Low heap at start, try again with each request
+        if (!buffer) {
+            buffer = malloc(METRICS_BUFFER_SIZE);
+            if (!buffer) {
+                ERROR2("Metrics buffer");
+                close(s);
+                continue;
+            }
+        }
+        
+        const struct timeval timeout = { METRICS_RECV_TIMEOUT_MS / 1000, 0 };
+        setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        
+        // Any request gets metrics. Only headers start is read, rest is discarded by close()
+        const int len = read(s, buffer, METRICS_BUFFER_SIZE);
+        if (len > 0) {
+#ifdef PROFILER
+            if (len >= 12 && strncmp(buffer, "GET /profile", 12) == 0) {
+                metrics_profiler(s, buffer);
+                close(s);
+                continue;
+            }
+#endif  // PROFILER
+            metrics_send_all(s, buffer);
+        }
+        
+        close(s);
+    }
+}
+
 homekit_characteristic_t name = HOMEKIT_CHARACTERISTIC_(NAME, NULL);
 homekit_characteristic_t serial = HOMEKIT_CHARACTERISTIC_(SERIAL_NUMBER, NULL);
 homekit_characteristic_t manufacturer = HOMEKIT_CHARACTERISTIC_(MANUFACTURER, "José A. Jiménez Campos");
@@ -3000,6 +3509,10 @@ void run_homekit_server() {
     sdk_os_timer_setfn(&wifi_watchdog_timer, wifi_watchdog, NULL);
     sdk_os_timer_arm(&wifi_watchdog_timer, WIFI_WATCHDOG_POLL_PERIOD_MS, 1);
 
+    if (metrics_port > 0) {
+        xTaskCreate(metrics_task, "metrics_task", METRICS_TASK_SIZE, NULL, METRICS_TASK_PRIORITY, NULL);
+    }
+
     if (ping_inputs) {
         ping_task_timer = malloc(sizeof(ETSTimer));
         memset(ping_task_timer, 0, sizeof(*ping_task_timer));
@@ -3078,6 +3591,26 @@ void normal_mode_init() {
             }
             adv_button_register_callback_fn(gpio, callback, button_type, (void *) hk_ch, param);
             
+            if (cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_DOUBLEPRESS_TIME) != NULL ||
+                cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_LONGPRESS_TIME) != NULL) {
+                uint16_t doublepress_time = 0;
+                if (cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_DOUBLEPRESS_TIME) != NULL) {
+                    doublepress_time = (uint16_t) cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_DOUBLEPRESS_TIME)->valuedouble;
+                }
+                
+                uint16_t longpress_time = 0;
+                if (cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_LONGPRESS_TIME) != NULL) {
+                    longpress_time = (uint16_t) cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_LONGPRESS_TIME)->valuedouble;
+                }
+                
+                adv_button_set_press_times(gpio, doublepress_time, longpress_time);
+            }
+            
+            if (cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_SPECULATIVE) != NULL &&
+                cJSON_GetObjectItemCaseSensitive(cJSON_GetArrayItem(json_buttons, j), BUTTON_SPECULATIVE)->valuedouble == 1) {
+                adv_button_set_speculative(gpio, true);
+            }
+            
             INFO2("Digital input GPIO: %i, type: %i, inv: %i", gpio, button_type, inverted);
              
             if (gpio_read(gpio) == button_type) {
@@ -3657,6 +4190,13 @@ void normal_mode_init() {
         return 2;
     }
     
+    uint8_t th_sensor_index(cJSON *json_accessory) {
+        if (cJSON_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_SENSOR_INDEX) != NULL) {
+            return (uint8_t) cJSON_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_SENSOR_INDEX)->valuedouble;
+        }
+        return 0;
+    }
+    
     float th_sensor_temp_offset(cJSON *json_accessory) {
         if (cJSON_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_OFFSET) != NULL) {
             return (float) cJSON_GetObjectItemCaseSensitive(json_accessory, TEMPERATURE_OFFSET)->valuedouble;
@@ -3685,12 +4225,127 @@ void normal_mode_init() {
         return th_poll_period;
     }
     
+    float get_float_value(cJSON *json_accessory, const char *key, const float default_value) {
+        if (cJSON_GetObjectItemCaseSensitive(json_accessory, key) != NULL) {
+            return (float) cJSON_GetObjectItemCaseSensitive(json_accessory, key)->valuedouble;
+        }
+        return default_value;
+    }
+    
+    void th_sensor_adc(ch_group_t *ch_group, cJSON *json_accessory) {
+        adc_group_t *adc_group = malloc(sizeof(adc_group_t));
+        if (!adc_group) {
+            ERROR2("ADC sensor memory");
+            return;
+        }
+        
+        memset(adc_group, 0, sizeof(*adc_group));
+        adc_group->ch_group = ch_group;
+        
+        adc_group->samples = get_float_value(json_accessory, ADC_SAMPLES, ADC_SAMPLES_DEFAULT);
+        if (adc_group->samples == 0) {
+            adc_group->samples = 1;
+        } else if (adc_group->samples > ADC_SENSOR_MAX_SAMPLES) {
+            adc_group->samples = ADC_SENSOR_MAX_SAMPLES;
+        }
+        
+        const float ema_shift = get_float_value(json_accessory, ADC_EMA_SHIFT, ADC_EMA_SHIFT_DEFAULT);
+        if (ema_shift < 0) {
+            adc_group->adc_sensor.ema_shift = 0;
+        } else if (ema_shift > ADC_SENSOR_MAX_EMA_SHIFT) {
+            adc_group->adc_sensor.ema_shift = ADC_SENSOR_MAX_EMA_SHIFT;
+        } else {
+            adc_group->adc_sensor.ema_shift = ema_shift;
+        }
+        
+        if (TH_SENSOR_TYPE == 5) {
+            adc_sensor_ntc_t ntc;
+            memset(&ntc, 0, sizeof(ntc));
+            ntc.beta = get_float_value(json_accessory, NTC_BETA, NTC_BETA_DEFAULT);
+            ntc.r0 = get_float_value(json_accessory, NTC_R0, NTC_R0_DEFAULT);
+            ntc.series = get_float_value(json_accessory, NTC_SERIES_RESISTOR, NTC_SERIES_RESISTOR_DEFAULT);
+            ntc.adc_top = NTC_ADC_TOP;
+            
+            cJSON *json_sh = cJSON_GetObjectItemCaseSensitive(json_accessory, NTC_STEINHART_HART_ARRAY);
+            if (json_sh != NULL && cJSON_GetArraySize(json_sh) == 3) {
+                for (uint8_t i = 0; i < 3; i++) {
+                    ntc.sh[i] = (float) cJSON_GetArrayItem(json_sh, i)->valuedouble;
+                }
+            }
+            
+            adc_group->lut = malloc(ADC_SENSOR_LUT_SIZE * sizeof(int16_t));
+            if (!adc_group->lut) {
+                ERROR2("NTC table memory");
+                free(adc_group);
+                return;
+            }
+            
+            adc_sensor_ntc_lut(adc_group->lut, &ntc);
+        }
+        
+        adc_group->next = adc_groups;
+        adc_groups = adc_group;
+    }
+    
+    void th_sensor_filter(ch_group_t *ch_group, cJSON *json_accessory) {
+        const char *keys[] = {
+            SENSOR_FILTER_MEDIAN,
+            SENSOR_FILTER_AVERAGE,
+            SENSOR_FILTER_MIN_INTERVAL,
+            SENSOR_FILTER_TEMP_STEP,
+            SENSOR_FILTER_TEMP_MIN_DELTA,
+            SENSOR_FILTER_HUM_STEP,
+            SENSOR_FILTER_HUM_MIN_DELTA
+        };
+        
+        bool has_filter = false;
+        for (uint8_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            if (cJSON_GetObjectItemCaseSensitive(json_accessory, keys[i]) != NULL) {
+                has_filter = true;
+                break;
+            }
+        }
+        
+        // Without filter keys every new value is published, as always
+        if (!has_filter) {
+            return;
+        }
+        
+        sensor_filter_group_t *sensor_filter_group = malloc(sizeof(sensor_filter_group_t));
+        memset(sensor_filter_group, 0, sizeof(*sensor_filter_group));
+        sensor_filter_group->ch_group = ch_group;
+        
+        const uint8_t median_size = get_float_value(json_accessory, SENSOR_FILTER_MEDIAN, 0);
+        const uint8_t average_size = get_float_value(json_accessory, SENSOR_FILTER_AVERAGE, 0);
+        const uint32_t min_interval_ms = get_float_value(json_accessory, SENSOR_FILTER_MIN_INTERVAL, 0) * 1000;
+        
+        sensor_filter_init(&sensor_filter_group->sensor_filters[0], median_size, average_size,
+                           get_float_value(json_accessory, SENSOR_FILTER_TEMP_STEP, 0),
+                           get_float_value(json_accessory, SENSOR_FILTER_TEMP_MIN_DELTA, 0),
+                           min_interval_ms);
+        
+        sensor_filter_init(&sensor_filter_group->sensor_filters[1], median_size, average_size,
+                           get_float_value(json_accessory, SENSOR_FILTER_HUM_STEP, 0),
+                           get_float_value(json_accessory, SENSOR_FILTER_HUM_MIN_DELTA, 0),
+                           min_interval_ms);
+        
+        sensor_filter_group->next = sensor_filter_groups;
+        sensor_filter_groups = sensor_filter_group;
+    }
+    
     void th_sensor(ch_group_t *ch_group, cJSON *json_accessory) {
         TH_SENSOR_GPIO = th_sensor_gpio(json_accessory);
         TH_SENSOR_TYPE = th_sensor_type(json_accessory);
+        TH_SENSOR_INDEX = th_sensor_index(json_accessory);
         TH_SENSOR_TEMP_OFFSET = th_sensor_temp_offset(json_accessory);
         TH_SENSOR_HUM_OFFSET = th_sensor_hum_offset(json_accessory);
         TH_SENSOR_POLL_PERIOD = th_sensor_poll_period(json_accessory);
+        
+        if (TH_SENSOR_TYPE > 4) {
+            th_sensor_adc(ch_group, json_accessory);
+        }
+        
+        th_sensor_filter(ch_group, json_accessory);
     }
     
     void th_sensor_starter(ch_group_t *ch_group) {
@@ -3707,6 +4362,7 @@ void normal_mode_init() {
     bool used_uart[2];
     used_uart[0] = false;
     used_uart[1] = false;
+    bool uart0_swapped = false;     // UART0 RX is GPIO13 instead of GPIO3
 
     if (cJSON_GetObjectItemCaseSensitive(json_config, UART_CONFIG_ARRAY) != NULL) {
         cJSON *json_uarts = cJSON_GetObjectItemCaseSensitive(json_config, UART_CONFIG_ARRAY);
@@ -3718,6 +4374,7 @@ void normal_mode_init() {
                 
                 if (uart_config == 2) {
                     sdk_system_uart_swap();
+                    uart0_swapped = true;
                     uart_config = 0;
                 }
                 
@@ -3874,6 +4531,16 @@ void normal_mode_init() {
         INFO2("PWM Freq: %i", pwm_freq);
     }
     
+    // LED strip
+    if (cJSON_GetObjectItemCaseSensitive(json_config, LED_STRIP_PIXELS) != NULL) {
+        led_strip_pixels = (uint16_t) cJSON_GetObjectItemCaseSensitive(json_config, LED_STRIP_PIXELS)->valuedouble;
+        INFO2("LED strip pixels: %i", led_strip_pixels);
+    }
+    
+    if (cJSON_GetObjectItemCaseSensitive(json_config, LED_STRIP_TYPE) != NULL) {
+        led_strip_type = (uint8_t) cJSON_GetObjectItemCaseSensitive(json_config, LED_STRIP_TYPE)->valuedouble;
+    }
+    
     // Ping poll period
     if (cJSON_GetObjectItemCaseSensitive(json_config, PING_POLL_PERIOD) != NULL) {
         ping_poll_period = (float) cJSON_GetObjectItemCaseSensitive(json_config, PING_POLL_PERIOD)->valuedouble;
@@ -3898,6 +4565,12 @@ void normal_mode_init() {
         INFO2("Unsecure connections: %i", config.insecure);
     }
     
+    // Metrics server port
+    if (cJSON_GetObjectItemCaseSensitive(json_config, METRICS_PORT) != NULL) {
+        metrics_port = (uint16_t) cJSON_GetObjectItemCaseSensitive(json_config, METRICS_PORT)->valuedouble;
+        INFO2("Metrics port: %i", metrics_port);
+    }
+    
     // mDNS TTL
     config.mdns_ttl = MDNS_TTL_DEFAULT;
     if (cJSON_GetObjectItemCaseSensitive(json_config, MDNS_TTL) != NULL) {
@@ -4372,7 +5045,7 @@ void normal_mode_init() {
         uint8_t calloc_count = 2;
         
         if (is_power_meter) {
-            calloc_count += 3;
+            calloc_count += 4;
         }
         
         accessories[accessory]->services[1]->characteristics = calloc(calloc_count, sizeof(homekit_characteristic_t*));
@@ -4387,16 +5060,86 @@ void normal_mode_init() {
             homekit_characteristic_t *ch1 = NEW_HOMEKIT_CHARACTERISTIC(MIAU_VOLT, 0);
             homekit_characteristic_t *ch2 = NEW_HOMEKIT_CHARACTERISTIC(MIAU_AMPERE, 0);
             homekit_characteristic_t *ch3 = NEW_HOMEKIT_CHARACTERISTIC(MIAU_WATT, 0);
+            homekit_characteristic_t *ch4 = NEW_HOMEKIT_CHARACTERISTIC(MIAU_KWH, 0);
             
             accessories[accessory]->services[1]->characteristics[1] = ch1;
             accessories[accessory]->services[1]->characteristics[2] = ch2;
             accessories[accessory]->services[1]->characteristics[3] = ch3;
+            accessories[accessory]->services[1]->characteristics[4] = ch4;
             
             ch_group->ch1 = ch1;
-            ch_group->ch1 = ch2;
-            ch_group->ch1 = ch3;
-
+            ch_group->ch2 = ch2;
+            ch_group->ch3 = ch3;
+            ch_group->ch4 = ch4;
+            
+            power_monitor_factors_t factors;
+            factors.voltage = get_float_value(json_context, PM_VOLTAGE_FACTOR, 0);
+            factors.voltage_offset = get_float_value(json_context, PM_VOLTAGE_OFFSET, 0);
+            factors.current = get_float_value(json_context, PM_CURRENT_FACTOR, 0);
+            factors.current_offset = get_float_value(json_context, PM_CURRENT_OFFSET, 0);
+            factors.power = get_float_value(json_context, PM_POWER_FACTOR, 0);
+            factors.power_offset = get_float_value(json_context, PM_POWER_OFFSET, 0);
+            
+            power_monitor_t *power_monitor = NULL;
+            const uint8_t pm_sensor_type = get_float_value(json_context, PM_SENSOR_TYPE, POWER_MONITOR_TYPE_HLW8012);
+            
+            if (pm_sensor_type == POWER_MONITOR_TYPE_CSE7766) {
+                // CSE7766 sets UART0 to 4800 8E1 and receives on GPIO3, shared with log, UART actions and LED strip
+                if (used_uart[0] || log_output_type == 1 || used_gpio[3]) {
+                    ERROR2("PM sensor UART0 or GPIO3 already used");
+                    
+                } else {
+                    power_monitor = power_monitor_cse7766_new(get_float_value(json_context, PM_SENSOR_UART, PM_SENSOR_UART_DEFAULT), &factors);
+                    if (power_monitor) {
+                        used_uart[0] = true;
+                        used_gpio[3] = true;
+                        if (log_output_type == 0) {
+                            sdk_os_install_putc1(alternate_putc);
+                        }
+                    }
+                }
+                
+            } else {
+                cJSON *json_pm_gpios = cJSON_GetObjectItemCaseSensitive(json_context, PM_SENSOR_GPIO_ARRAY);
+                if (json_pm_gpios != NULL && cJSON_GetArraySize(json_pm_gpios) == 3) {
+                    power_monitor = power_monitor_hlw8012_new(pm_sensor_type,
+                                                              (uint8_t) cJSON_GetArrayItem(json_pm_gpios, 0)->valuedouble,
+                                                              (uint8_t) cJSON_GetArrayItem(json_pm_gpios, 1)->valuedouble,
+                                                              (uint8_t) cJSON_GetArrayItem(json_pm_gpios, 2)->valuedouble,
+                                                              (bool) get_float_value(json_context, PM_SENSOR_SEL_INVERTED, 0),
+                                                              &factors);
+                }
+            }
+            
+            pm_group_t *pm_group = NULL;
+            if (power_monitor) {
+                pm_group = malloc(sizeof(pm_group_t));
+            }
             
+            if (pm_group) {
+                memset(pm_group, 0, sizeof(*pm_group));
+                pm_group->power_monitor = power_monitor;
+                pm_group->ch_group = ch_group;
+                
+                // Same id scheme than saved states
+                pm_group->energy_id = malloc(5);
+                itoa(((accessory + 10) * 10) + 4, pm_group->energy_id, 10);
+                
+                int32_t saved_energy;
+                if (sysparam_get_int32(pm_group->energy_id, &saved_energy) == SYSPARAM_OK && saved_energy > 0) {
+                    pm_group->energy_saved = saved_energy;
+                    power_monitor_set_energy(power_monitor, (uint64_t) saved_energy * POWER_MONITOR_MWS_PER_WH);
+                    ch4->value.float_value = saved_energy / 1000.f;
+                }
+                
+                ch_group->timer = malloc(sizeof(ETSTimer));
+                memset(ch_group->timer, 0, sizeof(*ch_group->timer));
+                sdk_os_timer_setfn(ch_group->timer, power_monitor_timer_worker, pm_group);
+                sdk_os_timer_arm(ch_group->timer, get_float_value(json_context, PM_POLL_PERIOD, PM_POLL_PERIOD_DEFAULT) * 1000, 1);
+                
+            } else {
+                ERROR2("PM sensor config");
+            }
         }
 
         const bool exec_actions_on_boot = get_exec_actions_on_boot(json_context);
@@ -4881,7 +5624,8 @@ void normal_mode_init() {
         
         bool is_pwm = true;
         if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_R) == NULL &&
-            cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W) == NULL) {
+            cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W) == NULL &&
+            cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_STRIP_SEGMENT) == NULL) {
             is_pwm = false;
         }
 
@@ -4891,14 +5635,10 @@ void normal_mode_init() {
             memset(pwm_timer, 0, sizeof(*pwm_timer));
             sdk_os_timer_setfn(pwm_timer, rgbw_set_timer_worker, NULL);
             
-            pwm_info = malloc(sizeof(pwm_info_t));
-            memset(pwm_info, 0, sizeof(*pwm_info));
-            
-            multipwm_init(pwm_info);
+            adv_pwm_init();
             if (pwm_freq > 0) {
-                multipwm_set_freq(pwm_info, pwm_freq);
+                adv_pwm_set_freq(pwm_freq);
             }
-            pwm_info->channels = 0;
         }
         
         homekit_characteristic_t *ch0 = NEW_HOMEKIT_CHARACTERISTIC(ON, false, .setter_ex=hkc_rgbw_setter);
@@ -4928,19 +5668,23 @@ void normal_mode_init() {
         lightbulb_group->pwm_w = 255;
         lightbulb_group->pwm_cw = 255;
         lightbulb_group->pwm_ww = 255;
+        lightbulb_group->strip_segment = 255;
         lightbulb_group->target_r = 0;
         lightbulb_group->target_g = 0;
         lightbulb_group->target_b = 0;
         lightbulb_group->target_w = 0;
         lightbulb_group->target_cw = 0;
         lightbulb_group->target_ww = 0;
-        lightbulb_group->factor_r = 1;
-        lightbulb_group->factor_g = 1;
-        lightbulb_group->factor_b = 1;
-        lightbulb_group->factor_w = 1;
-        lightbulb_group->factor_cw = 1;
-        lightbulb_group->factor_ww = 1;
-        lightbulb_group->step = RGBW_STEP_DEFAULT;
+        lightbulb_group->factor_r = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->factor_g = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->factor_b = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->factor_w = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->factor_cw = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->factor_ww = LIGHTBULB_FACTOR_ONE;
+        lightbulb_group->fade_time = LIGHTBULB_FADE_DURATION_DEFAULT;
+        lightbulb_group->fade_curve = LIGHTBULB_FADE_LINEAR;
+        lightbulb_group->gamma = false;
+        lightbulb_group->is_fading = false;
         lightbulb_group->autodimmer = 0;
         lightbulb_group->armed_autodimmer = false;
         lightbulb_group->autodimmer_task_delay = AUTODIMMER_TASK_DELAY_DEFAULT;
@@ -4948,70 +5692,126 @@ void normal_mode_init() {
         lightbulb_group->next = lightbulb_groups;
         lightbulb_groups = lightbulb_group;
 
-        if (is_pwm) {
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_R) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_r = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_r, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_R)->valuedouble);
+        cJSON *json_strip_segment = cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_STRIP_SEGMENT);
+        if (json_strip_segment != NULL && cJSON_GetArraySize(json_strip_segment) == 2) {
+            // Strip segment is a RGB or RGBW lightbulb
+            // Strip data is I2S on GPIO3, same pin as UART0 RX when it is not swapped
+            if (!led_strip_timer) {
+                if (used_gpio[3] || (used_uart[0] && !uart0_swapped)) {
+                    ERROR2("LED strip GPIO3 used by UART0 or other function");
+                    
+                } else {
+                    led_strip_timer = malloc(sizeof(ETSTimer));
+                    const int result = led_strip_timer ? led_strip_init(led_strip_type, led_strip_pixels) : -2;
+                    if (result < 0) {
+                        ERROR2("LED strip init %i", result);
+                        free(led_strip_timer);
+                        led_strip_timer = NULL;
+                        
+                    } else {
+                        used_gpio[3] = true;
+                        memset(led_strip_timer, 0, sizeof(*led_strip_timer));
+                        sdk_os_timer_setfn(led_strip_timer, led_strip_effect_worker, NULL);
+                    }
+                }
+            }
+            
+            int segment = -1;
+            if (led_strip_timer) {
+                segment = led_strip_add_segment((uint16_t) cJSON_GetArrayItem(json_strip_segment, 0)->valuedouble,
+                                                (uint16_t) cJSON_GetArrayItem(json_strip_segment, 1)->valuedouble);
+            }
+            
+            if (segment >= 0 && led_strip_next_channel + 4 <= LIGHTBULB_CHANNELS) {
+                lightbulb_group->strip_segment = segment;
+                lightbulb_group->pwm_r = led_strip_next_channel++;
+                lightbulb_group->pwm_g = led_strip_next_channel++;
+                lightbulb_group->pwm_b = led_strip_next_channel++;
+                if (led_strip_type == LED_STRIP_TYPE_GRBW) {
+                    lightbulb_group->pwm_w = led_strip_next_channel++;
+                }
+                
+                if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_STRIP_EFFECT) != NULL) {
+                    led_strip_set_effect(segment, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_STRIP_EFFECT)->valuedouble);
+                }
+            } else {
+                ERROR2("LED strip segment not valid");
+            }
+            
+        } else if (is_pwm) {
+            // Channel is 255 when GPIO is not valid or all channels are used
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_R) != NULL) {
+                lightbulb_group->pwm_r = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_R)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_R) != NULL) {
-                lightbulb_group->factor_r = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_R)->valuedouble;
+                lightbulb_group->factor_r = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_R)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
 
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_G) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_g = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_g, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_G)->valuedouble);
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_G) != NULL) {
+                lightbulb_group->pwm_g = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_G)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_G) != NULL) {
-                lightbulb_group->factor_g = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_G)->valuedouble;
+                lightbulb_group->factor_g = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_G)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
 
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_B) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_b = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_b, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_B)->valuedouble);
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_B) != NULL) {
+                lightbulb_group->pwm_b = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_B)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_B) != NULL) {
-                lightbulb_group->factor_b = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_B)->valuedouble;
+                lightbulb_group->factor_b = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_B)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
 
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_w = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_w, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W)->valuedouble);
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W) != NULL) {
+                lightbulb_group->pwm_w = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_W)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_W) != NULL) {
-                lightbulb_group->factor_w = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_W)->valuedouble;
+                lightbulb_group->factor_w = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_W)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
             
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_CW) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_cw = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_cw, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_CW)->valuedouble);
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_CW) != NULL) {
+                lightbulb_group->pwm_cw = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_CW)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_CW) != NULL) {
-                lightbulb_group->factor_cw = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_CW)->valuedouble;
+                lightbulb_group->factor_cw = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_CW)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
             
-            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_WW) != NULL && pwm_info->channels < MULTIPWM_MAX_CHANNELS) {
-                lightbulb_group->pwm_ww = pwm_info->channels;
-                pwm_info->channels++;
-                multipwm_set_pin(pwm_info, lightbulb_group->pwm_ww, (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_WW)->valuedouble);
+            if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_WW) != NULL) {
+                lightbulb_group->pwm_ww = adv_pwm_add_channel((uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_PWM_GPIO_WW)->valuedouble);
             }
             
             if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_WW) != NULL) {
-                lightbulb_group->factor_ww = (float) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_WW)->valuedouble;
+                lightbulb_group->factor_ww = (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FACTOR_WW)->valuedouble * LIGHTBULB_FACTOR_ONE) + 0.5;
             }
         }
         
+        // Old step per RGBW_PERIOD setting is converted to a full scale fade duration
         if (cJSON_GetObjectItemCaseSensitive(json_context, RGBW_STEP) != NULL) {
-            lightbulb_group->step = (uint16_t) cJSON_GetObjectItemCaseSensitive(json_context, RGBW_STEP)->valuedouble;
+            const uint16_t step = (uint16_t) cJSON_GetObjectItemCaseSensitive(json_context, RGBW_STEP)->valuedouble;
+            lightbulb_group->fade_time = 0;
+            if (step > 0 && step < PWM_SCALE) {
+                lightbulb_group->fade_time = (uint32_t) PWM_SCALE / step * RGBW_PERIOD;
+            }
+        }
+        
+        if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FADE_DURATION) != NULL) {
+            lightbulb_group->fade_time = (uint32_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FADE_DURATION)->valuedouble;
+        }
+        
+        if (lightbulb_group->fade_time > LIGHTBULB_FADE_DURATION_MAX) {
+            lightbulb_group->fade_time = LIGHTBULB_FADE_DURATION_MAX;
+        }
+        
+        if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FADE_CURVE) != NULL) {
+            lightbulb_group->fade_curve = (uint8_t) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_FADE_CURVE)->valuedouble;
+        }
+        
+        if (cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_GAMMA) != NULL) {
+            lightbulb_group->gamma = (bool) cJSON_GetObjectItemCaseSensitive(json_context, LIGHTBULB_GAMMA)->valuedouble;
         }
         
         if (cJSON_GetObjectItemCaseSensitive(json_context, AUTODIMMER_TASK_DELAY) != NULL) {
@@ -5270,8 +6070,8 @@ void normal_mode_init() {
         WINDOW_COVER_CH_TARGET_POSITION = ch1;
         WINDOW_COVER_CH_STATE = ch2;
         WINDOW_COVER_CH_OBSTRUCTION = ch3;
-        WINDOW_COVER_STEP_TIME_UP = WINDOW_COVER_STEP_TIME(WINDOW_COVER_TIME_OPEN_DEFAULT);
-        WINDOW_COVER_STEP_TIME_DOWN = WINDOW_COVER_STEP_TIME(WINDOW_COVER_TIME_OPEN_DEFAULT);
+        WINDOW_COVER_SPEED_UP = WINDOW_COVER_SPEED(WINDOW_COVER_TIME_OPEN_DEFAULT);
+        WINDOW_COVER_SPEED_DOWN = WINDOW_COVER_SPEED(WINDOW_COVER_TIME_OPEN_DEFAULT);
         WINDOW_COVER_POSITION = 0;
         WINDOW_COVER_REAL_POSITION = 0;
         WINDOW_COVER_CORRECTION = WINDOW_COVER_CORRECTION_DEFAULT;
@@ -5287,11 +6087,11 @@ void normal_mode_init() {
         sdk_os_timer_setfn(ch_group->timer, window_cover_timer_worker, ch0);
         
         if (cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_OPEN_SET) != NULL) {
-            WINDOW_COVER_STEP_TIME_UP = WINDOW_COVER_STEP_TIME(cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_OPEN_SET)->valuedouble);
+            WINDOW_COVER_SPEED_UP = WINDOW_COVER_SPEED(cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_OPEN_SET)->valuedouble);
         }
         
         if (cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_CLOSE_SET) != NULL) {
-            WINDOW_COVER_STEP_TIME_DOWN = WINDOW_COVER_STEP_TIME(cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_CLOSE_SET)->valuedouble);
+            WINDOW_COVER_SPEED_DOWN = WINDOW_COVER_SPEED(cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_TIME_CLOSE_SET)->valuedouble);
         }
         
         if (cJSON_GetObjectItemCaseSensitive(json_context, WINDOW_COVER_CORRECTION_SET) != NULL) {
@@ -5711,11 +6511,23 @@ void normal_mode_init() {
 }
 
 void user_init(void) {
+#ifdef HEAP_STATS
+    cJSON_Hooks cjson_hooks = {
+        .malloc_fn = heap_stats_cjson_malloc,
+        .free_fn = heap_stats_cjson_free
+    };
+    cJSON_InitHooks(&cjson_hooks);
+#endif  // HEAP_STATS
+    
 #ifdef HAA_DEBUG
     sdk_os_timer_setfn(&free_heap_timer, free_heap_watchdog, NULL);
     sdk_os_timer_arm(&free_heap_timer, 2000, 1);
 #endif // HAA_DEBUG
     
+#ifdef TASK_STATS
+    task_stats_start(TASK_STATS_PERIOD_MS);
+#endif  // TASK_STATS
+    
     sdk_wifi_station_set_auto_connect(false);
     sdk_wifi_set_opmode(STATION_MODE);
     sdk_wifi_station_disconnect();
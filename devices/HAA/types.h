@@ -138,11 +138,13 @@ typedef struct _ch_group {
     homekit_characteristic_t *ch_child;
     homekit_characteristic_t *ch_sec;
     
-    float num[10];
+    float num[11];
     
     ETSTimer *timer;
     ETSTimer *timer2;
     
+    uint32_t motion_start;      // Microseconds, for time based positions
+    
     char *ir_protocol;
     
     action_copy_t *action_copy;
@@ -160,6 +162,13 @@ typedef struct _ch_group {
     struct _ch_group *next;
 } ch_group_t;
 
+typedef struct _haa_metrics {
+    uint32_t actions[METRICS_ACTION_TYPES];
+    uint32_t sensor_errors;
+    uint32_t wifi_disconnects;
+    uint32_t wifi_reconnects;
+} haa_metrics_t;
+
 typedef struct _action_task {
     uint8_t action;
     ch_group_t *ch_group;
@@ -176,6 +185,8 @@ typedef struct _lightbulb_group {
     uint8_t autodimmer;
     uint8_t autodimmer_task_step;
     
+    uint8_t strip_segment;
+    
     uint16_t target_r;
     uint16_t target_g;
     
@@ -185,24 +196,61 @@ typedef struct _lightbulb_group {
     uint16_t target_cw;
     uint16_t target_ww;
     
-    uint16_t step;
     uint16_t autodimmer_task_delay;
+    
+    uint32_t fade_time;
+    uint32_t fade_start;
+    uint32_t fade_duration;
 
-    float factor_r;
-    float factor_g;
-    float factor_b;
-    float factor_w;
-    float factor_cw;
-    float factor_ww;
+    uint32_t factor_r;      // Q16
+    uint32_t factor_g;
+    uint32_t factor_b;
+    uint32_t factor_w;
+    uint32_t factor_cw;
+    uint32_t factor_ww;
+    
+    uint8_t fade_curve;
+    uint8_t autodimmer_phase;
+    uint8_t autodimmer_from;
+    bool gamma;
     
     bool is_pwm;
     bool armed_autodimmer;
+    bool is_fading;
 
     homekit_characteristic_t *ch0;
     
     struct _lightbulb_group *next;
 } lightbulb_group_t;
 
+typedef struct _adc_group {
+    uint8_t samples;
+    adc_sensor_t adc_sensor;
+    int16_t *lut;           // Only for NTC
+    
+    ch_group_t *ch_group;
+    
+    struct _adc_group *next;
+} adc_group_t;
+
+typedef struct _sensor_filter_group {
+    sensor_filter_t sensor_filters[2];      // Temperature or ADC value, and humidity
+    
+    ch_group_t *ch_group;
+    
+    struct _sensor_filter_group *next;
+} sensor_filter_group_t;
+
+typedef struct _pm_group {
+    power_monitor_t *power_monitor;
+    
+    char *energy_id;
+    uint32_t energy_saved;  // Wh
+    uint32_t energy_saved_ms;
+    
+    ch_group_t *ch_group;
+} pm_group_t;
+
 typedef void (*ping_callback_fn)(uint8_t gpio, void *args, uint8_t param);
 
 typedef struct _ping_input_callback_fn {
@@ -0,0 +1,233 @@
+/*
+* HAA Crypto Benchmark v1.0
+*
+* Copyright 2020 José Antonio Jiménez Campos (@RavenSystem)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "crypto.h"
+#include "port.h"
+
+#include "crypto_bench.h"
+
+#define HAP_FRAME_SIZE              1024    // Max encrypted frame payload
+#define HAP_FRAME_AAD_SIZE          2
+#define HAP_SIGNED_INFO_SIZE        100     // Curve25519 key + pairing id + Curve25519 key
+#define HAP_SRP_PUBLIC_KEY_SIZE     384     // 3072 bits
+
+typedef struct _bench_state {
+    Srp *srp;
+    Srp *srp_peer;
+    ed25519_key *ed_key;
+    curve25519_key *my_key;
+    curve25519_key *peer_key;
+
+    byte srp_peer_public_key[HAP_SRP_PUBLIC_KEY_SIZE];
+    size_t srp_peer_public_key_size;
+    byte srp_public_key[HAP_SRP_PUBLIC_KEY_SIZE];
+    size_t srp_public_key_size;
+
+    byte key[32];
+    byte nonce[12];
+    byte aad[HAP_FRAME_AAD_SIZE];
+    byte message[HAP_FRAME_SIZE];
+    byte encrypted[HAP_FRAME_SIZE + 16];
+    byte decrypted[HAP_FRAME_SIZE];
+    byte signature[64];
+} bench_state_t;
+
+typedef int (*bench_fn)(bench_state_t *state, const size_t size);
+
+static bench_state_t *bench_state;
+
+static int bench_srp_init(bench_state_t *state, const size_t size) {
+    crypto_srp_free(state->srp);
+    state->srp = crypto_srp_new();
+    if (!state->srp) {
+        return -1;
+    }
+
+    return crypto_srp_init(state->srp, "Pair-Setup", "021-82-017");
+}
+
+static int bench_srp_public_key(bench_state_t *state, const size_t size) {
+    state->srp_public_key_size = sizeof(state->srp_public_key);
+    return crypto_srp_get_public_key(state->srp, state->srp_public_key, &state->srp_public_key_size);
+}
+
+static int bench_srp_compute_key(bench_state_t *state, const size_t size) {
+    return crypto_srp_compute_key(state->srp,
+                                  state->srp_peer_public_key, state->srp_peer_public_key_size,
+                                  state->srp_public_key, state->srp_public_key_size);
+}
+
+static int bench_srp_hkdf(bench_state_t *state, const size_t size) {
+    const byte salt[] = "Pair-Setup-Encrypt-Salt";
+    const byte info[] = "Pair-Setup-Encrypt-Info";
+    size_t key_size = sizeof(state->key);
+
+    return crypto_srp_hkdf(state->srp, salt, sizeof(salt) - 1, info, sizeof(info) - 1, state->key, &key_size);
+}
+
+static int bench_hkdf(bench_state_t *state, const size_t size) {
+    const byte salt[] = "Control-Salt";
+    const byte info[] = "Control-Read-Encryption-Key";
+    size_t key_size = sizeof(state->key);
+
+    return crypto_hkdf(state->key, sizeof(state->key), salt, sizeof(salt) - 1, info, sizeof(info) - 1, state->key, &key_size);
+}
+
+static int bench_chacha20poly1305_encrypt(bench_state_t *state, const size_t size) {
+    size_t encrypted_size = size + 16;
+    state->aad[0] = size % 256;
+    state->aad[1] = size / 256;
+
+    return crypto_chacha20poly1305_encrypt(state->key, state->nonce, state->aad, HAP_FRAME_AAD_SIZE,
+                                           state->message, size,
+                                           state->encrypted, &encrypted_size);
+}
+
+static int bench_chacha20poly1305_decrypt(bench_state_t *state, const size_t size) {
+    size_t decrypted_size = size;
+
+    return crypto_chacha20poly1305_decrypt(state->key, state->nonce, state->aad, HAP_FRAME_AAD_SIZE,
+                                           state->encrypted, size + 16,
+                                           state->decrypted, &decrypted_size);
+}
+
+static int bench_ed25519_generate(bench_state_t *state, const size_t size) {
+    crypto_ed25519_free(state->ed_key);
+    state->ed_key = crypto_ed25519_generate();
+
+    return state->ed_key ? 0 : -1;
+}
+
+static int bench_ed25519_sign(bench_state_t *state, const size_t size) {
+    size_t signature_size = sizeof(state->signature);
+
+    return crypto_ed25519_sign(state->ed_key, state->message, size, state->signature, &signature_size);
+}
+
+static int bench_ed25519_verify(bench_state_t *state, const size_t size) {
+    return crypto_ed25519_verify(state->ed_key, state->message, size, state->signature, sizeof(state->signature));
+}
+
+static int bench_curve25519_generate(bench_state_t *state, const size_t size) {
+    crypto_curve25519_free(state->my_key);
+    state->my_key = crypto_curve25519_generate();
+
+    return state->my_key ? 0 : -1;
+}
+
+static int bench_curve25519_shared_secret(bench_state_t *state, const size_t size) {
+    size_t shared_secret_size = sizeof(state->key);
+
+    return crypto_curve25519_shared_secret(state->my_key, state->peer_key, state->key, &shared_secret_size);
+}
+
+static int bench_run(const char *name, bench_fn fn, const size_t size) {
+    uint32_t total_time = 0;
+    uint32_t runs = 0;
+    int r = 0;
+
+    while (runs < BENCH_MAX_RUNS && (total_time < BENCH_MIN_TIME_US || runs == 0)) {
+        const uint32_t start_time = crypto_bench_time_us();
+        r = fn(bench_state, size);
+        total_time += crypto_bench_time_us() - start_time;
+        runs++;
+
+        if (r) {
+            break;
+        }
+
+        // Let idle and WiFi tasks run, outside of measured time
+        if ((runs & 0x0F) == 0 || total_time > 1000000) {
+            crypto_bench_yield();
+        }
+    }
+
+    if (r) {
+        printf("# %s failed (%i)\n", name, r);
+        return 1;
+    }
+
+    const float ops_s = runs * 1000000.f / total_time;
+
+    printf("{\"bench\":\"%s\",\"size\":%u,\"runs\":%u,\"us\":%u,\"ops_s\":%.2f,\"bytes_s\":%.2f,\"target\":\"%s\",\"cpu_mhz\":%u,"
+           "\"small\":%i,\"fe32\":%i,\"inline\":%i,\"mp_low_mem\":%i}\n",
+           name, (unsigned int) size, runs, total_time, ops_s, ops_s * size, crypto_bench_target(), crypto_bench_cpu_mhz(),
+           BENCH_HOMEKIT_SMALL, BENCH_HOMEKIT_CURVE25519_32BIT, BENCH_HOMEKIT_WOLFSSL_INLINE, BENCH_HOMEKIT_WOLFSSL_MP_LOW_MEM);
+
+    return 0;
+}
+
+int crypto_bench_run_all() {
+    bench_state = calloc(1, sizeof(bench_state_t));
+    if (!bench_state) {
+        printf("# No memory\n");
+        return 1;
+    }
+
+    int failed = 0;
+
+    homekit_random_fill(bench_state->key, sizeof(bench_state->key));
+    homekit_random_fill(bench_state->nonce, sizeof(bench_state->nonce));
+    homekit_random_fill(bench_state->message, sizeof(bench_state->message));
+
+    printf("# Preparing peers\n");
+
+    // Controller side of SRP is emulated by other accessory instance public key
+    bench_state->srp_peer = crypto_srp_new();
+    crypto_srp_init(bench_state->srp_peer, "Pair-Setup", "021-82-017");
+    bench_state->srp_peer_public_key_size = sizeof(bench_state->srp_peer_public_key);
+    crypto_srp_get_public_key(bench_state->srp_peer, bench_state->srp_peer_public_key, &bench_state->srp_peer_public_key_size);
+    crypto_srp_free(bench_state->srp_peer);
+    bench_state->srp_peer = NULL;
+
+    bench_state->peer_key = crypto_curve25519_generate();
+
+    // Pair Setup
+    failed += bench_run("srp_init", bench_srp_init, HAP_SRP_PUBLIC_KEY_SIZE);
+    failed += bench_run("srp_public_key", bench_srp_public_key, HAP_SRP_PUBLIC_KEY_SIZE);
+    failed += bench_run("srp_compute_key", bench_srp_compute_key, HAP_SRP_PUBLIC_KEY_SIZE);
+    failed += bench_run("srp_hkdf", bench_srp_hkdf, 64);
+    failed += bench_run("ed25519_generate", bench_ed25519_generate, 32);
+
+    // Pair Verify
+    failed += bench_run("curve25519_generate", bench_curve25519_generate, 32);
+    failed += bench_run("curve25519_shared_secret", bench_curve25519_shared_secret, 32);
+    failed += bench_run("ed25519_sign", bench_ed25519_sign, HAP_SIGNED_INFO_SIZE);
+    failed += bench_run("ed25519_verify", bench_ed25519_verify, HAP_SIGNED_INFO_SIZE);
+    failed += bench_run("hkdf_sha512", bench_hkdf, 32);
+
+    // Encrypted session frames
+    const size_t frame_sizes[] = { 64, 256, HAP_FRAME_SIZE };
+    for (uint8_t i = 0; i < sizeof(frame_sizes) / sizeof(frame_sizes[0]); i++) {
+        failed += bench_run("chacha20poly1305_encrypt", bench_chacha20poly1305_encrypt, frame_sizes[i]);
+        failed += bench_run("chacha20poly1305_decrypt", bench_chacha20poly1305_decrypt, frame_sizes[i]);
+    }
+
+    crypto_srp_free(bench_state->srp);
+    crypto_ed25519_free(bench_state->ed_key);
+    crypto_curve25519_free(bench_state->my_key);
+    crypto_curve25519_free(bench_state->peer_key);
+    free(bench_state);
+    bench_state = NULL;
+
+    return failed;
+}
@@ -0,0 +1,52 @@
+/*
+* HAA Crypto Benchmark v1.0
+*
+* Copyright 2020 José Antonio Jiménez Campos (@RavenSystem)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/*
+ * Runs the external_libs/homekit/src/crypto.c wrappers with the same input
+ * sizes used by HAP and prints one JSON object per line:
+ *
+ * {"bench":"ed25519_sign","size":100,"runs":12,"us":1234567,"ops_s":9.72,"bytes_s":972.00,"target":"esp8266","cpu_mhz":80,"small":0,"fe32":0,"inline":0,"mp_low_mem":1}
+ *
+ * Lines starting with '#' are comments. Capture output of builds with
+ * different options and compare them by "bench" and "size".
+ *
+ * Same cases are built for ESP8266 (main.c) and for host (host/), and each
+ * one provides time, yield and CPU frequency functions.
+ */
+
+#ifndef __CRYPTO_BENCH_H__
+#define __CRYPTO_BENCH_H__
+
+#include <stdint.h>
+
+#ifndef BENCH_MIN_TIME_US
+#define BENCH_MIN_TIME_US           3000000
+#endif // BENCH_MIN_TIME_US
+
+#define BENCH_MAX_RUNS              100000
+
+// Platform functions
+uint32_t crypto_bench_time_us();
+void crypto_bench_yield();
+uint32_t crypto_bench_cpu_mhz();        // 0 if unknown
+const char *crypto_bench_target();
+
+// Prints one JSON line per case. Returns number of failed cases
+int crypto_bench_run_all();
+
+#endif  // __CRYPTO_BENCH_H__
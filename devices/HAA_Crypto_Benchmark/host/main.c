@@ -0,0 +1,87 @@
+/*
+* HAA Crypto Benchmark v1.0
+*
+* Copyright 2020 José Antonio Jiménez Campos (@RavenSystem)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/*
+ * Host frontend of crypto_bench.c, with same wolfSSL sources and options
+ * than firmware. Results are printed to stdout:
+ *
+ *   make -C devices/HAA_Crypto_Benchmark/host
+ *   make -C devices/HAA_Crypto_Benchmark/host HOMEKIT_SMALL=1
+ *
+ * Host CPU has 64-bit products and caches, so only relative differences
+ * between options are meaningful, not absolute ESP8266 times.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/random.h>
+
+#include "port.h"
+#include "crypto_bench.h"
+
+int host_random_generate_block(uint8_t *buf, size_t len) {
+    while (len > 0) {
+        const ssize_t r = getrandom(buf, len, 0);
+        if (r < 0) {
+            return -1;
+        }
+
+        buf += r;
+        len -= r;
+    }
+
+    return 0;
+}
+
+uint32_t homekit_random() {
+    uint32_t value;
+    host_random_generate_block((uint8_t *) &value, sizeof(value));
+    return value;
+}
+
+void homekit_random_fill(uint8_t *data, size_t size) {
+    host_random_generate_block(data, size);
+}
+
+uint32_t crypto_bench_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void crypto_bench_yield() {
+}
+
+uint32_t crypto_bench_cpu_mhz() {
+    return 0;
+}
+
+const char *crypto_bench_target() {
+    return "host";
+}
+
+int main() {
+    printf("# HAA Crypto Benchmark v1.0 (host)\n");
+
+    const int failed = crypto_bench_run_all();
+
+    printf("# Done\n");
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,31 @@
+#ifndef wolfcrypt_user_settings_h
+#define wolfcrypt_user_settings_h
+
+// Host version of external_libs/wolfssl/user_settings.h
+
+#include <stddef.h>
+#include <stdint.h>
+
+int host_random_generate_block(uint8_t *buf, size_t len);
+
+#define WC_NO_HARDEN
+#define NO_WOLFSSL_DIR
+#define SINGLE_THREADED
+
+#ifndef HOMEKIT_WOLFSSL_INLINE
+#define NO_INLINE
+#endif
+
+#define NO_WOLFSSL_MEMORY
+#define NO_WOLFSSL_SMALL_STACK
+
+#ifndef HOMEKIT_WOLFSSL_NO_MP_LOW_MEM
+#define MP_LOW_MEM
+#endif
+
+#define CUSTOM_RAND_GENERATE_BLOCK host_random_generate_block
+
+// Same 64-bit product field arithmetic as on ESP8266, not the 128-bit one
+#define NO_CURVED25519_128BIT
+
+#endif
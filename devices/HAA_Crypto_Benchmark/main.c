@@ -0,0 +1,82 @@
+/*
+* HAA Crypto Benchmark v1.0
+*
+* Copyright 2020 José Antonio Jiménez Campos (@RavenSystem)
+*
+* Licensed under the Apache License, Version 2.0 (the "License");
+* you may not use this file except in compliance with the License.
+* You may obtain a copy of the License at
+*
+* http://www.apache.org/licenses/LICENSE-2.0
+*
+* Unless required by applicable law or agreed to in writing, software
+* distributed under the License is distributed on an "AS IS" BASIS,
+* WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+* See the License for the specific language governing permissions and
+* limitations under the License.
+*/
+
+/*
+ * Firmware frontend of crypto_bench.c. Results are printed to serial port.
+ * Same benchmark runs on host with: make -C devices/HAA_Crypto_Benchmark/host
+ */
+
+#include <stdio.h>
+#include <esp/uart.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <espressif/esp_common.h>
+#include <esplibs/libmain.h>
+
+#include "crypto_bench.h"
+
+#define BENCH_TASK_SIZE             (configMINIMAL_STACK_SIZE * 8)
+#define BENCH_TASK_PRIORITY         (tskIDLE_PRIORITY + 2)
+
+uint32_t crypto_bench_time_us() {
+    return sdk_system_get_time();
+}
+
+void crypto_bench_yield() {
+    // Let idle and WiFi tasks run
+    vTaskDelay(1);
+}
+
+uint32_t crypto_bench_cpu_mhz() {
+    return sdk_system_get_cpu_freq();
+}
+
+const char *crypto_bench_target() {
+    return "esp8266";
+}
+
+static void bench_task() {
+    printf("# Free Heap: %d\n", xPortGetFreeHeapSize());
+
+#ifdef BENCH_OVERCLOCK
+    sdk_system_overclock();
+#endif
+
+    crypto_bench_run_all();
+
+#ifdef BENCH_OVERCLOCK
+    sdk_system_restoreclock();
+#endif
+
+    printf("# Done. Free Heap: %d\n", xPortGetFreeHeapSize());
+
+    vTaskDelete(NULL);
+}
+
+void user_init() {
+    sdk_wifi_station_set_auto_connect(false);
+    sdk_wifi_set_opmode(STATION_MODE);
+    sdk_wifi_station_disconnect();
+
+    uart_set_baud(0, 115200);
+
+    printf("\n\n# HAA Crypto Benchmark v1.0\n");
+    printf("# by José A. Jiménez Campos\n\n");
+
+    xTaskCreate(bench_task, "bench_task", BENCH_TASK_SIZE, NULL, BENCH_TASK_PRIORITY, NULL);
+}
@@ -22,6 +22,14 @@ ifdef component_compile_rules
     # Set to 1 to enable WolfSSL low resources, saving about 70KB in firmware size,
     # but increasing pair verify time from 1 to 7 secs (Without overclocking).
     HOMEKIT_SMALL ?= 0
+    # Set to 1 to use Curve25519/Ed25519 field arithmetic built only from 16x16 and 32x32->32
+    # bits multiplications, for cores without 64-bit product multiplier (Ignored if HOMEKIT_SMALL = 1).
+    # Checked and benchmarked on host with: make -C external_libs/homekit/test
+    HOMEKIT_CURVE25519_32BIT ?= 0
+    # Set to 1 to let WolfSSL inline its helper functions (Faster, but bigger firmware).
+    HOMEKIT_WOLFSSL_INLINE ?= 0
+    # Set to 0 to use faster WolfSSL big integer math on SRP, using more RAM.
+    HOMEKIT_WOLFSSL_MP_LOW_MEM ?= 1
     # Set to 1 to enable the ability to use overclock on some functions (It will reduce times by half).
     HOMEKIT_OVERCLOCK ?= 1
     # Set to 1 to enable overclock on initial pair-setup function (Requires HOMEKIT_OVERCLOCK = 1).
@@ -57,6 +65,17 @@ ifdef component_compile_rules
     EXTRA_WOLFSSL_CFLAGS += \
         -DCURVE25519_SMALL \
         -DED25519_SMALL
+    else ifeq ($(HOMEKIT_CURVE25519_32BIT),1)
+    EXTRA_WOLFSSL_CFLAGS += \
+        -DCURVED25519_32BIT
+    endif
+
+    ifeq ($(HOMEKIT_WOLFSSL_INLINE),1)
+    EXTRA_WOLFSSL_CFLAGS += -DHOMEKIT_WOLFSSL_INLINE
+    endif
+
+    ifeq ($(HOMEKIT_WOLFSSL_MP_LOW_MEM),0)
+    EXTRA_WOLFSSL_CFLAGS += -DHOMEKIT_WOLFSSL_NO_MP_LOW_MEM
     endif
 
     wolfssl_CFLAGS += $(EXTRA_WOLFSSL_CFLAGS)
@@ -84,6 +103,6 @@ else
 
     COMPONENT_PRIV_INCLUDEDIRS = src
     COMPONENT_SRCDIRS = src
-    COMPONENT_OBJEXCLUDE = src/mdnsresponder.o
+    COMPONENT_OBJEXCLUDE = src/mdnsresponder.o src/mdns_records.o
 
 endif
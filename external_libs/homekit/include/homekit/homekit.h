@@ -54,6 +54,38 @@ int  homekit_get_accessory_id(char *buffer, size_t size);
 bool homekit_is_pairing();
 bool homekit_is_paired();
 
+// Runtime metrics. Counters are cumulative since boot
+#define HOMEKIT_METRICS_ENDPOINTS           11
+#define HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS 6
+
+typedef struct {
+    // Completed requests per endpoint, see homekit_metrics_endpoint_name()
+    uint32_t requests[HOMEKIT_METRICS_ENDPOINTS];
+
+    // Pair Verify from M1 received to M4 sent
+    uint32_t pair_verify_started;
+    uint32_t pair_verify_ok;
+    uint32_t pair_verify_sum_ms;
+    uint32_t pair_verify_last_ms;
+    uint32_t pair_verify_max_ms;
+    // Not cumulative. Upper bounds are homekit_metrics_pair_verify_bucket_ms, last one is +Inf
+    uint32_t pair_verify_buckets[HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS];
+
+    // Characteristic changes sent in EVENT messages, merged with a newer
+    // queued value of the same characteristic, and lost because of full queue
+    uint32_t notifications_sent;
+    uint32_t notifications_coalesced;
+    uint32_t notifications_dropped;
+
+    uint32_t clients_rejected;
+    uint8_t clients;
+} homekit_metrics_t;
+
+extern const uint16_t homekit_metrics_pair_verify_bucket_ms[HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS - 1];
+
+void homekit_get_metrics(homekit_metrics_t *metrics);
+const char *homekit_metrics_endpoint_name(const uint8_t endpoint);
+
 // Client related stuff
 homekit_client_id_t homekit_get_client_id();
 
@@ -2,6 +2,11 @@
 #include <string.h>
 #include <homekit/types.h>
 
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 bool homekit_value_equal(homekit_value_t *a, homekit_value_t *b) {
     if (a->is_null != b->is_null)
         return false;
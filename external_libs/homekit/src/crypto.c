@@ -58,6 +58,11 @@ int wc_SrpSetKeyH(Srp *srp, byte *secret, word32 size) {
     SrpHash hash;
     int r = BAD_FUNC_ARG;
 
+    // key is computed again if crypto_srp_compute_key() is called more than once
+    if (srp->key) {
+        XFREE(srp->key, NULL, DYNAMIC_TYPE_SRP);
+    }
+
     srp->key = (byte*) XMALLOC(WC_SHA512_DIGEST_SIZE, NULL, DYNAMIC_TYPE_SRP);
     if (!srp->key)
         return MEMORY_E;
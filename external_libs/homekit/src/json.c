@@ -5,6 +5,11 @@
 #include "json.h"
 #include "debug.h"
 
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 #define JSON_MAX_DEPTH 30
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 
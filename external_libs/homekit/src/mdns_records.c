@@ -0,0 +1,1001 @@
+/*
+ * Multicast DNS records and packets
+ *
+ * RR database, query matching and reply, announcement and probe packet
+ * building for mdnsresponder.c. See RFC6762, RFC6763
+ *
+ * This sample code is in the public domain.
+ *
+ * by M J A Hamel 2016
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mdns_records.h"
+
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_MDNS
+#include <heap_stats.h>
+#endif
+
+#define kDummyDataSize      8           // arbitrary, dynamically resized
+#define kDictHashSize       8           // RR database hash buckets, power of 2
+#define kMaxAnswers         8           // max RRs in a single reply
+#define kMaxCachedReplies   8           // max pre-built reply packets
+#define kMcastRateLimitMs   1000        // min time between multicasts of the same RR, RFC6762 s6
+#define kLegacyMaxTTL       10          // max TTL in replies to legacy resolvers, RFC6762 s6.7
+
+#define kRsrcMcastSent      0x01        // rLastMcast is valid
+#define kClassCacheFlush    0x8000      // RR class top bit in responses, RFC6762 s10.2
+
+typedef struct mdns_rsrc {
+    struct mdns_rsrc*    rNext;
+    struct mdns_rsrc*    rHashNext;     // Next RR in the same gDictHash bucket
+    u32_t    rHash;                     // Case-folded hash of key labels
+    u32_t    rLastMcast;                // Last time this RR was multicast, ms
+    u8_t     rFlags;
+    u16_t     rType;
+    u32_t    rTTL;
+    u16_t    rKeySize;
+    u16_t    rLabelSize;
+    u16_t    rDataSize;
+    char    rData[kDummyDataSize];      // Key, as C str with . seperators, followed by key encoded as DNS labels
+                                        // at rData[rKeySize], followed by data in network-ready form
+                                        // at rData[rKeySize + rLabelSize]
+} mdns_rsrc;
+
+#define mdns_rsrc_labels(r)     ((u8_t*) &(r)->rData[(r)->rKeySize])
+#define mdns_rsrc_data(r)       (&(r)->rData[(r)->rKeySize + (r)->rLabelSize])
+
+// Ready to send reply to a single question without known answers
+typedef struct mdns_cached_reply {
+    struct mdns_cached_reply* cNext;
+    const mdns_rsrc* cRsrc;             // Matched RR
+    u16_t    cType;                     // Question type
+    u16_t    cSize;
+    ip4_addr_t cAddr;                   // Address used in A records
+    u8_t     cData[kDummyDataSize];
+} mdns_cached_reply;
+
+// RR selected for a reply
+typedef struct {
+    mdns_rsrc* rsrc;                    // NULL if suppressed
+    bool       extra;                   // Goes in additional section
+} mdns_reply_rr;
+
+static mdns_rsrc*      gDictP = NULL;       // RR database, linked list
+static mdns_rsrc*      gDictHash[kDictHashSize] = { NULL }; // RR database, indexed by key hash
+static mdns_cached_reply* gReplyCache = NULL;   // Pre-built replies
+static u8_t            gReplyCacheCount = 0;
+static u32_t           gLabelSizes[kMaxQStr / 32 + 1] = { 0 };   // Bit set for each key labels size in RR database
+mdns_stats_t           gMdnsStats;
+
+//---------------------- Debug/logging utilities -------------------------
+
+#ifdef qDebugLog
+    static char qstr[12];
+
+    char* mdns_qrtype(uint16_t typ)
+    {
+        switch(typ) {
+            case DNS_RRTYPE_A    : return ("A");
+            case DNS_RRTYPE_NS   : return ("NS");
+            case DNS_RRTYPE_PTR  : return ("PTR");
+            case DNS_RRTYPE_TXT  : return ("TXT ");
+            case DNS_RRTYPE_AAAA : return ("AAAA");
+            case DNS_RRTYPE_SRV  : return ("SRV ");
+            case DNS_RRTYPE_NSEC : return ("NSEC ");
+            case DNS_RRTYPE_ANY  : return ("ANY");
+        }
+        sprintf(qstr, "type %d", typ);
+        return qstr;
+    }
+
+#ifdef qLogAllTraffic
+
+        static void mdns_printhex(u8_t* p, int n)
+        {
+            int i;
+            for (i=0; i<n; i++) {
+                printf("%02X ",*p++);
+                if ((i % 32) == 31) printf("\n");
+            }
+            printf("\n");
+        }
+
+        static void mdns_print_pstr(u8_t* p)
+        {
+            int i, n;
+            char* cp;
+
+            n = *p++;
+            cp = (char*)p;
+            for (i = 0; i < n; i++) {
+                putchar(*cp++);
+            }
+        }
+
+        static char cstr[16];
+
+        static char* mdns_qclass(uint16_t cls)
+        {
+            switch(cls) {
+                case DNS_RRCLASS_IN  : return ("In");
+                case DNS_RRCLASS_ANY : return ("ANY");
+            }
+            sprintf(cstr,"class %d",cls);
+            return cstr;
+        }
+
+        // Sequence of Pascal strings, terminated by zero-length string
+        // Handles compression, returns ptr to next item
+        static u8_t* mdns_print_name(u8_t* p, struct mdns_hdr* hp)
+        {
+            char* cp = (char*)p;
+            int i, n;
+
+            do {
+                n = *cp++;
+                if ((n & 0xC0) == 0xC0) {
+                    n = (n & 0x3F) << 8;
+                    n |= (u8_t)*cp++;
+                    mdns_print_name((u8_t*)hp + n, hp);
+                    n = 0;
+                } else if (n & 0xC0) {
+                    printf("<label $%X?>",n);
+                    n = 0;
+                } else {
+                    for (i = 0; i < n; i++)
+                        putchar(*cp++);
+                    if (n != 0) putchar('.');
+                }
+            } while (n > 0);
+            return (u8_t*)cp;
+        }
+
+
+        static u8_t* mdns_print_header(struct mdns_hdr* hdr)
+        {
+            if (hdr->flags1 & DNS_FLAG1_RESP) {
+                printf("Response, ID $%X %s ", htons(hdr->id), (hdr->flags1 & DNS_FLAG1_AUTH) ? "Auth " : "Non-auth ");
+                if (hdr->flags2 & DNS_FLAG2_RA) printf("RA ");
+                if ((hdr->flags2 & DNS_FLAG2_RESMASK) == 0) printf("noerr");
+                                       else printf("err %d", hdr->flags2 & DNS_FLAG2_RESMASK);
+            } else {
+                printf("Query, ID $%X op %d", htons(hdr->id), (hdr->flags1 >> 4) & 0x7 );
+            }
+            if (hdr->flags1 & DNS_FLAG1_RD) printf("RD ");
+            if (hdr->flags1 & DNS_FLAG1_TRUNC) printf("[TRUNC] ");
+
+            printf(": %d questions", htons(hdr->numquestions) );
+            if (hdr->numanswers != 0)
+                printf(", %d answers",htons(hdr->numanswers));
+            if (hdr->numauthrr != 0)
+                printf(", %d auth RR",htons(hdr->numauthrr));
+            if (hdr->numextrarr != 0)
+                printf(", %d extra RR",htons(hdr->numextrarr));
+            putchar('\n');
+            return (u8_t*)hdr + SIZEOF_DNS_HDR;
+        }
+
+        // Copy needed because it may be misaligned
+        static u8_t* mdns_print_query(u8_t* p)
+        {
+            struct mdns_query q;
+            uint16_t c;
+
+            memcpy(&q, p, SIZEOF_DNS_QUERY);
+            c = htons(q.class);
+            printf(" %s %s", mdns_qrtype(htons(q.type)), mdns_qclass(c & 0x7FFF) );
+            if (c & 0x8000) printf(" unicast-req");
+            printf("\n");
+            return p + SIZEOF_DNS_QUERY;
+        }
+
+        // Copy needed because it may be misaligned
+        static u8_t* mdns_print_answer(u8_t* p, struct mdns_hdr* hp)
+        {
+            struct mdns_answer ans;
+            u16_t rrlen, atype, rrClass;;
+
+            memcpy(&ans,p,SIZEOF_DNS_ANSWER);
+            atype = htons(ans.type);
+            rrlen = htons(ans.len);
+            rrClass = htons(ans.class);
+            printf(" %s %s TTL %d ", mdns_qrtype(atype), mdns_qclass(rrClass & 0x7FFF), htonl(ans.ttl));
+            if (rrClass & 0x8000)
+                printf("cache-flush ");
+            if (rrlen > 0) {
+                u8_t* rp = p + SIZEOF_DNS_ANSWER;
+                if (atype == DNS_RRTYPE_A && rrlen == 4) {
+                    printf("%d.%d.%d.%d\n",rp[0],rp[1],rp[2],rp[3]);
+                } else if (atype == DNS_RRTYPE_PTR) {
+                    mdns_print_name(rp, hp);
+                    printf("\n");
+                } else if (atype == DNS_RRTYPE_TXT) {
+                    mdns_print_pstr(rp);
+                    printf("\n");
+                } else if (atype == DNS_RRTYPE_SRV && rrlen > SIZEOF_DNS_RR_SRV) {
+                    struct mdns_rr_srv srvRR;
+                    memcpy(&srvRR, rp, SIZEOF_DNS_RR_SRV);
+                    printf("prio %d, weight %d, port %d, target ", srvRR.prio, srvRR.weight, ntohs(srvRR.port));
+                    mdns_print_name(rp + SIZEOF_DNS_RR_SRV, hp);
+                    printf("\n");
+                } else {
+                    printf("%db:", rrlen);
+                    mdns_printhex(rp, rrlen);
+                }
+            } else
+                printf("\n");
+            return p + SIZEOF_DNS_ANSWER + rrlen;
+        }
+
+        int mdns_print_msg(u8_t* msgP, int msgLen)
+        {
+            int i;
+            u8_t *tp;
+            u8_t *limP = msgP + msgLen;
+            struct mdns_hdr* hdr;
+
+            hdr = (struct mdns_hdr*) msgP;
+            tp = mdns_print_header(hdr);
+            for (i = 0; i < htons(hdr->numquestions); i++) {
+                printf(" Q%d: ", i + 1);
+                tp = mdns_print_name(tp, hdr);
+                tp = mdns_print_query(tp);
+                if (tp > limP) return 0;
+            }
+
+            for (i = 0; i < htons(hdr->numanswers); i++) {
+                printf(" A%d: ", i + 1);
+                tp = mdns_print_name(tp, hdr);
+                tp = mdns_print_answer(tp, hdr);
+                if (tp > limP) return 0;
+            }
+
+            for (i = 0; i < htons(hdr->numauthrr); i++) {
+                printf(" AuRR%d: ", i + 1);
+                tp = mdns_print_name(tp, hdr);
+                tp = mdns_print_answer(tp, hdr);
+                if (tp > limP) return 0;
+            }
+
+            for (i = 0; i < htons(hdr->numextrarr); i++) {
+                printf(" ExRR%d: ", i + 1);
+                tp = mdns_print_name(tp, hdr);
+                tp = mdns_print_answer(tp, hdr);
+                if (tp > limP) return 0;
+            }
+            return 1;
+        }
+#endif // qLogAllTraffic
+#endif // qDebugLog
+
+//---------------------------------------------------------------------------
+
+// Copy a DNS domain name label sequence into lseq, uncompressed, return pointer to next item
+// Handles compression, returns NULL if malformed or longer than max
+static u8_t* mdns_read_labels(u8_t* hdrP, u8_t* limP, u8_t* p, u8_t* lseq, u16_t* lsize, int max)
+{
+    u8_t* nextP = NULL;
+    int n, jumps = 0, lc = 0;
+
+    while (p < limP) {
+        n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            if (p >= limP || ++jumps > 8) {
+                return NULL;
+            }
+            n = (n & 0x3F) << 8;
+            n |= (u8_t)*p++;
+            if (!nextP) {
+                nextP = p;
+            }
+            p = hdrP + n;
+        } else if (n & 0xC0) {
+            printf(">>> mdns_read_labels,label $%X?", n);
+            return NULL;
+        } else {
+            if (lc + 1 + n > max || p + n > limP) {
+                return NULL;
+            }
+            lseq[lc++] = n;
+            memcpy(&lseq[lc], p, n);
+            lc += n;
+            p += n;
+            if (n == 0) {
+                *lsize = lc;
+                return nextP ? nextP : p;
+            }
+        }
+    }
+    return NULL;
+}
+
+static inline u8_t mdns_fold(u8_t c)
+{
+    return (u8_t) (c - 'A') <= 'Z' - 'A' ? c + ('a' - 'A') : c;
+}
+
+// FNV-1a of ASCII case-folded labels. Length bytes (<= 63) are not changed by folding
+static u32_t mdns_hash_labels(const u8_t* lseq, int size)
+{
+    u32_t hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= mdns_fold(lseq[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool mdns_labels_equal(const u8_t* a, const u8_t* b, int size)
+{
+    int i;
+
+    for (i = 0; i < size; i++) {
+        if (mdns_fold(a[i]) != mdns_fold(b[i]))
+            return false;
+    }
+    return true;
+}
+
+// Return pointer to next item after DNS domain name at p, NULL if malformed
+static u8_t* mdns_skip_labels(u8_t* limP, u8_t* p)
+{
+    int n;
+
+    while (p < limP) {
+        n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            return p < limP ? p + 1 : NULL;
+        } else if (n & 0xC0) {
+            return NULL;
+        } else if (n == 0) {
+            return p;
+        }
+        p += n;
+    }
+    return NULL;
+}
+
+// Compare DNS domain name at p, may be compressed, with label sequence lseq, ignoring ASCII case
+// Stops at first different label, nothing is copied
+static bool mdns_labels_match(u8_t* hdrP, u8_t* limP, u8_t* p, const u8_t* lseq, int size)
+{
+    int n, jumps = 0, lc = 0;
+
+    while (p < limP) {
+        n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            if (p >= limP || ++jumps > 8) {
+                return false;
+            }
+            p = hdrP + (((n & 0x3F) << 8) | *p);
+        } else if (n & 0xC0) {
+            return false;
+        } else {
+            if (lc + 1 + n > size || p + n > limP || lseq[lc] != n ||
+                !mdns_labels_equal(&lseq[lc + 1], p, n)) {
+                return false;
+            }
+            lc += 1 + n;
+            p += n;
+            if (n == 0) {
+                return lc == size;
+            }
+        }
+    }
+    return false;
+}
+
+// Encode a <string>.<string>.<string> as a sequence of labels, return length
+int mdns_str2labels(const char* name, u8_t* lseq, int max)
+{
+    int i, n, sdx, idx = 0;
+    int lc = 0;
+
+    do {
+        sdx = idx;
+        while (name[idx] != '.' && name[idx] != 0) idx++;
+        n = idx - sdx;
+        if (lc + 1 + n > max) {
+            printf(">>> mdns_str2labels: oversize (%d)\n", lc + 1 + n);
+            return 0;
+        }
+        *lseq++ = n;
+        lc++;
+        for (i = 0; i < n; i++)
+            *lseq++ = name[sdx + i];
+        lc += n;
+        if (name[idx] == '.')
+            idx++;
+    } while (n > 0);
+    return lc;
+}
+
+// Unpack a DNS question RR at qp, return pointer to next RR, or NULL if malformed
+static u8_t* mdns_get_question(u8_t* hdrP, u8_t* limP, u8_t* qp, u8_t* qLabels, u16_t* qLabelSize, uint16_t* qClass, uint16_t* qType, u8_t* qUnicast)
+{
+    struct mdns_query qr;
+    uint16_t cls;
+
+    qp = mdns_read_labels(hdrP, limP, qp, qLabels, qLabelSize, kMaxQStr);
+    if (qp == NULL || qp + SIZEOF_DNS_QUERY > limP)
+        return NULL;
+    memcpy(&qr, qp, SIZEOF_DNS_QUERY);
+    *qType = htons(qr.type);
+    cls = htons(qr.class);
+    *qUnicast = cls >> 15;
+    *qClass = cls & 0x7FFF;
+    return qp + SIZEOF_DNS_QUERY;
+}
+
+//---------------------------------------------------------------------------
+
+// Drop all pre-built replies
+static void mdns_cache_clear()
+{
+    mdns_cached_reply* cacheP = gReplyCache;
+    gReplyCache = NULL;
+    gReplyCacheCount = 0;
+
+    while (cacheP) {
+        mdns_cached_reply* next = cacheP->cNext;
+        free(cacheP);
+        cacheP = next;
+    }
+}
+
+void mdns_records_clear()
+{
+    mdns_rsrc *rsrc = gDictP;
+    gDictP = NULL;
+    memset(gDictHash, 0, sizeof(gDictHash));
+    memset(gLabelSizes, 0, sizeof(gLabelSizes));
+    mdns_cache_clear();
+
+    while (rsrc) {
+        mdns_rsrc *next = rsrc->rNext;
+        free(rsrc);
+        rsrc = next;
+    }
+}
+
+bool mdns_records_empty()
+{
+    return gDictP == NULL;
+}
+
+bool mdns_records_add(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize)
+{
+    mdns_rsrc* rsrcP;
+    int keyLen, labelLen, recSize;
+    u8_t lBuff[kMaxQStr];
+
+    // Key labels are encoded once here, and copied as they are into every answer
+    labelLen = mdns_str2labels(vKey, lBuff, sizeof(lBuff));
+    if (labelLen == 0) {
+        return false;
+    }
+
+    keyLen = strlen(vKey) + 1;
+    recSize = sizeof(mdns_rsrc) - kDummyDataSize + keyLen + labelLen + vDataSize;
+    rsrcP = (mdns_rsrc*)malloc(recSize);
+    if (rsrcP == NULL) {
+        printf(">>> mdns_add_response: couldn't alloc %d\n",recSize);
+        return false;
+    }
+
+    rsrcP->rType = vType;
+    rsrcP->rTTL = ttl;
+    rsrcP->rKeySize = keyLen;
+    rsrcP->rLabelSize = labelLen;
+    rsrcP->rDataSize = vDataSize;
+    rsrcP->rHash = mdns_hash_labels(lBuff, labelLen);
+    rsrcP->rFlags = 0;
+    memcpy(rsrcP->rData, vKey, keyLen);
+    memcpy(mdns_rsrc_labels(rsrcP), lBuff, labelLen);
+    memcpy(mdns_rsrc_data(rsrcP), dataP, vDataSize);
+
+    rsrcP->rNext = gDictP;
+    gDictP = rsrcP;
+    mdns_rsrc** bucketP = &gDictHash[rsrcP->rHash & (kDictHashSize - 1)];
+    rsrcP->rHashNext = *bucketP;
+    *bucketP = rsrcP;
+    gLabelSizes[labelLen / 32] |= 1u << (labelLen % 32);
+    mdns_cache_clear();
+
+#ifdef qDebugLog
+    printf("mDNS added RR '%s' %s, %d bytes\n", vKey, mdns_qrtype(vType), vDataSize);
+#endif
+    return true;
+}
+
+// Most questions are for other hosts, they are dropped by size before hashing
+static mdns_rsrc* mdns_match(const u8_t* qLabels, u16_t qLabelSize, u16_t qType)
+{
+    if (!(gLabelSizes[qLabelSize / 32] & (1u << (qLabelSize % 32))))
+        return NULL;
+
+    const u32_t qHash = mdns_hash_labels(qLabels, qLabelSize);
+    mdns_rsrc* rp = gDictHash[qHash & (kDictHashSize - 1)];
+    while (rp != NULL) {
+        if ((rp->rType == qType || qType == DNS_RRTYPE_ANY) &&
+            rp->rHash == qHash && rp->rLabelSize == qLabelSize &&
+            mdns_labels_equal(mdns_rsrc_labels(rp), qLabels, qLabelSize)) {
+#ifdef qDebugLog
+            printf(" - matched '%s' %s\n", rp->rData, mdns_qrtype(rp->rType));
+#endif
+            break;
+        }
+        rp = rp->rHashNext;
+    }
+    return rp;
+}
+
+// Create answer RR with given TTL and append to resp[respLen], return new length
+// With flush, unique RRs, all but PTR, tell caches to drop older RRs with same name and type
+static int mdns_add_to_answer(mdns_rsrc* rsrcP, u32_t ttl, bool flush, u8_t* resp, int respLen)
+{
+    // Key is stored already encoded as labels
+    size_t rem = MDNS_RESPONDER_REPLY_SIZE - respLen;
+    size_t len = rsrcP->rLabelSize;
+    if ((len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize) > rem) {
+        // Overflow, skip this answer.
+        printf(">>> mdns_add_to_answer: oversize (%d)\n", (int) (len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize));
+        return respLen;
+    }
+    memcpy(&resp[respLen], mdns_rsrc_labels(rsrcP), len);
+    respLen += len;
+
+    // Answer fields: may be misaligned, so build and memcpy
+    struct mdns_answer ans;
+    ans.type  = htons(rsrcP->rType);
+    ans.class = htons(DNS_RRCLASS_IN | (flush && rsrcP->rType != DNS_RRTYPE_PTR ? kClassCacheFlush : 0));
+    ans.ttl   = htonl(ttl);
+    ans.len   = htons(rsrcP->rDataSize);
+    memcpy(&resp[respLen], &ans, SIZEOF_DNS_ANSWER);
+    respLen += SIZEOF_DNS_ANSWER;
+
+    // Data for this key
+    memcpy(&resp[respLen], mdns_rsrc_data(rsrcP), rsrcP->rDataSize);
+    respLen += rsrcP->rDataSize;
+
+    return respLen;
+}
+
+// Append rsrcP with current addresses, one answer for each IPv6 address. Return number of answers added
+static int mdns_add_rsrc(mdns_rsrc* rsrcP, const mdns_if_addrs* addrs, u32_t ttl, bool flush, u8_t* resp, int* respLen)
+{
+    int count = 0;
+
+#if LWIP_IPV6
+    if (rsrcP->rType == DNS_RRTYPE_AAAA) {
+        // Emit an answer for each ipv6 address.
+        for (int i = 0; i < addrs->ip6Count; i++) {
+            memcpy(mdns_rsrc_data(rsrcP), &addrs->ip6[i], sizeof(addrs->ip6[i].addr));
+            int new_len = mdns_add_to_answer(rsrcP, ttl, flush, resp, *respLen);
+            if (new_len > *respLen) {
+                count++;
+                *respLen = new_len;
+            }
+        }
+        return count;
+    }
+#endif
+
+    if (rsrcP->rType == DNS_RRTYPE_A) {
+        memcpy(mdns_rsrc_data(rsrcP), &addrs->ip4, sizeof(ip4_addr_t));
+    }
+
+    int new_len = mdns_add_to_answer(rsrcP, ttl, flush, resp, *respLen);
+    if (new_len > *respLen) {
+        count++;
+        *respLen = new_len;
+    }
+    return count;
+}
+
+//---------------------------------------------------------------------------
+
+static bool mdns_sent_within(const mdns_rsrc* rsrcP, u32_t now, u32_t ms)
+{
+    return (rsrcP->rFlags & kRsrcMcastSent) && (now - rsrcP->rLastMcast) < ms;
+}
+
+static void mdns_mark_sent(mdns_rsrc* rsrcP, u32_t now)
+{
+    rsrcP->rLastMcast = now;
+    rsrcP->rFlags |= kRsrcMcastSent;
+}
+
+// Add rsrcP to the reply list once, an answer takes precedence over an additional RR
+static int mdns_reply_add(mdns_reply_rr* rrs, int nRRs, mdns_rsrc* rsrcP, bool extra)
+{
+    for (int i = 0; i < nRRs; i++) {
+        if (rrs[i].rsrc == rsrcP) {
+            rrs[i].extra &= extra;
+            return nRRs;
+        }
+    }
+
+    if (nRRs < kMaxAnswers) {
+        rrs[nRRs].rsrc = rsrcP;
+        rrs[nRRs].extra = extra;
+        nRRs++;
+    }
+    return nRRs;
+}
+
+// Compare data of a known answer RR at dP with our RR, names in data may be compressed
+static bool mdns_rdata_equal(const mdns_rsrc* rsrcP, u8_t* hdrP, u8_t* limP, u8_t* dP, u16_t dLen)
+{
+    const u8_t* rdP = (const u8_t*) mdns_rsrc_data(rsrcP);
+    int off = 0;
+
+    switch (rsrcP->rType) {
+        case DNS_RRTYPE_SRV:
+            if (dLen < SIZEOF_DNS_RR_SRV || memcmp(rdP, dP, SIZEOF_DNS_RR_SRV) != 0)
+                return false;
+            off = SIZEOF_DNS_RR_SRV;
+            // Fall through
+        case DNS_RRTYPE_PTR:
+            return mdns_labels_match(hdrP, limP, dP + off, rdP + off, rsrcP->rDataSize - off);
+
+        default:
+            return dLen == rsrcP->rDataSize && memcmp(rdP, dP, dLen) == 0;
+    }
+}
+
+// Unpack a known answer RR at p and suppress matching RRs of the reply, return pointer to next RR,
+// or NULL if malformed. See RFC6762 s7.1
+static u8_t* mdns_known_answer(u8_t* hdrP, u8_t* limP, u8_t* p, mdns_reply_rr* rrs, int nRRs)
+{
+    u8_t* nameP = p;
+    u16_t dLen;
+    struct mdns_answer ans;
+
+    p = mdns_skip_labels(limP, p);
+    if (p == NULL || p + SIZEOF_DNS_ANSWER > limP)
+        return NULL;
+    memcpy(&ans, p, SIZEOF_DNS_ANSWER);
+    p += SIZEOF_DNS_ANSWER;
+    dLen = htons(ans.len);
+    if (p + dLen > limP)
+        return NULL;
+
+    const u16_t type = htons(ans.type);
+    const u32_t ttl = htonl(ans.ttl);
+
+    for (int i = 0; i < nRRs; i++) {
+        mdns_rsrc* rsrcP = rrs[i].rsrc;
+        if (rsrcP && rsrcP->rType == type && ttl >= rsrcP->rTTL / 2 &&
+            mdns_labels_match(hdrP, limP, nameP, mdns_rsrc_labels(rsrcP), rsrcP->rLabelSize) &&
+            mdns_rdata_equal(rsrcP, hdrP, limP, p, dLen)) {
+            rrs[i].rsrc = NULL;
+            gMdnsStats.answers_suppressed++;
+        }
+    }
+
+    return p + dLen;
+}
+
+static mdns_cached_reply* mdns_cache_find(const mdns_rsrc* rsrcP, u16_t qType, const ip4_addr_t* addr4)
+{
+    mdns_cached_reply* cacheP = gReplyCache;
+    while (cacheP) {
+        if (cacheP->cRsrc == rsrcP && cacheP->cType == qType) {
+            if (ip4_addr_cmp(&cacheP->cAddr, addr4))
+                return cacheP;
+
+            // IP changed, replies are not valid anymore
+            mdns_cache_clear();
+            return NULL;
+        }
+        cacheP = cacheP->cNext;
+    }
+    return NULL;
+}
+
+static void mdns_cache_add(const mdns_rsrc* rsrcP, u16_t qType, const ip4_addr_t* addr4, const u8_t* msgP, int nBytes)
+{
+    if (gReplyCacheCount >= kMaxCachedReplies)
+        return;
+
+    mdns_cached_reply* cacheP = malloc(sizeof(mdns_cached_reply) - kDummyDataSize + nBytes);
+    if (cacheP) {
+        cacheP->cRsrc = rsrcP;
+        cacheP->cType = qType;
+        cacheP->cSize = nBytes;
+        ip4_addr_copy(cacheP->cAddr, *addr4);
+        memcpy(cacheP->cData, msgP, nBytes);
+        cacheP->cNext = gReplyCache;
+        gReplyCache = cacheP;
+        gReplyCacheCount++;
+    }
+}
+
+bool mdns_records_reply(u8_t* msgP, int msgLen, bool legacy, const mdns_if_addrs* addrs, u32_t nowMs, mdns_reply_msg* reply)
+{
+    int i, nquestions, nknown, respLen, qSize, nRRs = 0;
+    struct mdns_hdr* hdrP = (struct mdns_hdr*) msgP;
+    struct mdns_hdr* rHdr;
+    mdns_reply_rr rrs[kMaxAnswers];
+    u8_t* qLim = msgP + msgLen;
+    u8_t* qp;
+    u8_t* mdns_response;
+    u16_t cType = 0;
+    bool unicast = true;
+    bool cacheable;
+
+    memset(reply, 0, sizeof(*reply));
+    gMdnsStats.queries++;
+
+    qp = msgP + SIZEOF_DNS_HDR;
+    nquestions = htons(hdrP->numquestions);
+    nknown = htons(hdrP->numanswers);
+
+    for (i = 0; i < nquestions; i++) {
+        u8_t  qLabels[kMaxQStr];
+        u16_t qLabelSize, qClass, qType;
+        u8_t  qUnicast;
+        mdns_rsrc* rsrcP;
+
+        qp = mdns_get_question(msgP, qLim, qp, qLabels, &qLabelSize, &qClass, &qType, &qUnicast);
+        if (qp == NULL)
+            break;
+        if (qClass == DNS_RRCLASS_IN || qClass == DNS_RRCLASS_ANY) {
+            rsrcP = mdns_match(qLabels, qLabelSize, qType);
+            if (rsrcP) {
+                nRRs = mdns_reply_add(rrs, nRRs, rsrcP, false);
+                cType = qType;
+                if (!qUnicast)
+                    unicast = false;
+
+                // Extra RR logic: if SRV follows PTR, or A follows SRV, volunteer it in extraRR
+                // Not required, but could do more here, see RFC6763 s12
+                if (qType == DNS_RRTYPE_PTR) {
+                    if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_SRV)
+                        nRRs = mdns_reply_add(rrs, nRRs, rsrcP->rNext, true);
+                } else if (qType == DNS_RRTYPE_SRV) {
+                    if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_A)
+                        nRRs = mdns_reply_add(rrs, nRRs, rsrcP->rNext, true);
+                }
+            }
+        }
+    } // for nQuestions
+
+    if (nRRs == 0 || qp == NULL)
+        return false;
+    qSize = qp - msgP - SIZEOF_DNS_HDR;
+
+    // A records always carry current address, also when compared with known answers
+    for (i = 0; i < nRRs; i++) {
+        if (rrs[i].rsrc->rType == DNS_RRTYPE_A) {
+            memcpy(mdns_rsrc_data(rrs[i].rsrc), &addrs->ip4, sizeof(ip4_addr_t));
+        }
+    }
+
+    // Known answer suppression
+    for (i = 0; i < nknown && qp; i++) {
+        qp = mdns_known_answer(msgP, qLim, qp, rrs, nRRs);
+    }
+
+    // Legacy resolvers, not sending from port 5353, only get unicast replies, RFC6762 s6.7
+    // Unicast is only honored for others if RRs were multicast recently, RFC6762 s5.4
+    unicast |= legacy;
+    for (i = 0; i < nRRs && unicast && !legacy; i++) {
+        if (rrs[i].rsrc && !mdns_sent_within(rrs[i].rsrc, nowMs, rrs[i].rsrc->rTTL * 1000 / 4))
+            unicast = false;
+    }
+
+    cacheable = !unicast && nquestions == 1 && nknown == 0 && !rrs[0].extra;
+    for (i = 0; i < nRRs; i++) {
+        if (!rrs[i].rsrc) {
+            cacheable = false;
+        } else if (!unicast && mdns_sent_within(rrs[i].rsrc, nowMs, kMcastRateLimitMs)) {
+            rrs[i].rsrc = NULL;
+            gMdnsStats.rate_limited++;
+            cacheable = false;
+        }
+#if LWIP_IPV6
+        else if (rrs[i].rsrc->rType == DNS_RRTYPE_AAAA) {
+            cacheable = false;
+        }
+#endif
+    }
+
+    if (cacheable) {
+        mdns_cached_reply* cacheP = mdns_cache_find(rrs[0].rsrc, cType, &addrs->ip4);
+        if (cacheP) {
+            gMdnsStats.cache_hits++;
+            for (i = 0; i < nRRs; i++) {
+                mdns_mark_sent(rrs[i].rsrc, nowMs);
+            }
+            ((struct mdns_hdr*) cacheP->cData)->id = hdrP->id;
+            reply->data = cacheP->cData;
+            reply->size = cacheP->cSize;
+            return true;
+        }
+    }
+
+    mdns_response = malloc(MDNS_RESPONDER_REPLY_SIZE);
+    if (mdns_response == NULL) {
+        printf(">>> mdns_reply could not alloc %d\n", MDNS_RESPONDER_REPLY_SIZE);
+        return false;
+    }
+
+    // Build response header
+    rHdr = (struct mdns_hdr*) mdns_response;
+    rHdr->id = hdrP->id;
+    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+    rHdr->flags2 = 0;
+    rHdr->numquestions = 0;
+    rHdr->numanswers = 0;
+    rHdr->numauthrr = 0;
+    rHdr->numextrarr = 0;
+    respLen = SIZEOF_DNS_HDR;
+
+    // Legacy reply repeats questions. They are copied at same offset, so compressed names still
+    // point to the same labels
+    if (legacy) {
+        rHdr->numquestions = hdrP->numquestions;
+        memcpy(&mdns_response[respLen], msgP + SIZEOF_DNS_HDR, qSize);
+        respLen += qSize;
+    }
+
+    // Answers first, then additional RRs
+    u16_t count[2] = { 0, 0 };
+    for (int section = 0; section < 2; section++) {
+        for (i = 0; i < nRRs; i++) {
+            mdns_rsrc* rsrcP = rrs[i].rsrc;
+            if (!rsrcP || rrs[i].extra != section)
+                continue;
+
+            u32_t ttl = legacy && rsrcP->rTTL > kLegacyMaxTTL ? kLegacyMaxTTL : rsrcP->rTTL;
+            // No cache-flush bit for legacy resolvers, RFC6762 s6.7
+            count[section] += mdns_add_rsrc(rsrcP, addrs, ttl, !legacy, mdns_response, &respLen);
+
+            if (!unicast)
+                mdns_mark_sent(rsrcP, nowMs);
+        }
+    }
+
+    rHdr->numanswers = htons(count[0]);
+    rHdr->numextrarr = htons(count[1]);
+
+    if (count[0] + count[1] == 0) {
+        free(mdns_response);
+        return false;
+    }
+
+    if (cacheable)
+        mdns_cache_add(rrs[0].rsrc, cType, &addrs->ip4, mdns_response, respLen);
+
+    reply->data = mdns_response;
+    reply->size = respLen;
+    reply->unicast = unicast;
+    reply->buffer = mdns_response;
+    return true;
+}
+
+int mdns_records_announce(const mdns_if_addrs* addrs, bool goodbye, u32_t nowMs, u8_t* buffer)
+{
+    // Build response header
+    struct mdns_hdr *rHdr = (struct mdns_hdr*) buffer;
+    memset(rHdr, 0, sizeof(*rHdr));
+    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+
+    int respLen = SIZEOF_DNS_HDR;
+    u16_t count = 0;
+
+    for (mdns_rsrc *rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        if (!goodbye)
+            mdns_mark_sent(rsrcP, nowMs);
+
+        count += mdns_add_rsrc(rsrcP, addrs, goodbye ? 0 : rsrcP->rTTL, !goodbye, buffer, &respLen);
+    }
+
+    rHdr->numanswers = htons(count);
+    return count > 0 ? respLen : 0;
+}
+
+int mdns_records_probe(const mdns_if_addrs* addrs, bool unicast, u8_t* buffer)
+{
+    struct mdns_hdr *pHdr = (struct mdns_hdr*) buffer;
+    memset(pHdr, 0, sizeof(*pHdr));
+
+    int probeLen = SIZEOF_DNS_HDR;
+    u16_t nquestions = 0, nauth = 0;
+    mdns_rsrc *rsrcP;
+
+    // PTR records are shared, any other name is ours
+    for (rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        if (rsrcP->rType == DNS_RRTYPE_PTR)
+            continue;
+
+        bool asked = false;
+        for (mdns_rsrc *prevP = gDictP; prevP != rsrcP && !asked; prevP = prevP->rNext) {
+            asked = prevP->rType != DNS_RRTYPE_PTR && prevP->rHash == rsrcP->rHash &&
+                    prevP->rLabelSize == rsrcP->rLabelSize &&
+                    mdns_labels_equal(mdns_rsrc_labels(prevP), mdns_rsrc_labels(rsrcP), rsrcP->rLabelSize);
+        }
+        if (asked)
+            continue;
+
+        if (probeLen + rsrcP->rLabelSize + SIZEOF_DNS_QUERY > MDNS_RESPONDER_REPLY_SIZE)
+            break;
+
+        struct mdns_query qr;
+        qr.type = htons(DNS_RRTYPE_ANY);
+        qr.class = htons(DNS_RRCLASS_IN | (unicast ? 0x8000 : 0));
+        memcpy(&buffer[probeLen], mdns_rsrc_labels(rsrcP), rsrcP->rLabelSize);
+        probeLen += rsrcP->rLabelSize;
+        memcpy(&buffer[probeLen], &qr, SIZEOF_DNS_QUERY);
+        probeLen += SIZEOF_DNS_QUERY;
+        nquestions++;
+    }
+
+    // AAAA records are left out, they are built per address when answering
+    for (rsrcP = gDictP; rsrcP; rsrcP = rsrcP->rNext) {
+        if (rsrcP->rType == DNS_RRTYPE_PTR || rsrcP->rType == DNS_RRTYPE_AAAA)
+            continue;
+
+        nauth += mdns_add_rsrc(rsrcP, addrs, rsrcP->rTTL, false, buffer, &probeLen);
+    }
+
+    pHdr->numquestions = htons(nquestions);
+    pHdr->numauthrr = htons(nauth);
+
+    return nquestions > 0 ? probeLen : 0;
+}
+
+int mdns_records_check_conflict(u8_t* msgP, int msgLen)
+{
+    struct mdns_hdr* hdrP = (struct mdns_hdr*) msgP;
+    u8_t* qLim = msgP + msgLen;
+    u8_t* p = msgP + SIZEOF_DNS_HDR;
+    int i, nquestions, nanswers, conflicts = 0;
+
+    nquestions = htons(hdrP->numquestions);
+    nanswers = htons(hdrP->numanswers);
+
+    for (i = 0; i < nquestions && p; i++) {
+        u8_t  qLabels[kMaxQStr];
+        u16_t qLabelSize, qClass, qType;
+        u8_t  qUnicast;
+
+        p = mdns_get_question(msgP, qLim, p, qLabels, &qLabelSize, &qClass, &qType, &qUnicast);
+    }
+
+    for (i = 0; i < nanswers && p; i++) {
+        u8_t lBuff[kMaxQStr];
+        u16_t lSize, dLen;
+        struct mdns_answer ans;
+
+        p = mdns_read_labels(msgP, qLim, p, lBuff, &lSize, sizeof(lBuff));
+        if (p == NULL || p + SIZEOF_DNS_ANSWER > qLim)
+            break;
+        memcpy(&ans, p, SIZEOF_DNS_ANSWER);
+        p += SIZEOF_DNS_ANSWER;
+        dLen = htons(ans.len);
+        if (p + dLen > qLim)
+            break;
+
+        mdns_rsrc* rsrcP = mdns_match(lBuff, lSize, htons(ans.type));
+        if (rsrcP && rsrcP->rType != DNS_RRTYPE_PTR && rsrcP->rType != DNS_RRTYPE_AAAA &&
+            !mdns_rdata_equal(rsrcP, msgP, qLim, p, dLen)) {
+            gMdnsStats.conflicts++;
+            conflicts++;
+            printf(">>> mDNS conflict on '%s' type %d\n", rsrcP->rData, rsrcP->rType);
+        }
+
+        p += dLen;
+    }
+
+    return conflicts;
+}
@@ -0,0 +1,146 @@
+/*
+ * Multicast DNS records and packets
+ *
+ * RR database, query matching and reply, announcement and probe packet
+ * building for mdnsresponder.c. No sockets, timers or RTOS calls are used
+ * here, so it is built and replayed on host by external_libs/homekit/test.
+ * Calls are not thread safe, mdnsresponder.c holds its mutex around them.
+ *
+ * This sample code is in the public domain.
+ */
+
+#ifndef __MDNS_RECORDS_H__
+#define __MDNS_RECORDS_H__
+
+#include <stdbool.h>
+#include <lwip/def.h>
+#include <lwip/ip_addr.h>
+#include <lwip/prot/dns.h>
+
+#include "mdnsresponder.h"
+
+// #define qDebugLog             // Log activity generally
+// #define qLogIncoming          // Log all arriving multicast packets
+// #define qLogAllTraffic        // Log and decode all mDNS packets
+
+/** DNS message header */
+struct mdns_hdr {
+    u16_t id;
+    u8_t flags1;
+    u8_t flags2;
+    u16_t numquestions;
+    u16_t numanswers;
+    u16_t numauthrr;
+    u16_t numextrarr;
+} __attribute__((packed));
+
+#define SIZEOF_DNS_HDR 12
+
+/** MDNS query message structure */
+struct mdns_query {
+    /* MDNS query record starts with either a domain name or a pointer
+     to a name already present somewhere in the packet. */
+    u16_t type;
+    u16_t class;
+} __attribute__((packed));
+
+#define SIZEOF_DNS_QUERY 4
+
+/** MDNS answer message structure */
+struct mdns_answer {
+    /* MDNS answer record starts with either a domain name or a pointer
+     to a name already present somewhere in the packet. */
+    u16_t type;
+    u16_t class;
+    u32_t ttl;
+    u16_t len;
+} __attribute__((packed));
+
+#define SIZEOF_DNS_ANSWER 10
+
+struct mdns_rr_srv {
+    /* RR SRV  */
+    u16_t prio;
+    u16_t weight;
+    u16_t port;
+} __attribute__((packed));
+
+#define SIZEOF_DNS_RR_SRV 6
+
+// DNS field TYPE used for "Resource Records", some additions
+#define DNS_RRTYPE_AAAA           28    /* IPv6 host address */
+#define DNS_RRTYPE_SRV            33    /* Service record */
+#define DNS_RRTYPE_OPT            41    /* EDNS0 OPT record */
+#define DNS_RRTYPE_NSEC           47    /* NSEC record */
+#define DNS_RRTYPE_TSIG           250   /* Transaction Signature */
+#define DNS_RRTYPE_ANY            255   /* Not a DNS type, but a DNS query type, meaning "all types"*/
+
+// DNS field CLASS used for "Resource Records"
+#define DNS_RRCLASS_ANY           255  /* Any class (q) */
+
+#define DNS_FLAG1_RESP            0x80
+#define DNS_FLAG1_OPMASK          0x78
+#define DNS_FLAG1_AUTH            0x04
+#define DNS_FLAG1_TRUNC           0x02
+#define DNS_FLAG1_RD              0x01
+#define DNS_FLAG2_RA              0x80
+#define DNS_FLAG2_RESMASK         0x0F
+
+#define kMaxNameSize        64
+#define kMaxQStr            128         // max incoming question key handled
+
+// Current addresses of the interface, copied into A and AAAA records
+typedef struct {
+    ip4_addr_t ip4;
+#if LWIP_IPV6
+    ip6_addr_t ip6[LWIP_IPV6_NUM_ADDRESSES];
+    u8_t       ip6Count;
+#endif
+} mdns_if_addrs;
+
+// Reply built for a query
+typedef struct {
+    const u8_t* data;                   // Packet to send, in buffer or in the reply cache
+    int         size;
+    bool        unicast;                // Send to query source address and port, else multicast
+    u8_t*       buffer;                 // Free it after sending, may be NULL
+} mdns_reply_msg;
+
+// Responder counters, updated here and by mdnsresponder.c
+extern mdns_stats_t gMdnsStats;
+
+// Encode a <string>.<string>.<string> as a sequence of labels, return length
+int mdns_str2labels(const char* name, u8_t* lseq, int max);
+
+// Add a record to the RR database, vKey is a C str with . separators
+bool mdns_records_add(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize);
+
+// Free all records and pre-built replies
+void mdns_records_clear();
+
+bool mdns_records_empty();
+
+// Match a query against the RR database, msgP holds msgLen bytes. legacy is set for queries not
+// sent from port 5353. nowMs is a millisecond clock, allowed to wrap. Return true if reply must be sent
+bool mdns_records_reply(u8_t* msgP, int msgLen, bool legacy, const mdns_if_addrs* addrs, u32_t nowMs, mdns_reply_msg* reply);
+
+// Build announcement of all records into buffer of MDNS_RESPONDER_REPLY_SIZE bytes, or goodbye with
+// TTL 0. Return its length, 0 if there is nothing to send
+int mdns_records_announce(const mdns_if_addrs* addrs, bool goodbye, u32_t nowMs, u8_t* buffer);
+
+// Build probe for our unique names into buffer of MDNS_RESPONDER_REPLY_SIZE bytes, RFC6762 s8.1
+// Return its length, 0 if there is nothing to send
+int mdns_records_probe(const mdns_if_addrs* addrs, bool unicast, u8_t* buffer);
+
+// Look for answers from other hosts with our unique names and different data, RFC6762 s9
+// Return number of conflicts
+int mdns_records_check_conflict(u8_t* msgP, int msgLen);
+
+#ifdef qDebugLog
+char* mdns_qrtype(uint16_t typ);
+#ifdef qLogAllTraffic
+int mdns_print_msg(u8_t* msgP, int msgLen);
+#endif
+#endif
+
+#endif
@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <etstimer.h>
 #include <esplibs/libmain.h>
+#include <esp/hwrand.h>
 
 #include <FreeRTOS.h>
 #include <task.h>
@@ -35,92 +36,26 @@
 #include <lwip/igmp.h>
 #include <lwip/netif.h>
 
-#include "mdnsresponder.h"
+#include "mdns_records.h"
+
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_MDNS
+#include <heap_stats.h>
+#endif
 
 #if !LWIP_IGMP
 #error "LWIP_IGMP needs to be defined in lwipopts.h"
 #endif
 
-// #define qDebugLog             // Log activity generally
-// #define qLogIncoming          // Log all arriving multicast packets
-// #define qLogAllTraffic        // Log and decode all mDNS packets
-
 //-------------------------------------------------------------------
 
-#ifdef PACK_STRUCT_USE_INCLUDES
-#  include "arch/bpstruct.h"
-#endif
-
-PACK_STRUCT_BEGIN
-/** DNS message header */
-struct mdns_hdr {
-    PACK_STRUCT_FIELD(u16_t id);
-    PACK_STRUCT_FIELD(u8_t flags1);
-    PACK_STRUCT_FIELD(u8_t flags2);
-    PACK_STRUCT_FIELD(u16_t numquestions);
-    PACK_STRUCT_FIELD(u16_t numanswers);
-    PACK_STRUCT_FIELD(u16_t numauthrr);
-    PACK_STRUCT_FIELD(u16_t numextrarr);
-}PACK_STRUCT_STRUCT;
-PACK_STRUCT_END
-
-#define SIZEOF_DNS_HDR 12
-
-PACK_STRUCT_BEGIN
-/** MDNS query message structure */
-struct mdns_query {
-    /* MDNS query record starts with either a domain name or a pointer
-     to a name already present somewhere in the packet. */
-    PACK_STRUCT_FIELD(u16_t type);
-    PACK_STRUCT_FIELD(u16_t class);
-}PACK_STRUCT_STRUCT;
-PACK_STRUCT_END
-
-#define SIZEOF_DNS_QUERY 4
-
-PACK_STRUCT_BEGIN
-/** MDNS answer message structure */
-struct mdns_answer {
-    /* MDNS answer record starts with either a domain name or a pointer
-     to a name already present somewhere in the packet. */
-    PACK_STRUCT_FIELD(u16_t type);
-    PACK_STRUCT_FIELD(u16_t class);
-    PACK_STRUCT_FIELD(u32_t ttl);
-    PACK_STRUCT_FIELD(u16_t len);
-}PACK_STRUCT_STRUCT;
-PACK_STRUCT_END
-#define SIZEOF_DNS_ANSWER 10
-
-PACK_STRUCT_BEGIN
-struct mdns_rr_srv {
-    /* RR SRV  */
-    PACK_STRUCT_FIELD(u16_t prio);
-    PACK_STRUCT_FIELD(u16_t weight);
-    PACK_STRUCT_FIELD(u16_t port);
-}PACK_STRUCT_STRUCT;
-PACK_STRUCT_END
-#define SIZEOF_DNS_RR_SRV 6
-
-
-#ifdef PACK_STRUCT_USE_INCLUDES
-#  include "arch/epstruct.h"
-#endif
-
 #define vTaskDelayMs(ms)    vTaskDelay((ms)/portTICK_PERIOD_MS)
 #define UNUSED_ARG(x)       (void)x
-#define kDummyDataSize      8           // arbitrary, dynamically resized
-#define kMaxNameSize        64
-#define kMaxQStr            128         // max incoming question key handled
-
-typedef struct mdns_rsrc {
-    struct mdns_rsrc*    rNext;
-    u16_t     rType;
-    u32_t    rTTL;
-    u16_t    rKeySize;
-    u16_t    rDataSize;
-    char    rData[kDummyDataSize];      // Key, as C str with . seperators, followed by data in network-ready form
-                                        // at rData[rKeySize]
-} mdns_rsrc;
+#define kWaitIPPollMs       200         // without LWIP_NETIF_EXT_STATUS_CALLBACK only
+#define kProbeCount         3           // RFC6762 s8.1
+#define kProbeIntervalMs    250
+#define kAnnounceCount      3           // RFC6762 s8.3, at least 2
+#define kAnnounceIntervalMs 1000        // doubled after each announcement
 
 static struct udp_pcb* gMDNS_pcb = NULL;
 static const ip_addr_t gMulticastV4Addr = DNS_MQUERY_IPV4_GROUP_INIT;
@@ -128,321 +63,100 @@ static const ip_addr_t gMulticastV4Addr = DNS_MQUERY_IPV4_GROUP_INIT;
 #include "lwip/mld6.h"
 static const ip_addr_t gMulticastV6Addr = DNS_MQUERY_IPV6_GROUP_INIT;
 #endif
-static SemaphoreHandle_t gDictMutex = NULL;
-static mdns_rsrc*      gDictP = NULL;       // RR database, linked list
-
-//---------------------- Debug/logging utilities -------------------------
-
-    // DNS field TYPE used for "Resource Records", some additions
-    #define DNS_RRTYPE_AAAA           28    /* IPv6 host address */
-    #define DNS_RRTYPE_SRV            33    /* Service record */
-    #define DNS_RRTYPE_OPT            41    /* EDNS0 OPT record */
-    #define DNS_RRTYPE_NSEC           47    /* NSEC record */
-    #define DNS_RRTYPE_TSIG           250   /* Transaction Signature */
-    #define DNS_RRTYPE_ANY            255   /* Not a DNS type, but a DNS query type, meaning "all types"*/
-
-    // DNS field CLASS used for "Resource Records" 
-    #define DNS_RRCLASS_ANY           255  /* Any class (q) */
-
-    #define DNS_FLAG1_RESP            0x80
-    #define DNS_FLAG1_OPMASK          0x78
-    #define DNS_FLAG1_AUTH            0x04
-    #define DNS_FLAG1_TRUNC           0x02
-    #define DNS_FLAG1_RD              0x01
-    #define DNS_FLAG2_RA              0x80
-    #define DNS_FLAG2_RESMASK         0x0F
-
-#ifdef qDebugLog
-    static char qstr[12];
-
-    static char* mdns_qrtype(uint16_t typ)
-    {
-        switch(typ) {
-            case DNS_RRTYPE_A    : return ("A");
-            case DNS_RRTYPE_NS   : return ("NS");
-            case DNS_RRTYPE_PTR  : return ("PTR");
-            case DNS_RRTYPE_TXT  : return ("TXT ");
-            case DNS_RRTYPE_AAAA : return ("AAAA");
-            case DNS_RRTYPE_SRV  : return ("SRV ");
-            case DNS_RRTYPE_NSEC : return ("NSEC ");
-            case DNS_RRTYPE_ANY  : return ("ANY");
-        }
-        sprintf(qstr, "type %d", typ);
-        return qstr;
-    }
-
-#ifdef qLogAllTraffic
-
-        static void mdns_printhex(u8_t* p, int n)
-        {
-            int i;
-            for (i=0; i<n; i++) {
-                printf("%02X ",*p++);
-                if ((i % 32) == 31) printf("\n");
-            }
-            printf("\n");
-        }
-
-        static void mdns_print_pstr(u8_t* p)
-        {
-            int i, n;
-            char* cp;
-
-            n = *p++;
-            cp = (char*)p;
-            for (i = 0; i < n; i++) {
-                putchar(*cp++);
-            }
-        }
-
-        static char cstr[16];
-
-        static char* mdns_qclass(uint16_t cls)
-        {
-            switch(cls) {
-                case DNS_RRCLASS_IN  : return ("In");
-                case DNS_RRCLASS_ANY : return ("ANY");
-            }
-            sprintf(cstr,"class %d",cls);
-            return cstr;
-        }
-
-        // Sequence of Pascal strings, terminated by zero-length string
-        // Handles compression, returns ptr to next item
-        static u8_t* mdns_print_name(u8_t* p, struct mdns_hdr* hp)
-        {
-            char* cp = (char*)p;
-            int i, n;
-
-            do {
-                n = *cp++;
-                if ((n & 0xC0) == 0xC0) {
-                    n = (n & 0x3F) << 8;
-                    n |= (u8_t)*cp++;
-                    mdns_print_name((u8_t*)hp + n, hp);
-                    n = 0;
-                } else if (n & 0xC0) {
-                    printf("<label $%X?>",n);
-                    n = 0;
-                } else {
-                    for (i = 0; i < n; i++)
-                        putchar(*cp++);
-                    if (n != 0) putchar('.');
-                }
-            } while (n > 0);
-            return (u8_t*)cp;
-        }
-
-
-        static u8_t* mdns_print_header(struct mdns_hdr* hdr)
-        {
-            if (hdr->flags1 & DNS_FLAG1_RESP) {
-                printf("Response, ID $%X %s ", htons(hdr->id), (hdr->flags1 & DNS_FLAG1_AUTH) ? "Auth " : "Non-auth ");
-                if (hdr->flags2 & DNS_FLAG2_RA) printf("RA ");
-                if ((hdr->flags2 & DNS_FLAG2_RESMASK) == 0) printf("noerr");
-                                       else printf("err %d", hdr->flags2 & DNS_FLAG2_RESMASK);
-            } else {
-                printf("Query, ID $%X op %d", htons(hdr->id), (hdr->flags1 >> 4) & 0x7 );
-            }
-            if (hdr->flags1 & DNS_FLAG1_RD) printf("RD ");
-            if (hdr->flags1 & DNS_FLAG1_TRUNC) printf("[TRUNC] ");
-
-            printf(": %d questions", htons(hdr->numquestions) );
-            if (hdr->numanswers != 0)
-                printf(", %d answers",htons(hdr->numanswers));
-            if (hdr->numauthrr != 0)
-                printf(", %d auth RR",htons(hdr->numauthrr));
-            if (hdr->numextrarr != 0)
-                printf(", %d extra RR",htons(hdr->numextrarr));
-            putchar('\n');
-            return (u8_t*)hdr + SIZEOF_DNS_HDR;
-        }
-
-        // Copy needed because it may be misaligned
-        static u8_t* mdns_print_query(u8_t* p)
-        {
-            struct mdns_query q;
-            uint16_t c;
-
-            memcpy(&q, p, SIZEOF_DNS_QUERY);
-            c = htons(q.class);
-            printf(" %s %s", mdns_qrtype(htons(q.type)), mdns_qclass(c & 0x7FFF) );
-            if (c & 0x8000) printf(" unicast-req");
-            printf("\n");
-            return p + SIZEOF_DNS_QUERY;
-        }
-
-        // Copy needed because it may be misaligned
-        static u8_t* mdns_print_answer(u8_t* p, struct mdns_hdr* hp)
-        {
-            struct mdns_answer ans;
-            u16_t rrlen, atype, rrClass;;
-
-            memcpy(&ans,p,SIZEOF_DNS_ANSWER);
-            atype = htons(ans.type);
-            rrlen = htons(ans.len);
-            rrClass = htons(ans.class);
-            printf(" %s %s TTL %d ", mdns_qrtype(atype), mdns_qclass(rrClass & 0x7FFF), htonl(ans.ttl));
-            if (rrClass & 0x8000) 
-                printf("cache-flush ");
-            if (rrlen > 0) {
-                u8_t* rp = p + SIZEOF_DNS_ANSWER;
-                if (atype == DNS_RRTYPE_A && rrlen == 4) {
-                    printf("%d.%d.%d.%d\n",rp[0],rp[1],rp[2],rp[3]);
-                } else if (atype == DNS_RRTYPE_PTR) {
-                    mdns_print_name(rp, hp);
-                    printf("\n");
-                } else if (atype == DNS_RRTYPE_TXT) {
-                    mdns_print_pstr(rp);
-                    printf("\n");
-                } else if (atype == DNS_RRTYPE_SRV && rrlen > SIZEOF_DNS_RR_SRV) {
-                    struct mdns_rr_srv srvRR;
-                    memcpy(&srvRR, rp, SIZEOF_DNS_RR_SRV);
-                    printf("prio %d, weight %d, port %d, target ", srvRR.prio, srvRR.weight, ntohs(srvRR.port));
-                    mdns_print_name(rp + SIZEOF_DNS_RR_SRV, hp);
-                    printf("\n");
-                } else {
-                    printf("%db:", rrlen);
-                    mdns_printhex(rp, rrlen);
-                }
-            } else
-                printf("\n");
-            return p + SIZEOF_DNS_ANSWER + rrlen;
-        }
-
-        static int mdns_print_msg(u8_t* msgP, int msgLen)
-        {
-            int i;
-            u8_t *tp;
-            u8_t *limP = msgP + msgLen;
-            struct mdns_hdr* hdr;
-
-            hdr = (struct mdns_hdr*) msgP;
-            tp = mdns_print_header(hdr);
-            for (i = 0; i < htons(hdr->numquestions); i++) {
-                printf(" Q%d: ", i + 1);
-                tp = mdns_print_name(tp, hdr);
-                tp = mdns_print_query(tp);
-                if (tp > limP) return 0;
-            }
-
-            for (i = 0; i < htons(hdr->numanswers); i++) {
-                printf(" A%d: ", i + 1);
-                tp = mdns_print_name(tp, hdr);
-                tp = mdns_print_answer(tp, hdr);
-                if (tp > limP) return 0;
-            }
-
-            for (i = 0; i < htons(hdr->numauthrr); i++) {
-                printf(" AuRR%d: ", i + 1);
-                tp = mdns_print_name(tp, hdr);
-                tp = mdns_print_answer(tp, hdr);
-                if (tp > limP) return 0;
-            }
-
-            for (i = 0; i < htons(hdr->numextrarr); i++) {
-                printf(" ExRR%d: ", i + 1);
-                tp = mdns_print_name(tp, hdr);
-                tp = mdns_print_answer(tp, hdr);
-                if (tp > limP) return 0;
-            }
-            return 1;
-        }
-#endif // qLogAllTraffic
-#endif // qDebugLog
+static SemaphoreHandle_t gDictMutex = NULL; // Guards all mdns_records calls
 
 //---------------------------------------------------------------------------
+static void mdns_announce_netif(struct netif *netif, const ip_addr_t *addr, bool goodbye);
+static void mdns_schedule(void *arg);
+
+// Announcement scheduler state, all steps run from mdns_announce_timer
+typedef enum {
+    mdns_Idle = 0,
+    mdns_WaitIP,
+    mdns_Probing,
+    mdns_Announcing,
+    mdns_Announced
+} mdns_state;
+
+static ETSTimer mdns_announce_timer;
+static mdns_state gState = mdns_Idle;
+static u8_t gStateCount = 0;
+static u32_t gAnnounceTTL = 0;
+static TickType_t gIPTick = 0;
+static bool gFirstAnswerPending = false;
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+NETIF_DECLARE_EXT_CALLBACK(gNetifCallback)
+#endif
 
-// Convert a DNS domain name label sequence into C string with . seperators
-// Handles compression
-static u8_t* mdns_labels2str(u8_t* hdrP, u8_t* p, char* qStr)
+// Millisecond clock for mdns_records, wraps with the tick count
+static u32_t mdns_now_ms()
 {
-    int i, n;
-
-    do {
-        n = *p++;
-        if ((n & 0xC0) == 0xC0) {
-            n = (n & 0x3F) << 8;
-            n |= (u8_t)*p++;
-            mdns_labels2str( hdrP, hdrP + n, qStr);
-            return p;
-        } else if (n & 0xC0) {
-            printf(">>> mdns_labels2str,label $%X?",n);
-            return p;
-        } else {
-            for (i = 0; i < n; i++)
-                *qStr++ = *p++;
-            if (n == 0) *qStr++ = 0;
-                 else *qStr++ = '.';
-        }
-    } while (n>0);
-    return p;
+    return xTaskGetTickCount() * portTICK_PERIOD_MS;
 }
 
-// Encode a <string>.<string>.<string> as a sequence of labels, return length
-static int mdns_str2labels(const char* name, u8_t* lseq, int max)
+// Current addresses of netif, for A and AAAA records
+static void mdns_get_addrs(struct netif *netif, mdns_if_addrs* addrs)
 {
-    int i, n, sdx, idx = 0;
-    int lc = 0;
-
-    do {
-        sdx = idx;
-        while (name[idx] != '.' && name[idx] != 0) idx++;
-        n = idx - sdx;
-        if (lc + 1 + n > max) {
-            printf(">>> mdns_str2labels: oversize (%d)\n", lc + 1 + n);
-            return 0;
+    ip4_addr_copy(addrs->ip4, *netif_ip4_addr(netif));
+#ifdef qDebugLog
+    char addr4_str[IP4ADDR_STRLEN_MAX];
+    ip4addr_ntoa_r(&addrs->ip4, addr4_str, IP4ADDR_STRLEN_MAX);
+    printf("Updating A records to %s\n", addr4_str);
+#endif
+
+#if LWIP_IPV6
+    addrs->ip6Count = 0;
+    for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
+        if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
+            const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
+#ifdef qDebugLog
+            char addr6_str[IP6ADDR_STRLEN_MAX];
+            ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
+            printf("Updating AAAA records to %s\n", addr6_str);
+#endif
+            ip6_addr_copy(addrs->ip6[addrs->ip6Count], *addr6);
+            addrs->ip6Count++;
         }
-        *lseq++ = n;
-        lc++;
-        for (i = 0; i < n; i++)
-            *lseq++ = name[sdx + i];
-        lc += n;
-        if (name[idx] == '.')
-            idx++;
-    } while (n > 0);
-    return lc;
+    }
+#endif
 }
 
-// Unpack a DNS question RR at qp, return pointer to next RR
-static u8_t* mdns_get_question(u8_t* hdrP, u8_t* qp, char* qStr, uint16_t* qClass, uint16_t* qType, u8_t* qUnicast)
+void mdns_get_stats(mdns_stats_t* stats)
 {
-    struct mdns_query qr;
-    uint16_t cls;
-
-    qp = mdns_labels2str(hdrP, qp, qStr);
-    memcpy(&qr, qp, SIZEOF_DNS_QUERY);
-    *qType = htons(qr.type);
-    cls = htons(qr.class);
-    *qUnicast = cls >> 15;
-    *qClass = cls & 0x7FFF;
-    return qp + SIZEOF_DNS_QUERY;
+    *stats = gMdnsStats;
 }
 
-//---------------------------------------------------------------------------
-static void mdns_announce_netif(struct netif *netif, const ip_addr_t *addr);
-
-static ETSTimer mdns_announce_timer;
+static void mdns_announce_all(bool goodbye)
+{
+    struct netif *netif = sdk_system_get_netif(STATION_IF);
+#if LWIP_IPV4
+    mdns_announce_netif(netif, &gMulticastV4Addr, goodbye);
+#endif
+#if LWIP_IPV6
+    mdns_announce_netif(netif, &gMulticastV6Addr, goodbye);
+#endif
+}
 
 void mdns_clear() {
     sdk_os_timer_disarm(&mdns_announce_timer);
-    
+
+    // Goodbye packet, so old records are flushed from caches at once, RFC6762 s10.1
+    if (gState >= mdns_Announcing && sdk_wifi_station_get_connect_status() == STATION_GOT_IP) {
+        mdns_announce_all(true);
+    }
+    gState = mdns_Idle;
+
     if (!xSemaphoreTake(gDictMutex, portMAX_DELAY))
         return;
-    
-    mdns_rsrc *rsrc = gDictP;
-    gDictP = NULL;
 
-    while (rsrc) {
-        mdns_rsrc *next = rsrc->rNext;
-        free(rsrc);
-        rsrc = next;
-    }
+    mdns_records_clear();
 
     xSemaphoreGive(gDictMutex);
 }
 
 
+
+
 void mdns_TXT_append(char* txt, size_t txt_size, const char* record, size_t record_size)
 {
     size_t txt_len = strlen(txt);
@@ -470,31 +184,9 @@ void mdns_TXT_append(char* txt, size_t txt_size, const char* record, size_t reco
 // Add a record to the RR database list
 static void mdns_add_response(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize)
 {
-    mdns_rsrc* rsrcP;
-    int keyLen, recSize;
-
-    keyLen = strlen(vKey) + 1;
-    recSize = sizeof(mdns_rsrc) - kDummyDataSize + keyLen + vDataSize;
-    rsrcP = (mdns_rsrc*)malloc(recSize);
-    if (rsrcP == NULL) {
-        printf(">>> mdns_add_response: couldn't alloc %d\n",recSize);
-    } else {
-        rsrcP->rType = vType;
-        rsrcP->rTTL = ttl;
-        rsrcP->rKeySize = keyLen;
-        rsrcP->rDataSize = vDataSize;
-        memcpy(rsrcP->rData, vKey, keyLen);
-        memcpy(&rsrcP->rData[keyLen], dataP, vDataSize);
-
-        if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
-            rsrcP->rNext = gDictP;
-            gDictP = rsrcP;
-            xSemaphoreGive(gDictMutex);
-        }
-
-#ifdef qDebugLog
-        printf("mDNS added RR '%s' %s, %d bytes\n", vKey, mdns_qrtype(vType), vDataSize);
-#endif
+    if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
+        mdns_records_add(vKey, vType, ttl, dataP, vDataSize);
+        xSemaphoreGive(gDictMutex);
     }
 }
 
@@ -546,30 +238,24 @@ void mdns_add_AAAA(const char* rKey, u32_t ttl, const ip6_addr_t *addr)
 #endif
 
 void mdns_announce() {
-    struct netif *netif = sdk_system_get_netif(STATION_IF);
-#if LWIP_IPV4
-    mdns_announce_netif(netif, &gMulticastV4Addr);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    mdns_announce_netif(netif, &gMulticastV4Addr);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    mdns_announce_netif(netif, &gMulticastV4Addr);
-#endif
-#if LWIP_IPV6
-    mdns_announce_netif(netif, &gMulticastV6Addr);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    mdns_announce_netif(netif, &gMulticastV4Addr);
-    vTaskDelay(50 / portTICK_PERIOD_MS);
-    mdns_announce_netif(netif, &gMulticastV4Addr);
-#endif
+    sdk_os_timer_disarm(&mdns_announce_timer);
+
+    if (mdns_records_empty()) {
+        gState = mdns_Idle;
+        return;
+    }
+
+    gState = mdns_WaitIP;
+    mdns_schedule(NULL);
 }
 
-void mdns_add_facility_work(const char* instanceName,   // Friendly name, need not be unique
-                            const char* serviceName,    // Must be "_name", e.g. "_hap" or "_http"
-                            const char* addText,        // Must be <key>=<value>
-                            mdns_flags flags,           // TCP or UDP
-                            u16_t onPort,               // port number
-                            u32_t ttl                   // seconds
-                           )
+void mdns_add_facility(const char* instanceName,   // Friendly name, need not be unique
+                       const char* serviceName,    // Must be "_name", e.g. "_hap" or "_http"
+                       const char* addText,        // Must be <key>=<value>
+                       mdns_flags flags,           // TCP or UDP
+                       u16_t onPort,               // port number
+                       u32_t ttl                   // seconds
+                      )
 {
     size_t key_len = strlen(serviceName) + 12;
     char *key = malloc(key_len + 1);
@@ -615,93 +301,12 @@ void mdns_add_facility_work(const char* instanceName,   // Friendly name, need n
     free(fullName);
     free(devName);
 
-    sdk_os_timer_disarm(&mdns_announce_timer);
-    
+    gAnnounceTTL = ttl;
     mdns_announce();
-    
-    if (ttl > 0) {
-        sdk_os_timer_setfn(&mdns_announce_timer, mdns_announce, NULL);
-        sdk_os_timer_arm(&mdns_announce_timer, ttl * 1000, 1);
-    }
 }
 
-void mdns_add_facility(const char* instanceName,   // Friendly name, need not be unique
-                       const char* serviceName,    // Must be "_name", e.g. "_hap" or "_http"
-                       const char* addText,        // Must be <key>=<value>
-                       mdns_flags flags,           // TCP or UDP
-                       u16_t onPort,               // port number
-                       u32_t ttl                   // seconds
-                      )
-{
-    while (sdk_wifi_station_get_connect_status() != STATION_GOT_IP) {
-        vTaskDelayMs(200);
-    }
-    
-    vTaskDelayMs(600);
-    
-    if (strstr(addText, "sf=1") != NULL) {
-        mdns_add_facility_work(instanceName, serviceName, addText, flags, onPort, 0);
-        vTaskDelayMs(2000);
-        mdns_clear();
-    }
-    
-    mdns_add_facility_work(instanceName, serviceName, addText, flags, onPort, ttl);
-}
-
-static mdns_rsrc* mdns_match(const char* qstr, u16_t qType)
-{
-    mdns_rsrc* rp = gDictP;
-    while (rp != NULL) {
-       if (rp->rType == qType || qType == DNS_RRTYPE_ANY) {
-            if (strcasecmp(rp->rData, qstr) == 0) {
-#ifdef qDebugLog
-                printf(" - matched '%s' %s\n", qstr, mdns_qrtype(rp->rType));
-#endif
-                break;
-            }
-        }
-        rp = rp->rNext;
-    }
-    return rp;
-}
-
-// Create answer RR and append to resp[respLen], return new length
-static int mdns_add_to_answer(mdns_rsrc* rsrcP, u8_t* resp, int respLen)
-{
-    // Key is stored as C str, convert to labels
-    size_t rem = MDNS_RESPONDER_REPLY_SIZE - respLen;
-    size_t len = mdns_str2labels(rsrcP->rData, &resp[respLen], rem);
-    if (len == 0) {
-        // Overflow, skip this answer.
-        return respLen;
-    }
-    if ((len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize) > rem) {
-        // Overflow, skip this answer.
-        printf(">>> mdns_add_to_answer: oversize (%d)\n", len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize);
-        return respLen;
-    }
-    respLen += len;
-
-    // Answer fields: may be misaligned, so build and memcpy
-    struct mdns_answer ans;
-    ans.type  = htons(rsrcP->rType);
-    ans.class = htons(DNS_RRCLASS_IN);
-    ans.ttl   = htonl(rsrcP->rTTL);
-    ans.len   = htons(rsrcP->rDataSize);
-    memcpy(&resp[respLen], &ans, SIZEOF_DNS_ANSWER);
-    respLen += SIZEOF_DNS_ANSWER;
-
-    // Data for this key
-    memcpy(&resp[respLen], &rsrcP->rData[rsrcP->rKeySize], rsrcP->rDataSize);
-    respLen += rsrcP->rDataSize;
-
-    return respLen;
-}
-
-//---------------------------------------------------------------------------
-
-// Send UDP to multicast address
-static void mdns_send_mcast(const ip_addr_t *addr, u8_t* msgP, int nBytes)
+// Send UDP to addr and port
+static void mdns_send(const ip_addr_t *dest_addr, u16_t port, u8_t* msgP, int nBytes)
 {
     struct pbuf* p;
     err_t err;
@@ -713,16 +318,8 @@ static void mdns_send_mcast(const ip_addr_t *addr, u8_t* msgP, int nBytes)
     p = pbuf_alloc(PBUF_TRANSPORT, nBytes, PBUF_RAM);
     if (p) {
         memcpy(p->payload, msgP, nBytes);
-        const ip_addr_t *dest_addr;
-        if (IP_IS_V6_VAL(*addr)) {
-#if LWIP_IPV6
-            dest_addr = &gMulticastV6Addr;
-#endif
-        } else {
-            dest_addr = &gMulticastV4Addr;
-        }
         LOCK_TCPIP_CORE();
-        err = udp_sendto(gMDNS_pcb, p, dest_addr, LWIP_IANA_PORT_MDNS);
+        err = udp_sendto(gMDNS_pcb, p, dest_addr, port);
         UNLOCK_TCPIP_CORE();
         if (err == ERR_OK) {
 #ifdef qDebugLog
@@ -735,204 +332,250 @@ static void mdns_send_mcast(const ip_addr_t *addr, u8_t* msgP, int nBytes)
         printf(">>> mdns_send: alloc failed[%d]\n", nBytes);
     }
 }
-    
+
+// Send UDP to multicast address
+static void mdns_send_mcast(const ip_addr_t *addr, u8_t* msgP, int nBytes)
+{
+    const ip_addr_t *dest_addr;
+    if (IP_IS_V6_VAL(*addr)) {
+#if LWIP_IPV6
+        dest_addr = &gMulticastV6Addr;
+#endif
+    } else {
+        dest_addr = &gMulticastV4Addr;
+    }
+
+    gMdnsStats.mcast_sent++;
+    mdns_send(dest_addr, LWIP_IANA_PORT_MDNS, msgP, nBytes);
+}
+
+// First answer after getting IP means a controller can reach us
+static void mdns_first_answer(TickType_t now)
+{
+    if (gFirstAnswerPending) {
+        gFirstAnswerPending = false;
+        gMdnsStats.ip_to_answer_ms = (now - gIPTick) * portTICK_PERIOD_MS;
+        printf("mDNS first answer %u ms after IP\n", gMdnsStats.ip_to_answer_ms);
+    }
+}
+
 // Message has passed tests, may want to send an answer
-static void mdns_reply(const ip_addr_t *addr, struct mdns_hdr* hdrP)
+static void mdns_reply(const ip_addr_t *addr, u16_t port, struct mdns_hdr* hdrP, int plen)
 {
-    int i, nquestions, respLen;
-    struct mdns_hdr* rHdr;
-    mdns_rsrc* extra;
-    u8_t* qBase = (u8_t*)hdrP;
-    u8_t* qp;
-    u8_t* mdns_response;
-
-    mdns_response = malloc(MDNS_RESPONDER_REPLY_SIZE);
+    mdns_if_addrs addrs;
+    mdns_reply_msg reply;
+    struct netif *netif = ip_current_input_netif();
+    const TickType_t now = xTaskGetTickCount();
+
+    mdns_get_addrs(netif, &addrs);
+
+    if (!xSemaphoreTake(gDictMutex, portMAX_DELAY))
+        return;
+
+    if (mdns_records_reply((u8_t*) hdrP, plen, port != LWIP_IANA_PORT_MDNS, &addrs, now * portTICK_PERIOD_MS, &reply)) {
+        if (reply.unicast) {
+            gMdnsStats.ucast_sent++;
+            mdns_send(addr, port, (u8_t*) reply.data, reply.size);
+        } else {
+            mdns_send_mcast(addr, (u8_t*) reply.data, reply.size);
+        }
+        mdns_first_answer(now);
+    }
+
+    xSemaphoreGive(gDictMutex);
+    free(reply.buffer);
+}
+
+// Announce all configured services, or say goodbye with TTL 0
+static void mdns_announce_netif(struct netif *netif, const ip_addr_t *addr, bool goodbye)
+{
+    u8_t *mdns_response = malloc(MDNS_RESPONDER_REPLY_SIZE);
     if (mdns_response == NULL) {
         printf(">>> mdns_reply could not alloc %d\n", MDNS_RESPONDER_REPLY_SIZE);
         return;
     }
 
-    // Build response header
-    rHdr = (struct mdns_hdr*) mdns_response;
-    rHdr->id = hdrP->id;
-    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
-    rHdr->flags2 = 0;
-    rHdr->numquestions = 0;
-    rHdr->numanswers = 0;
-    rHdr->numauthrr = 0;
-    rHdr->numextrarr = 0;
-    respLen = SIZEOF_DNS_HDR;
-
-    extra = NULL;
-    qp = qBase + SIZEOF_DNS_HDR;
-    nquestions = htons(hdrP->numquestions);
+    mdns_if_addrs addrs;
+    int respLen = 0;
+
+    mdns_get_addrs(netif, &addrs);
 
     if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
+        respLen = mdns_records_announce(&addrs, goodbye, mdns_now_ms(), mdns_response);
+        xSemaphoreGive(gDictMutex);
+    }
 
-        for (i = 0; i < nquestions; i++) {
-            char  qStr[kMaxQStr];
-            u16_t qClass, qType;
-            u8_t  qUnicast;
-            mdns_rsrc* rsrcP;
+    if (respLen > 0) {
+        mdns_send_mcast(addr, mdns_response, respLen);
+    }
 
-            qp = mdns_get_question(qBase, qp, qStr, &qClass, &qType, &qUnicast);
-            if (qClass == DNS_RRCLASS_IN || qClass == DNS_RRCLASS_ANY) {
-                rsrcP = mdns_match(qStr, qType);
-                if (rsrcP) {
-#if LWIP_IPV6
-                    if (rsrcP->rType == DNS_RRTYPE_AAAA) {
-                        // Emit an answer for each ipv6 address.
-                        struct netif *netif = ip_current_input_netif();
-                        for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
-                            if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
-                                const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
-#ifdef qDebugLog
-                                char addr6_str[IP6ADDR_STRLEN_MAX];
-                                ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
-                                printf("Updating AAAA record for '%s' to %s\n", rsrcP->rData, addr6_str);
-#endif
-                                memcpy(&rsrcP->rData[rsrcP->rKeySize], addr6, sizeof(addr6->addr));
-                                size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                                if (new_len > respLen) {
-                                    rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                                    respLen = new_len;
-                                }
-                            }
-                        }
-                        continue;
-                    }
-#endif
+    free(mdns_response);
+}
 
-                    if (rsrcP->rType == DNS_RRTYPE_A) {
-                        struct netif *netif = ip_current_input_netif();
-#ifdef qDebugLog
-                        char addr4_str[IP4ADDR_STRLEN_MAX];
-                        ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                        printf("Updating A record for '%s' to %s\n", rsrcP->rData, addr4_str);
-#endif
-                        memcpy(&rsrcP->rData[rsrcP->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
-                    }
-
-                    size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                    if (new_len > respLen) {
-                        rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                        respLen = new_len;
-                    }
-
-                    // Extra RR logic: if SRV follows PTR, or A follows SRV, volunteer it in extraRR
-                    // Not required, but could do more here, see RFC6763 s12
-                    if (qType == DNS_RRTYPE_PTR) {
-                        if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_SRV)
-                            extra = rsrcP->rNext;
-                    } else if (qType == DNS_RRTYPE_SRV) {
-                        if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_A)
-                            extra = rsrcP->rNext;
-                    }
-                }
-            }
-        } // for nQuestions
+// Probe for our unique names with proposed records in authority section, RFC6762 s8.1
+static void mdns_probe_netif(struct netif *netif, const ip_addr_t *addr, bool unicast)
+{
+    u8_t *mdns_probe = malloc(MDNS_RESPONDER_REPLY_SIZE);
+    if (mdns_probe == NULL) {
+        printf(">>> mdns_probe could not alloc %d\n", MDNS_RESPONDER_REPLY_SIZE);
+        return;
+    }
 
+    mdns_if_addrs addrs;
+    int probeLen = 0;
+
+    mdns_get_addrs(netif, &addrs);
+
+    if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
+        probeLen = mdns_records_probe(&addrs, unicast, mdns_probe);
         xSemaphoreGive(gDictMutex);
     }
 
-    if (respLen > SIZEOF_DNS_HDR) {
-        if (extra) {
-            if (extra->rType == DNS_RRTYPE_A) {
-                struct netif *netif = ip_current_input_netif();
-#ifdef qDebugLog
-                char addr4_str[IP4ADDR_STRLEN_MAX];
-                ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                printf("Updating A record for '%s' to %s\n", extra->rData, addr4_str);
-#endif
-                memcpy(&extra->rData[extra->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
-            }
-            size_t new_len = mdns_add_to_answer(extra, mdns_response, respLen);
-            if (new_len > respLen) {
-                rHdr->numextrarr = htons(htons(rHdr->numextrarr) + 1);
-                respLen = new_len;
-            }
-        }
-        mdns_send_mcast(addr, mdns_response, respLen);
+    if (probeLen > 0) {
+        mdns_send_mcast(addr, mdns_probe, probeLen);
     }
 
-    free(mdns_response);
+    free(mdns_probe);
 }
 
-// Announce all configured services
-static void mdns_announce_netif(struct netif *netif, const ip_addr_t *addr)
+static void mdns_schedule_in(u32_t ms)
 {
-    u8_t *mdns_response = malloc(MDNS_RESPONDER_REPLY_SIZE);
-    if (mdns_response == NULL) {
-        printf(">>> mdns_reply could not alloc %d\n", MDNS_RESPONDER_REPLY_SIZE);
+    // Shorter delays round down to 0 ticks
+    if (ms < portTICK_PERIOD_MS) {
+        ms = portTICK_PERIOD_MS;
+    }
+
+    sdk_os_timer_disarm(&mdns_announce_timer);
+    sdk_os_timer_setfn(&mdns_announce_timer, mdns_schedule, NULL);
+    sdk_os_timer_arm(&mdns_announce_timer, ms, 0);
+}
+
+static bool mdns_has_ip(struct netif *netif)
+{
+    return netif && netif_is_up(netif) && !ip4_addr_isany_val(*netif_ip4_addr(netif));
+}
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+// Called by lwIP core when station netif gets, changes or loses its address. Probe and announce
+// start from here instead of polling, and start again after a new address, RFC6762 s8.4
+static void mdns_netif_callback(struct netif *netif, netif_nsc_reason_t reason, const netif_ext_callback_args_t *args)
+{
+    UNUSED_ARG(args);
+
+    if (netif != sdk_system_get_netif(STATION_IF)
+        || !(reason & (LWIP_NSC_IPV4_ADDRESS_CHANGED | LWIP_NSC_IPV4_SETTINGS_CHANGED | LWIP_NSC_STATUS_CHANGED | LWIP_NSC_LINK_CHANGED))) {
         return;
     }
 
-    // Build response header
-    struct mdns_hdr *rHdr = (struct mdns_hdr*) mdns_response;
-    memset(rHdr, 0, sizeof(*rHdr));
-    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+    if (!mdns_has_ip(netif)) {
+        gIPTick = 0;
+        if (gState != mdns_Idle) {
+            sdk_os_timer_disarm(&mdns_announce_timer);
+            gState = mdns_WaitIP;
+        }
+    } else {
+        if (gIPTick == 0 || (reason & LWIP_NSC_IPV4_ADDRESS_CHANGED)) {
+            gIPTick = xTaskGetTickCount();
+        }
 
-    int respLen = SIZEOF_DNS_HDR;
+        if (gState == mdns_WaitIP || (gState != mdns_Idle && (reason & LWIP_NSC_IPV4_ADDRESS_CHANGED))) {
+            gState = mdns_WaitIP;
+            mdns_schedule_in(portTICK_PERIOD_MS);
+        }
+    }
+}
+#endif
 
-    if (xSemaphoreTake(gDictMutex, portMAX_DELAY)) {
-        mdns_rsrc *rsrcP = gDictP;
-        while (rsrcP) {
-#if LWIP_IPV6
-            if (rsrcP->rType == DNS_RRTYPE_AAAA) {
-                // Emit an answer for each ipv6 address.
-                for (int i = 0; i < LWIP_IPV6_NUM_ADDRESSES; i++) {
-                    if (ip6_addr_isvalid(netif_ip6_addr_state(netif, i))) {
-                        const ip6_addr_t *addr6 = netif_ip6_addr(netif, i);
-#ifdef qDebugLog
-                        char addr6_str[IP6ADDR_STRLEN_MAX];
-                        ip6addr_ntoa_r(addr6, addr6_str, IP6ADDR_STRLEN_MAX);
-                        printf("Updating AAAA record for '%s' to %s\n", rsrcP->rData, addr6_str);
+// One step of probe and announce sequence. Called from mdns_announce_timer, never blocks
+static void mdns_schedule(void *arg)
+{
+    UNUSED_ARG(arg);
+
+    struct netif *netif = sdk_system_get_netif(STATION_IF);
+
+    switch (gState) {
+        case mdns_WaitIP:
+            if (!mdns_has_ip(netif)) {
+#if !LWIP_NETIF_EXT_STATUS_CALLBACK
+                mdns_schedule_in(kWaitIPPollMs);
 #endif
-                        memcpy(&rsrcP->rData[rsrcP->rKeySize], addr6, sizeof(addr6->addr));
-                        size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-                        if (new_len > respLen) {
-                            rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                            respLen = new_len;
-                        }
-                    }
-                }
-                continue;
+                // else mdns_netif_callback schedules next step
+                break;
             }
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+            if (gIPTick == 0)   // Address was set before mdns_init
 #endif
+                gIPTick = xTaskGetTickCount();
+            gFirstAnswerPending = true;
+            gState = mdns_Probing;
+            gStateCount = 0;
 
-            if (rsrcP->rType == DNS_RRTYPE_A) {
-#ifdef qDebugLog
-                char addr4_str[IP4ADDR_STRLEN_MAX];
-                ip4addr_ntoa_r(netif_ip4_addr(netif), addr4_str, IP4ADDR_STRLEN_MAX);
-                printf("Updating A record for '%s' to %s\n", rsrcP->rData, addr4_str);
+            // Random delay, so devices powered up at once do not probe at once
+            mdns_schedule_in(1 + hwrand() % kProbeIntervalMs);
+            break;
+
+        case mdns_Probing:
+            // First probe asks for unicast replies, RFC6762 s8.1
+#if LWIP_IPV4
+            mdns_probe_netif(netif, &gMulticastV4Addr, gStateCount == 0);
+#endif
+#if LWIP_IPV6
+            mdns_probe_netif(netif, &gMulticastV6Addr, gStateCount == 0);
 #endif
-                memcpy(&rsrcP->rData[rsrcP->rKeySize], netif_ip4_addr(netif), sizeof(ip4_addr_t));
+            gStateCount++;
+            if (gStateCount >= kProbeCount) {
+                gState = mdns_Announcing;
+                gStateCount = 0;
             }
+            mdns_schedule_in(kProbeIntervalMs);
+            break;
 
-            size_t new_len = mdns_add_to_answer(rsrcP, mdns_response, respLen);
-            if (new_len > respLen) {
-                rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
-                respLen = new_len;
+        case mdns_Announcing:
+            mdns_announce_all(false);
+            if (gStateCount == 0) {
+                gMdnsStats.ip_to_announce_ms = (xTaskGetTickCount() - gIPTick) * portTICK_PERIOD_MS;
             }
 
-            rsrcP = rsrcP->rNext;
-        }
+            gStateCount++;
+            if (gStateCount < kAnnounceCount) {
+                mdns_schedule_in(kAnnounceIntervalMs << (gStateCount - 1));
+            } else {
+                gState = mdns_Announced;
+                if (gAnnounceTTL > 0) {
+                    mdns_schedule_in(gAnnounceTTL * 1000);
+                }
+            }
+            break;
 
-        xSemaphoreGive(gDictMutex);
-    }
+        case mdns_Announced:
+            // Periodic reannouncement
+            mdns_announce_all(false);
+            if (gAnnounceTTL > 0) {
+                mdns_schedule_in(gAnnounceTTL * 1000);
+            }
+            break;
 
-    if (respLen > SIZEOF_DNS_HDR) {
-        mdns_send_mcast(addr, mdns_response, respLen);
+        default:
+            break;
     }
+}
 
-    free(mdns_response);
+// Look for answers from other hosts with our unique names and different data, RFC6762 s9
+static void mdns_check_conflict(struct mdns_hdr* hdrP, int plen)
+{
+    if (!xSemaphoreTake(gDictMutex, portMAX_DELAY))
+        return;
+
+    mdns_records_check_conflict((u8_t*) hdrP, plen);
+
+    xSemaphoreGive(gDictMutex);
 }
 
 // Callback from udp_recv
 static void mdns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_addr_t *addr, u16_t port)
 {
     UNUSED_ARG(pcb);
-    UNUSED_ARG(port);
 
     u8_t* mdns_payload;
     int   plen;
@@ -962,7 +605,9 @@ static void mdns_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p, const ip_a
 
                 if ( (hdrP->flags1 & (DNS_FLAG1_RESP + DNS_FLAG1_OPMASK + DNS_FLAG1_TRUNC) ) == 0
                      && hdrP->numquestions > 0 )
-                    mdns_reply(addr, hdrP);
+                    mdns_reply(addr, port, hdrP, plen);
+                else if ((hdrP->flags1 & DNS_FLAG1_RESP) && (gState == mdns_Probing || gState == mdns_Announcing))
+                    mdns_check_conflict(hdrP, plen);
             }
             free(mdns_payload);
         }
@@ -1032,6 +677,10 @@ void mdns_init()
     udp_bind_netif(gMDNS_pcb, netif);
 
     udp_recv(gMDNS_pcb, mdns_recv, NULL);
+
+#if LWIP_NETIF_EXT_STATUS_CALLBACK
+    netif_add_ext_callback(&gNetifCallback, mdns_netif_callback);
+#endif
     
     UNLOCK_TCPIP_CORE();
 }
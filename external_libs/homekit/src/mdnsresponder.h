@@ -27,6 +27,7 @@ void mdns_init();
 // Build and advertise an appropriate linked set of PTR/TXT/SRV/A records for the parameters provided
 // This is a simple canned way to build a set of records for a single service that will
 // be advertised whenever the device is given an IP address by WiFi
+// mdns_clear() says goodbye to records already announced, so call it before changing them
 
 typedef enum {
     mdns_TCP,
@@ -37,6 +38,8 @@ typedef enum {
 // Clear all records
 void mdns_clear();
 
+// Probe and announce all records again, e.g. after a WiFi reconnection. Never blocks,
+// packets are sent from a timer once there is an IP
 void mdns_announce();
 
 void mdns_add_facility( const char* instanceName,   // Short user-friendly instance name, should NOT include serial number/MAC/etc
@@ -57,6 +60,21 @@ void mdns_add_A  (const char* rKey, u32_t ttl, const ip4_addr_t *addr);
 void mdns_add_AAAA(const char* rKey, u32_t ttl, const ip6_addr_t *addr);
 #endif
 
+// Responder counters, since mdns_init()
+typedef struct {
+    u32_t queries;              // Queries with questions received
+    u32_t answers_suppressed;   // RRs not sent because they were in the known answer list
+    u32_t rate_limited;         // RRs not sent because they were multicast less than 1 second ago
+    u32_t cache_hits;           // Replies sent from a pre-built packet
+    u32_t mcast_sent;           // Multicast packets sent, including announcements
+    u32_t ucast_sent;           // Unicast packets sent
+    u32_t conflicts;            // Answers from other hosts for our names while probing or announcing
+    u32_t ip_to_announce_ms;    // From getting IP to first announcement
+    u32_t ip_to_answer_ms;      // From getting IP to first answered query, 0 if none yet
+} mdns_stats_t;
+
+void mdns_get_stats(mdns_stats_t* stats);
+
 void mdns_TXT_append(char* txt, size_t txt_size, const char* record, size_t record_size);
 /* Sample usage, advertising a secure web service
 
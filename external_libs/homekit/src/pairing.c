@@ -1,5 +1,10 @@
 #include "pairing.h"
 
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 
 pairing_t *pairing_new() {
     pairing_t *p = malloc(sizeof(pairing_t));
@@ -2,6 +2,11 @@
 #include <string.h>
 #include "query_params.h"
 
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 
 query_param_t *query_params_parse(const char *s) {
     query_param_t *params = NULL;
@@ -41,6 +41,17 @@
 #include <homekit/characteristics.h>
 #include <homekit/tlv.h>
 
+#ifdef LATENCY_TRACE
+#include <latency_trace.h>
+#else
+#define LATENCY_TRACE_MARK(point, arg)
+#endif
+
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 
 #define PORT 5556
 
@@ -68,8 +79,32 @@ typedef enum {
     HOMEKIT_ENDPOINT_UPDATE_CHARACTERISTICS,
     HOMEKIT_ENDPOINT_PAIRINGS,
     HOMEKIT_ENDPOINT_RESOURCE,
+    // Debug builds only
+    HOMEKIT_ENDPOINT_HEAP_STATS,
+    HOMEKIT_ENDPOINT_LATENCY_TRACE,
 } homekit_endpoint_t;
 
+// Same order as homekit_endpoint_t
+static const char *homekit_endpoint_names[HOMEKIT_METRICS_ENDPOINTS] = {
+    "unknown",
+    "pair_setup",
+    "pair_verify",
+    "identify",
+    "get_accessories",
+    "get_characteristics",
+    "update_characteristics",
+    "pairings",
+    "resource",
+    "heap_stats",
+    "latency_trace",
+};
+
+const uint16_t homekit_metrics_pair_verify_bucket_ms[HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS - 1] = {
+    250, 500, 1000, 2000, 4000
+};
+
+static homekit_metrics_t server_metrics;
+
 
 typedef struct {
     Srp *srp;
@@ -89,6 +124,8 @@ typedef struct {
     size_t device_public_key_size;
     byte *accessory_public_key;
     size_t accessory_public_key_size;
+
+    TickType_t start_time;
 } pair_verify_context_t;
 
 
@@ -308,6 +345,8 @@ pair_verify_context_t *pair_verify_context_new() {
     context->accessory_public_key = NULL;
     context->accessory_public_key_size = 0;
 
+    context->start_time = 0;
+
     return context;
 }
 
@@ -725,6 +764,7 @@ void client_notify_characteristic(homekit_characteristic_t *ch, homekit_value_t
 
     if (!client->event_queue) {
         HOMEKIT_ERROR("Client has no event queue. Skipping notification");
+        server_metrics.notifications_dropped++;
         return;
     }
 
@@ -734,7 +774,15 @@ void client_notify_characteristic(homekit_characteristic_t *ch, homekit_value_t
 
     HOMEKIT_DEBUG_LOG("Sending event to client %d", client->socket);
 
-    xQueueSendToBack(client->event_queue, &event, 10);
+    if (xQueueSendToBack(client->event_queue, &event, 10) != pdTRUE) {
+        HOMEKIT_ERROR("Client %d event queue full. Skipping notification", client->socket);
+        homekit_value_destruct(&event->value);
+        free(event);
+        server_metrics.notifications_dropped++;
+        return;
+    }
+
+    LATENCY_TRACE_MARK(LATENCY_TRACE_NOTIFY, client->socket);
 }
 
 
@@ -818,6 +866,8 @@ void send_client_events(client_context_t *context, client_event_t *events) {
         write_characteristic_json(json, context, e->characteristic, 0, &e->value);
         json_object_end(json);
 
+        server_metrics.notifications_sent++;
+
         e = e->next;
     }
 
@@ -828,6 +878,8 @@ void send_client_events(client_context_t *context, client_event_t *events) {
     json_free(json);
 
     client_send_chunk(NULL, 0, context);
+
+    LATENCY_TRACE_MARK(LATENCY_TRACE_EVENT_SENT, context->socket);
 }
 
 
@@ -1515,10 +1567,28 @@ void homekit_server_on_pair_setup(client_context_t *context, const byte *data, s
 #endif
 }
 
+static void homekit_metrics_pair_verify_done(const uint32_t duration_ms) {
+    uint8_t bucket = 0;
+    while (bucket < HOMEKIT_METRICS_PAIR_VERIFY_BUCKETS - 1 &&
+           duration_ms > homekit_metrics_pair_verify_bucket_ms[bucket]) {
+        bucket++;
+    }
+
+    server_metrics.pair_verify_ok++;
+    server_metrics.pair_verify_buckets[bucket]++;
+    server_metrics.pair_verify_sum_ms += duration_ms;
+    server_metrics.pair_verify_last_ms = duration_ms;
+    if (duration_ms > server_metrics.pair_verify_max_ms) {
+        server_metrics.pair_verify_max_ms = duration_ms;
+    }
+}
+
 void homekit_server_on_pair_verify(client_context_t *context, const byte *data, size_t size) {
     HOMEKIT_DEBUG_LOG("HomeKit Pair Verify");
     DEBUG_HEAP();
 
+    const TickType_t start_time = xTaskGetTickCount();
+
 #ifdef HOMEKIT_OVERCLOCK_PAIR_VERIFY
     sdk_system_overclock();
 #endif
@@ -1534,6 +1604,8 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
         case 1: {
             CLIENT_INFO(context, "Verify 1/2");
 
+            server_metrics.pair_verify_started++;
+
             CLIENT_DEBUG(context, "Importing device Curve25519 public key");
             tlv_t *tlv_device_public_key = tlv_get_value(message, TLVType_PublicKey);
             if (!tlv_device_public_key) {
@@ -1736,6 +1808,8 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
                    tlv_device_public_key->value, tlv_device_public_key->size);
             context->verify_context->device_public_key_size = tlv_device_public_key->size;
 
+            context->verify_context->start_time = start_time;
+
             break;
         }
         case 3: {
@@ -1910,6 +1984,8 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
                 context->write_key, &write_key_size
             );
 
+            const TickType_t verify_start_time = context->verify_context->start_time;
+
             pair_verify_context_free(context->verify_context);
             context->verify_context = NULL;
 
@@ -1936,6 +2012,8 @@ void homekit_server_on_pair_verify(client_context_t *context, const byte *data,
 
             HOMEKIT_NOTIFY_EVENT(context->server, HOMEKIT_EVENT_CLIENT_VERIFIED);
 
+            homekit_metrics_pair_verify_done((xTaskGetTickCount() - verify_start_time) * portTICK_PERIOD_MS);
+
             CLIENT_INFO(context, "Verification OK");
 
             break;
@@ -2174,6 +2252,8 @@ void homekit_server_on_get_characteristics(client_context_t *context) {
 }
 
 void homekit_server_on_update_characteristics(client_context_t *context, const byte *data, size_t size) {
+    LATENCY_TRACE_MARK(LATENCY_TRACE_HAP_WRITE, context->socket);
+
     CLIENT_INFO(context, "Update Characteristics");
     DEBUG_HEAP();
 
@@ -2911,6 +2991,46 @@ void homekit_server_on_resource(client_context_t *context) {
 }
 
 
+#ifdef HEAP_STATS
+void homekit_server_on_heap_stats(client_context_t *context) {
+    CLIENT_INFO(context, "Heap stats");
+
+    const size_t buffer_size = 768;
+    char *buffer = malloc(buffer_size);
+    if (!buffer) {
+        send_json_error_response(context, 500, HAPStatus_OutOfResources);
+        return;
+    }
+
+    int len = heap_stats_json(buffer, buffer_size);
+    send_json_response(context, 200, (byte *)buffer, len);
+
+    free(buffer);
+}
+#endif
+
+
+#ifdef LATENCY_TRACE
+void homekit_server_on_latency_trace(client_context_t *context) {
+    CLIENT_INFO(context, "Latency trace");
+
+    const size_t buffer_size = 1536;
+    char *buffer = malloc(buffer_size);
+    if (!buffer) {
+        send_json_error_response(context, 500, HAPStatus_OutOfResources);
+        return;
+    }
+
+    int len = latency_trace_json(buffer, buffer_size);
+    send_json_response(context, 200, (byte *)buffer, len);
+
+    free(buffer);
+
+    latency_trace_print();
+}
+#endif
+
+
 int homekit_server_on_url(http_parser *parser, const char *data, size_t length) {
     client_context_t *context = (client_context_t*) parser->data;
 
@@ -2918,6 +3038,14 @@ int homekit_server_on_url(http_parser *parser, const char *data, size_t length)
     if (parser->method == HTTP_GET) {
         if (!strncmp(data, "/accessories", length)) {
             context->endpoint = HOMEKIT_ENDPOINT_GET_ACCESSORIES;
+#ifdef HEAP_STATS
+        } else if (!strncmp(data, "/heap", length)) {
+            context->endpoint = HOMEKIT_ENDPOINT_HEAP_STATS;
+#endif
+#ifdef LATENCY_TRACE
+        } else if (!strncmp(data, "/trace", length)) {
+            context->endpoint = HOMEKIT_ENDPOINT_LATENCY_TRACE;
+#endif
         } else {
             static const char url[] = "/characteristics";
             size_t url_len = sizeof(url)-1;
@@ -2975,6 +3103,8 @@ static bool allow_insecure_connections = false;
 int homekit_server_on_message_complete(http_parser *parser) {
     client_context_t *context = parser->data;
 
+    server_metrics.requests[context->endpoint]++;
+
     switch(context->endpoint) {
         case HOMEKIT_ENDPOINT_PAIR_SETUP: {
             homekit_server_on_pair_setup(context, (const byte *)context->body, context->body_length);
@@ -3020,7 +3150,22 @@ int homekit_server_on_message_complete(http_parser *parser) {
             }
             break;
         }
-        case HOMEKIT_ENDPOINT_UNKNOWN: {
+#ifdef HEAP_STATS
+        case HOMEKIT_ENDPOINT_HEAP_STATS: {
+            // Debug builds only, no pairing required
+            homekit_server_on_heap_stats(context);
+            break;
+        }
+#endif
+#ifdef LATENCY_TRACE
+        case HOMEKIT_ENDPOINT_LATENCY_TRACE: {
+            // Debug builds only, no pairing required
+            homekit_server_on_latency_trace(context);
+            break;
+        }
+#endif
+        case HOMEKIT_ENDPOINT_UNKNOWN:
+        default: {
             HOMEKIT_DEBUG_LOG("Unknown endpoint");
             send_404_response(context);
             break;
@@ -3124,6 +3269,7 @@ void homekit_server_close_client(homekit_server_t *server, client_context_t *con
 
     FD_CLR(context->socket, &server->fds);
     server->client_count--;
+    server_metrics.clients = server->client_count;
 
     close(context->socket);
 
@@ -3151,6 +3297,7 @@ client_context_t *homekit_server_accept_client(homekit_server_t *server) {
 
     if (server->client_count >= HOMEKIT_MAX_CLIENTS) {
         HOMEKIT_INFO("Max client connections reached (%d)", HOMEKIT_MAX_CLIENTS);
+        server_metrics.clients_rejected++;
         close(s);
         return NULL;
     }
@@ -3210,6 +3357,7 @@ client_context_t *homekit_server_accept_client(homekit_server_t *server) {
 
     FD_SET(s, &server->fds);
     server->client_count++;
+    server_metrics.clients = server->client_count;
     if (s > server->max_fd)
         server->max_fd = s;
 
@@ -3258,6 +3406,7 @@ void homekit_server_process_notifications(homekit_server_t *server) {
 
                 if (e) {
                     homekit_value_destruct(&e->value);
+                    server_metrics.notifications_coalesced++;
                 } else {
                     e = malloc(sizeof(client_event_t));
                     e->characteristic = event->characteristic;
@@ -3543,6 +3692,18 @@ void homekit_mdns_announce() {
     homekit_port_mdns_announce();
 }
 
+void homekit_get_metrics(homekit_metrics_t *metrics) {
+    memcpy(metrics, &server_metrics, sizeof(homekit_metrics_t));
+}
+
+const char *homekit_metrics_endpoint_name(const uint8_t endpoint) {
+    if (endpoint >= HOMEKIT_METRICS_ENDPOINTS) {
+        return NULL;
+    }
+
+    return homekit_endpoint_names[endpoint];
+}
+
 bool homekit_is_paired() {
     pairing_iterator_t *pairing_it = homekit_storage_pairing_iterator();
     pairing_t *pairing;
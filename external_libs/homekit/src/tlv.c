@@ -3,6 +3,11 @@
 
 #include <homekit/tlv.h>
 
+#ifdef HEAP_STATS
+#define HEAP_STATS_TAG  HEAP_STATS_HOMEKIT
+#include <heap_stats.h>
+#endif
+
 
 tlv_values_t *tlv_new() {
     tlv_values_t *values = malloc(sizeof(tlv_values_t));
@@ -0,0 +1,311 @@
+// Curve25519 and Ed25519 host checks
+//
+// Runs RFC 7748 (X25519) and RFC 8032 (Ed25519) test vectors through the
+// same wolfCrypt sources used by firmware. It is built once with generic
+// ref10 field arithmetic and once with CURVED25519_32BIT
+// (HOMEKIT_CURVE25519_32BIT = 1), and 32-bit build also compares fe_mul,
+// fe_sq, fe_sq2 and fe_mul121666 against generic ones with random and
+// worst case limbs.
+//
+//   make -C external_libs/homekit/test
+//   make -C external_libs/homekit/test bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssl/wolfcrypt/fe_operations.h>
+#include <wolfssl/wolfcrypt/curve25519.h>
+#include <wolfssl/wolfcrypt/ed25519.h>
+#include <wolfssl/wolfcrypt/random.h>
+
+#ifdef CURVED25519_32BIT
+#define BACKEND             "32bit"
+#else
+#define BACKEND             "generic"
+#endif
+
+#define FIELD_CHECKS        200000
+#define BENCH_MIN_NS        1000000000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void from_hex(const char *hex, uint8_t *out, const size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        unsigned int value;
+        sscanf(hex + (i * 2), "%2x", &value);
+        out[i] = value;
+    }
+}
+
+static int equals_hex(const uint8_t *data, const char *hex, const size_t len) {
+    uint8_t expected[64];
+    from_hex(hex, expected, len);
+    return memcmp(data, expected, len) == 0;
+}
+
+// Private key bytes returned by wc_ed25519_make_key(), so public key derivation is checked too
+static const uint8_t *rng_bytes = NULL;
+static WC_RNG rng;
+
+int wc_RNG_GenerateBlock(WC_RNG *rng, byte *output, word32 size) {
+    (void) rng;
+    memcpy(output, rng_bytes, size);
+    return 0;
+}
+
+// RFC 7748 section 5, scalar is clamped as decodeScalar25519()
+static void x25519(uint8_t *out, const uint8_t *scalar, const uint8_t *u) {
+    uint8_t k[32];
+    memcpy(k, scalar, 32);
+    k[0] &= 248;
+    k[31] &= 127;
+    k[31] |= 64;
+
+    curve25519(out, k, (uint8_t *) u);
+}
+
+static void check_x25519() {
+    static const char *vectors[][3] = {
+        {   // RFC 7748 section 5.2
+            "a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4",
+            "e6db6867583030db3594c1a424b15f7c726624ec26b3353b10a903a6d0ab1c4c",
+            "c3da55379de9c6908e94ea4df28d084f32eccf03491c71f754b4075577a28552",
+        }, {
+            "4b66e9d4d1b4673c5ad22691957d6af5c11b6421e0ea01d42ca4169e7918ba0d",
+            "e5210f12786811d3f4b7959d0538ae2c31dbe7106fc03c3efc4cd549c715a493",
+            "95cbde9476e8907d7aade45cb4b873f88b595a68799fa152e6f8f7647aac7957",
+        },
+    };
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t scalar[32], u[32], out[32];
+        from_hex(vectors[i][0], scalar, 32);
+        from_hex(vectors[i][1], u, 32);
+        x25519(out, scalar, u);
+        CHECK(equals_hex(out, vectors[i][2], 32), "x25519 vector %zu", i + 1);
+    }
+
+    // RFC 7748 section 5.2 iterations: k = X25519(k, u), u = old k
+    uint8_t k[32] = { 9 };
+    uint8_t u[32] = { 9 };
+    for (int i = 1; i <= 1000; i++) {
+        uint8_t out[32];
+        x25519(out, k, u);
+        memcpy(u, k, 32);
+        memcpy(k, out, 32);
+
+        if (i == 1) {
+            CHECK(equals_hex(k, "422c8e7a6227d7bca1350b3e2bb7279f7897b87bb6854b783c60e80311ae3079", 32), "x25519 1 iteration");
+        }
+    }
+    CHECK(equals_hex(k, "684cf59ba83309552800ef566f2f4d3c1c3887c49360e3875f2eb94d99532c51", 32), "x25519 1000 iterations");
+
+    // RFC 7748 section 6.1 Diffie-Hellman through wolfCrypt key API, as crypto_curve25519_shared_secret()
+    static const uint8_t base[32] = { 9 };
+    uint8_t alice_private[32], bob_private[32];
+    uint8_t alice_public[32], bob_public[32];
+    from_hex("77076d0a7318a57d3c16c17251b26645df4c2f87ebc0992ab177fba51db92c2a", alice_private, 32);
+    from_hex("5dab087e624a8a4b79e17f8b83800ee66f3bb1292618b6fd1c2f8b27ff88e0eb", bob_private, 32);
+    x25519(alice_public, alice_private, base);
+    x25519(bob_public, bob_private, base);
+    CHECK(equals_hex(alice_public, "8520f0098930a754748b7ddcb43ef75a0dbf3a0d26381af4eba4a98eaa9b4e6a", 32), "x25519 alice public");
+    CHECK(equals_hex(bob_public, "de9edb7d7b7dc1b4d35b61c2ece435373f8343c85b78674dadfc7e146f882b4f", 32), "x25519 bob public");
+
+    curve25519_key private_key, public_key;
+    wc_curve25519_init(&private_key);
+    wc_curve25519_init(&public_key);
+    wc_curve25519_import_private_raw_ex(alice_private, 32, alice_public, 32, &private_key, EC25519_LITTLE_ENDIAN);
+    wc_curve25519_import_public_ex(bob_public, 32, &public_key, EC25519_LITTLE_ENDIAN);
+
+    uint8_t shared[32];
+    word32 shared_len = sizeof(shared);
+    const int r = wc_curve25519_shared_secret_ex(&private_key, &public_key, shared, &shared_len, EC25519_LITTLE_ENDIAN);
+    CHECK(r == 0 && equals_hex(shared, "4a5d9d5ba4ce2de1728e3bf480350f25e07e21c947d19e3376f09b3c1e161742", 32), "x25519 shared secret");
+}
+
+static void check_ed25519() {
+    static const char *vectors[][4] = {
+        {   // RFC 8032 section 7.1, tests 1 to 3
+            "9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60",
+            "d75a980182b10ab7d54bfed3c964073a0ee172f3daa62325af021a68f707511a",
+            "",
+            "e5564300c360ac729086e2cc806e828a84877f1eb8e5d974d873e065224901555fb8821590a33bacc61e39701cf9b46bd25bf5f0595bbe24655141438e7a100b",
+        }, {
+            "4ccd089b28ff96da9db6c346ec114e0f5b8a319f35aba624da8cf6ed4fb8a6fb",
+            "3d4017c3e843895a92b70aa74d1b7ebc9c982ccf2ec4968cc0cd55f12af4660c",
+            "72",
+            "92a009a9f0d4cab8720e820b5f642540a2b27b5416503f8fb3762223ebdb69da085ac1e43e15996e458f3613d0f11d8c387b2eaeb4302aeeb00d291612bb0c00",
+        }, {
+            "c5aa8df43f9f837bedb7442f31dcb7b166d38535076f094b85ce3a2e0b4458f7",
+            "fc51cd8e6218a1a38da47ed00230f0580816ed13ba3303ac5deb911548908025",
+            "af82",
+            "6291d657deec24024827e69c3abe01a30ce548a284743a445e3680d7db5ac3ac18ff9b538d16f290ae67f760984dc6594a7c15e9716ed28dc027beceea1ec40a",
+        },
+    };
+
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t secret[32], message[2], signature[64];
+        from_hex(vectors[i][0], secret, 32);
+        const word32 message_len = strlen(vectors[i][2]) / 2;
+        from_hex(vectors[i][2], message, message_len);
+
+        // As crypto_ed25519_generate()
+        ed25519_key key;
+        wc_ed25519_init(&key);
+        rng_bytes = secret;
+        CHECK(wc_ed25519_make_key(&rng, ED25519_KEY_SIZE, &key) == 0, "ed25519 %zu make key", i + 1);
+        CHECK(equals_hex(key.p, vectors[i][1], 32), "ed25519 %zu public key", i + 1);
+
+        word32 signature_len = sizeof(signature);
+        CHECK(wc_ed25519_sign_msg(message, message_len, signature, &signature_len, &key) == 0, "ed25519 %zu sign", i + 1);
+        CHECK(equals_hex(signature, vectors[i][3], 64), "ed25519 %zu signature", i + 1);
+
+        int verified = 0;
+        wc_ed25519_verify_msg(signature, signature_len, message, message_len, &verified, &key);
+        CHECK(verified == 1, "ed25519 %zu verify", i + 1);
+
+        signature[17] ^= 0x04;
+        verified = 0;
+        wc_ed25519_verify_msg(signature, signature_len, message, message_len, &verified, &key);
+        CHECK(verified == 0, "ed25519 %zu verify of bad signature", i + 1);
+
+        wc_ed25519_free(&key);
+    }
+}
+
+#ifdef CURVED25519_32BIT
+// Generic fe_operations.c with ref_ prefix, see Makefile
+void ref_fe_mul(fe h, const fe f, const fe g);
+void ref_fe_sq(fe h, const fe f);
+void ref_fe_sq2(fe h, const fe f);
+void ref_fe_mul121666(fe h, fe f);
+
+// Limbs up to 1.65 * 2^26 and 2^25, bounds of ref10 fe_mul() inputs, and worst case corners
+static void random_fe(fe f, const int corner) {
+    for (int i = 0; i < 10; i++) {
+        const int32_t bound = (i & 1) ? 55364812 : 110729625;
+        if (corner) {
+            f[i] = (rand() & 1) ? bound : -bound;
+        } else {
+            f[i] = (int32_t) ((((int64_t) rand() << 16) ^ rand()) % (2 * (int64_t) bound + 1)) - bound;
+        }
+    }
+}
+
+static void check_field() {
+    srand(1);
+
+    for (int n = 0; n < FIELD_CHECKS; n++) {
+        fe f, g, h, expected;
+        random_fe(f, (n & 7) == 0);
+        random_fe(g, (n & 7) == 1);
+
+        fe_mul(h, f, g);
+        ref_fe_mul(expected, f, g);
+        CHECK(memcmp(h, expected, sizeof(fe)) == 0, "fe_mul %i", n);
+
+        fe_sq(h, f);
+        ref_fe_sq(expected, f);
+        CHECK(memcmp(h, expected, sizeof(fe)) == 0, "fe_sq %i", n);
+
+        fe_sq2(h, f);
+        ref_fe_sq2(expected, f);
+        CHECK(memcmp(h, expected, sizeof(fe)) == 0, "fe_sq2 %i", n);
+
+        fe_mul121666(h, f);
+        ref_fe_mul121666(expected, f);
+        CHECK(memcmp(h, expected, sizeof(fe)) == 0, "fe_mul121666 %i", n);
+
+        if (failures > 10) {
+            return;
+        }
+    }
+}
+#endif
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void bench_result(const char *name, const uint32_t ops, const uint64_t elapsed_ns) {
+    printf("{\"backend\":\"%s\",\"op\":\"%s\",\"us_per_op\":%.1f}\n", BACKEND, name, (double) elapsed_ns / ops / 1000);
+}
+
+static void bench() {
+    uint8_t scalar[32], u[32] = { 9 }, out[32];
+    from_hex("a546e36bf0527c9d3b16154b82465edd62144c0ac1fc5a18506a2244ba449ac4", scalar, 32);
+
+    uint32_t ops = 0;
+    uint64_t start = now_ns();
+    do {
+        x25519(out, scalar, u);
+        ops++;
+    } while (now_ns() - start < BENCH_MIN_NS);
+    bench_result("x25519", ops, now_ns() - start);
+
+    uint8_t secret[32], message[100], signature[64];
+    from_hex("9d61b19deffd5a60ba844af492ec2cc44449c5697b326919703bac031cae7f60", secret, 32);
+    memset(message, 0x5A, sizeof(message));
+
+    ed25519_key key;
+    wc_ed25519_init(&key);
+    rng_bytes = secret;
+    wc_ed25519_make_key(&rng, ED25519_KEY_SIZE, &key);
+
+    word32 signature_len = sizeof(signature);
+    ops = 0;
+    start = now_ns();
+    do {
+        signature_len = sizeof(signature);
+        wc_ed25519_sign_msg(message, sizeof(message), signature, &signature_len, &key);
+        ops++;
+    } while (now_ns() - start < BENCH_MIN_NS);
+    bench_result("ed25519_sign", ops, now_ns() - start);
+
+    ops = 0;
+    start = now_ns();
+    do {
+        int verified;
+        wc_ed25519_verify_msg(signature, signature_len, message, sizeof(message), &verified, &key);
+        ops++;
+    } while (now_ns() - start < BENCH_MIN_NS);
+    bench_result("ed25519_verify", ops, now_ns() - start);
+
+    wc_ed25519_free(&key);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+
+    check_x25519();
+    check_ed25519();
+
+#ifdef CURVED25519_32BIT
+    check_field();
+#endif
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("curve25519 %s: all checks passed\n", BACKEND);
+    return 0;
+}
@@ -0,0 +1,18 @@
+// Host stand-in for the lwIP headers used by src/mdns_records.c
+
+#ifndef __LWIP_DEF_H__
+#define __LWIP_DEF_H__
+
+#include <stdint.h>
+#include <arpa/inet.h>
+
+typedef uint8_t  u8_t;
+typedef uint16_t u16_t;
+typedef uint32_t u32_t;
+
+#ifndef LWIP_IPV6
+#define LWIP_IPV6 0
+#endif
+#define LWIP_IPV6_NUM_ADDRESSES 3
+
+#endif
@@ -0,0 +1,19 @@
+// Host stand-in for the lwIP headers used by src/mdns_records.c
+
+#ifndef __LWIP_IP_ADDR_H__
+#define __LWIP_IP_ADDR_H__
+
+#include "lwip/def.h"
+
+typedef struct {
+    u32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    u32_t addr[4];
+} ip6_addr_t;
+
+#define ip4_addr_cmp(addr1, addr2)  ((addr1)->addr == (addr2)->addr)
+#define ip4_addr_copy(dest, src)    ((dest).addr = (src).addr)
+
+#endif
@@ -0,0 +1,12 @@
+// Host stand-in for the lwIP headers used by src/mdns_records.c
+
+#ifndef __LWIP_PROT_DNS_H__
+#define __LWIP_PROT_DNS_H__
+
+#define DNS_RRTYPE_A              1
+#define DNS_RRTYPE_NS             2
+#define DNS_RRTYPE_PTR            12
+#define DNS_RRTYPE_TXT            16
+#define DNS_RRCLASS_IN            1
+
+#endif
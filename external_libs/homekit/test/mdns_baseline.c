@@ -0,0 +1,192 @@
+// Reply path of mdnsresponder.c before records were indexed and replies were cached, for replay
+// benchmark only. Records keep their key as C str, questions are converted to C str and matched
+// by a linear strcasecmp walk, and keys are encoded as labels again for every answer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mdns_baseline.h"
+
+#define kDummyDataSize      8
+
+typedef struct baseline_rsrc {
+    struct baseline_rsrc* rNext;
+    u16_t    rType;
+    u32_t    rTTL;
+    u16_t    rKeySize;
+    u16_t    rDataSize;
+    char     rData[kDummyDataSize];     // Key, as C str, followed by data at rData[rKeySize]
+} baseline_rsrc;
+
+static baseline_rsrc* gBaselineDictP = NULL;
+
+static u8_t* baseline_labels2str(u8_t* hdrP, u8_t* p, char* qStr)
+{
+    int i, n;
+
+    do {
+        n = *p++;
+        if ((n & 0xC0) == 0xC0) {
+            n = (n & 0x3F) << 8;
+            n |= (u8_t)*p++;
+            baseline_labels2str(hdrP, hdrP + n, qStr);
+            return p;
+        } else if (n & 0xC0) {
+            return p;
+        } else {
+            for (i = 0; i < n; i++)
+                *qStr++ = *p++;
+            if (n == 0) *qStr++ = 0;
+                 else *qStr++ = '.';
+        }
+    } while (n > 0);
+    return p;
+}
+
+static u8_t* baseline_get_question(u8_t* hdrP, u8_t* qp, char* qStr, u16_t* qClass, u16_t* qType)
+{
+    struct mdns_query qr;
+
+    qp = baseline_labels2str(hdrP, qp, qStr);
+    memcpy(&qr, qp, SIZEOF_DNS_QUERY);
+    *qType = htons(qr.type);
+    *qClass = htons(qr.class) & 0x7FFF;
+    return qp + SIZEOF_DNS_QUERY;
+}
+
+void baseline_add(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize)
+{
+    int keyLen = strlen(vKey) + 1;
+    baseline_rsrc* rsrcP = malloc(sizeof(baseline_rsrc) - kDummyDataSize + keyLen + vDataSize);
+    if (rsrcP == NULL)
+        return;
+
+    rsrcP->rType = vType;
+    rsrcP->rTTL = ttl;
+    rsrcP->rKeySize = keyLen;
+    rsrcP->rDataSize = vDataSize;
+    memcpy(rsrcP->rData, vKey, keyLen);
+    memcpy(&rsrcP->rData[keyLen], dataP, vDataSize);
+    rsrcP->rNext = gBaselineDictP;
+    gBaselineDictP = rsrcP;
+}
+
+void baseline_clear()
+{
+    while (gBaselineDictP) {
+        baseline_rsrc* next = gBaselineDictP->rNext;
+        free(gBaselineDictP);
+        gBaselineDictP = next;
+    }
+}
+
+static baseline_rsrc* baseline_match(const char* qstr, u16_t qType)
+{
+    baseline_rsrc* rp = gBaselineDictP;
+    while (rp != NULL) {
+        if (rp->rType == qType || qType == DNS_RRTYPE_ANY) {
+            if (strcasecmp(rp->rData, qstr) == 0)
+                break;
+        }
+        rp = rp->rNext;
+    }
+    return rp;
+}
+
+static int baseline_add_to_answer(baseline_rsrc* rsrcP, u8_t* resp, int respLen)
+{
+    size_t rem = MDNS_RESPONDER_REPLY_SIZE - respLen;
+    size_t len = mdns_str2labels(rsrcP->rData, &resp[respLen], rem);
+    if (len == 0 || (len + SIZEOF_DNS_ANSWER + rsrcP->rDataSize) > rem)
+        return respLen;
+    respLen += len;
+
+    struct mdns_answer ans;
+    ans.type  = htons(rsrcP->rType);
+    ans.class = htons(DNS_RRCLASS_IN);
+    ans.ttl   = htonl(rsrcP->rTTL);
+    ans.len   = htons(rsrcP->rDataSize);
+    memcpy(&resp[respLen], &ans, SIZEOF_DNS_ANSWER);
+    respLen += SIZEOF_DNS_ANSWER;
+
+    memcpy(&resp[respLen], &rsrcP->rData[rsrcP->rKeySize], rsrcP->rDataSize);
+    respLen += rsrcP->rDataSize;
+
+    return respLen;
+}
+
+int baseline_reply(u8_t* msgP, const ip4_addr_t* addr4, u8_t* out)
+{
+    int i, nquestions, respLen;
+    struct mdns_hdr* hdrP = (struct mdns_hdr*) msgP;
+    struct mdns_hdr* rHdr;
+    baseline_rsrc* extra = NULL;
+    u8_t* qp;
+    u8_t* mdns_response;
+
+    mdns_response = malloc(MDNS_RESPONDER_REPLY_SIZE);
+    if (mdns_response == NULL)
+        return 0;
+
+    rHdr = (struct mdns_hdr*) mdns_response;
+    rHdr->id = hdrP->id;
+    rHdr->flags1 = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+    rHdr->flags2 = 0;
+    rHdr->numquestions = 0;
+    rHdr->numanswers = 0;
+    rHdr->numauthrr = 0;
+    rHdr->numextrarr = 0;
+    respLen = SIZEOF_DNS_HDR;
+
+    qp = msgP + SIZEOF_DNS_HDR;
+    nquestions = htons(hdrP->numquestions);
+
+    for (i = 0; i < nquestions; i++) {
+        char  qStr[kMaxQStr];
+        u16_t qClass, qType;
+        baseline_rsrc* rsrcP;
+
+        qp = baseline_get_question(msgP, qp, qStr, &qClass, &qType);
+        if (qClass == DNS_RRCLASS_IN || qClass == DNS_RRCLASS_ANY) {
+            rsrcP = baseline_match(qStr, qType);
+            if (rsrcP) {
+                if (rsrcP->rType == DNS_RRTYPE_A)
+                    memcpy(&rsrcP->rData[rsrcP->rKeySize], addr4, sizeof(ip4_addr_t));
+
+                int new_len = baseline_add_to_answer(rsrcP, mdns_response, respLen);
+                if (new_len > respLen) {
+                    rHdr->numanswers = htons(htons(rHdr->numanswers) + 1);
+                    respLen = new_len;
+                }
+
+                if (qType == DNS_RRTYPE_PTR) {
+                    if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_SRV)
+                        extra = rsrcP->rNext;
+                } else if (qType == DNS_RRTYPE_SRV) {
+                    if (rsrcP->rNext && rsrcP->rNext->rType == DNS_RRTYPE_A)
+                        extra = rsrcP->rNext;
+                }
+            }
+        }
+    }
+
+    if (respLen > SIZEOF_DNS_HDR && extra) {
+        if (extra->rType == DNS_RRTYPE_A)
+            memcpy(&extra->rData[extra->rKeySize], addr4, sizeof(ip4_addr_t));
+        int new_len = baseline_add_to_answer(extra, mdns_response, respLen);
+        if (new_len > respLen) {
+            rHdr->numextrarr = htons(htons(rHdr->numextrarr) + 1);
+            respLen = new_len;
+        }
+    }
+
+    if (respLen > SIZEOF_DNS_HDR)
+        memcpy(out, mdns_response, respLen);
+    else
+        respLen = 0;
+
+    free(mdns_response);
+    return respLen;
+}
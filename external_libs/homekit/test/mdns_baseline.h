@@ -0,0 +1,14 @@
+// Reply path of mdnsresponder.c before records were indexed, for replay benchmark only
+
+#ifndef __MDNS_BASELINE_H__
+#define __MDNS_BASELINE_H__
+
+#include "mdns_records.h"
+
+void baseline_add(const char* vKey, u16_t vType, u32_t ttl, const void* dataP, u16_t vDataSize);
+void baseline_clear();
+
+// Build reply to query at msgP into out, return its length, 0 if nothing to send
+int baseline_reply(u8_t* msgP, const ip4_addr_t* addr4, u8_t* out);
+
+#endif
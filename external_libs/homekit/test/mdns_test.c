@@ -0,0 +1,548 @@
+// mDNS host checks and replay benchmark
+//
+// Builds src/mdns_records.c, record database and packet building of
+// mdnsresponder.c, against small lwIP stand-ins in lwip/, loads records
+// as homekit does for an accessory, and checks replies, known answer
+// suppression, rate limiting, reply cache, legacy unicast, probes,
+// announcements and conflict detection. Benchmark replays mdns_traffic.txt through the
+// reply path and through the one before records were indexed
+// (mdns_baseline.c).
+//
+//   make -C external_libs/homekit/test
+//   make -C external_libs/homekit/test bench
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mdns_records.h"
+#include "mdns_baseline.h"
+
+#define INSTANCE            "HAA-1A2B3C"
+#define SERVICE_KEY         "_hap._tcp.local."
+#define FULL_NAME           INSTANCE "." SERVICE_KEY
+#define DEV_NAME            INSTANCE ".local."
+#define HAP_PORT            5556
+#define HAP_TTL             4500
+#define TRAFFIC_FILE        "mdns_traffic.txt"
+#define MAX_PACKETS         1024
+#define BENCH_MIN_NS        1000000000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    u32_t ms;
+    int size;
+    u8_t data[MDNS_RESPONDER_REPLY_SIZE];
+} packet_t;
+
+static packet_t packets[MAX_PACKETS];
+static int packet_count = 0;
+
+static mdns_if_addrs if_addrs;
+
+static void set_ip(u8_t a, u8_t b, u8_t c, u8_t d) {
+    u8_t ip[4] = { a, b, c, d };
+    memcpy(&if_addrs.ip4, ip, sizeof(ip));
+}
+
+// Same records as mdns_add_facility() with homekit TXT, PTR first in database
+static void add_records(void (*add)(const char*, u16_t, u32_t, const void*, u16_t)) {
+    const char txt[] = "\x05md=HAA\x06pv=1.0\x14id=1A:2B:3C:4D:5E:6F\x04c#=7\x04s#=1\x04""ff=0\x04sf=0\x04""ci=5";
+    u8_t labels[kMaxNameSize + SIZEOF_DNS_RR_SRV];
+    const ip4_addr_t addr4 = { 0 };
+    int n;
+
+    add(FULL_NAME, DNS_RRTYPE_TXT, HAP_TTL, txt, strlen(txt));
+    add(DEV_NAME, DNS_RRTYPE_A, HAP_TTL, &addr4, sizeof(addr4));
+
+    struct mdns_rr_srv srv = { 0, 0, htons(HAP_PORT) };
+    memcpy(labels, &srv, SIZEOF_DNS_RR_SRV);
+    n = mdns_str2labels(DEV_NAME, labels + SIZEOF_DNS_RR_SRV, kMaxNameSize);
+    add(FULL_NAME, DNS_RRTYPE_SRV, HAP_TTL, labels, SIZEOF_DNS_RR_SRV + n);
+
+    n = mdns_str2labels(FULL_NAME, labels, kMaxNameSize);
+    add(SERVICE_KEY, DNS_RRTYPE_PTR, HAP_TTL, labels, n);
+}
+
+static void records_add(const char* key, u16_t type, u32_t ttl, const void* data, u16_t size) {
+    CHECK(mdns_records_add(key, type, ttl, data, size), "mdns_records_add %s", key);
+}
+
+//---------------------------------------------------------------------------
+
+// Query header, returns length
+static int query_start(u8_t* buf, u16_t id, u16_t nquestions, u16_t nknown) {
+    struct mdns_hdr hdr = { htons(id), 0, 0, htons(nquestions), htons(nknown), 0, 0 };
+    memcpy(buf, &hdr, SIZEOF_DNS_HDR);
+    return SIZEOF_DNS_HDR;
+}
+
+static int query_add(u8_t* buf, int len, const char* name, u16_t type, bool qu) {
+    struct mdns_query q = { htons(type), htons(DNS_RRCLASS_IN | (qu ? 0x8000 : 0)) };
+    len += mdns_str2labels(name, buf + len, kMaxQStr);
+    memcpy(buf + len, &q, SIZEOF_DNS_QUERY);
+    return len + SIZEOF_DNS_QUERY;
+}
+
+static int answer_add(u8_t* buf, int len, const char* name, u16_t type, u32_t ttl, const void* data, u16_t size) {
+    struct mdns_answer ans = { htons(type), htons(DNS_RRCLASS_IN), htonl(ttl), htons(size) };
+    len += mdns_str2labels(name, buf + len, kMaxQStr);
+    memcpy(buf + len, &ans, SIZEOF_DNS_ANSWER);
+    len += SIZEOF_DNS_ANSWER;
+    memcpy(buf + len, data, size);
+    return len + size;
+}
+
+static int query(const char* name, u16_t type, bool qu, u8_t* buf) {
+    int len = query_start(buf, 0x1234, 1, 0);
+    return query_add(buf, len, name, type, qu);
+}
+
+static u16_t get16(const u8_t* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static u32_t get32(const u8_t* p) {
+    return ((u32_t) get16(p) << 16) | get16(p + 2);
+}
+
+static const u8_t* skip_name(const u8_t* p) {
+    while (*p && (*p & 0xC0) != 0xC0) p += *p + 1;
+    return p + (*p ? 2 : 1);
+}
+
+// Find RR number index of a built packet, questions skipped
+static const u8_t* packet_rr(const u8_t* msg, int index, u16_t* type, u16_t* class, u32_t* ttl, u16_t* dlen) {
+    const u8_t* p = msg + SIZEOF_DNS_HDR;
+    int nquestions = get16(msg + 4);
+
+    for (int i = 0; i < nquestions; i++) {
+        p = skip_name(p) + SIZEOF_DNS_QUERY;
+    }
+    for (int i = 0; ; i++) {
+        p = skip_name(p);
+        *type = get16(p);
+        *class = get16(p + 2);
+        *ttl = get32(p + 4);
+        *dlen = get16(p + 8);
+        if (i == index)
+            return p + SIZEOF_DNS_ANSWER;
+        p += SIZEOF_DNS_ANSWER + *dlen;
+    }
+}
+
+static bool reply(u8_t* msg, int len, u32_t now, mdns_reply_msg* out) {
+    return mdns_records_reply(msg, len, false, &if_addrs, now, out);
+}
+
+static bool legacy_reply(u8_t* msg, int len, u32_t now, mdns_reply_msg* out) {
+    return mdns_records_reply(msg, len, true, &if_addrs, now, out);
+}
+
+//---------------------------------------------------------------------------
+
+static void check_reply() {
+    u8_t msg[MDNS_RESPONDER_REPLY_SIZE];
+    u8_t labels[kMaxNameSize];
+    mdns_reply_msg r;
+    u16_t type, class, dlen;
+    u32_t ttl;
+    const u8_t* data;
+    int len;
+    u32_t now = 100000;
+
+    mdns_records_clear();
+    memset(&gMdnsStats, 0, sizeof(gMdnsStats));
+    add_records(records_add);
+    set_ip(192, 168, 1, 50);
+
+    // Browse: PTR answer, SRV in additional section
+    len = query(SERVICE_KEY, DNS_RRTYPE_PTR, false, msg);
+    CHECK(reply(msg, len, now, &r), "PTR query not answered");
+    CHECK(!r.unicast, "PTR reply must be multicast");
+    CHECK(get16(r.data) == 0x1234, "reply id %04x", get16(r.data));
+    CHECK(get16(r.data + 6) == 1 && get16(r.data + 10) == 1, "PTR reply answers %d extra %d", get16(r.data + 6), get16(r.data + 10));
+    data = packet_rr(r.data, 0, &type, &class, &ttl, &dlen);
+    int n = mdns_str2labels(FULL_NAME, labels, sizeof(labels));
+    CHECK(type == DNS_RRTYPE_PTR && ttl == HAP_TTL && dlen == n && memcmp(data, labels, n) == 0, "PTR answer");
+    CHECK(class == DNS_RRCLASS_IN, "shared PTR answer class %04x", class);
+    data = packet_rr(r.data, 1, &type, &class, &ttl, &dlen);
+    CHECK(type == DNS_RRTYPE_SRV && get16(data + 4) == HAP_PORT, "SRV additional type %d port %d", type, get16(data + 4));
+    CHECK(class == (DNS_RRCLASS_IN | 0x8000), "unique SRV additional class %04x", class);
+    free(r.buffer);
+
+    // Same RRs are not multicast again within 1 s, then come from reply cache
+    CHECK(!reply(msg, len, now + 500, &r), "PTR reply not rate limited");
+    CHECK(gMdnsStats.rate_limited == 2, "rate_limited %u", gMdnsStats.rate_limited);
+    msg[1] = 0x78;
+    CHECK(reply(msg, len, now + 1000, &r), "PTR query not answered after 1 s");
+    CHECK(r.buffer == NULL && gMdnsStats.cache_hits == 1, "PTR reply not from cache, hits %u", gMdnsStats.cache_hits);
+    CHECK(get16(r.data) == 0x1278, "cached reply id %04x", get16(r.data));
+
+    // Known answer with at least half TTL suppresses it, RFC6762 s7.1
+    now += 5000;
+    len = query_start(msg, 1, 1, 1);
+    len = query_add(msg, len, SERVICE_KEY, DNS_RRTYPE_PTR, false);
+    len = answer_add(msg, len, SERVICE_KEY, DNS_RRTYPE_PTR, HAP_TTL / 2, labels, n);
+    CHECK(reply(msg, len, now, &r) && get16(r.data + 6) == 0, "PTR known answer not suppressed");
+    free(r.buffer);
+    CHECK(gMdnsStats.answers_suppressed == 1, "answers_suppressed %u", gMdnsStats.answers_suppressed);
+
+    len = query_start(msg, 1, 1, 1);
+    len = query_add(msg, len, SERVICE_KEY, DNS_RRTYPE_PTR, false);
+    len = answer_add(msg, len, SERVICE_KEY, DNS_RRTYPE_PTR, HAP_TTL / 2 - 1, labels, n);
+    CHECK(reply(msg, len, now, &r), "PTR known answer with low TTL suppressed");
+    free(r.buffer);
+
+    // A record carries current address, also after a change
+    len = query(DEV_NAME, DNS_RRTYPE_A, false, msg);
+    CHECK(reply(msg, len, now, &r), "A query not answered");
+    data = packet_rr(r.data, 0, &type, &class, &ttl, &dlen);
+    CHECK(type == DNS_RRTYPE_A && dlen == 4 && data[3] == 50, "A answer %d.%d.%d.%d", data[0], data[1], data[2], data[3]);
+    free(r.buffer);
+
+    set_ip(192, 168, 1, 51);
+    CHECK(reply(msg, len, now + 2000, &r), "A query not answered after IP change");
+    data = packet_rr(r.data, 0, &type, &class, &ttl, &dlen);
+    CHECK(r.buffer != NULL && data[3] == 51, "A answer after IP change .%d", data[3]);
+    free(r.buffer);
+
+    // Case-insensitive names, other names and classes are ignored
+    len = query("haa-1a2b3c._HAP._tcp.LOCAL.", DNS_RRTYPE_TXT, false, msg);
+    CHECK(reply(msg, len, now, &r), "TXT query with other case not answered");
+    free(r.buffer);
+    len = query("Apple-TV.local.", DNS_RRTYPE_A, false, msg);
+    CHECK(!reply(msg, len, now, &r), "other host answered");
+    len = query(DEV_NAME, DNS_RRTYPE_TXT, false, msg);
+    CHECK(!reply(msg, len, now, &r), "other type answered");
+
+    // Unicast response is only used when RR was multicast recently, RFC6762 s5.4
+    len = query(FULL_NAME, DNS_RRTYPE_SRV, true, msg);
+    CHECK(reply(msg, len, now, &r) && !r.unicast, "SRV QU reply before multicast not multicast");
+    free(r.buffer);
+    CHECK(reply(msg, len, now + 100, &r) && r.unicast, "SRV QU reply after multicast not unicast");
+    free(r.buffer);
+
+    // Malformed packets
+    len = query(SERVICE_KEY, DNS_RRTYPE_PTR, false, msg);
+    CHECK(!reply(msg, len - 3, now + 10000, &r), "truncated query answered");
+    msg[SIZEOF_DNS_HDR] = 0xC0;
+    msg[SIZEOF_DNS_HDR + 1] = SIZEOF_DNS_HDR;
+    CHECK(!reply(msg, len, now + 10000, &r), "compression loop answered");
+    msg[SIZEOF_DNS_HDR] = 0x80;
+    CHECK(!reply(msg, len, now + 10000, &r), "bad label answered");
+}
+
+// Queries not from port 5353, RFC6762 s6.7
+static void check_legacy() {
+    u8_t msg[MDNS_RESPONDER_REPLY_SIZE];
+    mdns_reply_msg r;
+    u16_t type, class, dlen;
+    u32_t ttl;
+    const u8_t* data;
+    int len;
+
+    mdns_records_clear();
+    memset(&gMdnsStats, 0, sizeof(gMdnsStats));
+    add_records(records_add);
+    set_ip(192, 168, 1, 50);
+
+    // Unicast with query ID, questions and TTL of at most 10 s, second question is compressed
+    len = query_start(msg, 0xBEEF, 2, 0);
+    len = query_add(msg, len, DEV_NAME, DNS_RRTYPE_A, false);
+    msg[len++] = 0xC0;
+    msg[len++] = SIZEOF_DNS_HDR;
+    struct mdns_query q = { htons(DNS_RRTYPE_AAAA), htons(DNS_RRCLASS_IN) };
+    memcpy(msg + len, &q, SIZEOF_DNS_QUERY);
+    len += SIZEOF_DNS_QUERY;
+
+    CHECK(legacy_reply(msg, len, 1000, &r), "legacy query not answered");
+    CHECK(r.unicast, "legacy reply not unicast");
+    CHECK(get16(r.data) == 0xBEEF, "legacy reply id %04x", get16(r.data));
+    CHECK(get16(r.data + 4) == 2 && memcmp(r.data + SIZEOF_DNS_HDR, msg + SIZEOF_DNS_HDR, len - SIZEOF_DNS_HDR) == 0,
+          "legacy reply questions %d", get16(r.data + 4));
+    CHECK(get16(r.data + 6) == 1, "legacy reply answers %d", get16(r.data + 6));
+    data = packet_rr(r.data, 0, &type, &class, &ttl, &dlen);
+    CHECK(type == DNS_RRTYPE_A && ttl == 10 && data[3] == 50, "legacy A answer type %d TTL %u", type, ttl);
+    CHECK(class == DNS_RRCLASS_IN, "legacy A answer class %04x", class);
+    free(r.buffer);
+
+    // Not rate limited and does not count as multicast
+    CHECK(legacy_reply(msg, len, 1100, &r) && r.unicast, "second legacy query not answered");
+    free(r.buffer);
+    len = query(DEV_NAME, DNS_RRTYPE_A, false, msg);
+    CHECK(reply(msg, len, 1200, &r) && !r.unicast && r.buffer, "multicast reply after legacy ones");
+    free(r.buffer);
+    CHECK(gMdnsStats.rate_limited == 0 && gMdnsStats.cache_hits == 0, "legacy rate limited %u cached %u",
+          gMdnsStats.rate_limited, gMdnsStats.cache_hits);
+}
+
+static void check_probe_announce() {
+    u8_t msg[MDNS_RESPONDER_REPLY_SIZE];
+    u16_t type, class, dlen;
+    u32_t ttl;
+    int len;
+
+    mdns_records_clear();
+    memset(&gMdnsStats, 0, sizeof(gMdnsStats));
+    add_records(records_add);
+    set_ip(192, 168, 1, 50);
+
+    // One question per unique name, proposed TXT, SRV and A in authority section
+    len = mdns_records_probe(&if_addrs, true, msg);
+    CHECK(len > 0, "probe empty");
+    CHECK(get16(msg + 4) == 2 && get16(msg + 8) == 3, "probe questions %d auth %d", get16(msg + 4), get16(msg + 8));
+    const u8_t* p = msg + SIZEOF_DNS_HDR;
+    while (*p) p += *p + 1;
+    CHECK(get16(p + 1) == DNS_RRTYPE_ANY && get16(p + 3) == (DNS_RRCLASS_IN | 0x8000), "probe question type %d class %04x", get16(p + 1), get16(p + 3));
+    len = mdns_records_probe(&if_addrs, false, msg);
+    p = msg + SIZEOF_DNS_HDR;
+    while (*p) p += *p + 1;
+    CHECK(get16(p + 3) == DNS_RRCLASS_IN, "second probe question class %04x", get16(p + 3));
+
+    for (int i = 0; i < 3; i++) {
+        packet_rr(msg, i, &type, &class, &ttl, &dlen);
+        CHECK(class == DNS_RRCLASS_IN, "probe authority RR %d class %04x", i, class);
+    }
+
+    // Cache-flush bit on unique RRs, RFC6762 s10.2
+    len = mdns_records_announce(&if_addrs, false, 1000, msg);
+    CHECK(len > 0 && get16(msg + 6) == 4, "announcement answers %d", get16(msg + 6));
+    packet_rr(msg, 0, &type, &class, &ttl, &dlen);
+    CHECK(type == DNS_RRTYPE_PTR && ttl == HAP_TTL, "announcement first RR type %d TTL %u", type, ttl);
+    for (int i = 0; i < 4; i++) {
+        packet_rr(msg, i, &type, &class, &ttl, &dlen);
+        CHECK(class == (DNS_RRCLASS_IN | (type == DNS_RRTYPE_PTR ? 0 : 0x8000)), "announcement RR type %d class %04x", type, class);
+    }
+
+    len = mdns_records_announce(&if_addrs, true, 1000, msg);
+    for (int i = 0; i < 4; i++) {
+        packet_rr(msg, i, &type, &class, &ttl, &dlen);
+        CHECK(ttl == 0 && class == DNS_RRCLASS_IN, "goodbye RR %d TTL %u class %04x", i, ttl, class);
+    }
+
+    // Announced RRs are rate limited
+    len = query(SERVICE_KEY, DNS_RRTYPE_PTR, false, msg);
+    mdns_reply_msg r;
+    CHECK(!reply(msg, len, 1500, &r), "query right after announcement answered");
+
+    // Conflict: our SRV name with other data
+    u8_t srv[SIZEOF_DNS_RR_SRV + kMaxNameSize];
+    struct mdns_rr_srv srvRR = { 0, 0, htons(HAP_PORT) };
+    memcpy(srv, &srvRR, SIZEOF_DNS_RR_SRV);
+    int n = SIZEOF_DNS_RR_SRV + mdns_str2labels(DEV_NAME, srv + SIZEOF_DNS_RR_SRV, kMaxNameSize);
+    len = query_start(msg, 0, 0, 1);
+    msg[2] = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+    len = answer_add(msg, len, FULL_NAME, DNS_RRTYPE_SRV, 120, srv, n);
+    CHECK(mdns_records_check_conflict(msg, len) == 0, "own SRV seen as conflict");
+    srv[5]++;
+    len = query_start(msg, 0, 0, 1);
+    msg[2] = DNS_FLAG1_RESP + DNS_FLAG1_AUTH;
+    len = answer_add(msg, len, FULL_NAME, DNS_RRTYPE_SRV, 120, srv, n);
+    CHECK(mdns_records_check_conflict(msg, len) == 1 && gMdnsStats.conflicts == 1, "SRV conflict not found");
+}
+
+//---------------------------------------------------------------------------
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Lines are <ms> <hex payload>, "#" starts a comment, ":" separators are skipped
+static void load_traffic(const char* path) {
+    static char line[4 * MDNS_RESPONDER_REPLY_SIZE];
+    FILE* f = fopen(path, "r");
+
+    CHECK(f != NULL, "cannot open %s", path);
+    if (!f)
+        return;
+
+    while (fgets(line, sizeof(line), f) && packet_count < MAX_PACKETS) {
+        char* p;
+        packet_t* pkt = &packets[packet_count];
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        pkt->ms = strtoul(line, &p, 10);
+        pkt->size = 0;
+        while (*p == ' ') p++;
+        while (pkt->size < MDNS_RESPONDER_REPLY_SIZE) {
+            if (*p == ':') {
+                p++;
+                continue;
+            }
+            int hi = hex_value(p[0]);
+            int lo = hi < 0 ? -1 : hex_value(p[1]);
+            if (lo < 0)
+                break;
+            pkt->data[pkt->size++] = (hi << 4) | lo;
+            p += 2;
+        }
+        packet_count++;
+    }
+    fclose(f);
+}
+
+// Same filter as mdns_recv()
+static bool is_query(const packet_t* pkt) {
+    const struct mdns_hdr* hdrP = (const struct mdns_hdr*) pkt->data;
+    return pkt->size >= SIZEOF_DNS_HDR + SIZEOF_DNS_QUERY + 1 + SIZEOF_DNS_ANSWER + 1 &&
+           (hdrP->flags1 & (DNS_FLAG1_RESP + DNS_FLAG1_OPMASK + DNS_FLAG1_TRUNC)) == 0 &&
+           hdrP->numquestions > 0;
+}
+
+typedef struct {
+    u32_t replies;
+    u32_t unicast;
+    u32_t bytes;
+} replay_result_t;
+
+enum {
+    REPLAY_ALL = 0,
+    REPLAY_OTHERS,                      // Queries without questions for our records
+    REPLAY_OURS
+};
+
+static u8_t work[MDNS_RESPONDER_REPLY_SIZE];
+static u8_t baseline_out[MDNS_RESPONDER_REPLY_SIZE];
+static u8_t packet_class[MAX_PACKETS];
+
+// Packet time is offset by loop, so rate limiting and reply cache see a steady clock
+static void replay(u32_t loop, int which, replay_result_t* res) {
+    const u32_t period = packets[packet_count - 1].ms + 1000;
+
+    for (int i = 0; i < packet_count; i++) {
+        if (!is_query(&packets[i]) || (which != REPLAY_ALL && packet_class[i] != which))
+            continue;
+        // Received copy, as in mdns_recv()
+        memcpy(work, packets[i].data, packets[i].size);
+        mdns_reply_msg r;
+        if (reply(work, packets[i].size, loop * period + packets[i].ms, &r)) {
+            res->replies++;
+            res->unicast += r.unicast;
+            res->bytes += r.size;
+            free(r.buffer);
+        }
+    }
+}
+
+static void replay_baseline(int which, replay_result_t* res) {
+    for (int i = 0; i < packet_count; i++) {
+        if (!is_query(&packets[i]) || (which != REPLAY_ALL && packet_class[i] != which))
+            continue;
+        memcpy(work, packets[i].data, packets[i].size);
+        int len = baseline_reply(work, &if_addrs.ip4, baseline_out);
+        if (len > 0) {
+            res->replies++;
+            res->bytes += len;
+        }
+    }
+}
+
+static int queries[3];
+
+static void check_replay() {
+    replay_result_t now = { 0 }, before = { 0 };
+
+    mdns_records_clear();
+    baseline_clear();
+    add_records(records_add);
+    add_records(baseline_add);
+    set_ip(192, 168, 1, 50);
+
+    memset(queries, 0, sizeof(queries));
+    for (int i = 0; i < packet_count; i++) {
+        if (is_query(&packets[i])) {
+            memcpy(work, packets[i].data, packets[i].size);
+            packet_class[i] = baseline_reply(work, &if_addrs.ip4, baseline_out) > 0 ? REPLAY_OURS : REPLAY_OTHERS;
+            queries[REPLAY_ALL]++;
+            queries[packet_class[i]]++;
+        }
+    }
+    CHECK(queries[REPLAY_ALL] > 0 && queries[REPLAY_OURS] > 0, "no queries for us in %s", TRAFFIC_FILE);
+
+    memset(&gMdnsStats, 0, sizeof(gMdnsStats));
+    replay(0, REPLAY_ALL, &now);
+    replay_baseline(REPLAY_ALL, &before);
+    CHECK(now.replies > 0, "replay got no reply");
+    CHECK(gMdnsStats.answers_suppressed > 0, "no compressed known answer suppressed in replay");
+    CHECK(now.replies <= before.replies, "replay replies %u, before %u", now.replies, before.replies);
+
+    printf("replay: %d packets, %d queries, %d for us: replies %u (%u unicast, %u bytes), before %u (%u bytes)\n",
+           packet_count, queries[REPLAY_ALL], queries[REPLAY_OURS],
+           now.replies, now.unicast, now.bytes, before.replies, before.bytes);
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void bench_path(const char* name, int which, bool baseline) {
+    replay_result_t res = { 0 };
+    u32_t loops = 0;
+    uint64_t start, elapsed;
+
+    mdns_records_clear();
+    add_records(records_add);
+
+    start = now_ns();
+    do {
+        if (baseline)
+            replay_baseline(which, &res);
+        else
+            replay(loops, which, &res);
+        loops++;
+    } while ((elapsed = now_ns() - start) < BENCH_MIN_NS);
+
+    printf("%-8s %-7s %8.1f ns/query, %u replies, %u bytes per replay\n", name, baseline ? "before" : "after",
+           (double) elapsed / ((uint64_t) loops * queries[which]), res.replies / loops, res.bytes / loops);
+}
+
+static void bench() {
+    static const char* names[] = { "all", "others", "ours" };
+
+    check_replay();
+
+    for (int which = REPLAY_ALL; which <= REPLAY_OURS; which++) {
+        bench_path(names[which], which, true);
+        bench_path(names[which], which, false);
+    }
+}
+
+int main(int argc, char **argv) {
+    load_traffic(TRAFFIC_FILE);
+
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+
+    check_reply();
+    check_legacy();
+    check_probe_announce();
+    check_replay();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("mdns: all checks passed\n");
+    return 0;
+}
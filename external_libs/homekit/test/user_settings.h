@@ -0,0 +1,23 @@
+#ifndef wolfcrypt_user_settings_h
+#define wolfcrypt_user_settings_h
+
+/* Host build of the curve25519/ed25519 code, see Makefile */
+
+#define WC_NO_HARDEN
+#define NO_WOLFSSL_DIR
+#define SINGLE_THREADED
+#define NO_INLINE
+#define NO_WOLFSSL_MEMORY
+#define NO_WOLFSSL_SMALL_STACK
+#define WOLFCRYPT_ONLY
+#define WOLFSSL_SHA512
+#define USE_SLOW_SHA512
+#define HAVE_ED25519
+#define HAVE_CURVE25519
+#define NO_MD5
+#define NO_SHA
+
+/* Same 64-bit product code as on device, not the 128-bit one */
+#define NO_CURVED25519_128BIT
+
+#endif
@@ -13,11 +13,17 @@ static inline int hwrand_generate_block(uint8_t *buf, size_t len) {
 #define NO_WOLFSSL_DIR
 #define SINGLE_THREADED
 #define WOLFSSL_LWIP
+
+#ifndef HOMEKIT_WOLFSSL_INLINE
 #define NO_INLINE
+#endif
 
 #define NO_WOLFSSL_MEMORY
 #define NO_WOLFSSL_SMALL_STACK
+
+#ifndef HOMEKIT_WOLFSSL_NO_MP_LOW_MEM
 #define MP_LOW_MEM
+#endif
 
 #define CUSTOM_RAND_GENERATE_BLOCK hwrand_generate_block
 
@@ -124,6 +124,11 @@ void fe_init()
 }
 #endif
 
+#ifdef CURVED25519_32BIT
+/* fe_mul, fe_sq, fe_sq2 and fe_mul121666 without 64-bit multiplications */
+#include "fe_x25519_32.i"
+#endif
+
 #if defined(HAVE_CURVE25519) && !defined(CURVE25519_SMALL) && \
     !defined(FREESCALE_LTC_ECC)
 int curve25519(byte* q, byte* n, byte* p)
@@ -204,6 +209,7 @@ int curve25519(byte* q, byte* n, byte* p)
 #endif /* HAVE_CURVE25519 && !CURVE25519_SMALL && !FREESCALE_LTC_ECC */
 
 
+#ifndef CURVED25519_32BIT
 /*
 h = f * f
 Can overlap h with f.
@@ -350,6 +356,7 @@ void fe_sq(fe h,const fe f)
   h[8] = (int32_t)h8;
   h[9] = (int32_t)h9;
 }
+#endif /* !CURVED25519_32BIT */
 
 
 /*
@@ -705,6 +712,7 @@ void fe_copy(fe h,const fe f)
 }
 
 
+#ifndef CURVED25519_32BIT
 /*
 h = f * g
 Can overlap h with f or g.
@@ -955,6 +963,7 @@ void fe_mul(fe h,const fe f,const fe g)
   h[8] = (int32_t)h8;
   h[9] = (int32_t)h9;
 }
+#endif /* !CURVED25519_32BIT */
 
 
 /*
@@ -1030,6 +1039,7 @@ void fe_cswap(fe f, fe g, int b)
 }
 
 
+#ifndef CURVED25519_32BIT
 /*
 h = f * 121666
 Can overlap h with f.
@@ -1097,8 +1107,10 @@ void fe_mul121666(fe h,fe f)
   h[8] = (int32_t)h8;
   h[9] = (int32_t)h9;
 }
+#endif /* !CURVED25519_32BIT */
 
 
+#ifndef CURVED25519_32BIT
 /*
 h = 2 * f * f
 Can overlap h with f.
@@ -1256,6 +1268,7 @@ void fe_sq2(fe h,const fe f)
   h[8] = (int32_t)h8;
   h[9] = (int32_t)h9;
 }
+#endif /* !CURVED25519_32BIT */
 
 
 void fe_pow22523(fe out,const fe z)
@@ -0,0 +1,326 @@
+/* fe_x25519_32.i
+ *
+ * Copyright (C) 2006-2017 wolfSSL Inc.
+ *
+ * This file is part of wolfSSL.
+ *
+ * wolfSSL is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSL is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1335, USA
+ */
+
+/* Field multiplication for 32-bit cores without a 32x32->64 multiplier
+ * (e.g. Xtensa LX106, which only has MUL16 and MULL).
+ *
+ * The element representation is the same radix 2^25.5 one used by the
+ * generic code (fe is int32_t[10]), so the rest of fe_operations.c and
+ * ge_operations.c are shared. Only fe_mul, fe_sq, fe_sq2 and fe_mul121666
+ * are replaced.
+ *
+ * Every limb is split into a signed high part and an unsigned 14-bit low
+ * part that both fit in 16 bits:
+ *   x = xh * 2^14 + xl
+ * Partial products are then 16x16->32 multiplies accumulated per column in
+ * 32-bit registers, and each of the 19 columns is widened to 64 bits only
+ * once with shifts and adds. The reduction by 2^255 = 19 and the carry
+ * chain use shifts and adds too, so no 64-bit multiplication (__muldi3) is
+ * ever emitted. Results are bit-identical to the generic implementation.
+ *
+ * Accumulator bounds with |limb| <= 3.2*2^26 (ten terms per column):
+ *   |hh| <= 10 * 13107^2         < 2^31
+ *   |hl|, |lh| <= 10 * 13107 * 16383 < 2^31
+ *   ll <= 10 * 16383^2          < 2^32 (unsigned)
+ * which leaves about twice the headroom required by the ref10 bounds.
+ *
+ * Host checks with RFC 7748/8032 vectors, comparison against the generic
+ * code and a benchmark of both are in external_libs/homekit/test.
+ */
+
+#define FE32_LO_BITS    14
+#define FE32_LO_MASK    ((1 << FE32_LO_BITS) - 1)
+
+
+static INLINE int64_t fe32_mul19(int64_t x)
+{
+    return (x << 4) + (x << 1) + x;
+}
+
+
+/* Split f into high/low halves. Index [1] holds odd limbs doubled, which are
+ * used when both limbs of a partial product are odd (2^26 * 2^26 = 2 * 2^51).
+ */
+static void fe32_split(int16_t hi[2][10], uint16_t lo[2][10], const fe f)
+{
+    int i;
+    for (i = 0; i < 10; i++) {
+        int32_t x = f[i];
+        hi[0][i] = (int16_t)(x >> FE32_LO_BITS);
+        lo[0][i] = (uint16_t)(x & FE32_LO_MASK);
+        if (i & 1) {
+            x <<= 1;
+        }
+        hi[1][i] = (int16_t)(x >> FE32_LO_BITS);
+        lo[1][i] = (uint16_t)(x & FE32_LO_MASK);
+    }
+}
+
+
+static INLINE int64_t fe32_join(int32_t hh, int32_t hl, int32_t lh,
+                                uint32_t ll)
+{
+    return ((int64_t)hh << (2 * FE32_LO_BITS))
+         + (((int64_t)hl + lh) << FE32_LO_BITS)
+         + (int64_t)ll;
+}
+
+
+/* Fold columns 10..18 into 0..8 (2^255 = 19) and carry into 25.5 radix. */
+static void fe32_reduce(fe h, const int64_t c[19], int twice)
+{
+    int64_t h0 = c[0] + fe32_mul19(c[10]);
+    int64_t h1 = c[1] + fe32_mul19(c[11]);
+    int64_t h2 = c[2] + fe32_mul19(c[12]);
+    int64_t h3 = c[3] + fe32_mul19(c[13]);
+    int64_t h4 = c[4] + fe32_mul19(c[14]);
+    int64_t h5 = c[5] + fe32_mul19(c[15]);
+    int64_t h6 = c[6] + fe32_mul19(c[16]);
+    int64_t h7 = c[7] + fe32_mul19(c[17]);
+    int64_t h8 = c[8] + fe32_mul19(c[18]);
+    int64_t h9 = c[9];
+    int64_t carry0;
+    int64_t carry1;
+    int64_t carry2;
+    int64_t carry3;
+    int64_t carry4;
+    int64_t carry5;
+    int64_t carry6;
+    int64_t carry7;
+    int64_t carry8;
+    int64_t carry9;
+
+    if (twice) {
+        h0 += h0;
+        h1 += h1;
+        h2 += h2;
+        h3 += h3;
+        h4 += h4;
+        h5 += h5;
+        h6 += h6;
+        h7 += h7;
+        h8 += h8;
+        h9 += h9;
+    }
+
+    carry0 = (h0 + (int64_t) (1<<25)) >> 26; h1 += carry0; h0 -= carry0 << 26;
+    carry4 = (h4 + (int64_t) (1<<25)) >> 26; h5 += carry4; h4 -= carry4 << 26;
+
+    carry1 = (h1 + (int64_t) (1<<24)) >> 25; h2 += carry1; h1 -= carry1 << 25;
+    carry5 = (h5 + (int64_t) (1<<24)) >> 25; h6 += carry5; h5 -= carry5 << 25;
+
+    carry2 = (h2 + (int64_t) (1<<25)) >> 26; h3 += carry2; h2 -= carry2 << 26;
+    carry6 = (h6 + (int64_t) (1<<25)) >> 26; h7 += carry6; h6 -= carry6 << 26;
+
+    carry3 = (h3 + (int64_t) (1<<24)) >> 25; h4 += carry3; h3 -= carry3 << 25;
+    carry7 = (h7 + (int64_t) (1<<24)) >> 25; h8 += carry7; h7 -= carry7 << 25;
+
+    carry4 = (h4 + (int64_t) (1<<25)) >> 26; h5 += carry4; h4 -= carry4 << 26;
+    carry8 = (h8 + (int64_t) (1<<25)) >> 26; h9 += carry8; h8 -= carry8 << 26;
+
+    carry9 = (h9 + (int64_t) (1<<24)) >> 25; h0 += fe32_mul19(carry9); h9 -= carry9 << 25;
+
+    carry0 = (h0 + (int64_t) (1<<25)) >> 26; h1 += carry0; h0 -= carry0 << 26;
+
+    h[0] = (int32_t)h0;
+    h[1] = (int32_t)h1;
+    h[2] = (int32_t)h2;
+    h[3] = (int32_t)h3;
+    h[4] = (int32_t)h4;
+    h[5] = (int32_t)h5;
+    h[6] = (int32_t)h6;
+    h[7] = (int32_t)h7;
+    h[8] = (int32_t)h8;
+    h[9] = (int32_t)h9;
+}
+
+
+/*
+h = f * g
+Can overlap h with f or g.
+
+Preconditions and postconditions as the generic fe_mul.
+*/
+
+void fe_mul(fe h, const fe f, const fe g)
+{
+    int16_t fh[2][10], gh[2][10];
+    uint16_t fl[2][10], gl[2][10];
+    int64_t c[19];
+    int i, j;
+
+    fe32_split(fh, fl, f);
+    fe32_split(gh, gl, g);
+
+    for (i = 0; i < 19; i++) {
+        int32_t hh = 0, hl = 0, lh = 0;
+        uint32_t ll = 0;
+        int end = (i < 10) ? i : 9;
+
+        for (j = (i < 10) ? 0 : i - 9; j <= end; j++) {
+            int k = i - j;
+            int d = j & k & 1;
+            hh += fh[d][j] * gh[0][k];
+            hl += fh[d][j] * gl[0][k];
+            lh += fl[d][j] * gh[0][k];
+            ll += (uint32_t)(fl[d][j] * gl[0][k]);
+        }
+
+        c[i] = fe32_join(hh, hl, lh, ll);
+    }
+
+    fe32_reduce(h, c, 0);
+}
+
+
+/* Columns of f * f using only the j < k half of the products. */
+static void fe32_sq_columns(int64_t c[19], const fe f)
+{
+    int16_t fh[2][10];
+    uint16_t fl[2][10];
+    int i, j;
+
+    fe32_split(fh, fl, f);
+
+    for (i = 0; i < 19; i++) {
+        int32_t hh = 0, hl = 0, lh = 0;
+        uint32_t ll = 0;
+
+        for (j = (i < 10) ? 0 : i - 9; j < i - j; j++) {
+            int k = i - j;
+            int d = j & k & 1;
+            hh += fh[d][j] * fh[0][k];
+            hl += fh[d][j] * fl[0][k];
+            lh += fl[d][j] * fh[0][k];
+            ll += (uint32_t)(fl[d][j] * fl[0][k]);
+        }
+
+        c[i] = fe32_join(hh, hl, lh, ll) << 1;
+
+        if (!(i & 1)) {
+            int d;
+            j = i >> 1;
+            d = j & 1;
+            c[i] += fe32_join(fh[d][j] * fh[0][j],
+                              fh[d][j] * fl[0][j],
+                              fl[d][j] * fh[0][j],
+                              (uint32_t)(fl[d][j] * fl[0][j]));
+        }
+    }
+}
+
+
+/*
+h = f * f
+Can overlap h with f.
+
+Preconditions and postconditions as the generic fe_sq.
+*/
+
+void fe_sq(fe h, const fe f)
+{
+    int64_t c[19];
+
+    fe32_sq_columns(c, f);
+    fe32_reduce(h, c, 0);
+}
+
+
+/*
+h = 2 * f * f
+Can overlap h with f.
+
+Preconditions and postconditions as the generic fe_sq2.
+*/
+
+void fe_sq2(fe h, const fe f)
+{
+    int64_t c[19];
+
+    fe32_sq_columns(c, f);
+    fe32_reduce(h, c, 1);
+}
+
+
+/* x * 121666 as two 32-bit products: 121666 * 2^14 does not fit 32 bits but
+ * both halves of x times 121666 do. */
+static INLINE int64_t fe32_mul121666_limb(int32_t x)
+{
+    int32_t hi = (x >> FE32_LO_BITS) * 121666;
+    uint32_t lo = (uint32_t)(x & FE32_LO_MASK) * 121666;
+
+    return ((int64_t)hi << FE32_LO_BITS) + (int64_t)lo;
+}
+
+
+/*
+h = f * 121666
+Can overlap h with f.
+
+Preconditions and postconditions as the generic fe_mul121666.
+*/
+
+void fe_mul121666(fe h, fe f)
+{
+    int64_t h0 = fe32_mul121666_limb(f[0]);
+    int64_t h1 = fe32_mul121666_limb(f[1]);
+    int64_t h2 = fe32_mul121666_limb(f[2]);
+    int64_t h3 = fe32_mul121666_limb(f[3]);
+    int64_t h4 = fe32_mul121666_limb(f[4]);
+    int64_t h5 = fe32_mul121666_limb(f[5]);
+    int64_t h6 = fe32_mul121666_limb(f[6]);
+    int64_t h7 = fe32_mul121666_limb(f[7]);
+    int64_t h8 = fe32_mul121666_limb(f[8]);
+    int64_t h9 = fe32_mul121666_limb(f[9]);
+    int64_t carry0;
+    int64_t carry1;
+    int64_t carry2;
+    int64_t carry3;
+    int64_t carry4;
+    int64_t carry5;
+    int64_t carry6;
+    int64_t carry7;
+    int64_t carry8;
+    int64_t carry9;
+
+    carry9 = (h9 + (int64_t) (1<<24)) >> 25; h0 += fe32_mul19(carry9); h9 -= carry9 << 25;
+    carry1 = (h1 + (int64_t) (1<<24)) >> 25; h2 += carry1; h1 -= carry1 << 25;
+    carry3 = (h3 + (int64_t) (1<<24)) >> 25; h4 += carry3; h3 -= carry3 << 25;
+    carry5 = (h5 + (int64_t) (1<<24)) >> 25; h6 += carry5; h5 -= carry5 << 25;
+    carry7 = (h7 + (int64_t) (1<<24)) >> 25; h8 += carry7; h7 -= carry7 << 25;
+
+    carry0 = (h0 + (int64_t) (1<<25)) >> 26; h1 += carry0; h0 -= carry0 << 26;
+    carry2 = (h2 + (int64_t) (1<<25)) >> 26; h3 += carry2; h2 -= carry2 << 26;
+    carry4 = (h4 + (int64_t) (1<<25)) >> 26; h5 += carry4; h4 -= carry4 << 26;
+    carry6 = (h6 + (int64_t) (1<<25)) >> 26; h7 += carry6; h6 -= carry6 << 26;
+    carry8 = (h8 + (int64_t) (1<<25)) >> 26; h9 += carry8; h8 -= carry8 << 26;
+
+    h[0] = (int32_t)h0;
+    h[1] = (int32_t)h1;
+    h[2] = (int32_t)h2;
+    h[3] = (int32_t)h3;
+    h[4] = (int32_t)h4;
+    h[5] = (int32_t)h5;
+    h[6] = (int32_t)h6;
+    h[7] = (int32_t)h7;
+    h[8] = (int32_t)h8;
+    h[9] = (int32_t)h9;
+}
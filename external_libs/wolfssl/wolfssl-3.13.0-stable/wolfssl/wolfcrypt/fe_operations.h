@@ -33,7 +33,9 @@
 
 #include <wolfssl/wolfcrypt/types.h>
 
-#if defined(USE_INTEL_SPEEDUP) && !defined(NO_CURVED25519_X64)
+#if defined(CURVED25519_32BIT)
+    /* Radix 2^25.5 without 64-bit products, see fe_x25519_32.i */
+#elif defined(USE_INTEL_SPEEDUP) && !defined(NO_CURVED25519_X64)
     #define CURVED25519_X64
 #elif defined(HAVE___UINT128_T) && !defined(NO_CURVED25519_128BIT)
     #define CURVED25519_128BIT
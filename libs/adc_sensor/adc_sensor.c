@@ -0,0 +1,112 @@
+/*
+ * ADC Sensor Pipeline
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <math.h>
+
+#include "adc_sensor.h"
+
+#define ADC_SENSOR_KELVIN           273.15f
+#define ADC_SENSOR_NTC_T0           (25 + ADC_SENSOR_KELVIN)
+
+uint16_t adc_sensor_median(uint16_t *samples, const uint8_t count) {
+    // Insertion sort, bursts are short
+    for (uint8_t i = 1; i < count; i++) {
+        const uint16_t sample = samples[i];
+        uint8_t j = i;
+        while (j > 0 && samples[j - 1] > sample) {
+            samples[j] = samples[j - 1];
+            j--;
+        }
+        samples[j] = sample;
+    }
+
+    if ((count & 1) == 0) {
+        return (samples[(count >> 1) - 1] + samples[count >> 1] + 1) >> 1;
+    }
+
+    return samples[count >> 1];
+}
+
+uint16_t adc_sensor_filter(adc_sensor_t *adc_sensor, const uint16_t median) {
+    const int32_t target = median << ADC_SENSOR_FRAC_BITS;
+
+    if (!adc_sensor->has_value || adc_sensor->ema_shift == 0) {
+        adc_sensor->value = target;
+        adc_sensor->has_value = true;
+    } else {
+        const int32_t delta = target - adc_sensor->value;
+        int32_t step = (delta + (1 << (adc_sensor->ema_shift - 1))) >> adc_sensor->ema_shift;
+        if (step == 0 && delta != 0) {
+            // Always reach target
+            step = (delta > 0) ? 1 : -1;
+        }
+
+        adc_sensor->value += step;
+    }
+
+    return adc_sensor->value;
+}
+
+void adc_sensor_ntc_lut(int16_t *lut, const adc_sensor_ntc_t *ntc) {
+    for (uint16_t i = 0; i < ADC_SENSOR_LUT_SIZE; i++) {
+        float adc = i << ADC_SENSOR_LUT_STEP_BITS;
+        if (adc == 0) {
+            // Shorted NTC, hottest entry
+            adc = 0.5f;
+        }
+
+        float temperature = -ADC_SENSOR_LUT_LIMIT;
+        if (adc < ntc->adc_top) {
+            const float ln_r = logf(ntc->series * adc / (ntc->adc_top - adc));
+
+            float inverse;
+            if (ntc->sh[0] != 0) {
+                inverse = ntc->sh[0] + ntc->sh[1] * ln_r + ntc->sh[2] * ln_r * ln_r * ln_r;
+            } else {
+                inverse = (1 / ADC_SENSOR_NTC_T0) + ((ln_r - logf(ntc->r0)) / ntc->beta);
+            }
+
+            if (inverse > 0) {
+                temperature = ((1 / inverse) - ADC_SENSOR_KELVIN) * 100;
+            }
+        }
+
+        if (temperature > ADC_SENSOR_LUT_LIMIT) {
+            temperature = ADC_SENSOR_LUT_LIMIT;
+        } else if (temperature < -ADC_SENSOR_LUT_LIMIT) {
+            temperature = -ADC_SENSOR_LUT_LIMIT;
+        }
+
+        lut[i] = lroundf(temperature);
+    }
+}
+
+int16_t adc_sensor_lut_lookup(const int16_t *lut, const uint16_t value) {
+    const uint8_t step_bits = ADC_SENSOR_LUT_STEP_BITS + ADC_SENSOR_FRAC_BITS;
+    const uint16_t index = value >> step_bits;
+
+    if (index >= ADC_SENSOR_LUT_SIZE - 1) {
+        return lut[ADC_SENSOR_LUT_SIZE - 1];
+    }
+
+    const int32_t frac = value & ((1 << step_bits) - 1);
+    const int32_t delta = lut[index + 1] - lut[index];
+
+    return lut[index] + ((delta * frac) >> step_bits);
+}
@@ -0,0 +1,75 @@
+/*
+ * ADC Sensor Pipeline
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * ADC readings with oversampling, filtering and NTC thermistor conversion.
+ *
+ * A burst of samples is reduced to its median, which removes spikes, and then
+ * smoothed across polls with an exponential moving average with 1/2^n weight.
+ * Filtered value keeps 4 fractional bits.
+ *
+ * NTC temperature is taken from a table built once with Beta or
+ * Steinhart-Hart model and linearly interpolated, so no logarithm or float
+ * division is done on each poll. Nothing here accesses hardware.
+ */
+
+#ifndef __ADC_SENSOR_H__
+#define __ADC_SENSOR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ADC_SENSOR_RANGE            1024
+#define ADC_SENSOR_MAX_SAMPLES      32
+#define ADC_SENSOR_MAX_EMA_SHIFT    8       // 1/256 weight
+#define ADC_SENSOR_FRAC_BITS        4
+#define ADC_SENSOR_ONE              (1 << ADC_SENSOR_FRAC_BITS)
+
+// 129 entries, one every 8 ADC units, temperatures in hundredths of degree
+#define ADC_SENSOR_LUT_STEP_BITS    3
+#define ADC_SENSOR_LUT_SIZE         ((ADC_SENSOR_RANGE >> ADC_SENSOR_LUT_STEP_BITS) + 1)
+#define ADC_SENSOR_LUT_LIMIT        30000   // 300 degrees
+
+typedef struct _adc_sensor {
+    uint8_t ema_shift;      // 0 disables EMA, up to ADC_SENSOR_MAX_EMA_SHIFT
+    bool has_value;
+    uint16_t value;         // Filtered ADC, ADC_SENSOR_FRAC_BITS fractional bits
+} adc_sensor_t;
+
+typedef struct _adc_sensor_ntc {
+    float beta;
+    float r0;               // Resistance at 25 degrees
+    float series;           // Divider resistor
+    float adc_top;          // ADC value of divider supply
+    float sh[3];            // Steinhart-Hart A, B, C coefficients, used if A is not 0
+} adc_sensor_ntc_t;
+
+// Median of samples, which are sorted in place
+uint16_t adc_sensor_median(uint16_t *samples, const uint8_t count);
+
+// Adds a new median to the moving average and returns filtered value
+uint16_t adc_sensor_filter(adc_sensor_t *adc_sensor, const uint16_t median);
+
+// Fills ADC_SENSOR_LUT_SIZE entries
+void adc_sensor_ntc_lut(int16_t *lut, const adc_sensor_ntc_t *ntc);
+
+// Returns temperature in hundredths of degree for a filtered value
+int16_t adc_sensor_lut_lookup(const int16_t *lut, const uint16_t value);
+
+#endif  // __ADC_SENSOR_H__
@@ -0,0 +1,8 @@
+# Component makefile for adc_sensor
+
+INC_DIRS += $(adc_sensor_ROOT)
+
+adc_sensor_INC_DIR = $(adc_sensor_ROOT)
+adc_sensor_SRC_DIR = $(adc_sensor_ROOT)
+
+$(eval $(call component_compile_rules,adc_sensor))
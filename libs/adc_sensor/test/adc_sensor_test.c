@@ -0,0 +1,245 @@
+/*
+ * ADC Sensor Pipeline host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks median and EMA filter, and NTC table lookups against Beta and
+ * Steinhart-Hart formulas in double precision, on every filtered value
+ * whose temperature is between -20 and 100 degrees. Divider is HAA default
+ * one, 32K to 3.3V with ESP8266 1V ADC, so a 10K NTC reads from about 16
+ * degrees up.
+ *
+ *   make -C libs/adc_sensor/test
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "adc_sensor.h"
+
+#define KELVIN              273.15
+#define NTC_T0              (25 + KELVIN)
+#define NTC_MIN_TEMP        -20.0
+#define NTC_MAX_TEMP        100.0
+#define BETA_MAX_ERROR      0.0345  // Degrees, 0.034 at 3 decimals
+#define SH_MAX_ERROR        0.047
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static int compare_samples(const void *a, const void *b) {
+    return *(const uint16_t *) a - *(const uint16_t *) b;
+}
+
+static void check_median() {
+    uint16_t one[] = { 700 };
+    CHECK(adc_sensor_median(one, 1) == 700, "median of 1");
+
+    uint16_t odd[] = { 512, 1023, 0, 515, 513 };
+    CHECK(adc_sensor_median(odd, 5) == 513, "median of 5 with spikes");
+    CHECK(odd[0] == 0 && odd[4] == 1023, "samples not sorted");
+
+    uint16_t even[] = { 10, 3, 8, 4 };
+    CHECK(adc_sensor_median(even, 4) == 6, "median of 4");
+
+    uint16_t rounded[] = { 4, 7 };
+    CHECK(adc_sensor_median(rounded, 2) == 6, "median of 2 rounds up half");
+
+    // Random bursts up to ADC_SENSOR_MAX_SAMPLES against qsort
+    srand(1);
+    for (uint16_t n = 0; n < 2000; n++) {
+        const uint8_t count = 1 + rand() % ADC_SENSOR_MAX_SAMPLES;
+        uint16_t samples[ADC_SENSOR_MAX_SAMPLES];
+        uint16_t sorted[ADC_SENSOR_MAX_SAMPLES];
+        for (uint8_t i = 0; i < count; i++) {
+            samples[i] = rand() % ADC_SENSOR_RANGE;
+        }
+        memcpy(sorted, samples, sizeof(samples));
+        qsort(sorted, count, sizeof(uint16_t), compare_samples);
+
+        uint16_t expected = sorted[count >> 1];
+        if ((count & 1) == 0) {
+            expected = (sorted[(count >> 1) - 1] + sorted[count >> 1] + 1) >> 1;
+        }
+
+        const uint16_t median = adc_sensor_median(samples, count);
+        if (median != expected || memcmp(samples, sorted, count * sizeof(uint16_t)) != 0) {
+            CHECK(false, "burst %u of %u samples: median %u, expected %u", n, count, median, expected);
+            break;
+        }
+    }
+}
+
+static void check_filter() {
+    // First value is taken as is, with fractional bits
+    adc_sensor_t adc_sensor = { .ema_shift = 2 };
+    CHECK(adc_sensor_filter(&adc_sensor, 600) == 600 * ADC_SENSOR_ONE, "first value");
+
+    // EMA 0 follows input
+    adc_sensor_t direct = { .ema_shift = 0 };
+    adc_sensor_filter(&direct, 100);
+    CHECK(adc_sensor_filter(&direct, 900) == 900 * ADC_SENSOR_ONE, "EMA 0 does not follow input");
+
+    // Steps move towards input by 1/2^shift, never overshoot, and always reach it
+    for (uint8_t shift = 1; shift <= ADC_SENSOR_MAX_EMA_SHIFT; shift++) {
+        const uint16_t inputs[] = { 0, 1023, 512, 513, 512, 0 };
+        adc_sensor_t ema = { .ema_shift = shift };
+        adc_sensor_filter(&ema, inputs[0]);
+
+        for (uint8_t i = 1; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            const int32_t target = inputs[i] * ADC_SENSOR_ONE;
+            uint32_t polls = 0;
+            int32_t last = ema.value;
+
+            while (ema.value != target && polls < 10000) {
+                const int32_t value = adc_sensor_filter(&ema, inputs[i]);
+                const int32_t expected = last + (double) (target - last) / (1 << shift);
+                if (abs(value - expected) > 1 || (value - target) * (last - target) < 0 || value == last) {
+                    CHECK(false, "shift %u, %i to %i: %i after %i", shift, last, target, value, last);
+                    break;
+                }
+                last = value;
+                polls++;
+            }
+
+            CHECK(ema.value == target, "shift %u does not reach %i, %u", shift, target, ema.value);
+        }
+    }
+
+    // Default shift 2 removes 3/4 of a spike on first poll
+    adc_sensor_t spike = { .ema_shift = 2 };
+    adc_sensor_filter(&spike, 400);
+    CHECK(adc_sensor_filter(&spike, 800) == 500 * ADC_SENSOR_ONE, "spike %u", spike.value);
+}
+
+static double reference_temperature(const adc_sensor_ntc_t *ntc, const double adc) {
+    const double ln_r = log(ntc->series * adc / (ntc->adc_top - adc));
+
+    double inverse;
+    if (ntc->sh[0] != 0) {
+        inverse = ntc->sh[0] + ntc->sh[1] * ln_r + ntc->sh[2] * ln_r * ln_r * ln_r;
+    } else {
+        inverse = (1 / NTC_T0) + ((ln_r - log(ntc->r0)) / ntc->beta);
+    }
+
+    return (1 / inverse) - KELVIN;
+}
+
+// Max error in degrees of every filtered value between NTC_MIN_TEMP and NTC_MAX_TEMP
+static double lut_error(const adc_sensor_ntc_t *ntc, const int16_t *lut, uint32_t *checked) {
+    double max_error = 0;
+    *checked = 0;
+
+    for (uint32_t value = ADC_SENSOR_ONE; value < (ADC_SENSOR_RANGE - 1) * ADC_SENSOR_ONE; value++) {
+        const double reference = reference_temperature(ntc, (double) value / ADC_SENSOR_ONE);
+        if (reference >= NTC_MIN_TEMP && reference <= NTC_MAX_TEMP) {
+            const double error = fabs(adc_sensor_lut_lookup(lut, value) * 0.01 - reference);
+            if (error > max_error) {
+                max_error = error;
+            }
+            (*checked)++;
+        }
+    }
+
+    return max_error;
+}
+
+static void check_ntc() {
+    adc_sensor_ntc_t ntc;
+    memset(&ntc, 0, sizeof(ntc));
+    ntc.beta = 3350;
+    ntc.r0 = 10000;
+    ntc.series = 32000;
+    ntc.adc_top = ADC_SENSOR_RANGE * 3.3f;
+
+    int16_t beta_lut[ADC_SENSOR_LUT_SIZE];
+    adc_sensor_ntc_lut(beta_lut, &ntc);
+
+    uint32_t checked;
+    const double beta_error = lut_error(&ntc, beta_lut, &checked);
+    CHECK(checked > 10000, "only %u Beta values checked", checked);
+    CHECK(beta_error <= BETA_MAX_ERROR, "Beta error %.4f", beta_error);
+    printf("Beta: max error %.4f C in %u values\n", beta_error, checked);
+
+    // Table is monotonic, shorted NTC is hottest, ends are held
+    for (uint16_t i = 1; i < ADC_SENSOR_LUT_SIZE; i++) {
+        CHECK(beta_lut[i] <= beta_lut[i - 1], "table entry %u %i > %i", i, beta_lut[i], beta_lut[i - 1]);
+    }
+    CHECK(beta_lut[0] == ADC_SENSOR_LUT_LIMIT, "shorted NTC %i", beta_lut[0]);
+    CHECK(adc_sensor_lut_lookup(beta_lut, 0) == beta_lut[0], "lookup of 0");
+    CHECK(adc_sensor_lut_lookup(beta_lut, UINT16_MAX) == beta_lut[ADC_SENSOR_LUT_SIZE - 1], "lookup over range");
+    for (uint16_t i = 0; i < ADC_SENSOR_LUT_SIZE - 1; i++) {
+        const uint16_t value = (i << ADC_SENSOR_LUT_STEP_BITS) * ADC_SENSOR_ONE;
+        CHECK(adc_sensor_lut_lookup(beta_lut, value) == beta_lut[i], "lookup of entry %u", i);
+    }
+
+    // Steinhart-Hart with Beta curve coefficients is same table
+    adc_sensor_ntc_t sh_beta = ntc;
+    sh_beta.sh[0] = (1 / NTC_T0) - (log(ntc.r0) / ntc.beta);
+    sh_beta.sh[1] = 1 / ntc.beta;
+    sh_beta.sh[2] = 0;
+    int16_t sh_lut[ADC_SENSOR_LUT_SIZE];
+    adc_sensor_ntc_lut(sh_lut, &sh_beta);
+    for (uint16_t i = 1; i < ADC_SENSOR_LUT_SIZE; i++) {
+        if (abs(sh_lut[i] - beta_lut[i]) > 1) {
+            CHECK(false, "Steinhart-Hart as Beta entry %u: %i, Beta %i", i, sh_lut[i], beta_lut[i]);
+            break;
+        }
+    }
+
+    // Usual 10K NTC coefficients
+    adc_sensor_ntc_t sh = ntc;
+    sh.sh[0] = 1.009249522e-03;
+    sh.sh[1] = 2.378405444e-04;
+    sh.sh[2] = 2.019202697e-07;
+    adc_sensor_ntc_lut(sh_lut, &sh);
+
+    const double sh_error = lut_error(&sh, sh_lut, &checked);
+    CHECK(checked > 10000, "only %u Steinhart-Hart values checked", checked);
+    CHECK(sh_error <= SH_MAX_ERROR, "Steinhart-Hart error %.4f", sh_error);
+    printf("Steinhart-Hart: max error %.4f C in %u values\n", sh_error, checked);
+
+    // Open NTC, ADC at divider supply, is coldest
+    adc_sensor_ntc_t open = ntc;
+    open.adc_top = 1000;
+    adc_sensor_ntc_lut(sh_lut, &open);
+    CHECK(sh_lut[ADC_SENSOR_LUT_SIZE - 1] == -ADC_SENSOR_LUT_LIMIT, "open NTC %i", sh_lut[ADC_SENSOR_LUT_SIZE - 1]);
+}
+
+int main() {
+    check_median();
+    check_filter();
+    check_ntc();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("adc_sensor: all checks passed\n");
+    return 0;
+}
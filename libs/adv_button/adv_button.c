@@ -21,11 +21,26 @@
  * https://github.com/maximkulkin/esp-homekit-demo/blob/master/examples/button/button.c
  */
 
+
 #include <string.h>
 #include <etstimer.h>
 #include <esplibs/libmain.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <timers.h>
 #include "adv_button.h"
 
+// Edges start evaluation from GPIO interrupt. Without pended function calls, buttons are always polled
+#if INCLUDE_xTimerPendFunctionCall == 1
+#define ADV_BUTTON_INTERRUPT
+#endif
+
+#ifdef LATENCY_TRACE
+#include <latency_trace.h>
+#else
+#define LATENCY_TRACE_MARK(point, arg)
+#endif
+
 #define ADV_BUTTON_MAX_EVAL         (6)
 
 #define DOUBLEPRESS_TIME            (400)
@@ -44,14 +59,17 @@
 #define MAX(x, y)                   (((x) > (y)) ? (x) : (y))
 
 typedef struct _adv_button_callback_fn {
-    uint8_t param;
     button_callback_fn callback;
-    
     void *args;
-
-    struct _adv_button_callback_fn *next;
+    uint8_t param;
 } adv_button_callback_fn_t;
 
+// Packed vector, replaced as a whole when callbacks change
+typedef struct _adv_button_callbacks {
+    adv_button_callback_fn_t *fn;
+    uint8_t count;
+} adv_button_callbacks_t;
+
 typedef struct _adv_button {
     uint8_t gpio;
     uint8_t press_count;
@@ -60,47 +78,105 @@ typedef struct _adv_button {
     bool inverted;
     bool state;
     bool old_state;
+    bool speculative;
+    
+    uint16_t doublepress_time;
+    uint16_t longpress_time;
     
     ETSTimer press_timer;
     ETSTimer hold_timer;
     
     volatile uint32_t last_event_time;
     
-    adv_button_callback_fn_t *singlepress0_callback_fn;
-    adv_button_callback_fn_t *singlepress_callback_fn;
-    adv_button_callback_fn_t *doublepress_callback_fn;
-    adv_button_callback_fn_t *longpress_callback_fn;
-    adv_button_callback_fn_t *verylongpress_callback_fn;
-    adv_button_callback_fn_t *holdpress_callback_fn;
-
-    struct _adv_button *next;
+    adv_button_callbacks_t callbacks[ADV_BUTTON_CALLBACK_TYPES];
+    
+    struct _adv_button *destroyed_next;
 } adv_button_t;
 
 static uint32_t disable_time = 0;
 static uint8_t button_evaluate_delay = BUTTON_EVAL_DELAY_DEFAULT;
 static int8_t button_evaluate_count = ADV_BUTTON_MAX_EVAL;
 static bool button_evaluate_is_working = false;
+static volatile bool button_evaluate_is_armed = false;
+static bool button_evaluate_polling = false;
+static uint32_t button_evaluations = 0;
 static ETSTimer button_evaluate_timer;
 
-static adv_button_t *buttons = NULL;
+static adv_button_t *buttons[ADV_BUTTON_GPIO_COUNT];
+static uint8_t button_count = 0;
 
-static adv_button_t *button_find_by_gpio(const uint8_t gpio) {
-    adv_button_t *button = buttons;
+// Blocks replaced while a dispatch is running are freed when last one ends.
+// First word of each block links the list
+static volatile uint8_t dispatch_depth = 0;
+static void *retired_blocks = NULL;
+
+// Destroyed buttons are freed from timer task, after their timers are stopped
+static adv_button_t *destroyed_buttons = NULL;
+static ETSTimer button_free_timer;
+
+static inline adv_button_t *button_find_by_gpio(const uint8_t gpio) {
+    if (gpio < ADV_BUTTON_GPIO_COUNT) {
+        return buttons[gpio];
+    }
     
-    while (button && button->gpio != gpio) {
-        button = button->next;
+    return NULL;
+}
+
+static void adv_button_dispatch_begin() {
+    taskENTER_CRITICAL();
+    dispatch_depth++;
+    taskEXIT_CRITICAL();
+}
+
+static void adv_button_dispatch_end() {
+    taskENTER_CRITICAL();
+    dispatch_depth--;
+    void *block = NULL;
+    if (dispatch_depth == 0) {
+        block = retired_blocks;
+        retired_blocks = NULL;
+    }
+    taskEXIT_CRITICAL();
+    
+    while (block) {
+        void *next = *(void **) block;
+        free(block);
+        block = next;
     }
+}
 
-    return button;
+static void adv_button_retire(void *block) {
+    if (block) {
+        taskENTER_CRITICAL();
+        if (dispatch_depth > 0) {
+            *(void **) block = retired_blocks;
+            retired_blocks = block;
+            block = NULL;
+        }
+        taskEXIT_CRITICAL();
+        
+        free(block);
+    }
 }
 
-static void adv_button_run_callback_fn(adv_button_callback_fn_t *callbacks, const uint8_t gpio) {
-    adv_button_callback_fn_t *adv_button_callback_fn = callbacks;
+static void adv_button_run_callback_fn(adv_button_t *button, const uint8_t type) {
+    adv_button_dispatch_begin();
+    
+    taskENTER_CRITICAL();
+    const adv_button_callback_fn_t *callbacks = button->callbacks[type].fn;
+    const uint8_t count = button->callbacks[type].count;
+    taskEXIT_CRITICAL();
     
-    while (adv_button_callback_fn) {
-        adv_button_callback_fn->callback(gpio, adv_button_callback_fn->args, adv_button_callback_fn->param);
-        adv_button_callback_fn = adv_button_callback_fn->next;
+    // Last registered runs first
+    for (int16_t i = count - 1; i >= 0; i--) {
+        callbacks[i].callback(button->gpio, callbacks[i].args, callbacks[i].param);
     }
+    
+    adv_button_dispatch_end();
+}
+
+static inline bool adv_button_has_callback_fn(adv_button_t *button, const uint8_t type) {
+    return button->callbacks[type].count > 0;
 }
 
 void adv_button_set_evaluate_delay(const uint8_t new_delay) {
@@ -122,13 +198,12 @@ void adv_button_set_disable_time() {
     disable_time = xTaskGetTickCountFromISR();
 }
 
-IRAM static void push_down(const uint8_t used_gpio) {
+IRAM static void push_down(adv_button_t *button) {
     const uint32_t now = xTaskGetTickCountFromISR();
     
     if (now - disable_time > DISABLE_TIME / portTICK_PERIOD_MS) {
-        adv_button_t *button = button_find_by_gpio(used_gpio);
-        if (button->singlepress0_callback_fn) {
-            adv_button_run_callback_fn(button->singlepress0_callback_fn, button->gpio);
+        if (adv_button_has_callback_fn(button, INVSINGLEPRESS_TYPE)) {
+            adv_button_run_callback_fn(button, INVSINGLEPRESS_TYPE);
         } else {
             sdk_os_timer_arm(&button->hold_timer, HOLDPRESS_TIME, 0);
         }
@@ -136,12 +211,10 @@ IRAM static void push_down(const uint8_t used_gpio) {
     }
 }
 
-IRAM static void push_up(const uint8_t used_gpio) {
+IRAM static void push_up(adv_button_t *button) {
     const uint32_t now = xTaskGetTickCountFromISR();
     
     if (now - disable_time > DISABLE_TIME / portTICK_PERIOD_MS) {
-        adv_button_t *button = button_find_by_gpio(used_gpio);
-        
         if (button->press_count == DISABLE_PRESS_COUNT) {
             button->press_count = 0;
             return;
@@ -151,65 +224,168 @@ IRAM static void push_up(const uint8_t used_gpio) {
         if (now - button->last_event_time > VERYLONGPRESS_TIME / portTICK_PERIOD_MS) {
             // Very Long button pressed
             button->press_count = 0;
-            if (button->verylongpress_callback_fn) {
-                adv_button_run_callback_fn(button->verylongpress_callback_fn, button->gpio);
-            } else if (button->longpress_callback_fn) {
-                adv_button_run_callback_fn(button->longpress_callback_fn, button->gpio);
+            if (adv_button_has_callback_fn(button, VERYLONGPRESS_TYPE)) {
+                adv_button_run_callback_fn(button, VERYLONGPRESS_TYPE);
+            } else if (adv_button_has_callback_fn(button, LONGPRESS_TYPE)) {
+                adv_button_run_callback_fn(button, LONGPRESS_TYPE);
             } else {
-                adv_button_run_callback_fn(button->singlepress_callback_fn, button->gpio);
+                adv_button_run_callback_fn(button, SINGLEPRESS_TYPE);
             }
-        } else if (now - button->last_event_time > LONGPRESS_TIME / portTICK_PERIOD_MS) {
+        } else if (now - button->last_event_time > button->longpress_time / portTICK_PERIOD_MS) {
             // Long button pressed
             button->press_count = 0;
-            if (button->longpress_callback_fn) {
-                adv_button_run_callback_fn(button->longpress_callback_fn, button->gpio);
+            if (adv_button_has_callback_fn(button, LONGPRESS_TYPE)) {
+                adv_button_run_callback_fn(button, LONGPRESS_TYPE);
             } else {
-                adv_button_run_callback_fn(button->singlepress_callback_fn, button->gpio);
+                adv_button_run_callback_fn(button, SINGLEPRESS_TYPE);
             }
-        } else if (button->doublepress_callback_fn) {
+        } else if (adv_button_has_callback_fn(button, DOUBLEPRESS_TYPE)) {
             button->press_count++;
             if (button->press_count > 1) {
                 // Double button pressed
                 sdk_os_timer_disarm(&button->press_timer);
                 button->press_count = 0;
-                adv_button_run_callback_fn(button->doublepress_callback_fn, button->gpio);
+                if (button->speculative) {
+                    // Compensates single press already run
+                    adv_button_run_callback_fn(button, SINGLEPRESS_UNDO_TYPE);
+                }
+                adv_button_run_callback_fn(button, DOUBLEPRESS_TYPE);
             } else {
-                sdk_os_timer_arm(&button->press_timer, DOUBLEPRESS_TIME, 0);
+                if (button->speculative) {
+                    adv_button_run_callback_fn(button, SINGLEPRESS_TYPE);
+                }
+                sdk_os_timer_arm(&button->press_timer, button->doublepress_time, 0);
             }
         } else {
-            adv_button_run_callback_fn(button->singlepress_callback_fn, button->gpio);
+            adv_button_run_callback_fn(button, SINGLEPRESS_TYPE);
         }
     }
 }
 
+static inline bool adv_button_is_alive(adv_button_t *button) {
+    return button_find_by_gpio(button->gpio) == button;
+}
+
 static void adv_button_single_callback(void *arg) {
     adv_button_t *button = arg;
+    if (!adv_button_is_alive(button)) {
+        return;
+    }
+    
     // Single button pressed
     button->press_count = 0;
-    adv_button_run_callback_fn(button->singlepress_callback_fn, button->gpio);
+    if (!button->speculative) {
+        adv_button_run_callback_fn(button, SINGLEPRESS_TYPE);
+    }
 }
 
 static void adv_button_hold_callback(void *arg) {
     adv_button_t *button = arg;
+    if (!adv_button_is_alive(button)) {
+        return;
+    }
     
     // Hold button pressed
     button->press_count = DISABLE_PRESS_COUNT;
     
-    adv_button_run_callback_fn(button->holdpress_callback_fn, button->gpio);
+    adv_button_run_callback_fn(button, HOLDPRESS_TYPE);
+}
+
+static void button_evaluate_start() {
+    button_evaluate_is_armed = true;
+    sdk_os_timer_arm(&button_evaluate_timer, button_evaluate_delay, 1);
+}
+
+IRAM static void button_evaluate_fn();
+
+#ifdef ADV_BUTTON_INTERRUPT
+// Runs in timer task. First sample is taken now instead of a period later
+static void button_evaluate_pended(void *arg, uint32_t param) {
+    button_evaluate_start();
+    button_evaluate_fn();
+}
+
+IRAM static void adv_button_interrupt(const uint8_t gpio) {
+    if (!button_evaluate_is_armed) {
+        button_evaluate_is_armed = true;
+        
+        LATENCY_TRACE_MARK(LATENCY_TRACE_BUTTON_EDGE, gpio);
+        
+        BaseType_t task_woken = pdFALSE;
+        if (xTimerPendFunctionCallFromISR(button_evaluate_pended, NULL, 0, &task_woken) != pdPASS) {
+            // Timer queue is full, next edge will try again
+            button_evaluate_is_armed = false;
+        }
+        
+        portEND_SWITCHING_ISR(task_woken);
+    }
+}
+
+// Stops evaluate timer when all buttons are stable, edges will start it again
+static void button_evaluate_stop_if_stable() {
+    for (uint8_t gpio = 0; gpio < ADV_BUTTON_GPIO_COUNT; gpio++) {
+        adv_button_t *button = buttons[gpio];
+        if (button && button->value != (button->state ? ADV_BUTTON_MAX_EVAL : 0)) {
+            return;
+        }
+    }
+    
+    button_evaluate_is_armed = false;
+    sdk_os_timer_disarm(&button_evaluate_timer);
+    
+    // Edges between last sample and disarm did not start evaluation
+    for (uint8_t gpio = 0; gpio < ADV_BUTTON_GPIO_COUNT; gpio++) {
+        adv_button_t *button = buttons[gpio];
+        if (button && gpio_read(gpio) != button->state) {
+            button_evaluate_start();
+            return;
+        }
+    }
+}
+#endif  // ADV_BUTTON_INTERRUPT
+
+// Timer is always running when a button can not use interrupts
+static void button_evaluate_update_mode() {
+#ifdef ADV_BUTTON_INTERRUPT
+    // GPIO16 has no interrupt
+    button_evaluate_polling = (buttons[16] != NULL);
+#else
+    button_evaluate_polling = (button_count > 0);
+#endif  // ADV_BUTTON_INTERRUPT
+    
+    if (button_count == 0) {
+        button_evaluate_is_armed = false;
+        sdk_os_timer_disarm(&button_evaluate_timer);
+    } else if (button_evaluate_polling && !button_evaluate_is_armed) {
+        button_evaluate_start();
+    }
 }
 
 IRAM static void button_evaluate_fn() {
     if (!button_evaluate_is_working) {
         button_evaluate_is_working = true;
-        adv_button_t *button = buttons;
+        button_evaluations++;
         
-        while (button) {
-            if (gpio_read(button->gpio)) {
+        adv_button_dispatch_begin();
+        
+        for (uint8_t gpio = 0; gpio < ADV_BUTTON_GPIO_COUNT; gpio++) {
+            adv_button_t *button = buttons[gpio];
+            if (!button) {
+                continue;
+            }
+            
+            if (gpio_read(gpio)) {
+                if (button->value == 0 && button_evaluate_polling) {
+                    LATENCY_TRACE_MARK(LATENCY_TRACE_BUTTON_EDGE, gpio);
+                }
                 button->value = MIN(button->value++, ADV_BUTTON_MAX_EVAL);
                 if (button->value == ADV_BUTTON_MAX_EVAL) {
                     button->state = true;
                 }
             } else {
+                if (button->value == ADV_BUTTON_MAX_EVAL && button_evaluate_polling) {
+                    LATENCY_TRACE_MARK(LATENCY_TRACE_BUTTON_EDGE, gpio);
+                }
                 button->value = MAX(button->value--, 0);
                 if (button->value == 0) {
                     button->state = false;
@@ -219,107 +395,176 @@ IRAM static void button_evaluate_fn() {
             if (button->state != button->old_state) {
                 button->old_state = button->state;
                 
+                LATENCY_TRACE_MARK(LATENCY_TRACE_BUTTON, gpio);
+                
                 if (button->state ^ button->inverted) {     // 1 HIGH
-                    push_up(button->gpio);
+                    push_up(button);
                 } else {                                    // 0 LOW
-                    push_down(button->gpio);
+                    push_down(button);
                 }
             }
-            
-            button = button->next;
         }
         
+        adv_button_dispatch_end();
+        
+#ifdef ADV_BUTTON_INTERRUPT
+        if (!button_evaluate_polling) {
+            button_evaluate_stop_if_stable();
+        }
+#endif  // ADV_BUTTON_INTERRUPT
+        
         button_evaluate_is_working = false;
     }
 }
 
 int adv_button_create(const uint8_t gpio, const bool pullup_resistor, const bool inverted) {
-    adv_button_t *button = button_find_by_gpio(gpio);
+    if (gpio >= ADV_BUTTON_GPIO_COUNT || buttons[gpio]) {
+        return -1;
+    }
     
+    adv_button_t *button = malloc(sizeof(adv_button_t));
     if (!button) {
-        button = malloc(sizeof(adv_button_t));
-        memset(button, 0, sizeof(*button));
-        button->gpio = gpio;
-        button->inverted = inverted;
-        
-        if (!buttons) {
-            sdk_os_timer_setfn(&button_evaluate_timer, button_evaluate_fn, NULL);
-            sdk_os_timer_arm(&button_evaluate_timer, button_evaluate_delay, 1);
+        return -1;
+    }
+    
+    memset(button, 0, sizeof(*button));
+    button->gpio = gpio;
+    button->inverted = inverted;
+    button->doublepress_time = DOUBLEPRESS_TIME;
+    button->longpress_time = LONGPRESS_TIME;
+    
+    if (button_count == 0) {
+        sdk_os_timer_setfn(&button_evaluate_timer, button_evaluate_fn, NULL);
+    }
+    
+    button->press_count = 0;
+    
+    if (button->gpio != 0) {
+        gpio_enable(button->gpio, GPIO_INPUT);
+    }
+    
+    gpio_set_pullup(button->gpio, pullup_resistor, pullup_resistor);
+    
+    button->state = gpio_read(button->gpio);
+    
+    button->old_state = button->state;
+    
+    if (button->state) {
+        button->value = ADV_BUTTON_MAX_EVAL;
+    } else {
+        button->value = 0;
+    }
+
+    sdk_os_timer_setfn(&button->hold_timer, adv_button_hold_callback, button);
+    sdk_os_timer_setfn(&button->press_timer, adv_button_single_callback, button);
+    
+    buttons[gpio] = button;
+    button_count++;
+    
+#ifdef ADV_BUTTON_INTERRUPT
+    if (gpio != 16) {
+        gpio_set_interrupt(gpio, GPIO_INTTYPE_EDGE_ANY, adv_button_interrupt);
+    }
+#endif  // ADV_BUTTON_INTERRUPT
+    
+    button_evaluate_update_mode();
+    
+    return 0;
+}
+
+static int adv_button_set_callbacks(adv_button_t *button, const uint8_t type, adv_button_callback_fn_t *fn, const uint8_t count) {
+    taskENTER_CRITICAL();
+    adv_button_callback_fn_t *old_fn = button->callbacks[type].fn;
+    button->callbacks[type].fn = fn;
+    button->callbacks[type].count = count;
+    taskEXIT_CRITICAL();
+    
+    adv_button_retire(old_fn);
+    
+    return 0;
+}
+
+int adv_button_register_callback_fn(const uint8_t gpio, const button_callback_fn callback, const uint8_t button_callback_type, void *args, const uint8_t param) {
+    adv_button_t *button = button_find_by_gpio(gpio);
+    
+    if (button) {
+        uint8_t type = button_callback_type;
+        if (type >= ADV_BUTTON_CALLBACK_TYPES) {
+            type = SINGLEPRESS_TYPE;
         }
         
-        button->next = buttons;
-        buttons = button;
-        
-        button->press_count = 0;
+        const uint8_t count = button->callbacks[type].count;
+        if (count == UINT8_MAX) {
+            return -1;
+        }
         
-        if (button->gpio != 0) {
-            gpio_enable(button->gpio, GPIO_INPUT);
+        adv_button_callback_fn_t *fn = malloc(sizeof(adv_button_callback_fn_t) * (count + 1));
+        if (!fn) {
+            return -1;
         }
         
-        gpio_set_pullup(button->gpio, pullup_resistor, pullup_resistor);
+        if (count > 0) {
+            memcpy(fn, button->callbacks[type].fn, sizeof(adv_button_callback_fn_t) * count);
+        }
         
-        button->state = gpio_read(button->gpio);
+        fn[count].callback = callback;
+        fn[count].args = args;
+        fn[count].param = param;
         
-        button->old_state = button->state;
+        return adv_button_set_callbacks(button, type, fn, count + 1);
+    }
+    
+    return -1;
+}
+
+int adv_button_unregister_callback_fn(const uint8_t gpio, const button_callback_fn callback, const uint8_t button_callback_type, void *args) {
+    adv_button_t *button = button_find_by_gpio(gpio);
+    
+    if (button && button_callback_type < ADV_BUTTON_CALLBACK_TYPES) {
+        const uint8_t type = button_callback_type;
+        const uint8_t count = button->callbacks[type].count;
+        const adv_button_callback_fn_t *old_fn = button->callbacks[type].fn;
         
-        if (button->state) {
-            button->value = ADV_BUTTON_MAX_EVAL;
-        } else {
-            button->value = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            if (old_fn[i].callback == callback && old_fn[i].args == args) {
+                adv_button_callback_fn_t *fn = NULL;
+                
+                if (count > 1) {
+                    fn = malloc(sizeof(adv_button_callback_fn_t) * (count - 1));
+                    if (!fn) {
+                        return -1;
+                    }
+                    
+                    memcpy(fn, old_fn, sizeof(adv_button_callback_fn_t) * i);
+                    memcpy(fn + i, old_fn + i + 1, sizeof(adv_button_callback_fn_t) * (count - i - 1));
+                }
+                
+                return adv_button_set_callbacks(button, type, fn, count - 1);
+            }
         }
+    }
+    
+    return -1;
+}
 
-        sdk_os_timer_setfn(&button->hold_timer, adv_button_hold_callback, button);
-        sdk_os_timer_setfn(&button->press_timer, adv_button_single_callback, button);
+int adv_button_set_press_times(const uint8_t gpio, const uint16_t doublepress_time, const uint16_t longpress_time) {
+    adv_button_t *button = button_find_by_gpio(gpio);
+    
+    if (button) {
+        button->doublepress_time = doublepress_time > 0 ? doublepress_time : DOUBLEPRESS_TIME;
+        button->longpress_time = longpress_time > 0 ? longpress_time : LONGPRESS_TIME;
         
         return 0;
     }
-
+    
     return -1;
 }
 
-int adv_button_register_callback_fn(const uint8_t gpio, const button_callback_fn callback, const uint8_t button_callback_type, void *args, const uint8_t param) {
+int adv_button_set_speculative(const uint8_t gpio, const bool speculative) {
     adv_button_t *button = button_find_by_gpio(gpio);
     
     if (button) {
-        adv_button_callback_fn_t *adv_button_callback_fn;
-        adv_button_callback_fn = malloc(sizeof(adv_button_callback_fn_t));
-        memset(adv_button_callback_fn, 0, sizeof(*adv_button_callback_fn));
-        
-        adv_button_callback_fn->callback = callback;
-        adv_button_callback_fn->args = args;
-        adv_button_callback_fn->param = param;
-        
-        switch (button_callback_type) {
-            case INVSINGLEPRESS_TYPE:
-                adv_button_callback_fn->next = button->singlepress0_callback_fn;
-                button->singlepress0_callback_fn = adv_button_callback_fn;
-                break;
-                
-            case DOUBLEPRESS_TYPE:
-                adv_button_callback_fn->next = button->doublepress_callback_fn;
-                button->doublepress_callback_fn = adv_button_callback_fn;
-                break;
-                
-            case LONGPRESS_TYPE:
-                adv_button_callback_fn->next = button->longpress_callback_fn;
-                button->longpress_callback_fn = adv_button_callback_fn;
-                break;
-                
-            case VERYLONGPRESS_TYPE:
-                adv_button_callback_fn->next = button->verylongpress_callback_fn;
-                button->verylongpress_callback_fn = adv_button_callback_fn;
-                break;
-                
-            case HOLDPRESS_TYPE:
-                adv_button_callback_fn->next = button->holdpress_callback_fn;
-                button->holdpress_callback_fn = adv_button_callback_fn;
-                break;
-                
-            default:    // case SINGLEPRESS_TYPE:
-                adv_button_callback_fn->next = button->singlepress_callback_fn;
-                button->singlepress_callback_fn = adv_button_callback_fn;
-                break;
-        }
+        button->speculative = speculative;
         
         return 0;
     }
@@ -327,35 +572,66 @@ int adv_button_register_callback_fn(const uint8_t gpio, const button_callback_fn
     return -1;
 }
 
+uint32_t adv_button_get_evaluations() {
+    return button_evaluations;
+}
+
+// Runs in timer task, so no button evaluation or timer callback is using destroyed buttons. Stop commands
+// of their timers are queued before this call, and the ones queued now run before any other timer expires
+static void adv_button_free_destroyed(void *arg) {
+    taskENTER_CRITICAL();
+    adv_button_t *button = destroyed_buttons;
+    destroyed_buttons = NULL;
+    taskEXIT_CRITICAL();
+    
+    while (button) {
+        adv_button_t *next = button->destroyed_next;
+        
+        // An evaluation preempted by adv_button_destroy() could arm them again
+        sdk_os_timer_disarm(&button->press_timer);
+        sdk_os_timer_disarm(&button->hold_timer);
+        
+        free(button);
+        button = next;
+    }
+}
+
 void adv_button_destroy(const uint8_t gpio) {
-    if (buttons) {
-        adv_button_t *button = NULL;
-        if (buttons->gpio == gpio) {
-            
-            if (button->gpio != 0) {
-                gpio_disable(button->gpio);
-            }
-            
-            button = buttons;
-            buttons = buttons->next;
-        } else {
-            adv_button_t *b = buttons;
-            while (b->next) {
-                if (b->next->gpio == gpio) {
-                    
-                    if (b->next->gpio != 0) {
-                        gpio_disable(b->next->gpio);
-                    }
-                    
-                    button = b->next;
-                    b->next = b->next->next;
-                    break;
-                }
-            }
+    adv_button_t *button = button_find_by_gpio(gpio);
+    
+    if (button) {
+#ifdef ADV_BUTTON_INTERRUPT
+        if (gpio != 16) {
+            gpio_set_interrupt(gpio, GPIO_INTTYPE_NONE, NULL);
         }
-
-        if (!buttons) {
-            sdk_os_timer_disarm(&button_evaluate_timer);
+#endif  // ADV_BUTTON_INTERRUPT
+        
+        taskENTER_CRITICAL();
+        buttons[gpio] = NULL;
+        button_count--;
+        taskEXIT_CRITICAL();
+        
+        sdk_os_timer_disarm(&button->press_timer);
+        sdk_os_timer_disarm(&button->hold_timer);
+        
+        if (gpio != 0) {
+            gpio_disable(gpio);
         }
+        
+        button_evaluate_update_mode();
+        
+        for (uint8_t type = 0; type < ADV_BUTTON_CALLBACK_TYPES; type++) {
+            adv_button_set_callbacks(button, type, NULL, 0);
+        }
+        
+        // Its timers can still be running their callbacks, so struct is not freed here
+        taskENTER_CRITICAL();
+        button->destroyed_next = destroyed_buttons;
+        destroyed_buttons = button;
+        taskEXIT_CRITICAL();
+        
+        sdk_os_timer_disarm(&button_free_timer);
+        sdk_os_timer_setfn(&button_free_timer, adv_button_free_destroyed, NULL);
+        sdk_os_timer_arm(&button_free_timer, portTICK_PERIOD_MS, 0);
     }
 }
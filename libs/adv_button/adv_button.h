@@ -30,6 +30,10 @@
 #define LONGPRESS_TYPE              (3)
 #define VERYLONGPRESS_TYPE          (4)
 #define HOLDPRESS_TYPE              (5)
+#define SINGLEPRESS_UNDO_TYPE       (6)
+
+#define ADV_BUTTON_CALLBACK_TYPES   (7)
+#define ADV_BUTTON_GPIO_COUNT       (17)
 
 typedef void (*button_callback_fn)(uint8_t gpio, void *args, uint8_t param);
 
@@ -38,6 +42,20 @@ int adv_button_create(const uint8_t gpio, const bool pullup_resistor, const bool
 void adv_button_destroy(const uint8_t gpio);
 void adv_button_set_disable_time();
 
+// Times in ms, 0 sets default ones: 400 ms double press window, 410 ms long press
+int adv_button_set_press_times(const uint8_t gpio, const uint16_t doublepress_time, const uint16_t longpress_time);
+
+/*
+ * Speculative mode for buttons with double press callbacks: single press runs
+ * at release instead of after double press window. If a second press comes,
+ * single press undo callbacks run before double press ones.
+ */
+int adv_button_set_speculative(const uint8_t gpio, const bool speculative);
+
+// Evaluate timer runs since boot. Buttons use GPIO interrupts and timer only runs while some
+// button is changing, unless a button is on GPIO16 or FreeRTOS has no pended function calls
+uint32_t adv_button_get_evaluations();
+
 /*
  * Button callback types:
  * 0 Single press (inverted to 1)
@@ -46,7 +64,15 @@ void adv_button_set_disable_time();
  * 3 Long press
  * 4 Very long press
  * 5 Hold press
+ * 6 Single press undo, only in speculative mode
  */
 int adv_button_register_callback_fn(const uint8_t gpio, const button_callback_fn callback, const uint8_t button_callback_type, void *args, const uint8_t param);
 
+/*
+ * Removes a callback registered with same function and args. Callbacks can be
+ * registered and unregistered at any time, a removed one can still run once
+ * if its button event is being dispatched.
+ */
+int adv_button_unregister_callback_fn(const uint8_t gpio, const button_callback_fn callback, const uint8_t button_callback_type, void *args);
+
 #endif // __ADVANCED_BUTTON__
@@ -0,0 +1,2 @@
+// Host stand-in, see adv_button_sim.h
+#include "adv_button_sim.h"
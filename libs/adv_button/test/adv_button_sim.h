@@ -0,0 +1,53 @@
+// Host stand-ins for the SDK, FreeRTOS timer and GPIO calls used by adv_button.c. Stub headers
+// in this directory include it, adv_button_test.c implements it with a virtual millisecond clock
+
+#ifndef __ADV_BUTTON_SIM_H__
+#define __ADV_BUTTON_SIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define IRAM
+#define INCLUDE_xTimerPendFunctionCall  1
+#define portTICK_PERIOD_MS              10
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define portEND_SWITCHING_ISR(woken)    (void) (woken)
+
+typedef int32_t BaseType_t;
+typedef uint32_t TickType_t;
+#define pdFALSE                         0
+#define pdPASS                          1
+
+typedef void (ETSTimerFunc)(void *arg);
+
+typedef struct _ETSTimer {
+    ETSTimerFunc *fn;
+    void *arg;
+    bool armed;
+    uint32_t expire_ms;
+    uint32_t period_ms;             // 0 if not repeating
+} ETSTimer;
+
+void sdk_os_timer_setfn(ETSTimer *timer, ETSTimerFunc *fn, void *arg);
+void sdk_os_timer_arm(ETSTimer *timer, uint32_t ms, bool repeat);
+void sdk_os_timer_disarm(ETSTimer *timer);
+
+TickType_t xTaskGetTickCountFromISR();
+BaseType_t xTimerPendFunctionCallFromISR(void (*fn)(void *, uint32_t), void *arg, uint32_t param, BaseType_t *woken);
+
+#define GPIO_INPUT                      0
+#define GPIO_INTTYPE_NONE               0
+#define GPIO_INTTYPE_EDGE_ANY           3
+
+typedef void (*gpio_interrupt_handler_t)(const uint8_t gpio);
+
+bool gpio_read(const uint8_t gpio);
+void gpio_enable(const uint8_t gpio, const int direction);
+void gpio_disable(const uint8_t gpio);
+void gpio_set_pullup(const uint8_t gpio, const bool enabled, const bool enabled_during_sleep);
+void gpio_set_interrupt(const uint8_t gpio, const int type, gpio_interrupt_handler_t handler);
+
+#endif  // __ADV_BUTTON_SIM_H__
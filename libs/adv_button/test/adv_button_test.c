@@ -0,0 +1,451 @@
+/*
+ * Advanced Button Manager host checks
+ *
+ * Copyright 2018-2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs adv_button.c against a simulated clock, FreeRTOS timers and GPIO
+ * levels, and checks debounce and press types from edge sequences. It is
+ * included, so its static state can be checked too.
+ *
+ *   make -C libs/adv_button/test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "adv_button.c"
+
+#define MAX_TIMERS          16
+#define MAX_PENDED          8
+#define MAX_EVENTS          32
+
+#define PRESSED             false   // Buttons use pull-up and are not inverted
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// --- Simulation
+static uint32_t now_ms = 1000;
+
+// Armed timers only, so a freed one is never touched
+static ETSTimer *timers[MAX_TIMERS];
+static uint8_t timer_count = 0;
+
+typedef struct _pended {
+    void (*fn)(void *, uint32_t);
+    void *arg;
+    uint32_t param;
+} pended_t;
+
+static pended_t pended[MAX_PENDED];
+static uint8_t pended_count = 0;
+
+static bool gpio_levels[ADV_BUTTON_GPIO_COUNT];
+static gpio_interrupt_handler_t gpio_handlers[ADV_BUTTON_GPIO_COUNT];
+
+static int8_t timer_find(ETSTimer *timer) {
+    for (uint8_t i = 0; i < timer_count; i++) {
+        if (timers[i] == timer) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void sdk_os_timer_setfn(ETSTimer *timer, ETSTimerFunc *fn, void *arg) {
+    CHECK(timer_find(timer) < 0, "setfn on armed timer");
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+// FreeRTOS timers expire on tick boundaries, at least one tick later
+void sdk_os_timer_arm(ETSTimer *timer, uint32_t ms, bool repeat) {
+    uint32_t ticks = ms / portTICK_PERIOD_MS;
+    if (ticks == 0) {
+        ticks = 1;
+    }
+
+    timer->armed = true;
+    timer->expire_ms = (now_ms / portTICK_PERIOD_MS + ticks) * portTICK_PERIOD_MS;
+    timer->period_ms = repeat ? ticks * portTICK_PERIOD_MS : 0;
+
+    if (timer_find(timer) < 0) {
+        CHECK(timer_count < MAX_TIMERS, "too many timers");
+        timers[timer_count++] = timer;
+    }
+}
+
+void sdk_os_timer_disarm(ETSTimer *timer) {
+    const int8_t i = timer_find(timer);
+    if (i >= 0) {
+        timers[i] = timers[--timer_count];
+    }
+
+    timer->armed = false;
+}
+
+TickType_t xTaskGetTickCountFromISR() {
+    return now_ms / portTICK_PERIOD_MS;
+}
+
+BaseType_t xTimerPendFunctionCallFromISR(void (*fn)(void *, uint32_t), void *arg, uint32_t param, BaseType_t *woken) {
+    if (pended_count == MAX_PENDED) {
+        return pdFALSE;
+    }
+
+    pended[pended_count].fn = fn;
+    pended[pended_count].arg = arg;
+    pended[pended_count].param = param;
+    pended_count++;
+    *woken = pdFALSE;
+
+    return pdPASS;
+}
+
+bool gpio_read(const uint8_t gpio) {
+    return gpio_levels[gpio];
+}
+
+void gpio_enable(const uint8_t gpio, const int direction) {
+}
+
+void gpio_disable(const uint8_t gpio) {
+}
+
+void gpio_set_pullup(const uint8_t gpio, const bool enabled, const bool enabled_during_sleep) {
+    gpio_levels[gpio] = enabled;
+}
+
+void gpio_set_interrupt(const uint8_t gpio, const int type, gpio_interrupt_handler_t handler) {
+    gpio_handlers[gpio] = (type == GPIO_INTTYPE_NONE) ? NULL : handler;
+}
+
+static void set_level(const uint8_t gpio, const bool level) {
+    if (gpio_levels[gpio] != level) {
+        gpio_levels[gpio] = level;
+        if (gpio_handlers[gpio]) {
+            gpio_handlers[gpio](gpio);
+        }
+    }
+}
+
+// Timer task: pended calls first, then expired timers in expiry order
+static void run(const uint32_t ms) {
+    const uint32_t end_ms = now_ms + ms;
+
+    while (now_ms < end_ms) {
+        now_ms++;
+
+        while (pended_count > 0) {
+            const pended_t call = pended[0];
+            pended_count--;
+            memmove(pended, pended + 1, sizeof(pended_t) * pended_count);
+            call.fn(call.arg, call.param);
+        }
+
+        for (;;) {
+            ETSTimer *next = NULL;
+            for (uint8_t i = 0; i < timer_count; i++) {
+                if (timers[i]->expire_ms <= now_ms && (!next || timers[i]->expire_ms < next->expire_ms)) {
+                    next = timers[i];
+                }
+            }
+
+            if (!next) {
+                break;
+            }
+
+            if (next->period_ms > 0) {
+                next->expire_ms += next->period_ms;
+            } else {
+                sdk_os_timer_disarm(next);
+            }
+
+            next->fn(next->arg);
+        }
+    }
+}
+
+static void press(const uint8_t gpio, const uint32_t ms) {
+    set_level(gpio, PRESSED);
+    run(ms);
+    set_level(gpio, !PRESSED);
+}
+
+// --- Callbacks
+typedef struct _event {
+    uint8_t gpio;
+    uint8_t type;
+    uint32_t ms;
+} event_t;
+
+static event_t events[MAX_EVENTS];
+static uint8_t event_count = 0;
+
+static void button_callback(uint8_t gpio, void *args, uint8_t param) {
+    if (event_count < MAX_EVENTS) {
+        events[event_count].gpio = gpio;
+        events[event_count].type = param;
+        events[event_count].ms = now_ms;
+    }
+    event_count++;
+}
+
+static void register_types(const uint8_t gpio, const uint8_t *types, const uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        CHECK(adv_button_register_callback_fn(gpio, button_callback, types[i], NULL, types[i]) == 0, "register %u", types[i]);
+    }
+}
+
+// Events since last call must be exactly these types, in order
+static void expect(const char *name, const uint8_t gpio, const uint8_t *types, const uint8_t count) {
+    CHECK(event_count == count, "%s: %u events, expected %u", name, event_count, count);
+    for (uint8_t i = 0; i < count && i < event_count; i++) {
+        CHECK(events[i].gpio == gpio && events[i].type == types[i], "%s: event %u is GPIO%u type %u, expected GPIO%u type %u",
+              name, i, events[i].gpio, events[i].type, gpio, types[i]);
+    }
+
+    event_count = 0;
+}
+
+#define EXPECT(name, gpio, ...) do { \
+    const uint8_t expected[] = { __VA_ARGS__ }; \
+    expect(name, gpio, expected, sizeof(expected)); \
+} while (0)
+
+#define EXPECT_NONE(name) expect(name, 0, NULL, 0)
+
+// --- Checks
+#define GPIO_FULL           4       // All press types
+#define GPIO_TOGGLE         5       // Invert single press, for switches
+#define GPIO_SPECULATIVE    12
+#define GPIO_POLLED         16      // No GPIO interrupt
+
+static void check_press_types() {
+    CHECK(adv_button_create(GPIO_FULL, true, false) == 0, "create");
+    CHECK(adv_button_create(GPIO_FULL, true, false) < 0, "second create on same GPIO");
+    const uint8_t types[] = { SINGLEPRESS_TYPE, DOUBLEPRESS_TYPE, LONGPRESS_TYPE, VERYLONGPRESS_TYPE, HOLDPRESS_TYPE };
+    register_types(GPIO_FULL, types, sizeof(types));
+
+    run(1000);
+    EXPECT_NONE("idle");
+
+    // Single press runs when double press window ends
+    press(GPIO_FULL, 100);
+    const uint32_t release_ms = now_ms;
+    run(300);
+    EXPECT_NONE("single press inside double press window");
+    run(700);
+    EXPECT("single press", GPIO_FULL, SINGLEPRESS_TYPE);
+    CHECK(events[0].ms - release_ms >= DOUBLEPRESS_TIME && events[0].ms - release_ms <= DOUBLEPRESS_TIME + 100,
+          "single press %u ms after release", events[0].ms - release_ms);
+
+    press(GPIO_FULL, 100);
+    run(150);
+    press(GPIO_FULL, 100);
+    run(1000);
+    EXPECT("double press", GPIO_FULL, DOUBLEPRESS_TYPE);
+
+    press(GPIO_FULL, 700);
+    run(1000);
+    EXPECT("long press", GPIO_FULL, LONGPRESS_TYPE);
+
+    press(GPIO_FULL, 2000);
+    run(1000);
+    EXPECT("very long press", GPIO_FULL, VERYLONGPRESS_TYPE);
+
+    // Hold runs while pressed, its release is ignored
+    set_level(GPIO_FULL, PRESSED);
+    run(HOLDPRESS_TIME + 200);
+    EXPECT("hold press", GPIO_FULL, HOLDPRESS_TYPE);
+    set_level(GPIO_FULL, !PRESSED);
+    run(1000);
+    EXPECT_NONE("release after hold");
+
+    // Shorter times
+    CHECK(adv_button_set_press_times(GPIO_FULL, 200, 300) == 0, "press times");
+    press(GPIO_FULL, 400);
+    run(1000);
+    EXPECT("long press with 300 ms", GPIO_FULL, LONGPRESS_TYPE);
+    press(GPIO_FULL, 100);
+    run(300);
+    EXPECT("single press with 200 ms window", GPIO_FULL, SINGLEPRESS_TYPE);
+    adv_button_set_press_times(GPIO_FULL, 0, 0);
+}
+
+static void check_debounce() {
+    // Contact bounce around a press and a release, 3 ms per level
+    for (uint8_t i = 0; i < 10; i++) {
+        set_level(GPIO_FULL, !(i & 1));
+        run(3);
+    }
+    run(150);
+    for (uint8_t i = 0; i < 10; i++) {
+        set_level(GPIO_FULL, i & 1);
+        run(3);
+    }
+    run(1000);
+    EXPECT("bouncing press", GPIO_FULL, SINGLEPRESS_TYPE);
+
+    // Shorter than ADV_BUTTON_MAX_EVAL samples
+    press(GPIO_FULL, 40);
+    run(1000);
+    EXPECT_NONE("40 ms glitch");
+
+    for (uint8_t i = 0; i < 20; i++) {
+        press(GPIO_FULL, 5);
+        run(5);
+    }
+    run(1000);
+    EXPECT_NONE("fast noise");
+
+    // Evaluate timer only runs while a button is changing
+    CHECK(!button_evaluate_is_armed && timer_find(&button_evaluate_timer) < 0, "evaluate timer armed when stable");
+    const uint32_t evaluations = adv_button_get_evaluations();
+    run(5000);
+    CHECK(adv_button_get_evaluations() == evaluations, "%u evaluations while idle", adv_button_get_evaluations() - evaluations);
+
+    press(GPIO_FULL, 100);
+    run(1000);
+    EXPECT("press after idle", GPIO_FULL, SINGLEPRESS_TYPE);
+    CHECK(adv_button_get_evaluations() - evaluations < 40, "%u evaluations for one press", adv_button_get_evaluations() - evaluations);
+
+    // Ignored just after adv_button_set_disable_time()
+    adv_button_set_disable_time();
+    press(GPIO_FULL, 20);
+    run(1000);
+    EXPECT_NONE("press while disabled");
+}
+
+static void check_toggle_and_speculative() {
+    CHECK(adv_button_create(GPIO_TOGGLE, true, false) == 0, "create toggle");
+    const uint8_t toggle_types[] = { INVSINGLEPRESS_TYPE, SINGLEPRESS_TYPE };
+    register_types(GPIO_TOGGLE, toggle_types, sizeof(toggle_types));
+
+    set_level(GPIO_TOGGLE, PRESSED);
+    run(1000);
+    EXPECT("toggle low", GPIO_TOGGLE, INVSINGLEPRESS_TYPE);
+    set_level(GPIO_TOGGLE, !PRESSED);
+    run(1000);
+    EXPECT("toggle high", GPIO_TOGGLE, SINGLEPRESS_TYPE);
+
+    CHECK(adv_button_create(GPIO_SPECULATIVE, true, false) == 0, "create speculative");
+    const uint8_t speculative_types[] = { SINGLEPRESS_TYPE, DOUBLEPRESS_TYPE, SINGLEPRESS_UNDO_TYPE };
+    register_types(GPIO_SPECULATIVE, speculative_types, sizeof(speculative_types));
+    CHECK(adv_button_set_speculative(GPIO_SPECULATIVE, true) == 0, "speculative");
+
+    press(GPIO_SPECULATIVE, 100);
+    run(100);
+    EXPECT("speculative single press at release", GPIO_SPECULATIVE, SINGLEPRESS_TYPE);
+    run(1000);
+    EXPECT_NONE("speculative single press window end");
+
+    press(GPIO_SPECULATIVE, 100);
+    run(150);
+    press(GPIO_SPECULATIVE, 100);
+    run(1000);
+    EXPECT("speculative double press", GPIO_SPECULATIVE, SINGLEPRESS_TYPE, SINGLEPRESS_UNDO_TYPE, DOUBLEPRESS_TYPE);
+
+    // Both buttons at once
+    set_level(GPIO_TOGGLE, PRESSED);
+    press(GPIO_SPECULATIVE, 100);
+    run(1000);
+    CHECK(event_count == 2, "two buttons: %u events", event_count);
+    event_count = 0;
+    set_level(GPIO_TOGGLE, !PRESSED);
+    run(1000);
+    EXPECT("toggle high after two buttons", GPIO_TOGGLE, SINGLEPRESS_TYPE);
+}
+
+static void check_polled() {
+    CHECK(adv_button_create(GPIO_POLLED, true, false) == 0, "create polled");
+    const uint8_t types[] = { SINGLEPRESS_TYPE };
+    register_types(GPIO_POLLED, types, sizeof(types));
+    CHECK(gpio_handlers[GPIO_POLLED] == NULL && button_evaluate_polling, "GPIO16 is polled");
+
+    press(GPIO_POLLED, 100);
+    run(1000);
+    EXPECT("polled single press", GPIO_POLLED, SINGLEPRESS_TYPE);
+
+    // Other buttons keep working while polling
+    press(GPIO_TOGGLE, 100);
+    run(1000);
+    EXPECT("toggle while polling", GPIO_TOGGLE, INVSINGLEPRESS_TYPE, SINGLEPRESS_TYPE);
+
+    adv_button_destroy(GPIO_POLLED);
+    run(100);
+    CHECK(!button_evaluate_polling && !button_evaluate_is_armed, "polling after GPIO16 destroyed");
+}
+
+static void check_destroy() {
+    // Destroyed inside double press window and while holding
+    press(GPIO_FULL, 100);
+    run(100);
+    CHECK(timer_find(&buttons[GPIO_FULL]->press_timer) >= 0, "press timer armed");
+    adv_button_destroy(GPIO_FULL);
+
+    set_level(GPIO_SPECULATIVE, PRESSED);
+    run(100);
+    CHECK(timer_find(&buttons[GPIO_SPECULATIVE]->hold_timer) >= 0, "hold timer armed");
+    adv_button_destroy(GPIO_SPECULATIVE);
+    set_level(GPIO_SPECULATIVE, !PRESSED);
+
+    CHECK(destroyed_buttons != NULL, "destroyed buttons freed before their timers stop");
+    run(HOLDPRESS_TIME + 1000);
+    EXPECT_NONE("destroyed buttons");
+    CHECK(destroyed_buttons == NULL, "destroyed buttons not freed");
+    CHECK(timer_count == 0, "%u timers armed after destroy", timer_count);
+    CHECK(gpio_handlers[GPIO_FULL] == NULL, "interrupt kept after destroy");
+
+    // GPIO can be used again
+    CHECK(adv_button_create(GPIO_FULL, true, false) == 0, "create after destroy");
+    const uint8_t types[] = { SINGLEPRESS_TYPE };
+    register_types(GPIO_FULL, types, sizeof(types));
+    press(GPIO_FULL, 100);
+    run(1000);
+    EXPECT("single press after create again", GPIO_FULL, SINGLEPRESS_TYPE);
+
+    adv_button_destroy(GPIO_FULL);
+    adv_button_destroy(GPIO_TOGGLE);
+    run(100);
+    CHECK(button_count == 0 && timer_count == 0 && destroyed_buttons == NULL, "%u buttons, %u timers left", button_count, timer_count);
+}
+
+int main() {
+    check_press_types();
+    check_debounce();
+    check_toggle_and_speculative();
+    check_polled();
+    check_destroy();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("adv_button: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Advanced PWM Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <common_macros.h>
+#include <xtensa_ops.h>
+#include <esp/gpio.h>
+#include <esp/timer.h>
+#include <esp/clocks.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "adv_pwm.h"
+
+#define ADV_PWM_MAX_PERIOD_TICKS    (TIMER_FRC1_MAX_LOAD)
+
+static uint8_t gpios[ADV_PWM_MAX_CHANNELS];
+static uint16_t duties[ADV_PWM_MAX_CHANNELS];
+static uint8_t channel_count = 0;
+static uint16_t channel_mask = 0;
+static uint32_t period_ticks = ADV_PWM_TICKS_PER_SECOND / ADV_PWM_DEFAULT_FREQ;
+static bool stagger = true;
+static bool dirty = false;
+
+// ISR uses schedules[active][dither] and swaps to the other set at period start when pending
+static adv_pwm_schedule_t schedules[2][ADV_PWM_DITHER_PERIODS];
+static volatile uint8_t active = 0;
+static volatile uint8_t dither = 0;
+static volatile bool pending = false;
+static volatile uint8_t next_edge = 0;
+static bool running = false;
+
+static volatile uint32_t isr_periods = 0;
+static volatile uint32_t isr_period_cycles = 0;
+static volatile uint32_t isr_last_cycles = 0;
+static volatile uint32_t isr_max_cycles = 0;
+
+static IRAM void adv_pwm_isr(void *arg) {
+    uint32_t isr_start;
+    RSR(isr_start, ccount);
+
+    const adv_pwm_schedule_t *schedule = &schedules[active][dither];
+
+    if (next_edge < schedule->edge_count) {
+        const adv_pwm_edge_t *edge = &schedule->edges[next_edge];
+        GPIO.OUT_SET = edge->set_mask;
+        GPIO.OUT_CLEAR = edge->clear_mask;
+        timer_set_load(FRC1, edge->ticks);
+        next_edge++;
+
+    } else {
+        // Period start
+        isr_last_cycles = isr_period_cycles;
+        if (isr_period_cycles > isr_max_cycles) {
+            isr_max_cycles = isr_period_cycles;
+        }
+        isr_period_cycles = 0;
+        isr_periods++;
+
+        if (pending) {
+            active ^= 1;
+            pending = false;
+            dither = 0;
+        } else if (++dither == ADV_PWM_DITHER_PERIODS) {
+            dither = 0;
+        }
+
+        schedule = &schedules[active][dither];
+
+        GPIO.OUT_SET = schedule->set_mask;
+        GPIO.OUT_CLEAR = schedule->clear_mask;
+        timer_set_load(FRC1, schedule->first_ticks);
+        next_edge = 0;
+    }
+
+    uint32_t isr_end;
+    RSR(isr_end, ccount);
+    isr_period_cycles += isr_end - isr_start;
+}
+
+// Returns false if all channels are off
+static bool adv_pwm_build_schedules(adv_pwm_schedule_t *set) {
+    uint32_t total_ticks[ADV_PWM_MAX_CHANNELS];
+    bool is_on = false;
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        total_ticks[i] = ((uint64_t) duties[i] * period_ticks * ADV_PWM_DITHER_PERIODS) / ADV_PWM_MAX_DUTY;
+        is_on |= (total_ticks[i] > 0);
+    }
+
+    for (uint8_t period = 0; period < ADV_PWM_DITHER_PERIODS; period++) {
+        adv_pwm_build_schedule(&set[period], gpios, total_ticks, channel_count, period_ticks, stagger, period);
+    }
+
+    return is_on;
+}
+
+static void adv_pwm_stop() {
+    timer_set_interrupts(FRC1, false);
+    timer_set_run(FRC1, false);
+
+    GPIO.OUT_CLEAR = channel_mask;
+    running = false;
+}
+
+static void adv_pwm_start() {
+    // First interrupt is a period start, and it moves to first dither period
+    dither = ADV_PWM_DITHER_PERIODS - 1;
+    next_edge = schedules[active][dither].edge_count;
+    isr_period_cycles = 0;
+    running = true;
+
+    timer_set_load(FRC1, ADV_PWM_MIN_TICKS);
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+}
+
+void adv_pwm_init() {
+    timer_set_interrupts(FRC1, false);
+    timer_set_run(FRC1, false);
+
+    _xt_isr_attach(INUM_TIMER_FRC1, adv_pwm_isr, NULL);
+    timer_set_divider(FRC1, TIMER_CLKDIV_16);
+    timer_set_reload(FRC1, false);
+
+    channel_count = 0;
+    channel_mask = 0;
+    running = false;
+    pending = false;
+}
+
+void adv_pwm_set_freq(const uint16_t freq) {
+    if (freq > 0) {
+        period_ticks = ADV_PWM_TICKS_PER_SECOND / freq;
+        if (period_ticks > ADV_PWM_MAX_PERIOD_TICKS) {
+            period_ticks = ADV_PWM_MAX_PERIOD_TICKS;
+        }
+
+        dirty = true;
+    }
+}
+
+void adv_pwm_set_stagger(const bool new_stagger) {
+    if (stagger != new_stagger) {
+        stagger = new_stagger;
+        dirty = true;
+    }
+}
+
+int adv_pwm_add_channel(const uint8_t gpio) {
+    if (gpio > 15 || channel_count == ADV_PWM_MAX_CHANNELS) {
+        return -1;
+    }
+
+    gpio_enable(gpio, GPIO_OUTPUT);
+    gpio_write(gpio, false);
+
+    gpios[channel_count] = gpio;
+    duties[channel_count] = 0;
+    channel_mask |= BIT(gpio);
+    channel_count++;
+
+    // Phases depend on channel count
+    dirty = true;
+
+    return channel_count - 1;
+}
+
+uint8_t adv_pwm_channels() {
+    return channel_count;
+}
+
+void adv_pwm_set_duty(const uint8_t channel, const uint16_t duty) {
+    if (channel < channel_count && duties[channel] != duty) {
+        duties[channel] = duty;
+        dirty = true;
+    }
+}
+
+uint16_t adv_pwm_get_duty(const uint8_t channel) {
+    if (channel < channel_count) {
+        return duties[channel];
+    }
+
+    return 0;
+}
+
+void adv_pwm_update() {
+    if (!dirty) {
+        return;
+    }
+
+    dirty = false;
+
+    if (running) {
+        // ISR does not swap while shadow buffer is being written
+        pending = false;
+        __asm__ volatile("" ::: "memory");
+
+        if (adv_pwm_build_schedules(schedules[active ^ 1])) {
+            // Shadow buffer must be complete before ISR can see it
+            __asm__ volatile("" ::: "memory");
+            pending = true;
+        } else {
+            adv_pwm_stop();
+            active ^= 1;
+        }
+
+    } else if (adv_pwm_build_schedules(schedules[active])) {
+        adv_pwm_start();
+    }
+}
+
+void adv_pwm_get_isr_stats(adv_pwm_isr_stats_t *stats) {
+    stats->periods = isr_periods;
+    stats->last_cycles = isr_last_cycles;
+    stats->max_cycles = isr_max_cycles;
+}
@@ -0,0 +1,104 @@
+/*
+ * Advanced PWM Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * FRC1 timer PWM for up to ADV_PWM_MAX_CHANNELS GPIOs, 0 to 15, all with same frequency.
+ *
+ * Duties are staged with adv_pwm_set_duty(). adv_pwm_update() builds the sorted
+ * edge schedules into a shadow buffer and timer ISR swaps it at next period
+ * start, so output is never stopped and every period is complete. Schedules
+ * are only rebuilt when some duty, frequency or stagger setting changed.
+ *
+ * Channels are switched on at staggered phases instead of all at period start,
+ * to spread current spikes. Each schedule set has ADV_PWM_DITHER_PERIODS periods
+ * and duty ticks remainder is spread across them, so low duties keep resolution
+ * below one timer tick and below ADV_PWM_MIN_TICKS.
+ *
+ * Schedules are built in adv_pwm_schedule.c, without hardware access, so they
+ * can be checked on host with test/adv_pwm_test.c.
+ *
+ * FRC1 is also used by profiler and ir_tx, none of them can run at the same time.
+ */
+
+#ifndef __ADV_PWM_H__
+#define __ADV_PWM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ADV_PWM_MAX_CHANNELS        8
+#define ADV_PWM_MAX_DUTY            UINT16_MAX
+#define ADV_PWM_DEFAULT_FREQ        1000    // Hz
+
+#ifndef ADV_PWM_MIN_TICKS
+#define ADV_PWM_MIN_TICKS           40      // 8 us, shorter intervals are merged
+#endif
+
+#ifndef ADV_PWM_DITHER_PERIODS
+#define ADV_PWM_DITHER_PERIODS      4       // 1 disables dithering
+#endif
+
+#define ADV_PWM_TICKS_PER_SECOND    (APB_CLK_FREQ / 16)
+
+typedef struct _adv_pwm_edge {
+    uint16_t set_mask;
+    uint16_t clear_mask;
+    uint32_t ticks;                 // To next interrupt
+} adv_pwm_edge_t;
+
+// Edges of one period, sorted by time
+typedef struct _adv_pwm_schedule {
+    uint16_t set_mask;              // Outputs on at period start
+    uint16_t clear_mask;            // Outputs off at period start
+    uint32_t first_ticks;           // To first edge, or to next period start
+    uint8_t edge_count;
+    adv_pwm_edge_t edges[ADV_PWM_MAX_CHANNELS * 2];
+} adv_pwm_schedule_t;
+
+typedef struct _adv_pwm_isr_stats {
+    uint32_t periods;
+    uint32_t last_cycles;           // CPU cycles used by ISR in last complete period
+    uint32_t max_cycles;
+} adv_pwm_isr_stats_t;
+
+void adv_pwm_init();
+void adv_pwm_set_freq(const uint16_t freq);
+
+// Phase staggering is enabled by default
+void adv_pwm_set_stagger(const bool stagger);
+
+// Returns channel index, or -1 if GPIO is not valid or all channels are used
+int adv_pwm_add_channel(const uint8_t gpio);
+uint8_t adv_pwm_channels();
+
+// Stages a duty, from 0 to ADV_PWM_MAX_DUTY. Applied by adv_pwm_update()
+void adv_pwm_set_duty(const uint8_t channel, const uint16_t duty);
+uint16_t adv_pwm_get_duty(const uint8_t channel);
+
+// Applies staged duties at next period start. Timer is stopped while all duties are 0
+void adv_pwm_update();
+
+void adv_pwm_get_isr_stats(adv_pwm_isr_stats_t *stats);
+
+// On ticks of a channel in dither period, from its total ticks in all ADV_PWM_DITHER_PERIODS periods
+uint32_t adv_pwm_dither_ticks(uint32_t total_ticks, const uint8_t period);
+
+// Edges of one dither period. Used by adv_pwm_update(), exported for host checks
+void adv_pwm_build_schedule(adv_pwm_schedule_t *schedule, const uint8_t *gpios, const uint32_t *total_ticks, const uint8_t channel_count, const uint32_t period_ticks, const bool stagger, const uint8_t period);
+
+#endif  // __ADV_PWM_H__
@@ -0,0 +1,141 @@
+/*
+ * Advanced PWM Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "adv_pwm.h"
+
+typedef struct _adv_pwm_event {
+    uint32_t ticks;                 // From period start
+    uint16_t set_mask;
+    uint16_t clear_mask;
+} adv_pwm_event_t;
+
+// On ticks of a channel in dither period, from its total ticks in all ADV_PWM_DITHER_PERIODS periods
+uint32_t adv_pwm_dither_ticks(uint32_t total_ticks, const uint8_t period) {
+    if (total_ticks == 0) {
+        return 0;
+    }
+
+    if (total_ticks >= ADV_PWM_DITHER_PERIODS * ADV_PWM_MIN_TICKS) {
+        return (total_ticks + period) / ADV_PWM_DITHER_PERIODS;
+    }
+
+    // Too short to be split in all periods, so it is sent as fewer pulses of at least ADV_PWM_MIN_TICKS
+    uint32_t pulses = total_ticks / ADV_PWM_MIN_TICKS;
+    if (pulses == 0) {
+        pulses = 1;
+        total_ticks = ADV_PWM_MIN_TICKS;
+    }
+
+    const uint32_t pulse = (period * pulses) / ADV_PWM_DITHER_PERIODS;
+    if (((period + 1) * pulses) / ADV_PWM_DITHER_PERIODS == pulse) {
+        return 0;
+    }
+
+    return (total_ticks + pulse) / pulses;
+}
+
+static void adv_pwm_add_event(adv_pwm_event_t *events, uint8_t *count, const uint32_t ticks, const uint16_t set_mask, const uint16_t clear_mask) {
+    // Insertion sort by time
+    uint8_t i = *count;
+    while (i > 0 && events[i - 1].ticks > ticks) {
+        events[i] = events[i - 1];
+        i--;
+    }
+
+    events[i].ticks = ticks;
+    events[i].set_mask = set_mask;
+    events[i].clear_mask = clear_mask;
+    (*count)++;
+}
+
+void adv_pwm_build_schedule(adv_pwm_schedule_t *schedule, const uint8_t *gpios, const uint32_t *total_ticks, const uint8_t channel_count, const uint32_t period_ticks, const bool stagger, const uint8_t period) {
+    adv_pwm_event_t events[ADV_PWM_MAX_CHANNELS * 2];
+    uint8_t count = 0;
+    uint16_t channel_mask = 0;
+
+    memset(schedule, 0, sizeof(*schedule));
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        const uint16_t mask = 1 << gpios[i];
+        channel_mask |= mask;
+        const uint32_t ticks = adv_pwm_dither_ticks(total_ticks[i], period);
+
+        if (ticks == 0) {
+            continue;
+        }
+
+        if (ticks + ADV_PWM_MIN_TICKS >= period_ticks) {
+            // Always on
+            schedule->set_mask |= mask;
+            continue;
+        }
+
+        // On window is kept inside period, so no channel is on across period start
+        uint32_t phase = 0;
+        if (stagger) {
+            phase = (period_ticks / channel_count) * i;
+            if (phase + ticks > period_ticks - ADV_PWM_MIN_TICKS) {
+                phase = period_ticks - ADV_PWM_MIN_TICKS - ticks;
+            }
+
+            if (phase < ADV_PWM_MIN_TICKS) {
+                phase = 0;
+            }
+        }
+
+        if (phase == 0) {
+            schedule->set_mask |= mask;
+        } else {
+            adv_pwm_add_event(events, &count, phase, mask, 0);
+        }
+
+        adv_pwm_add_event(events, &count, phase + ticks, 0, mask);
+    }
+
+    schedule->clear_mask = channel_mask & ~schedule->set_mask;
+
+    uint32_t last_ticks = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (schedule->edge_count > 0 && events[i].ticks - last_ticks < ADV_PWM_MIN_TICKS) {
+            // Too close to previous edge, both are done together
+            schedule->edges[schedule->edge_count - 1].set_mask |= events[i].set_mask;
+            schedule->edges[schedule->edge_count - 1].clear_mask |= events[i].clear_mask;
+            continue;
+        }
+
+        if (schedule->edge_count == 0) {
+            schedule->first_ticks = events[i].ticks;
+        } else {
+            schedule->edges[schedule->edge_count - 1].ticks = events[i].ticks - last_ticks;
+        }
+
+        schedule->edges[schedule->edge_count].set_mask = events[i].set_mask;
+        schedule->edges[schedule->edge_count].clear_mask = events[i].clear_mask;
+        schedule->edge_count++;
+        last_ticks = events[i].ticks;
+    }
+
+    if (schedule->edge_count == 0) {
+        schedule->first_ticks = period_ticks;
+    } else {
+        schedule->edges[schedule->edge_count - 1].ticks = period_ticks - last_ticks;
+    }
+}
@@ -0,0 +1,167 @@
+/*
+ * Advanced PWM Driver host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs edge schedules like FRC1 ISR does and checks on time of every channel.
+ *
+ *   make -C libs/adv_pwm/test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "adv_pwm.h"
+
+#define PERIOD_TICKS        5000    // 1 kHz
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// On ticks of each GPIO in all dither periods, same steps as ISR
+static void simulate(const adv_pwm_schedule_t *set, uint32_t *on_ticks) {
+    for (uint8_t gpio = 0; gpio < 16; gpio++) {
+        on_ticks[gpio] = 0;
+    }
+
+    for (uint8_t period = 0; period < ADV_PWM_DITHER_PERIODS; period++) {
+        const adv_pwm_schedule_t *schedule = &set[period];
+        uint16_t out = schedule->set_mask & ~schedule->clear_mask;
+        uint32_t ticks = schedule->first_ticks;
+        uint32_t total = 0;
+
+        for (uint8_t e = 0; e <= schedule->edge_count; e++) {
+            for (uint8_t gpio = 0; gpio < 16; gpio++) {
+                if (out & (1 << gpio)) {
+                    on_ticks[gpio] += ticks;
+                }
+            }
+            total += ticks;
+
+            if (e == schedule->edge_count) {
+                break;
+            }
+
+            const adv_pwm_edge_t *edge = &schedule->edges[e];
+            out = (out | edge->set_mask) & ~edge->clear_mask;
+            ticks = edge->ticks;
+
+            CHECK(ticks >= ADV_PWM_MIN_TICKS, "period %u edge %u is %u ticks", period, e, ticks);
+        }
+
+        CHECK(total == PERIOD_TICKS, "period %u lasts %u ticks", period, total);
+        CHECK(out == 0 || (out & schedule->set_mask) == out, "period %u ends with %04x on", period, out);
+    }
+}
+
+static void check_duties(const uint8_t *gpios, const uint16_t *duties, const uint8_t channel_count, const bool stagger) {
+    adv_pwm_schedule_t set[ADV_PWM_DITHER_PERIODS];
+    uint32_t total_ticks[ADV_PWM_MAX_CHANNELS];
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        total_ticks[i] = ((uint64_t) duties[i] * PERIOD_TICKS * ADV_PWM_DITHER_PERIODS) / ADV_PWM_MAX_DUTY;
+    }
+
+    for (uint8_t period = 0; period < ADV_PWM_DITHER_PERIODS; period++) {
+        adv_pwm_build_schedule(&set[period], gpios, total_ticks, channel_count, PERIOD_TICKS, stagger, period);
+    }
+
+    uint32_t on_ticks[16];
+    simulate(set, on_ticks);
+
+    for (uint8_t i = 0; i < channel_count; i++) {
+        const uint32_t expected = total_ticks[i];
+        const uint32_t got = on_ticks[gpios[i]];
+
+        if (duties[i] == 0) {
+            CHECK(got == 0, "duty 0 on for %u ticks", got);
+        } else if (duties[i] == ADV_PWM_MAX_DUTY) {
+            CHECK(got == PERIOD_TICKS * ADV_PWM_DITHER_PERIODS, "full duty on for %u ticks", got);
+        } else {
+            // Merged edges move up to ADV_PWM_MIN_TICKS, and always on channels gain the rest of period
+            const uint32_t error = abs((int32_t) got - (int32_t) expected);
+            CHECK(error <= ADV_PWM_MIN_TICKS * ADV_PWM_DITHER_PERIODS * 2,
+                  "gpio %u duty %u: %u on ticks, expected %u", gpios[i], duties[i], got, expected);
+        }
+    }
+}
+
+static void check_dither_ticks() {
+    for (uint32_t total = 0; total < PERIOD_TICKS * ADV_PWM_DITHER_PERIODS; total += 7) {
+        uint32_t sum = 0;
+        for (uint8_t period = 0; period < ADV_PWM_DITHER_PERIODS; period++) {
+            const uint32_t ticks = adv_pwm_dither_ticks(total, period);
+            CHECK(ticks == 0 || ticks >= ADV_PWM_MIN_TICKS, "total %u period %u gives %u ticks", total, period, ticks);
+            sum += ticks;
+        }
+
+        if (total >= ADV_PWM_DITHER_PERIODS * ADV_PWM_MIN_TICKS) {
+            CHECK(sum == total, "total %u dithered to %u", total, sum);
+        } else if (total > 0) {
+            // Short pulses are rounded to ADV_PWM_MIN_TICKS
+            CHECK(sum >= ADV_PWM_MIN_TICKS && sum <= total + ADV_PWM_MIN_TICKS, "total %u dithered to %u", total, sum);
+        } else {
+            CHECK(sum == 0, "total 0 dithered to %u", sum);
+        }
+    }
+}
+
+int main() {
+    const uint8_t gpios[ADV_PWM_MAX_CHANNELS] = { 4, 5, 12, 13, 14, 15, 0, 2 };
+
+    check_dither_ticks();
+
+    const uint16_t fixed[][5] = {
+        { 0, 0, 0, 0, 0 },
+        { ADV_PWM_MAX_DUTY, ADV_PWM_MAX_DUTY, ADV_PWM_MAX_DUTY, ADV_PWM_MAX_DUTY, ADV_PWM_MAX_DUTY },
+        { 1, 10, 100, 1000, 10000 },
+        { 32768, 32768, 32768, 32768, 32768 },
+        { ADV_PWM_MAX_DUTY - 1, 65000, 64000, 1, 0 },
+    };
+
+    for (uint8_t i = 0; i < sizeof(fixed) / sizeof(fixed[0]); i++) {
+        check_duties(gpios, fixed[i], 5, true);
+        check_duties(gpios, fixed[i], 5, false);
+    }
+
+    srand(1);
+    for (uint16_t n = 0; n < 5000; n++) {
+        uint16_t duties[ADV_PWM_MAX_CHANNELS];
+        const uint8_t channel_count = 1 + (rand() % ADV_PWM_MAX_CHANNELS);
+        for (uint8_t i = 0; i < channel_count; i++) {
+            duties[i] = rand() % (ADV_PWM_MAX_DUTY + 1);
+        }
+
+        check_duties(gpios, duties, channel_count, n & 1);
+    }
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("adv_pwm: all checks passed\n");
+    return 0;
+}
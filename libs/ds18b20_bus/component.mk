@@ -0,0 +1,8 @@
+# Component makefile for ds18b20_bus
+
+INC_DIRS += $(ds18b20_bus_ROOT)
+
+ds18b20_bus_INC_DIR = $(ds18b20_bus_ROOT)
+ds18b20_bus_SRC_DIR = $(ds18b20_bus_ROOT)
+
+$(eval $(call component_compile_rules,ds18b20_bus))
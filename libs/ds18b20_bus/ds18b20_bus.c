@@ -0,0 +1,160 @@
+/*
+ * DS18B20 Bus Manager
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <etstimer.h>
+#include <esplibs/libmain.h>
+#include <ds18b20/ds18b20.h>
+
+#include "ds18b20_bus.h"
+
+typedef struct _ds18b20_bus_read {
+    uint8_t index;
+    ds18b20_bus_callback_fn callback;
+    void *args;
+} ds18b20_bus_read_t;
+
+typedef struct _ds18b20_bus {
+    uint8_t gpio;
+    uint8_t sensor_count;
+    uint8_t read_count;
+    bool converting;
+    bool rescan;
+    uint16_t conversions;       // Since last search
+
+    ETSTimer timer;
+
+    ds18b20_addr_t addrs[DS18B20_BUS_MAX_SENSORS];
+    ds18b20_bus_read_t reads[DS18B20_BUS_MAX_READS];
+
+    struct _ds18b20_bus *next;
+} ds18b20_bus_t;
+
+static ds18b20_bus_t *buses = NULL;
+
+static ds18b20_bus_t *ds18b20_bus_find(const uint8_t gpio) {
+    ds18b20_bus_t *bus = buses;
+    while (bus && bus->gpio != gpio) {
+        bus = bus->next;
+    }
+
+    return bus;
+}
+
+// Calls all pending reads, with temperatures if conversion was started
+static void ds18b20_bus_finish(ds18b20_bus_t *bus, const bool converted) {
+    // Callbacks can queue new reads
+    ds18b20_bus_read_t reads[DS18B20_BUS_MAX_READS];
+    const uint8_t read_count = bus->read_count;
+    memcpy(reads, bus->reads, read_count * sizeof(ds18b20_bus_read_t));
+    bus->read_count = 0;
+    bus->converting = false;
+
+    for (uint8_t i = 0; i < read_count; i++) {
+        float temperature = 0;
+        bool result = false;
+
+        if (converted && reads[i].index < bus->sensor_count) {
+            temperature = ds18b20_read_temperature(bus->gpio, bus->addrs[reads[i].index]);
+            result = !isnan(temperature);
+        }
+
+        if (!result) {
+            bus->rescan = true;
+        }
+
+        reads[i].callback(result, temperature, reads[i].args);
+    }
+}
+
+static void ds18b20_bus_conversion_done(void *args) {
+    ds18b20_bus_finish((ds18b20_bus_t *) args, true);
+}
+
+static void ds18b20_bus_convert(ds18b20_bus_t *bus) {
+    if (bus->rescan || bus->conversions >= DS18B20_BUS_RESCAN_CONVERSIONS) {
+        const int found = ds18b20_scan_devices(bus->gpio, bus->addrs, DS18B20_BUS_MAX_SENSORS);
+        if (found < 0) {
+            bus->sensor_count = 0;
+        } else if (found > DS18B20_BUS_MAX_SENSORS) {
+            bus->sensor_count = DS18B20_BUS_MAX_SENSORS;
+        } else {
+            bus->sensor_count = found;
+        }
+
+        bus->conversions = 0;
+        bus->rescan = false;
+    }
+
+    // Convert T to all sensors, without waiting
+    if (bus->sensor_count == 0 || !ds18b20_measure(bus->gpio, DS18B20_ANY, false)) {
+        bus->rescan = true;
+        ds18b20_bus_finish(bus, false);
+        return;
+    }
+
+    bus->converting = true;
+    bus->conversions++;
+    sdk_os_timer_arm(&bus->timer, DS18B20_BUS_CONVERSION_MS, false);
+}
+
+bool ds18b20_bus_read(const uint8_t gpio, const uint8_t index, ds18b20_bus_callback_fn callback, void *args) {
+    ds18b20_bus_t *bus = ds18b20_bus_find(gpio);
+    if (!bus) {
+        bus = malloc(sizeof(ds18b20_bus_t));
+        if (!bus) {
+            return false;
+        }
+
+        memset(bus, 0, sizeof(*bus));
+        bus->gpio = gpio;
+        bus->rescan = true;
+        sdk_os_timer_setfn(&bus->timer, ds18b20_bus_conversion_done, bus);
+
+        bus->next = buses;
+        buses = bus;
+    }
+
+    if (bus->read_count == DS18B20_BUS_MAX_READS) {
+        return false;
+    }
+
+    ds18b20_bus_read_t *read = &bus->reads[bus->read_count];
+    read->index = index;
+    read->callback = callback;
+    read->args = args;
+    bus->read_count++;
+
+    if (!bus->converting) {
+        ds18b20_bus_convert(bus);
+    }
+
+    return true;
+}
+
+uint8_t ds18b20_bus_sensor_count(const uint8_t gpio) {
+    ds18b20_bus_t *bus = ds18b20_bus_find(gpio);
+    if (bus) {
+        return bus->sensor_count;
+    }
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * DS18B20 Bus Manager
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Shared 1-Wire buses with DS18B20 sensors.
+ *
+ * ROM codes are found once and cached, and searched again after
+ * DS18B20_BUS_RESCAN_CONVERSIONS conversions or after any error. Every
+ * conversion is started for all sensors of the bus with one broadcast command
+ * and results are read by a timer when it ends, so nothing waits 750 ms.
+ *
+ * Reads requested while a conversion is running get its result, so several
+ * accessories on same bus share conversions. Sensor index is position in
+ * search order, which depends only on ROM codes.
+ */
+
+#ifndef __DS18B20_BUS_H__
+#define __DS18B20_BUS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef DS18B20_BUS_MAX_SENSORS
+#define DS18B20_BUS_MAX_SENSORS         8
+#endif
+
+#define DS18B20_BUS_MAX_READS           8       // Pending reads per bus
+#define DS18B20_BUS_CONVERSION_MS       760     // 12 bits resolution needs 750 ms
+#define DS18B20_BUS_RESCAN_CONVERSIONS  100
+
+// Called from timer context, or before ds18b20_bus_read() returns if bus does not answer
+typedef void (*ds18b20_bus_callback_fn)(bool result, float temperature, void *args);
+
+// Returns false if read could not be queued
+bool ds18b20_bus_read(const uint8_t gpio, const uint8_t index, ds18b20_bus_callback_fn callback, void *args);
+
+// Sensors found by last search, 0 if bus is not used yet
+uint8_t ds18b20_bus_sensor_count(const uint8_t gpio);
+
+#endif  // __DS18B20_BUS_H__
@@ -0,0 +1,2 @@
+// Host stand-in, see ds18b20_bus_sim.h
+#include "ds18b20_bus_sim.h"
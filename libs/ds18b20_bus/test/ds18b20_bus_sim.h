@@ -0,0 +1,32 @@
+// Host stand-ins for the SDK timer and ds18b20 driver calls used by ds18b20_bus.c. Stub headers
+// in this directory include it, ds18b20_bus_test.c implements it with a virtual millisecond clock
+// and a fake 1-Wire bus
+
+#ifndef __DS18B20_BUS_SIM_H__
+#define __DS18B20_BUS_SIM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (ETSTimerFunc)(void *arg);
+
+typedef struct _ETSTimer {
+    ETSTimerFunc *fn;
+    void *arg;
+    bool armed;
+    uint32_t expire_ms;
+} ETSTimer;
+
+void sdk_os_timer_setfn(ETSTimer *timer, ETSTimerFunc *fn, void *arg);
+void sdk_os_timer_arm(ETSTimer *timer, uint32_t ms, bool repeat);
+void sdk_os_timer_disarm(ETSTimer *timer);
+
+typedef uint64_t ds18b20_addr_t;
+
+#define DS18B20_ANY                     ((ds18b20_addr_t) 0xffffffffffffffffLL)
+
+int ds18b20_scan_devices(int pin, ds18b20_addr_t *addr_list, int addr_count);
+bool ds18b20_measure(int pin, ds18b20_addr_t addr, bool wait);
+float ds18b20_read_temperature(int pin, ds18b20_addr_t addr);
+
+#endif  // __DS18B20_BUS_SIM_H__
@@ -0,0 +1,378 @@
+/*
+ * DS18B20 Bus Manager host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Runs ds18b20_bus.c against a simulated clock, timers and 1-Wire buses,
+ * and checks when buses are searched, when conversions are started, and
+ * which reads get which results. It is included, so its static state can be
+ * checked too.
+ *
+ *   make -C libs/ds18b20_bus/test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ds18b20_bus.c"
+
+#define MAX_TIMERS          4
+#define MAX_RESULTS         32
+
+#define GPIO_A              4
+#define GPIO_B              5
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// --- Simulation
+static uint32_t now_ms = 0;
+
+static ETSTimer *timers[MAX_TIMERS];
+static uint8_t timer_count = 0;
+
+static int8_t timer_find(ETSTimer *timer) {
+    for (uint8_t i = 0; i < timer_count; i++) {
+        if (timers[i] == timer) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void sdk_os_timer_setfn(ETSTimer *timer, ETSTimerFunc *fn, void *arg) {
+    CHECK(timer_find(timer) < 0, "setfn on armed timer");
+    timer->fn = fn;
+    timer->arg = arg;
+}
+
+void sdk_os_timer_arm(ETSTimer *timer, uint32_t ms, bool repeat) {
+    CHECK(!repeat, "conversion timer repeats");
+    CHECK(timer_find(timer) < 0, "conversion timer armed twice");
+
+    timer->armed = true;
+    timer->expire_ms = now_ms + ms;
+    if (timer_find(timer) < 0 && timer_count < MAX_TIMERS) {
+        timers[timer_count++] = timer;
+    }
+}
+
+void sdk_os_timer_disarm(ETSTimer *timer) {
+    const int8_t i = timer_find(timer);
+    if (i >= 0) {
+        timers[i] = timers[--timer_count];
+    }
+
+    timer->armed = false;
+}
+
+static void run_ms(const uint32_t ms) {
+    const uint32_t end_ms = now_ms + ms;
+
+    while (now_ms < end_ms) {
+        now_ms++;
+
+        // Callbacks can arm timers again, so list is searched from start after each one
+        bool fired = true;
+        while (fired) {
+            fired = false;
+            for (uint8_t i = 0; i < timer_count && !fired; i++) {
+                ETSTimer *timer = timers[i];
+                if (timer->expire_ms <= now_ms) {
+                    sdk_os_timer_disarm(timer);
+                    timer->fn(timer->arg);
+                    fired = true;
+                }
+            }
+        }
+    }
+}
+
+// Fake 1-Wire bus, one per GPIO
+typedef struct _fake_bus {
+    uint8_t sensor_count;
+    ds18b20_addr_t addrs[DS18B20_BUS_MAX_SENSORS + 2];
+    float temperatures[DS18B20_BUS_MAX_SENSORS + 2];
+    bool fail_measure;
+    bool fail_read;
+
+    uint16_t scans;
+    uint16_t measures;
+    uint16_t reads;
+    uint32_t measure_ms;        // Last conversion start
+} fake_bus_t;
+
+static fake_bus_t fake_buses[16];
+
+int ds18b20_scan_devices(int pin, ds18b20_addr_t *addr_list, int addr_count) {
+    fake_bus_t *fake = &fake_buses[pin];
+    fake->scans++;
+
+    // Like onewire search, it counts every device but only stores first ones
+    for (uint8_t i = 0; i < fake->sensor_count && i < addr_count; i++) {
+        addr_list[i] = fake->addrs[i];
+    }
+
+    return fake->sensor_count;
+}
+
+bool ds18b20_measure(int pin, ds18b20_addr_t addr, bool wait) {
+    fake_bus_t *fake = &fake_buses[pin];
+    CHECK(addr == DS18B20_ANY, "conversion not broadcast");
+    CHECK(!wait, "conversion waits");
+
+    fake->measures++;
+    fake->measure_ms = now_ms;
+
+    return fake->sensor_count > 0 && !fake->fail_measure;
+}
+
+float ds18b20_read_temperature(int pin, ds18b20_addr_t addr) {
+    fake_bus_t *fake = &fake_buses[pin];
+    fake->reads++;
+    CHECK(now_ms - fake->measure_ms >= 750, "read %u ms after conversion start", now_ms - fake->measure_ms);
+
+    if (!fake->fail_read) {
+        for (uint8_t i = 0; i < fake->sensor_count; i++) {
+            if (fake->addrs[i] == addr) {
+                return fake->temperatures[i];
+            }
+        }
+    }
+
+    return NAN;
+}
+
+static void fake_bus_setup(const uint8_t gpio, const uint8_t sensor_count) {
+    fake_bus_t *fake = &fake_buses[gpio];
+    memset(fake, 0, sizeof(*fake));
+    fake->sensor_count = sensor_count;
+    for (uint8_t i = 0; i < sensor_count; i++) {
+        fake->addrs[i] = 0x2800000000000028ULL | ((uint64_t) (gpio * 16 + i) << 8);
+        fake->temperatures[i] = 20.0f + gpio + i / 4.0f;
+    }
+}
+
+// Read results, in callback order
+typedef struct _result {
+    bool result;
+    float temperature;
+    uint8_t id;
+    uint32_t ms;
+} result_t;
+
+static result_t results[MAX_RESULTS];
+static uint8_t result_count = 0;
+
+static void read_callback(bool result, float temperature, void *args) {
+    if (result_count < MAX_RESULTS) {
+        results[result_count].result = result;
+        results[result_count].temperature = temperature;
+        results[result_count].id = (uintptr_t) args;
+        results[result_count].ms = now_ms;
+        result_count++;
+    }
+}
+
+static bool bus_read(const uint8_t gpio, const uint8_t index, const uint8_t id) {
+    return ds18b20_bus_read(gpio, index, read_callback, (void *) (uintptr_t) id);
+}
+
+static float expected_temperature(const uint8_t gpio, const uint8_t index) {
+    return fake_buses[gpio].temperatures[index];
+}
+
+// --- Checks
+static void check_shared_conversion() {
+    fake_bus_setup(GPIO_A, 3);
+    result_count = 0;
+
+    // First read searches bus once and starts one conversion, nothing is called yet
+    CHECK(bus_read(GPIO_A, 0, 1), "first read");
+    CHECK(fake_buses[GPIO_A].scans == 1 && fake_buses[GPIO_A].measures == 1, "first read: %u scans, %u conversions",
+          fake_buses[GPIO_A].scans, fake_buses[GPIO_A].measures);
+    CHECK(ds18b20_bus_sensor_count(GPIO_A) == 3, "sensor count %u", ds18b20_bus_sensor_count(GPIO_A));
+    CHECK(result_count == 0, "result before conversion ends");
+
+    // Reads while converting share it
+    run_ms(300);
+    CHECK(bus_read(GPIO_A, 2, 2) && bus_read(GPIO_A, 1, 3), "reads while converting");
+    CHECK(fake_buses[GPIO_A].scans == 1 && fake_buses[GPIO_A].measures == 1, "shared: %u scans, %u conversions",
+          fake_buses[GPIO_A].scans, fake_buses[GPIO_A].measures);
+
+    run_ms(DS18B20_BUS_CONVERSION_MS - 300 - 1);
+    CHECK(result_count == 0, "result before %u ms", DS18B20_BUS_CONVERSION_MS);
+    run_ms(1);
+
+    CHECK(result_count == 3, "%u results from shared conversion", result_count);
+    const uint8_t indexes[] = { 0, 2, 1 };
+    for (uint8_t i = 0; i < result_count; i++) {
+        CHECK(results[i].id == i + 1 && results[i].result && results[i].temperature == expected_temperature(GPIO_A, indexes[i]),
+              "result %u: id %u, %i, %.2f", i, results[i].id, results[i].result, results[i].temperature);
+    }
+    CHECK(fake_buses[GPIO_A].reads == 3, "%u scratchpad reads", fake_buses[GPIO_A].reads);
+
+    // Next read uses cached ROM codes
+    result_count = 0;
+    CHECK(bus_read(GPIO_A, 1, 4), "second conversion read");
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(fake_buses[GPIO_A].scans == 1 && fake_buses[GPIO_A].measures == 2, "second: %u scans, %u conversions",
+          fake_buses[GPIO_A].scans, fake_buses[GPIO_A].measures);
+    CHECK(result_count == 1 && results[0].result && results[0].temperature == expected_temperature(GPIO_A, 1), "second conversion result");
+}
+
+static void check_rescan() {
+    // Bus searched again after DS18B20_BUS_RESCAN_CONVERSIONS conversions
+    const uint16_t scans = fake_buses[GPIO_A].scans;
+    const uint16_t measures = fake_buses[GPIO_A].measures;
+    const uint16_t conversions = ds18b20_bus_find(GPIO_A)->conversions;
+    for (uint16_t i = conversions; i < DS18B20_BUS_RESCAN_CONVERSIONS; i++) {
+        bus_read(GPIO_A, 0, 5);
+        run_ms(DS18B20_BUS_CONVERSION_MS);
+    }
+    CHECK(fake_buses[GPIO_A].scans == scans, "searched before %u conversions", DS18B20_BUS_RESCAN_CONVERSIONS);
+
+    bus_read(GPIO_A, 0, 5);
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(fake_buses[GPIO_A].scans == scans + 1, "not searched after %u conversions", DS18B20_BUS_RESCAN_CONVERSIONS);
+    CHECK(fake_buses[GPIO_A].measures == measures + DS18B20_BUS_RESCAN_CONVERSIONS - conversions + 1, "conversions %u",
+          fake_buses[GPIO_A].measures - measures);
+
+    // Failed read makes next conversion search bus again, and a new sensor is found
+    result_count = 0;
+    fake_buses[GPIO_A].fail_read = true;
+    bus_read(GPIO_A, 0, 6);
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(result_count == 1 && !results[0].result, "failed read result");
+
+    fake_buses[GPIO_A].fail_read = false;
+    fake_buses[GPIO_A].sensor_count = 4;
+    fake_buses[GPIO_A].addrs[3] = 0x2800000000004428ULL;
+    fake_buses[GPIO_A].temperatures[3] = -5.5f;
+
+    result_count = 0;
+    bus_read(GPIO_A, 3, 7);
+    CHECK(fake_buses[GPIO_A].scans == scans + 2, "not searched after failed read");
+    CHECK(ds18b20_bus_sensor_count(GPIO_A) == 4, "new sensor not found");
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(result_count == 1 && results[0].result && results[0].temperature == -5.5f, "new sensor result");
+
+    // Index out of bus fails, and bus is searched again
+    result_count = 0;
+    bus_read(GPIO_A, 6, 8);
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(result_count == 1 && !results[0].result, "index out of bus");
+    CHECK(ds18b20_bus_find(GPIO_A)->rescan, "index out of bus does not search again");
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+}
+
+static void check_errors() {
+    // Empty bus answers at once, without conversion timer
+    fake_bus_setup(GPIO_B, 0);
+    result_count = 0;
+    CHECK(bus_read(GPIO_B, 0, 10), "empty bus read");
+    CHECK(result_count == 1 && !results[0].result, "empty bus result");
+    CHECK(fake_buses[GPIO_B].scans == 1 && fake_buses[GPIO_B].measures == 0, "empty bus: %u scans, %u conversions",
+          fake_buses[GPIO_B].scans, fake_buses[GPIO_B].measures);
+    CHECK(!ds18b20_bus_find(GPIO_B)->converting && ds18b20_bus_find(GPIO_B)->rescan, "empty bus state");
+
+    // Sensor plugged later is found by next read
+    fake_bus_setup(GPIO_B, 1);
+    result_count = 0;
+    bus_read(GPIO_B, 0, 11);
+    CHECK(fake_buses[GPIO_B].scans == 1 && fake_buses[GPIO_B].measures == 1, "plugged: %u scans, %u conversions",
+          fake_buses[GPIO_B].scans, fake_buses[GPIO_B].measures);
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(result_count == 1 && results[0].result && results[0].temperature == expected_temperature(GPIO_B, 0), "plugged result");
+
+    // Conversion command not answered
+    result_count = 0;
+    fake_buses[GPIO_B].fail_measure = true;
+    bus_read(GPIO_B, 0, 12);
+    CHECK(result_count == 1 && !results[0].result, "failed conversion result");
+    CHECK(fake_buses[GPIO_B].reads == 1, "scratchpad read after failed conversion");
+    fake_buses[GPIO_B].fail_measure = false;
+
+    // More sensors than DS18B20_BUS_MAX_SENSORS
+    fake_bus_setup(GPIO_B, DS18B20_BUS_MAX_SENSORS + 2);
+    bus_read(GPIO_B, 0, 13);
+    CHECK(ds18b20_bus_sensor_count(GPIO_B) == DS18B20_BUS_MAX_SENSORS, "sensor count %u", ds18b20_bus_sensor_count(GPIO_B));
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+
+    // Pending reads are limited per bus
+    result_count = 0;
+    for (uint8_t i = 0; i < DS18B20_BUS_MAX_READS; i++) {
+        CHECK(bus_read(GPIO_B, i, 20 + i), "read %u not queued", i);
+    }
+    CHECK(!bus_read(GPIO_B, 0, 30), "read over DS18B20_BUS_MAX_READS queued");
+    run_ms(DS18B20_BUS_CONVERSION_MS);
+    CHECK(result_count == DS18B20_BUS_MAX_READS, "%u results of full queue", result_count);
+
+    CHECK(ds18b20_bus_sensor_count(GPIO_B + 1) == 0, "unused bus sensor count");
+}
+
+// Read queued from its own callback starts a new conversion
+static uint8_t chained_reads = 0;
+
+static void chained_callback(bool result, float temperature, void *args) {
+    read_callback(result, temperature, args);
+    if (++chained_reads < 3) {
+        CHECK(ds18b20_bus_read(GPIO_A, 0, chained_callback, args), "chained read");
+    }
+}
+
+static void check_chained_reads() {
+    result_count = 0;
+    const uint16_t measures = fake_buses[GPIO_A].measures;
+    const uint16_t measures_b = fake_buses[GPIO_B].measures;
+
+    ds18b20_bus_read(GPIO_A, 0, chained_callback, (void *) 40);
+    bus_read(GPIO_B, 1, 41);
+    run_ms(DS18B20_BUS_CONVERSION_MS * 3);
+
+    CHECK(result_count == 4, "%u chained results", result_count);
+    CHECK(fake_buses[GPIO_A].measures == measures + 3, "%u chained conversions", fake_buses[GPIO_A].measures - measures);
+    CHECK(fake_buses[GPIO_B].measures == measures_b + 1, "other bus %u conversions", fake_buses[GPIO_B].measures - measures_b);
+    for (uint8_t i = 1; i < result_count; i++) {
+        CHECK(results[i].ms >= results[i - 1].ms, "results out of order");
+    }
+    CHECK(!ds18b20_bus_find(GPIO_A)->converting && ds18b20_bus_find(GPIO_A)->read_count == 0, "bus A idle");
+}
+
+int main() {
+    check_shared_conversion();
+    check_rescan();
+    check_errors();
+    check_chained_reads();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("ds18b20_bus: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Component makefile for heap_stats
+
+INC_DIRS += $(heap_stats_ROOT)
+
+heap_stats_INC_DIR = $(heap_stats_ROOT)
+heap_stats_SRC_DIR = $(heap_stats_ROOT)
+
+$(eval $(call component_compile_rules,heap_stats))
@@ -0,0 +1,268 @@
+/*
+ * Heap Stats Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef HEAP_STATS
+
+#include <stdio.h>
+#include <malloc.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "heap_stats.h"
+
+#define HEAP_STATS_MAGIC            (0x48A5C31E)
+#define HEAP_STATS_SIZE_MASK        (0x00FFFFFF)
+
+// Keeps 8 bytes alignment of returned blocks
+typedef struct _heap_stats_header {
+    uint32_t tag_size;              // Tag in high byte, block size with header in the rest
+    uint32_t check;                 // HEAP_STATS_MAGIC ^ tag_size
+} heap_stats_header_t;
+
+static const char *tag_names[HEAP_STATS_TAG_COUNT] = {
+    "accessories",
+    "actions",
+    "cjson",
+    "homekit",
+    "mdns"
+};
+
+static heap_stats_tag_info_t tag_info[HEAP_STATS_TAG_COUNT];
+static uint32_t min_free_heap = UINT32_MAX;
+
+static void heap_stats_failed(const uint8_t tag, const size_t size) {
+    taskENTER_CRITICAL();
+    tag_info[tag].failed++;
+    taskEXIT_CRITICAL();
+
+    printf("! Heap: %s alloc %u failed\n", tag_names[tag], size);
+    heap_stats_print();
+}
+
+static void heap_stats_add(const uint8_t tag, const uint32_t size) {
+    taskENTER_CRITICAL();
+    tag_info[tag].current += size;
+    tag_info[tag].blocks++;
+    if (tag_info[tag].current > tag_info[tag].peak) {
+        tag_info[tag].peak = tag_info[tag].current;
+    }
+    taskEXIT_CRITICAL();
+}
+
+static void heap_stats_remove(const uint8_t tag, const uint32_t size) {
+    taskENTER_CRITICAL();
+    tag_info[tag].current -= size;
+    tag_info[tag].blocks--;
+    taskEXIT_CRITICAL();
+}
+
+// Returns header if ptr was allocated by this library
+static heap_stats_header_t *heap_stats_header(void *ptr) {
+    heap_stats_header_t *header = ((heap_stats_header_t *) ptr) - 1;
+    if (header->check == (HEAP_STATS_MAGIC ^ header->tag_size) &&
+        (header->tag_size >> 24) < HEAP_STATS_TAG_COUNT) {
+        return header;
+    }
+
+    return NULL;
+}
+
+static void *heap_stats_set_header(heap_stats_header_t *header, const uint8_t tag, const size_t total_size) {
+    header->tag_size = (tag << 24) | total_size;
+    header->check = HEAP_STATS_MAGIC ^ header->tag_size;
+    heap_stats_add(tag, total_size);
+
+    return header + 1;
+}
+
+void *heap_stats_malloc(const uint8_t tag, size_t size) {
+    const size_t total_size = size + sizeof(heap_stats_header_t);
+    if (tag >= HEAP_STATS_TAG_COUNT || total_size > HEAP_STATS_SIZE_MASK) {
+        return NULL;
+    }
+
+    heap_stats_header_t *header = malloc(total_size);
+    if (!header) {
+        heap_stats_failed(tag, size);
+        return NULL;
+    }
+
+    return heap_stats_set_header(header, tag, total_size);
+}
+
+void *heap_stats_calloc(const uint8_t tag, size_t count, size_t size) {
+    if (size && count > HEAP_STATS_SIZE_MASK / size) {
+        return NULL;
+    }
+
+    void *ptr = heap_stats_malloc(tag, count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+
+    return ptr;
+}
+
+void *heap_stats_realloc(const uint8_t tag, void *ptr, size_t size) {
+    if (!ptr) {
+        return heap_stats_malloc(tag, size);
+    }
+
+    heap_stats_header_t *header = heap_stats_header(ptr);
+    if (!header) {
+        return realloc(ptr, size);
+    }
+
+    const uint8_t block_tag = header->tag_size >> 24;
+    const uint32_t old_size = header->tag_size & HEAP_STATS_SIZE_MASK;
+    const size_t total_size = size + sizeof(heap_stats_header_t);
+    if (total_size > HEAP_STATS_SIZE_MASK) {
+        return NULL;
+    }
+
+    heap_stats_header_t *new_header = realloc(header, total_size);
+    if (!new_header) {
+        heap_stats_failed(block_tag, size);
+        return NULL;
+    }
+
+    heap_stats_remove(block_tag, old_size);
+
+    return heap_stats_set_header(new_header, block_tag, total_size);
+}
+
+char *heap_stats_strdup(const uint8_t tag, const char *s) {
+    const size_t len = strlen(s);
+    char *d = heap_stats_malloc(tag, len + 1);
+    if (d) {
+        memcpy(d, s, len + 1);
+    }
+
+    return d;
+}
+
+char *heap_stats_strndup(const uint8_t tag, const char *s, size_t n) {
+    const size_t len = strnlen(s, n);
+    char *d = heap_stats_malloc(tag, len + 1);
+    if (d) {
+        memcpy(d, s, len);
+        d[len] = 0;
+    }
+
+    return d;
+}
+
+void heap_stats_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    heap_stats_header_t *header = heap_stats_header(ptr);
+    if (!header) {
+        free(ptr);
+        return;
+    }
+
+    heap_stats_remove(header->tag_size >> 24, header->tag_size & HEAP_STATS_SIZE_MASK);
+    header->check = 0;
+    free(header);
+}
+
+void *heap_stats_cjson_malloc(size_t size) {
+    return heap_stats_malloc(HEAP_STATS_CJSON, size);
+}
+
+void heap_stats_cjson_free(void *ptr) {
+    heap_stats_free(ptr);
+}
+
+const char *heap_stats_tag_name(const uint8_t tag) {
+    if (tag < HEAP_STATS_TAG_COUNT) {
+        return tag_names[tag];
+    }
+
+    return "unknown";
+}
+
+void heap_stats_get(heap_stats_t *stats) {
+    taskENTER_CRITICAL();
+    memcpy(stats->tag, tag_info, sizeof(tag_info));
+    taskEXIT_CRITICAL();
+
+    // xPortGetFreeHeapSize() is free space in malloc arena plus unused space over it.
+    // Top chunk of arena (keepcost) is contiguous with that unused space.
+    struct mallinfo mi = mallinfo();
+    stats->free_heap = xPortGetFreeHeapSize();
+    stats->largest_free_block = stats->free_heap - mi.fordblks + mi.keepcost;
+    if (stats->largest_free_block > stats->free_heap) {
+        stats->largest_free_block = stats->free_heap;
+    }
+
+    stats->fragmentation = 0;
+    if (stats->free_heap > 0) {
+        stats->fragmentation = 100 - ((uint64_t) stats->largest_free_block * 100 / stats->free_heap);
+    }
+
+    if (stats->free_heap < min_free_heap) {
+        min_free_heap = stats->free_heap;
+    }
+    stats->min_free_heap = min_free_heap;
+}
+
+void heap_stats_print() {
+    heap_stats_t stats;
+    heap_stats_get(&stats);
+
+    printf("Heap: free %u, min %u, largest %u, frag %u%%\n",
+           stats.free_heap, stats.min_free_heap, stats.largest_free_block, stats.fragmentation);
+
+    for (uint8_t i = 0; i < HEAP_STATS_TAG_COUNT; i++) {
+        if (stats.tag[i].peak > 0 || stats.tag[i].failed > 0) {
+            printf("Heap %-11s %6u, peak %6u, %u blocks, %u failed\n", tag_names[i],
+                   stats.tag[i].current, stats.tag[i].peak, stats.tag[i].blocks, stats.tag[i].failed);
+        }
+    }
+}
+
+int heap_stats_json(char *buffer, const size_t buffer_size) {
+    heap_stats_t stats;
+    heap_stats_get(&stats);
+
+    int len = snprintf(buffer, buffer_size,
+                       "{\"free\":%u,\"min_free\":%u,\"largest\":%u,\"frag\":%u,\"tags\":{",
+                       stats.free_heap, stats.min_free_heap, stats.largest_free_block, stats.fragmentation);
+
+    for (uint8_t i = 0; i < HEAP_STATS_TAG_COUNT && len < buffer_size; i++) {
+        len += snprintf(buffer + len, buffer_size - len,
+                        "%s\"%s\":{\"cur\":%u,\"peak\":%u,\"blocks\":%u,\"failed\":%u}",
+                        i == 0 ? "" : ",", tag_names[i],
+                        stats.tag[i].current, stats.tag[i].peak, stats.tag[i].blocks, stats.tag[i].failed);
+    }
+
+    if (len < buffer_size) {
+        len += snprintf(buffer + len, buffer_size - len, "}}");
+    }
+
+    if (len >= buffer_size) {
+        len = buffer_size - 1;
+    }
+
+    return len;
+}
+
+#endif  // HEAP_STATS
@@ -0,0 +1,87 @@
+/*
+ * Heap Stats Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per subsystem heap accounting. Only built with -DHEAP_STATS.
+ *
+ * A source file defines HEAP_STATS_TAG and includes this header after all
+ * other headers, so its malloc(), calloc(), realloc(), strdup(), strndup()
+ * and free() calls are counted under that tag. Each tagged block carries
+ * an 8 bytes header. Blocks from untagged code can be freed with tagged
+ * free() and the other way around is not allowed.
+ */
+
+#ifndef __HEAP_STATS_H__
+#define __HEAP_STATS_H__
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef enum {
+    HEAP_STATS_ACCESSORIES = 0,
+    HEAP_STATS_ACTIONS,
+    HEAP_STATS_CJSON,
+    HEAP_STATS_HOMEKIT,
+    HEAP_STATS_MDNS,
+    HEAP_STATS_TAG_COUNT
+} heap_stats_tag_t;
+
+typedef struct _heap_stats_tag_info {
+    uint32_t current;               // Bytes in use, headers included
+    uint32_t peak;
+    uint16_t blocks;
+    uint16_t failed;                // Failed allocations
+} heap_stats_tag_info_t;
+
+typedef struct _heap_stats {
+    heap_stats_tag_info_t tag[HEAP_STATS_TAG_COUNT];
+    uint32_t free_heap;
+    uint32_t min_free_heap;         // Lowest seen by heap_stats_get() and failed allocations
+    uint32_t largest_free_block;    // Contiguous free space at top of heap, a lower bound
+    uint8_t fragmentation;          // % of free heap not in largest_free_block
+} heap_stats_t;
+
+void *heap_stats_malloc(const uint8_t tag, size_t size);
+void *heap_stats_calloc(const uint8_t tag, size_t count, size_t size);
+void *heap_stats_realloc(const uint8_t tag, void *ptr, size_t size);
+char *heap_stats_strdup(const uint8_t tag, const char *s);
+char *heap_stats_strndup(const uint8_t tag, const char *s, size_t n);
+void heap_stats_free(void *ptr);
+
+// Wrappers for cJSON_InitHooks()
+void *heap_stats_cjson_malloc(size_t size);
+void heap_stats_cjson_free(void *ptr);
+
+const char *heap_stats_tag_name(const uint8_t tag);
+void heap_stats_get(heap_stats_t *stats);
+void heap_stats_print();
+
+// Writes stats as JSON into buffer, returns length
+int heap_stats_json(char *buffer, const size_t buffer_size);
+
+#ifdef HEAP_STATS_TAG
+#define malloc(size)            heap_stats_malloc(HEAP_STATS_TAG, size)
+#define calloc(count, size)     heap_stats_calloc(HEAP_STATS_TAG, count, size)
+#define realloc(ptr, size)      heap_stats_realloc(HEAP_STATS_TAG, ptr, size)
+#define strdup(s)               heap_stats_strdup(HEAP_STATS_TAG, s)
+#define strndup(s, n)           heap_stats_strndup(HEAP_STATS_TAG, s, n)
+#define free(ptr)               heap_stats_free(ptr)
+#endif  // HEAP_STATS_TAG
+
+#endif  // __HEAP_STATS_H__
@@ -0,0 +1,8 @@
+# Component makefile for ir_tx
+
+INC_DIRS += $(ir_tx_ROOT)
+
+ir_tx_INC_DIR = $(ir_tx_ROOT)
+ir_tx_SRC_DIR = $(ir_tx_ROOT)
+
+$(eval $(call component_compile_rules,ir_tx))
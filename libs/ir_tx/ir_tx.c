@@ -0,0 +1,123 @@
+/*
+ * IR Transmitter Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <common_macros.h>
+#include <esp/gpio.h>
+#include <esp/timer.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "ir_tx.h"
+
+static ir_tx_wave_t wave;
+static uint8_t tx_gpio;
+static bool tx_inverted;
+static uint32_t load_ticks;
+static TaskHandle_t tx_task = NULL;
+static volatile bool running = false;
+
+static IRAM void ir_tx_isr(void *arg) {
+    bool level;
+    const uint32_t ticks = ir_tx_wave_next(&wave, &level);
+
+    gpio_write(tx_gpio, level ^ tx_inverted);
+
+    if (ticks == 0) {
+        timer_set_interrupts(FRC1, false);
+        timer_set_run(FRC1, false);
+
+        BaseType_t task_woken = pdFALSE;
+        vTaskNotifyGiveFromISR(tx_task, &task_woken);
+        portEND_SWITCHING_ISR(task_woken);
+
+    } else if (ticks != load_ticks) {
+        // Carrier half periods are reloaded by timer itself
+        load_ticks = ticks;
+        timer_set_load(FRC1, ticks);
+    }
+}
+
+bool ir_tx_sending() {
+    return running;
+}
+
+int ir_tx_send(const uint8_t gpio, const bool inverted, const uint16_t *code, const uint16_t len, const uint8_t half_period_us, const uint8_t repeats, const uint16_t pause_us) {
+    // FRC1 is running if adv_pwm or profiler are using it
+    taskENTER_CRITICAL();
+    const bool busy = running || timer_get_run(FRC1);
+    if (!busy) {
+        running = true;
+    }
+    taskEXIT_CRITICAL();
+
+    if (busy) {
+        return -1;
+    }
+
+    ir_tx_wave_init(&wave, code, len, half_period_us, repeats, pause_us);
+
+    bool level;
+    const uint32_t ticks = ir_tx_wave_next(&wave, &level);
+    if (ticks == 0) {
+        // Nothing to send
+        running = false;
+        return 0;
+    }
+
+    tx_gpio = gpio;
+    tx_inverted = inverted;
+    load_ticks = ticks;
+    tx_task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    // Checked again with timer start, so profiler can not take FRC1 in between
+    taskENTER_CRITICAL();
+    if (timer_get_run(FRC1)) {
+        running = false;
+        taskEXIT_CRITICAL();
+        return -1;
+    }
+
+    timer_set_interrupts(FRC1, false);
+
+    _xt_isr_attach(INUM_TIMER_FRC1, ir_tx_isr, NULL);
+    timer_set_divider(FRC1, TIMER_CLKDIV_16);
+    timer_set_reload(FRC1, true);
+
+    gpio_write(tx_gpio, level ^ tx_inverted);
+    timer_set_load(FRC1, ticks);
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+    taskEXIT_CRITICAL();
+
+    const uint32_t timeout_ms = ir_tx_code_duration_ms(code, len, repeats, pause_us) + IR_TX_TIMEOUT_MARGIN_MS;
+
+    int result = 0;
+    if (ulTaskNotifyTake(pdTRUE, (timeout_ms / portTICK_PERIOD_MS) + 1) == 0) {
+        // ISR did not finish, so it is detached by masking FRC1 interrupt, and output is left off
+        timer_set_interrupts(FRC1, false);
+        timer_set_run(FRC1, false);
+        gpio_write(tx_gpio, tx_inverted);
+        result = -2;
+    }
+
+    running = false;
+
+    return result;
+}
@@ -0,0 +1,87 @@
+/*
+ * IR Transmitter Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * IR codes sent by FRC1 timer interrupt, without busy waiting.
+ *
+ * A code is a list of mark and space durations in microseconds, starting with
+ * a mark. Edges are placed on an absolute timeline from transmission start:
+ * during marks, carrier cycles start every carrier period and last one is cut
+ * at mark end, and spaces have no edges. So rounding never accumulates.
+ *
+ * Timer runs with auto reload at carrier half period, so ISR latency only
+ * delays an edge when interval changes, at mark and space boundaries.
+ * Repeats are separated by pause microseconds, also timed by ISR.
+ *
+ * Edge schedule does not access hardware, so it can be built and checked on
+ * host with test/ir_tx_wave_test.c.
+ *
+ * FRC1 is also used by adv_pwm and profiler, none of them can run at the same
+ * time. Codes are not sent while FRC1 is running, and profiler does not start
+ * while a code is being sent.
+ */
+
+#ifndef __IR_TX_H__
+#define __IR_TX_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IR_TX_TICKS_PER_US          5       // FRC1 with divider 16
+#define IR_TX_DEFAULT_PAUSE         100000  // us between repeats when pause is 0
+#define IR_TX_TIMEOUT_MARGIN_MS     500     // Added to code duration
+
+typedef struct _ir_tx_wave {
+    const uint16_t *code;
+    uint16_t len;
+    uint16_t index;                 // Current mark or space
+    uint8_t repeats;                // Left, current one included
+    bool carrier_on;
+
+    uint32_t half_ticks;            // Carrier half period
+    uint32_t pause_ticks;
+    uint32_t segment_start;         // Ticks from transmission start
+    uint32_t cycle_start;           // Next carrier cycle, ticks from transmission start
+
+    bool has_pending;
+    bool pending_level;
+    uint32_t pending_time;          // Next edge, ticks from transmission start
+
+    bool has_following;
+    bool following_level;
+    uint32_t following_time;        // Edge after next one, to merge edges at same time
+} ir_tx_wave_t;
+
+// half_period_us is half carrier period, 13 for 38 kHz
+void ir_tx_wave_init(ir_tx_wave_t *wave, const uint16_t *code, const uint16_t len, const uint8_t half_period_us, const uint8_t repeats, const uint16_t pause_us);
+
+// Sets level of next edge, and returns ticks from it to following one, or 0 if it was last edge
+uint32_t ir_tx_wave_next(ir_tx_wave_t *wave, bool *level);
+
+// Whole transmission, repeats and pauses between them included
+uint32_t ir_tx_code_duration_ms(const uint16_t *code, const uint16_t len, const uint8_t repeats, const uint16_t pause_us);
+
+// True while a code is being sent
+bool ir_tx_sending();
+
+// Blocks calling task until code is sent. Returns 0 if sent, -1 if FRC1 is busy,
+// or -2 if code was not completed in time, as when FRC1 was taken by other driver
+int ir_tx_send(const uint8_t gpio, const bool inverted, const uint16_t *code, const uint16_t len, const uint8_t half_period_us, const uint8_t repeats, const uint16_t pause_us);
+
+#endif  // __IR_TX_H__
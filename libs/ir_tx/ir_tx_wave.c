@@ -0,0 +1,145 @@
+/*
+ * IR Transmitter Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef IRAM
+#include <common_macros.h>
+#endif
+
+#include "ir_tx.h"
+
+// Computes next edge time and level, returns false when there are no more edges
+static IRAM bool ir_tx_wave_edge(ir_tx_wave_t *wave, uint32_t *time, bool *level) {
+    while (wave->repeats > 0) {
+        if (wave->index == wave->len) {
+            wave->repeats--;
+            wave->index = 0;
+            wave->segment_start += wave->pause_ticks;
+            wave->cycle_start = wave->segment_start;
+            continue;
+        }
+
+        const uint32_t segment_end = wave->segment_start + (wave->code[wave->index] * IR_TX_TICKS_PER_US);
+
+        if ((wave->index & 1) == 0) {   // Mark
+            if (wave->carrier_on) {
+                *time = wave->cycle_start + wave->half_ticks;
+                if (*time > segment_end) {
+                    *time = segment_end;
+                }
+
+                *level = false;
+                wave->carrier_on = false;
+                wave->cycle_start += wave->half_ticks << 1;
+                return true;
+            }
+
+            if (wave->cycle_start < segment_end) {
+                *time = wave->cycle_start;
+                *level = true;
+                wave->carrier_on = true;
+                return true;
+            }
+        }
+
+        wave->index++;
+        wave->segment_start = segment_end;
+        wave->cycle_start = segment_end;
+    }
+
+    return false;
+}
+
+// Moves to next edge changing output level. Edges at same time are merged and last one wins,
+// like mark end and next mark start when space is 0
+static IRAM void ir_tx_wave_advance(ir_tx_wave_t *wave, const bool level) {
+    do {
+        wave->has_pending = wave->has_following;
+        wave->pending_time = wave->following_time;
+        wave->pending_level = wave->following_level;
+
+        wave->has_following = ir_tx_wave_edge(wave, &wave->following_time, &wave->following_level);
+        while (wave->has_following && wave->following_time == wave->pending_time) {
+            wave->pending_level = wave->following_level;
+            wave->has_following = ir_tx_wave_edge(wave, &wave->following_time, &wave->following_level);
+        }
+    } while (wave->has_pending && wave->pending_level == level);
+}
+
+void ir_tx_wave_init(ir_tx_wave_t *wave, const uint16_t *code, const uint16_t len, const uint8_t half_period_us, const uint8_t repeats, const uint16_t pause_us) {
+    wave->code = code;
+    wave->len = len;
+    wave->index = 0;
+    wave->repeats = repeats;
+    wave->carrier_on = false;
+
+    wave->half_ticks = half_period_us * IR_TX_TICKS_PER_US;
+    if (wave->half_ticks == 0) {
+        // Nothing to send without carrier
+        wave->repeats = 0;
+    }
+    if (pause_us > 0) {
+        wave->pause_ticks = pause_us * IR_TX_TICKS_PER_US;
+    } else {
+        wave->pause_ticks = IR_TX_DEFAULT_PAUSE * IR_TX_TICKS_PER_US;
+    }
+
+    wave->segment_start = 0;
+    wave->cycle_start = 0;
+
+    wave->has_following = ir_tx_wave_edge(wave, &wave->following_time, &wave->following_level);
+    ir_tx_wave_advance(wave, false);
+}
+
+IRAM uint32_t ir_tx_wave_next(ir_tx_wave_t *wave, bool *level) {
+    if (!wave->has_pending) {
+        *level = false;
+        return 0;
+    }
+
+    *level = wave->pending_level;
+    const uint32_t time = wave->pending_time;
+
+    ir_tx_wave_advance(wave, *level);
+
+    if (!wave->has_pending) {
+        return 0;
+    }
+
+    return wave->pending_time - time;
+}
+
+uint32_t ir_tx_code_duration_ms(const uint16_t *code, const uint16_t len, const uint8_t repeats, const uint16_t pause_us) {
+    if (repeats == 0) {
+        return 0;
+    }
+
+    uint64_t duration = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        duration += code[i];
+    }
+
+    uint32_t pause = pause_us;
+    if (pause == 0) {
+        pause = IR_TX_DEFAULT_PAUSE;
+    }
+
+    duration = (duration * repeats) + ((uint64_t) pause * (repeats - 1));
+
+    return (duration + 999) / 1000;
+}
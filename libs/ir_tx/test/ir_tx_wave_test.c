@@ -0,0 +1,171 @@
+/*
+ * IR Transmitter Driver host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays edges from ir_tx_wave_next() and compares output level tick by tick
+ * to ideal modulated waveform of random codes, and checks code duration.
+ *
+ *   make -C libs/ir_tx/test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ir_tx.h"
+
+#define MAX_LEN             40
+#define MAX_EDGES           200000
+#define RANDOM_CODES        2000
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static uint32_t edge_time[MAX_EDGES];
+static bool edge_level[MAX_EDGES];
+
+// Ideal level at tick t: carrier cycles start at each mark start, and spaces and pauses are off
+static bool reference_level(const uint16_t *code, const uint16_t len, const uint32_t half_ticks, const uint8_t repeats, const uint32_t pause_ticks, const uint32_t t) {
+    uint32_t start = 0;
+    for (uint8_t r = 0; r < repeats; r++) {
+        for (uint16_t i = 0; i < len; i++) {
+            const uint32_t end = start + (code[i] * IR_TX_TICKS_PER_US);
+            if (t >= start && t < end && !(i & 1)) {
+                return ((t - start) % (2 * half_ticks)) < half_ticks;
+            }
+            start = end;
+        }
+        start += pause_ticks;
+    }
+
+    return false;
+}
+
+static void check_code(const int n, const uint16_t *code, const uint16_t len, const uint8_t half_period_us, const uint8_t repeats, const uint16_t pause_us) {
+    const uint32_t half_ticks = half_period_us * IR_TX_TICKS_PER_US;
+    const uint32_t pause_ticks = (pause_us ? pause_us : IR_TX_DEFAULT_PAUSE) * IR_TX_TICKS_PER_US;
+
+    uint32_t total = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        total += code[i] * IR_TX_TICKS_PER_US;
+    }
+    total = (total + pause_ticks) * repeats;
+
+    ir_tx_wave_t wave;
+    ir_tx_wave_init(&wave, code, len, half_period_us, repeats, pause_us);
+
+    uint32_t edges = 0;
+    uint32_t time = 0;
+    uint32_t ticks;
+    do {
+        bool level;
+        ticks = ir_tx_wave_next(&wave, &level);
+        edge_time[edges] = time;
+        edge_level[edges] = level;
+        edges++;
+        time += ticks;
+    } while (ticks > 0 && edges < MAX_EDGES);
+
+    CHECK(ticks == 0, "code %i: schedule does not end", n);
+    CHECK(!edge_level[edges - 1], "code %i: last level is on", n);
+
+    for (uint32_t i = 1; i < edges; i++) {
+        if (edge_level[i] == edge_level[i - 1]) {
+            CHECK(false, "code %i: edge %u repeats level", n, i);
+            return;
+        }
+    }
+
+    // Transmission starts at first mark with carrier, so timeline is shifted to it
+    uint32_t first_on = total;
+    for (uint32_t t = 0; t < total; t++) {
+        if (reference_level(code, len, half_ticks, repeats, pause_ticks, t)) {
+            first_on = t;
+            break;
+        }
+    }
+
+    if (first_on == total) {
+        CHECK(edges == 1 && !edge_level[0], "code %i: empty code sends %u edges", n, edges);
+        return;
+    }
+
+    uint32_t k = 0;
+    bool level = false;
+    for (uint32_t t = first_on; t < total; t++) {
+        while (k < edges && t - first_on >= edge_time[k]) {
+            level = edge_level[k];
+            k++;
+        }
+
+        if (level != reference_level(code, len, half_ticks, repeats, pause_ticks, t)) {
+            CHECK(false, "code %i: level differs at tick %u", n, t);
+            return;
+        }
+    }
+}
+
+static void check_duration() {
+    const uint16_t code[] = { 9000, 4500, 560, 560, 560 };
+
+    CHECK(ir_tx_code_duration_ms(code, 5, 0, 0) == 0, "no repeats");
+    CHECK(ir_tx_code_duration_ms(code, 5, 1, 0) == 16, "single code is %u ms", ir_tx_code_duration_ms(code, 5, 1, 0));
+    CHECK(ir_tx_code_duration_ms(code, 5, 2, 0) == 131, "default pause is %u ms", ir_tx_code_duration_ms(code, 5, 2, 0));
+    CHECK(ir_tx_code_duration_ms(code, 5, 3, 40000) == 126, "40 ms pause is %u ms", ir_tx_code_duration_ms(code, 5, 3, 40000));
+
+    uint16_t longest[MAX_LEN];
+    for (uint16_t i = 0; i < MAX_LEN; i++) {
+        longest[i] = UINT16_MAX;
+    }
+    CHECK(ir_tx_code_duration_ms(longest, MAX_LEN, UINT8_MAX, UINT16_MAX) == 685103, "longest code is %u ms", ir_tx_code_duration_ms(longest, MAX_LEN, UINT8_MAX, UINT16_MAX));
+}
+
+int main() {
+    srand(1);
+
+    for (int n = 0; n < RANDOM_CODES; n++) {
+        uint16_t code[MAX_LEN];
+        const uint16_t len = rand() % MAX_LEN;
+        for (uint16_t i = 0; i < len; i++) {
+            code[i] = (rand() % 5 == 0) ? 0 : rand() % 3000;
+        }
+
+        const uint8_t half_period_us = 8 + (rand() % 10);
+        const uint8_t repeats = rand() % 3;
+        const uint16_t pause_us = (rand() % 2) ? rand() % 5000 : 0;
+
+        check_code(n, code, len, half_period_us, repeats, pause_us);
+    }
+
+    check_duration();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("ir_tx: all checks passed\n");
+    return 0;
+}
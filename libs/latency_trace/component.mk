@@ -0,0 +1,8 @@
+# Component makefile for latency_trace
+
+INC_DIRS += $(latency_trace_ROOT)
+
+latency_trace_INC_DIR = $(latency_trace_ROOT)
+latency_trace_SRC_DIR = $(latency_trace_ROOT)
+
+$(eval $(call component_compile_rules,latency_trace))
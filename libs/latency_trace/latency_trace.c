@@ -0,0 +1,252 @@
+/*
+ * Latency Trace Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef LATENCY_TRACE
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <common_macros.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <espressif/esp_common.h>
+#include <esplibs/libmain.h>
+
+#include "latency_trace.h"
+
+#define LATENCY_TRACE_MASK          (LATENCY_TRACE_SIZE - 1)
+
+typedef struct _latency_trace_stats {
+    uint16_t count;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint32_t max;
+} latency_trace_stats_t;
+
+static const char *point_names[LATENCY_TRACE_POINT_COUNT] = {
+    "button_edge",
+    "hap_write",
+    "button",
+    "setter",
+    "actions",
+    "gpio",
+    "notify",
+    "event_sent"
+};
+
+static latency_trace_event_t trace_events[LATENCY_TRACE_SIZE];
+static uint16_t next_event = 0;
+static uint16_t event_count = 0;
+static uint32_t total_events = 0;
+
+// Ring buffer is written from ISRs too. taskENTER_CRITICAL() must not be used there, so
+// interrupts are masked directly, which nests and works in any context
+IRAM void latency_trace_mark(const uint8_t point, const uint8_t arg) {
+    const uint32_t now = sdk_system_get_time();
+
+    const uint32_t irq_state = _xt_disable_interrupts();
+    latency_trace_event_t *event = &trace_events[next_event];
+    event->time = now;
+    event->point = point;
+    event->arg = arg;
+
+    next_event = (next_event + 1) & LATENCY_TRACE_MASK;
+    if (event_count < LATENCY_TRACE_SIZE) {
+        event_count++;
+    }
+    total_events++;
+    _xt_restore_interrupts(irq_state);
+}
+
+void latency_trace_clear() {
+    const uint32_t irq_state = _xt_disable_interrupts();
+    next_event = 0;
+    event_count = 0;
+    _xt_restore_interrupts(irq_state);
+}
+
+const char *latency_trace_point_name(const uint8_t point) {
+    if (point >= LATENCY_TRACE_POINT_COUNT) {
+        return "unknown";
+    }
+
+    return point_names[point];
+}
+
+// Copies ring buffer oldest first, so analysis does not race with new events
+static uint16_t latency_trace_snapshot(latency_trace_event_t *events) {
+    const uint32_t irq_state = _xt_disable_interrupts();
+    const uint16_t count = event_count;
+    const uint16_t first = (next_event - count) & LATENCY_TRACE_MASK;
+    for (uint16_t i = 0; i < count; i++) {
+        events[i] = trace_events[(first + i) & LATENCY_TRACE_MASK];
+    }
+    _xt_restore_interrupts(irq_state);
+
+    return count;
+}
+
+static int latency_trace_compare(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a;
+    const uint32_t y = *(const uint32_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+// Nearest rank percentile of sorted samples
+static uint32_t latency_trace_percentile(const uint32_t *samples, const uint16_t count, const uint8_t percent) {
+    uint16_t rank = (count * percent + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    return samples[rank - 1];
+}
+
+static void latency_trace_stats(const latency_trace_event_t *events, const uint16_t count,
+                                const uint8_t start, const uint8_t stage,
+                                uint32_t *samples, latency_trace_stats_t *stats) {
+    bool active = false;
+    bool seen = false;
+    uint32_t start_time = 0;
+
+    stats->count = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        const latency_trace_event_t *event = &events[i];
+
+        if (event->point < LATENCY_TRACE_START_COUNT) {
+            active = (event->point == start);
+            seen = false;
+            start_time = event->time;
+
+        } else if (event->point == stage && active && !seen) {
+            seen = true;
+
+            const uint32_t elapsed = event->time - start_time;
+            if (elapsed <= LATENCY_TRACE_MAX_FLOW_US) {
+                samples[stats->count] = elapsed;
+                stats->count++;
+            }
+        }
+    }
+
+    if (stats->count > 0) {
+        qsort(samples, stats->count, sizeof(uint32_t), latency_trace_compare);
+
+        stats->p50 = latency_trace_percentile(samples, stats->count, 50);
+        stats->p90 = latency_trace_percentile(samples, stats->count, 90);
+        stats->p99 = latency_trace_percentile(samples, stats->count, 99);
+        stats->max = samples[stats->count - 1];
+    }
+}
+
+void latency_trace_dump() {
+    latency_trace_event_t *events = malloc(sizeof(latency_trace_event_t) * LATENCY_TRACE_SIZE);
+    if (!events) {
+        printf("! Trace: no memory\n");
+        return;
+    }
+
+    const uint16_t count = latency_trace_snapshot(events);
+
+    printf("Trace: %u events, %u total\n", count, total_events);
+
+    for (uint16_t i = 0; i < count; i++) {
+        printf("Trace %10u %-11s %u\n", events[i].time, latency_trace_point_name(events[i].point), events[i].arg);
+    }
+
+    free(events);
+}
+
+void latency_trace_print() {
+    latency_trace_event_t *events = malloc(sizeof(latency_trace_event_t) * LATENCY_TRACE_SIZE);
+    uint32_t *samples = malloc(sizeof(uint32_t) * LATENCY_TRACE_SIZE);
+    if (!events || !samples) {
+        printf("! Trace: no memory\n");
+        free(events);
+        free(samples);
+        return;
+    }
+
+    const uint16_t count = latency_trace_snapshot(events);
+
+    printf("Trace: %u events, %u total (us)\n", count, total_events);
+
+    for (uint8_t start = 0; start < LATENCY_TRACE_START_COUNT; start++) {
+        for (uint8_t stage = LATENCY_TRACE_START_COUNT; stage < LATENCY_TRACE_POINT_COUNT; stage++) {
+            latency_trace_stats_t stats;
+            latency_trace_stats(events, count, start, stage, samples, &stats);
+
+            if (stats.count > 0) {
+                printf("Trace %-11s > %-10s n %3u, p50 %7u, p90 %7u, p99 %7u, max %7u\n",
+                       point_names[start], point_names[stage], stats.count,
+                       stats.p50, stats.p90, stats.p99, stats.max);
+            }
+        }
+    }
+
+    free(events);
+    free(samples);
+}
+
+int latency_trace_json(char *buffer, const size_t buffer_size) {
+    latency_trace_event_t *events = malloc(sizeof(latency_trace_event_t) * LATENCY_TRACE_SIZE);
+    uint32_t *samples = malloc(sizeof(uint32_t) * LATENCY_TRACE_SIZE);
+    if (!events || !samples) {
+        free(events);
+        free(samples);
+        return snprintf(buffer, buffer_size, "{}");
+    }
+
+    const uint16_t count = latency_trace_snapshot(events);
+
+    int len = snprintf(buffer, buffer_size, "{\"events\":%u,\"total\":%u,\"stages\":[", count, total_events);
+
+    bool first = true;
+    for (uint8_t start = 0; start < LATENCY_TRACE_START_COUNT && len < buffer_size; start++) {
+        for (uint8_t stage = LATENCY_TRACE_START_COUNT; stage < LATENCY_TRACE_POINT_COUNT && len < buffer_size; stage++) {
+            latency_trace_stats_t stats;
+            latency_trace_stats(events, count, start, stage, samples, &stats);
+
+            if (stats.count > 0) {
+                len += snprintf(buffer + len, buffer_size - len,
+                                "%s{\"from\":\"%s\",\"to\":\"%s\",\"n\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+                                first ? "" : ",", point_names[start], point_names[stage], stats.count,
+                                stats.p50, stats.p90, stats.p99, stats.max);
+                first = false;
+            }
+        }
+    }
+
+    if (len < buffer_size) {
+        len += snprintf(buffer + len, buffer_size - len, "]}");
+    }
+
+    if (len >= buffer_size) {
+        len = buffer_size - 1;
+    }
+
+    free(events);
+    free(samples);
+
+    return len;
+}
+
+#endif  // LATENCY_TRACE
@@ -0,0 +1,84 @@
+/*
+ * Latency Trace Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Hot path latency tracing. Only built with -DLATENCY_TRACE.
+ *
+ * LATENCY_TRACE_MARK() stores a sdk_system_get_time() timestamp into a fixed
+ * ring buffer. It is safe to call from ISRs and timer callbacks.
+ *
+ * A start point (button edge or HAP write) begins a flow. Every later point
+ * is measured against the latest start point, only its first occurrence in
+ * each flow is used, and flows longer than LATENCY_TRACE_MAX_FLOW_US are
+ * ignored. Files using it include this header only under LATENCY_TRACE and
+ * define an empty LATENCY_TRACE_MARK() otherwise.
+ */
+
+#ifndef __LATENCY_TRACE_H__
+#define __LATENCY_TRACE_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifndef LATENCY_TRACE_SIZE
+#define LATENCY_TRACE_SIZE              256     // Events, must be a power of 2
+#endif
+
+#ifndef LATENCY_TRACE_MAX_FLOW_US
+#define LATENCY_TRACE_MAX_FLOW_US       5000000
+#endif
+
+typedef enum {
+    // Start points
+    LATENCY_TRACE_BUTTON_EDGE = 0,      // First raw level change seen by adv_button
+    LATENCY_TRACE_HAP_WRITE,            // PUT /characteristics received
+    LATENCY_TRACE_START_COUNT,
+
+    // Stages
+    LATENCY_TRACE_BUTTON = LATENCY_TRACE_START_COUNT,   // adv_button debounced, callbacks run
+    LATENCY_TRACE_SETTER,               // Accessory setter entry
+    LATENCY_TRACE_ACTIONS,              // do_actions() entry
+    LATENCY_TRACE_GPIO,                 // Digital output written
+    LATENCY_TRACE_NOTIFY,               // Event queued for a client
+    LATENCY_TRACE_EVENT_SENT,           // EVENT frame written to a client
+    LATENCY_TRACE_POINT_COUNT
+} latency_trace_point_t;
+
+typedef struct _latency_trace_event {
+    uint32_t time;                      // us
+    uint8_t point;
+    uint8_t arg;                        // GPIO, client socket... 0 if unused
+} latency_trace_event_t;
+
+#define LATENCY_TRACE_MARK(point, arg)  latency_trace_mark(point, arg)
+
+void latency_trace_mark(const uint8_t point, const uint8_t arg);
+void latency_trace_clear();
+
+const char *latency_trace_point_name(const uint8_t point);
+
+// Raw events, oldest first
+void latency_trace_dump();
+
+// Percentiles per start point and stage
+void latency_trace_print();
+
+// Writes percentiles as JSON into buffer, returns length
+int latency_trace_json(char *buffer, const size_t buffer_size);
+
+#endif  // __LATENCY_TRACE_H__
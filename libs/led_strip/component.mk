@@ -0,0 +1,8 @@
+# Component makefile for led_strip
+
+INC_DIRS += $(led_strip_ROOT)
+
+led_strip_INC_DIR = $(led_strip_ROOT)
+led_strip_SRC_DIR = $(led_strip_ROOT)
+
+$(eval $(call component_compile_rules,led_strip))
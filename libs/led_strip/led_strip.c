@@ -0,0 +1,174 @@
+/*
+ * LED Strip Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <common_macros.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <semphr.h>
+#include <i2s_dma/i2s_dma.h>
+
+#include "led_strip.h"
+
+#define LED_STRIP_DMA_BLOCK_SIZE    4092    // Descriptor length field is 12 bits, multiple of 4
+#define LED_STRIP_DMA_MARGIN_MS     50      // Over transfer time, before EOF interrupt is taken as lost
+
+static uint8_t strip_type = LED_STRIP_TYPE_GRB;
+static uint16_t strip_pixel_count = 0;
+static led_strip_color_t *pixels = NULL;
+
+static led_strip_segment_t segments[LED_STRIP_MAX_SEGMENTS];
+static uint8_t segment_count = 0;
+
+static uint32_t *dma_buffer = NULL;
+static dma_descriptor_t *dma_blocks = NULL;
+static uint8_t reset_buffer[LED_STRIP_RESET_BYTES] __attribute__((aligned(4)));
+static SemaphoreHandle_t dma_done = NULL;     // Given while DMA buffer is not being sent
+static TickType_t dma_timeout = 0;
+
+static IRAM void led_strip_dma_isr(void *arg) {
+    BaseType_t task_woken = pdFALSE;
+
+    if (i2s_dma_is_eof_interrupt()) {
+        i2s_dma_stop();
+        xSemaphoreGiveFromISR(dma_done, &task_woken);
+    }
+
+    i2s_dma_clear_interrupt();
+    portEND_SWITCHING_ISR(task_woken);
+}
+
+static void led_strip_dma_block(dma_descriptor_t *block, void *buffer, const uint16_t len, dma_descriptor_t *next) {
+    block->owner = 1;
+    block->eof = (next == NULL);
+    block->sub_sof = 0;
+    block->unused = 0;
+    block->buf_ptr = buffer;
+    block->datalen = len;
+    block->blocksize = len;
+    block->next_link_ptr = next;
+}
+
+int led_strip_init(const uint8_t type, const uint16_t pixel_count) {
+    if (pixels || pixel_count == 0) {
+        return -1;
+    }
+
+    const size_t dma_size = pixel_count * led_strip_bytes_per_pixel(type) * sizeof(uint32_t);
+    const uint8_t data_blocks = (dma_size + LED_STRIP_DMA_BLOCK_SIZE - 1) / LED_STRIP_DMA_BLOCK_SIZE;
+
+    pixels = calloc(pixel_count, sizeof(led_strip_color_t));
+    dma_buffer = malloc(dma_size);
+    dma_blocks = calloc(data_blocks + 1, sizeof(dma_descriptor_t));
+    dma_done = xSemaphoreCreateBinary();
+    if (!pixels || !dma_buffer || !dma_blocks || !dma_done) {
+        free(pixels);
+        free(dma_buffer);
+        free(dma_blocks);
+        if (dma_done) {
+            vSemaphoreDelete(dma_done);
+        }
+        pixels = NULL;
+        dma_buffer = NULL;
+        dma_blocks = NULL;
+        dma_done = NULL;
+        return -2;
+    }
+
+    xSemaphoreGive(dma_done);
+
+    strip_type = type;
+    strip_pixel_count = pixel_count;
+    dma_timeout = ((dma_size * 8 / (LED_STRIP_I2S_FREQ / 1000)) + LED_STRIP_DMA_MARGIN_MS) / portTICK_PERIOD_MS;
+    segment_count = 0;
+
+    // Pixel data, and a low level reset at the end
+    uint8_t *block_buffer = (uint8_t *) dma_buffer;
+    size_t remaining = dma_size;
+    for (uint8_t i = 0; i < data_blocks; i++) {
+        const uint16_t len = (remaining > LED_STRIP_DMA_BLOCK_SIZE) ? LED_STRIP_DMA_BLOCK_SIZE : remaining;
+        led_strip_dma_block(&dma_blocks[i], block_buffer, len, &dma_blocks[i + 1]);
+        block_buffer += len;
+        remaining -= len;
+    }
+
+    memset(reset_buffer, 0, sizeof(reset_buffer));
+    led_strip_dma_block(&dma_blocks[data_blocks], reset_buffer, sizeof(reset_buffer), NULL);
+
+    const i2s_pins_t i2s_pins = { .data = true, .clock = false, .ws = false };
+    i2s_dma_init(led_strip_dma_isr, NULL, i2s_get_clock_div(LED_STRIP_I2S_FREQ), i2s_pins);
+
+    return 0;
+}
+
+int led_strip_add_segment(const uint16_t start, const uint16_t length) {
+    if (segment_count == LED_STRIP_MAX_SEGMENTS || length == 0 || start + length > strip_pixel_count) {
+        return -1;
+    }
+
+    memset(&segments[segment_count], 0, sizeof(led_strip_segment_t));
+    segments[segment_count].start = start;
+    segments[segment_count].length = length;
+    segment_count++;
+
+    return segment_count - 1;
+}
+
+void led_strip_set_color(const uint8_t segment, const led_strip_color_t color) {
+    if (segment < segment_count) {
+        segments[segment].color = color;
+    }
+}
+
+void led_strip_set_effect(const uint8_t segment, const uint8_t effect) {
+    if (segment < segment_count) {
+        segments[segment].effect = effect;
+    }
+}
+
+bool led_strip_has_running_effects() {
+    for (uint8_t i = 0; i < segment_count; i++) {
+        const led_strip_color_t color = segments[i].color;
+        if (segments[i].effect != LED_STRIP_EFFECT_NONE && (color.r || color.g || color.b || color.w)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void led_strip_show() {
+    if (!pixels) {
+        return;
+    }
+
+    const uint32_t frame = (xTaskGetTickCount() * portTICK_PERIOD_MS) / LED_STRIP_EFFECT_FRAME_MS;
+    led_strip_render(segments, segment_count, pixels, strip_pixel_count, frame);
+
+    // DMA buffer is not written while it is being sent, task sleeps until EOF interrupt
+    if (xSemaphoreTake(dma_done, dma_timeout) != pdTRUE) {
+        // EOF interrupt was lost, transfer is restarted
+        i2s_dma_stop();
+    }
+
+    led_strip_encode(strip_type, pixels, strip_pixel_count, dma_buffer);
+
+    i2s_dma_start(dma_blocks);
+}
@@ -0,0 +1,93 @@
+/*
+ * LED Strip Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * WS2812 and SK6812 RGB(W) LED strip output from I2S peripheral with DMA.
+ *
+ * Each data bit is sent as 4 I2S bits at 3.2 MHz, 1000 for 0 and 1110 for 1,
+ * so every color byte is one 32 bits DMA word. Data pin is fixed by hardware
+ * to GPIO3 (I2S data out, UART0 RX).
+ *
+ * Strip is split into segments, each one with its own color and effect.
+ * Pixel rendering and I2S encoding do not access hardware, so they can be
+ * built and checked on host with test/led_strip_test.c.
+ */
+
+#ifndef __LED_STRIP_H__
+#define __LED_STRIP_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LED_STRIP_TYPE_GRB          0       // WS2812
+#define LED_STRIP_TYPE_GRBW         1       // SK6812 RGBW
+
+#define LED_STRIP_EFFECT_NONE       0
+#define LED_STRIP_EFFECT_RAINBOW    1
+#define LED_STRIP_EFFECT_CHASE      2
+
+#ifndef LED_STRIP_MAX_SEGMENTS
+#define LED_STRIP_MAX_SEGMENTS      8
+#endif
+
+#define LED_STRIP_I2S_FREQ          3200000
+#define LED_STRIP_RESET_BYTES       128     // 320 us low, SK6812 and new WS2812B need more than 280 us
+#define LED_STRIP_EFFECT_FRAME_MS   40
+#define LED_STRIP_CHASE_SPACING     4
+
+typedef struct _led_strip_color {
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+    uint8_t w;
+} led_strip_color_t;
+
+typedef struct _led_strip_segment {
+    uint16_t start;
+    uint16_t length;
+    led_strip_color_t color;
+    uint8_t effect;
+} led_strip_segment_t;
+
+// No hardware access
+uint8_t led_strip_bytes_per_pixel(const uint8_t type);
+uint32_t led_strip_encode_byte(const uint8_t value);
+
+// Returns number of 32 bits words written, led_strip_bytes_per_pixel() for each pixel
+size_t led_strip_encode(const uint8_t type, const led_strip_color_t *pixels, const uint16_t pixel_count, uint32_t *buffer);
+
+// Pixels out of any segment are off. Frame moves effects
+void led_strip_render(const led_strip_segment_t *segments, const uint8_t segment_count, led_strip_color_t *pixels, const uint16_t pixel_count, const uint32_t frame);
+
+// Returns 0 if ready, -1 if arguments are not valid, -2 if no memory
+int led_strip_init(const uint8_t type, const uint16_t pixel_count);
+
+// Returns segment index, or -1 if it does not fit in strip or all segments are used
+int led_strip_add_segment(const uint16_t start, const uint16_t length);
+void led_strip_set_color(const uint8_t segment, const led_strip_color_t color);
+void led_strip_set_effect(const uint8_t segment, const uint8_t effect);
+
+// True when some segment with effect is on, so it needs led_strip_show() every LED_STRIP_EFFECT_FRAME_MS
+bool led_strip_has_running_effects();
+
+// Sends all segments to strip. Blocks calling task until previous transfer ends, a 100 pixels RGB strip takes 3.3 ms
+void led_strip_show();
+
+#endif  // __LED_STRIP_H__
@@ -0,0 +1,134 @@
+/*
+ * LED Strip Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "led_strip.h"
+
+// One nibble of data bits as 4 I2S bits each, 1000 for 0 and 1110 for 1
+static const uint16_t nibble_patterns[16] = {
+    0x8888, 0x888E, 0x88E8, 0x88EE, 0x8E88, 0x8E8E, 0x8EE8, 0x8EEE,
+    0xE888, 0xE88E, 0xE8E8, 0xE8EE, 0xEE88, 0xEE8E, 0xEEE8, 0xEEEE
+};
+
+uint8_t led_strip_bytes_per_pixel(const uint8_t type) {
+    if (type == LED_STRIP_TYPE_GRBW) {
+        return 4;
+    }
+
+    return 3;
+}
+
+// I2S sends high half word first, both MSB first
+uint32_t led_strip_encode_byte(const uint8_t value) {
+    return ((uint32_t) nibble_patterns[value >> 4] << 16) | nibble_patterns[value & 0x0F];
+}
+
+size_t led_strip_encode(const uint8_t type, const led_strip_color_t *pixels, const uint16_t pixel_count, uint32_t *buffer) {
+    uint32_t *word = buffer;
+
+    for (uint16_t i = 0; i < pixel_count; i++) {
+        *word++ = led_strip_encode_byte(pixels[i].g);
+        *word++ = led_strip_encode_byte(pixels[i].r);
+        *word++ = led_strip_encode_byte(pixels[i].b);
+
+        if (type == LED_STRIP_TYPE_GRBW) {
+            *word++ = led_strip_encode_byte(pixels[i].w);
+        }
+    }
+
+    return word - buffer;
+}
+
+static uint8_t led_strip_scale(const uint8_t value, const uint8_t level) {
+    return (value * (level + 1)) >> 8;
+}
+
+static led_strip_color_t led_strip_wheel(uint8_t hue, const uint8_t level) {
+    led_strip_color_t color = { 0, 0, 0, 0 };
+
+    if (hue < 85) {
+        color.r = 255 - (hue * 3);
+        color.g = hue * 3;
+    } else if (hue < 170) {
+        hue -= 85;
+        color.g = 255 - (hue * 3);
+        color.b = hue * 3;
+    } else {
+        hue -= 170;
+        color.r = hue * 3;
+        color.b = 255 - (hue * 3);
+    }
+
+    color.r = led_strip_scale(color.r, level);
+    color.g = led_strip_scale(color.g, level);
+    color.b = led_strip_scale(color.b, level);
+
+    return color;
+}
+
+static void led_strip_render_segment(const led_strip_segment_t *segment, led_strip_color_t *pixels, const uint32_t frame) {
+    const led_strip_color_t off = { 0, 0, 0, 0 };
+    const led_strip_color_t color = segment->color;
+
+    switch (segment->effect) {
+        case LED_STRIP_EFFECT_RAINBOW: {
+            // Brightest channel of segment color sets rainbow brightness
+            uint8_t level = color.r;
+            if (color.g > level) {
+                level = color.g;
+            }
+            if (color.b > level) {
+                level = color.b;
+            }
+            if (color.w > level) {
+                level = color.w;
+            }
+
+            for (uint16_t i = 0; i < segment->length; i++) {
+                pixels[i] = led_strip_wheel(((i * 256) / segment->length) + frame, level);
+            }
+            break;
+        }
+
+        case LED_STRIP_EFFECT_CHASE: {
+            const uint8_t lit = frame % LED_STRIP_CHASE_SPACING;
+            for (uint16_t i = 0; i < segment->length; i++) {
+                pixels[i] = ((i % LED_STRIP_CHASE_SPACING) == lit) ? color : off;
+            }
+            break;
+        }
+
+        default:    // case LED_STRIP_EFFECT_NONE:
+            for (uint16_t i = 0; i < segment->length; i++) {
+                pixels[i] = color;
+            }
+            break;
+    }
+}
+
+void led_strip_render(const led_strip_segment_t *segments, const uint8_t segment_count, led_strip_color_t *pixels, const uint16_t pixel_count, const uint32_t frame) {
+    memset(pixels, 0, pixel_count * sizeof(led_strip_color_t));
+
+    for (uint8_t i = 0; i < segment_count; i++) {
+        if (segments[i].start + segments[i].length <= pixel_count) {
+            led_strip_render_segment(&segments[i], pixels + segments[i].start, frame);
+        }
+    }
+}
@@ -0,0 +1,164 @@
+/*
+ * LED Strip Driver host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Compares I2S words from led_strip_encode() to reference waveforms built bit
+ * by bit, and checks segment mapping and effects of led_strip_render().
+ *
+ *   make -C libs/led_strip/test
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "led_strip.h"
+
+#define MAX_WAVE            (32 * 64 + 1)
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// WS2812 bit is 1.25 us, 4 slots of 312.5 ns: high for 1 slot for 0, and for 3 slots for 1
+static void reference_wave(const uint8_t *bytes, const size_t len, char *wave) {
+    size_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        for (int8_t bit = 7; bit >= 0; bit--) {
+            memcpy(wave + k, ((bytes[i] >> bit) & 1) ? "1110" : "1000", 4);
+            k += 4;
+        }
+    }
+    wave[k] = 0;
+}
+
+// I2S sends each word MSB first
+static void i2s_wave(const uint32_t *words, const size_t len, char *wave) {
+    size_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+        for (int8_t bit = 31; bit >= 0; bit--) {
+            wave[k++] = ((words[i] >> bit) & 1) ? '1' : '0';
+        }
+    }
+    wave[k] = 0;
+}
+
+static void check_encode_byte() {
+    char expected[MAX_WAVE];
+    char got[MAX_WAVE];
+
+    for (uint16_t value = 0; value < 256; value++) {
+        const uint8_t byte = value;
+        const uint32_t word = led_strip_encode_byte(byte);
+        reference_wave(&byte, 1, expected);
+        i2s_wave(&word, 1, got);
+        CHECK(strcmp(expected, got) == 0, "byte %02x encoded as %08x", value, word);
+    }
+}
+
+static void check_encode(const uint8_t type, const led_strip_color_t *pixels, const uint16_t pixel_count, const uint8_t *wire, const size_t wire_len) {
+    uint32_t words[64];
+    char expected[MAX_WAVE];
+    char got[MAX_WAVE];
+
+    const size_t len = led_strip_encode(type, pixels, pixel_count, words);
+    CHECK(len == wire_len, "type %u: %u words, expected %u", type, (unsigned) len, (unsigned) wire_len);
+    CHECK(len == (size_t) pixel_count * led_strip_bytes_per_pixel(type), "type %u: %u words for %u pixels", type, (unsigned) len, pixel_count);
+
+    reference_wave(wire, wire_len, expected);
+    i2s_wave(words, len, got);
+    CHECK(strcmp(expected, got) == 0, "type %u: waveform does not match", type);
+}
+
+static bool is_on(const led_strip_color_t color) {
+    return color.r || color.g || color.b || color.w;
+}
+
+static void check_render() {
+    led_strip_segment_t segments[] = {
+        { 0, 3, { 10, 20, 30, 0 }, LED_STRIP_EFFECT_NONE },
+        { 5, 4, { 1, 2, 3, 4 }, LED_STRIP_EFFECT_CHASE },
+        { 9, 12, { 0, 200, 0, 0 }, LED_STRIP_EFFECT_RAINBOW },     // Does not fit, skipped
+    };
+    led_strip_color_t pixels[20];
+
+    memset(pixels, 0xAA, sizeof(pixels));
+    led_strip_render(segments, 3, pixels, 20, 1);
+
+    for (uint8_t i = 0; i < 20; i++) {
+        const bool expected = (i < 3) || (i >= 5 && i < 9 && ((i - 5) % LED_STRIP_CHASE_SPACING) == 1);
+        CHECK(is_on(pixels[i]) == expected, "pixel %u is %s", i, is_on(pixels[i]) ? "on" : "off");
+    }
+
+    CHECK(pixels[0].r == 10 && pixels[0].g == 20 && pixels[2].b == 30, "solid segment color");
+    CHECK(pixels[6].r == 1 && pixels[6].g == 2 && pixels[6].b == 3 && pixels[6].w == 4, "chase segment color");
+
+    // Chase moves one pixel per frame
+    led_strip_render(segments, 2, pixels, 20, 2);
+    CHECK(!is_on(pixels[6]) && is_on(pixels[7]), "chase frame 2");
+
+    // Rainbow brightness follows brightest channel of segment color
+    segments[2].length = 11;
+    led_strip_render(segments, 3, pixels, 20, 0);
+
+    uint8_t max_level = 0;
+    for (uint8_t i = 9; i < 20; i++) {
+        const led_strip_color_t c = pixels[i];
+        uint8_t level = c.r > c.g ? c.r : c.g;
+        level = level > c.b ? level : c.b;
+        CHECK(level > 0, "rainbow pixel %u is off", i);
+        CHECK(c.w == 0, "rainbow pixel %u has white", i);
+        if (level > max_level) {
+            max_level = level;
+        }
+    }
+    CHECK(max_level <= 200, "rainbow level %u over segment level", max_level);
+}
+
+int main() {
+    check_encode_byte();
+
+    const led_strip_color_t pixels[] = {
+        { 0x12, 0x34, 0x56, 0x78 },
+        { 0xFF, 0x00, 0x80, 0x01 },
+        { 0x00, 0x00, 0x00, 0x00 },
+    };
+
+    // GRB and GRBW wire order
+    const uint8_t grb[] = { 0x34, 0x12, 0x56, 0x00, 0xFF, 0x80, 0x00, 0x00, 0x00 };
+    check_encode(LED_STRIP_TYPE_GRB, pixels, 3, grb, sizeof(grb));
+
+    const uint8_t grbw[] = { 0x34, 0x12, 0x56, 0x78, 0x00, 0xFF, 0x80, 0x01 };
+    check_encode(LED_STRIP_TYPE_GRBW, pixels, 2, grbw, sizeof(grbw));
+
+    check_render();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("led_strip: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Component makefile for lightbulb_math
+
+INC_DIRS += $(lightbulb_math_ROOT)
+
+lightbulb_math_INC_DIR = $(lightbulb_math_ROOT)
+lightbulb_math_SRC_DIR = $(lightbulb_math_ROOT)
+
+$(eval $(call component_compile_rules,lightbulb_math))
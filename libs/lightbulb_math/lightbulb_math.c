@@ -0,0 +1,232 @@
+/*
+ * Lightbulb Math
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "lightbulb_math.h"
+
+#define LIGHTBULB_GAMMA_STEPS       64
+
+#define LIGHTBULB_MIN(a, b)         (((a) < (b)) ? (a) : (b))
+
+// Gamma 2.2, LIGHTBULB_GAMMA_STEPS + 1 entries, linear interpolated between them
+static const uint16_t lightbulb_gamma_lut[LIGHTBULB_GAMMA_STEPS + 1] = {
+        0,     7,    32,    78,   147,   240,   359,   504,
+      676,   875,  1104,  1361,  1649,  1966,  2314,  2693,
+     3104,  3547,  4022,  4531,  5072,  5646,  6255,  6898,
+     7575,  8286,  9033,  9815, 10633, 11486, 12375, 13301,
+    14263, 15262, 16298, 17372, 18482, 19631, 20817, 22041,
+    23304, 24605, 25944, 27323, 28740, 30197, 31693, 33228,
+    34803, 36419, 38074, 39769, 41505, 43281, 45098, 46956,
+    48855, 50794, 52776, 54798, 56862, 58968, 61116, 63305,
+    65535
+};
+
+uint16_t lightbulb_gamma(const uint16_t level) {
+    // Position in table with 10 bits between entries, so LIGHTBULB_PWM_SCALE lands on last one
+    const uint32_t position = ((uint32_t) level << 16) / LIGHTBULB_PWM_SCALE;
+    const uint32_t index = position >> 10;
+    if (index >= LIGHTBULB_GAMMA_STEPS) {
+        return LIGHTBULB_PWM_SCALE;
+    }
+
+    const uint32_t low = lightbulb_gamma_lut[index];
+    const uint32_t high = lightbulb_gamma_lut[index + 1];
+    const uint32_t duty = low + (((high - low) * (position & 0x3FF)) >> 10);
+
+    return ((duty > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : duty);
+}
+
+uint32_t lightbulb_fade_ease(const uint8_t curve, const uint32_t progress) {
+    switch (curve) {
+        case LIGHTBULB_FADE_EASE_IN_OUT:    // Smoothstep
+            return ((uint64_t) progress * progress * ((3 * LIGHTBULB_FADE_ONE) - (2 * progress))) >> 32;
+
+        case LIGHTBULB_FADE_EASE_IN:
+            return ((uint64_t) progress * progress) >> 16;
+
+        case LIGHTBULB_FADE_EASE_OUT:
+            return LIGHTBULB_FADE_ONE - (((uint64_t) (LIGHTBULB_FADE_ONE - progress) * (LIGHTBULB_FADE_ONE - progress)) >> 16);
+
+        default:    // case LIGHTBULB_FADE_LINEAR:
+            return progress;
+    }
+}
+
+uint16_t lightbulb_factor_scale(const uint32_t factor, const uint32_t value) {
+    const uint32_t scaled = ((uint64_t) factor * value) >> 16;
+    return ((scaled > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : scaled);
+}
+
+// Ratio limited to 1.0, because white factor is always limited to it
+static uint32_t lightbulb_white_ratio(const uint32_t n, const uint32_t d) {
+    if (n >= d) {
+        return LIGHTBULB_FACTOR_ONE;
+    }
+
+    return (n << 16) / d;
+}
+
+// https://gist.github.com/rasod/42eab9206e28ca91c8d9f926fa71a938
+uint32_t lightbulb_white_factor(const uint32_t r, const uint32_t g, const uint32_t b, const uint32_t w_r, const uint32_t w_g, const uint32_t w_b, const uint32_t rgb_min, const uint32_t rgb_max) {
+    uint32_t r_f = LIGHTBULB_FACTOR_ONE;
+    uint32_t g_f = LIGHTBULB_FACTOR_ONE;
+    uint32_t b_f = LIGHTBULB_FACTOR_ONE;
+    uint32_t w_f = 0;
+
+    if (rgb_max >= 1) {
+        const uint32_t w_min = LIGHTBULB_MIN(LIGHTBULB_MIN(w_r, w_g), w_b);
+
+        if (w_r > w_min) {
+            r_f = lightbulb_white_ratio(r - rgb_min, w_g - w_min);
+        }
+
+        if (w_g > w_min) {
+            g_f = lightbulb_white_ratio(g - rgb_min, w_g - w_min);
+        }
+
+        if (w_b > w_min) {
+            b_f = lightbulb_white_ratio(b - rgb_min, w_b - w_min);
+        }
+
+        w_f = LIGHTBULB_MIN(LIGHTBULB_MIN(r_f, g_f), b_f);
+    }
+
+    if (w_r > 0) {
+        r_f = lightbulb_white_ratio(r, w_r);
+    }
+
+    if (w_g > 0) {
+        g_f = lightbulb_white_ratio(g, w_g);
+    }
+
+    if (w_b > 0) {
+        b_f = lightbulb_white_ratio(b, w_b);
+    }
+
+    return LIGHTBULB_MIN(LIGHTBULB_MIN(LIGHTBULB_MIN(r_f, g_f), b_f), w_f);
+}
+
+//https://github.com/espressif/esp-idf/examples/peripherals/rmt/led_strip/main/led_strip_main.c
+void lightbulb_hsi2rgbw(uint16_t h, const uint16_t s, const uint16_t v, lightbulb_rgbw_t *rgbw) {
+    h %= 360; // h -> [0,360]
+    const uint32_t rgb_max = v * LIGHTBULB_PWM_SCALE / 100;
+    const uint32_t rgb_min = rgb_max * (100 - s) / 100;
+
+    const uint32_t i = h / 60;
+    const uint32_t diff = h % 60;
+
+    const uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+
+    uint32_t r, g, b;
+
+    switch (i) {
+        case 0:
+            r = rgb_max;
+            g = rgb_min + rgb_adj;
+            b = rgb_min;
+            break;
+        case 1:
+            r = rgb_max - rgb_adj;
+            g = rgb_max;
+            b = rgb_min;
+            break;
+        case 2:
+            r = rgb_min;
+            g = rgb_max;
+            b = rgb_min + rgb_adj;
+            break;
+        case 3:
+            r = rgb_min;
+            g = rgb_max - rgb_adj;
+            b = rgb_max;
+            break;
+        case 4:
+            r = rgb_min + rgb_adj;
+            g = rgb_min;
+            b = rgb_max;
+            break;
+        default:    // case 5:
+            r = rgb_max;
+            g = rgb_min;
+            b = rgb_max - rgb_adj;
+            break;
+    }
+
+    const uint32_t cw_f = lightbulb_white_factor(r, g, b, LIGHTBULB_CW_RED, LIGHTBULB_CW_GREEN, LIGHTBULB_CW_BLUE, rgb_min, rgb_max);
+    const uint32_t ww_f = lightbulb_white_factor(r, g, b, LIGHTBULB_WW_RED, LIGHTBULB_WW_GREEN, LIGHTBULB_WW_BLUE, rgb_min, rgb_max);
+
+    const uint32_t cw = (cw_f * LIGHTBULB_PWM_SCALE) >> 16;
+    const uint32_t ww = (ww_f * LIGHTBULB_PWM_SCALE) >> 16;
+
+    rgbw->r  = ((r  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : r);
+    rgbw->g  = ((g  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : g);
+    rgbw->b  = ((b  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : b);
+    rgbw->w  = ((rgb_min > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : rgb_min);
+    rgbw->cw = ((cw > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : cw);
+    rgbw->ww = ((ww > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : ww);
+}
+
+// For LIGHTBULB_COLOR_TEMP_MIN + 2 to LIGHTBULB_COLOR_TEMP_MAX - 6, precomputed with @seritos curve:
+// LIGHTBULB_PWM_SCALE * (((0.09 + sqrt(0.18 + (0.1352 * (mired - LIGHTBULB_COLOR_TEMP_MIN - 1)))) / 0.0676) - 1) / 100
+static const uint16_t lightbulb_color_temp_lut[LIGHTBULB_COLOR_TEMP_MAX - LIGHTBULB_COLOR_TEMP_MIN - 7] = {
+     5659,  6723,  7635,  8447,  9186,  9868, 10505, 11105, 11674, 12216,
+    12734, 13232, 13711, 14174, 14622, 15056, 15478, 15889, 16289, 16680,
+    17061, 17434, 17800, 18157, 18508, 18852, 19190, 19522, 19848, 20169,
+    20485, 20796, 21103, 21405, 21702, 21996, 22286, 22572, 22854, 23133,
+    23409, 23681, 23950, 24216, 24480, 24740, 24998, 25253, 25505, 25755,
+    26003, 26248, 26491, 26732, 26970, 27207, 27441, 27673, 27904, 28132,
+    28359, 28584, 28807, 29028, 29248, 29466, 29682, 29897, 30111, 30322,
+    30533, 30741, 30949, 31155, 31360, 31563, 31765, 31966, 32165, 32363,
+    32560, 32756, 32951, 33144, 33337, 33528, 33718, 33907, 34095, 34282,
+    34468, 34653, 34837, 35020, 35202, 35384, 35564, 35743, 35921, 36099,
+    36276, 36451, 36626, 36800, 36974, 37146, 37318, 37488, 37659, 37828,
+    37996, 38164, 38331, 38498, 38663, 38828, 38992, 39156, 39319, 39481,
+    39642, 39803, 39963, 40123, 40282, 40440, 40597, 40754, 40911, 41067,
+    41222, 41377, 41531, 41684, 41837, 41989, 42141, 42292, 42443, 42593,
+    42743, 42892, 43041, 43189, 43336, 43484, 43630, 43776, 43922, 44067,
+    44212, 44356, 44499, 44643, 44785, 44928, 45070, 45211, 45352, 45493,
+    45633, 45772, 45912, 46050, 46189, 46327, 46464, 46602, 46738, 46875,
+    47011, 47146, 47281, 47416, 47551, 47685, 47818, 47952, 48085, 48217,
+    48349, 48481, 48612, 48744, 48874, 49005, 49135, 49264, 49394, 49523,
+    49652, 49780, 49908, 50036, 50163, 50290, 50417, 50543, 50669, 50795,
+    50920, 51046, 51170, 51295, 51419, 51543, 51667, 51790, 51913, 52036,
+    52158, 52280, 52402, 52524, 52645, 52766, 52887, 53008, 53128, 53248,
+    53367, 53487, 53606, 53725, 53843, 53962, 54080, 54198, 54315, 54432,
+    54549, 54666, 54783, 54899, 55015, 55131, 55247, 55362, 55477, 55592,
+    55706, 55821, 55935, 56049, 56163, 56276, 56389, 56502, 56615, 56727,
+    56840, 56952, 57064, 57175, 57287, 57398, 57509, 57620, 57730, 57841,
+    57951, 58061, 58171, 58280, 58389, 58498, 58607, 58716, 58825, 58933,
+    59041, 59149, 59257, 59364, 59471, 59579, 59685, 59792, 59899, 60005,
+    60111, 60217, 60323, 60429, 60534, 60639, 60744, 60849, 60954, 61058,
+    61163, 61267, 61371, 61475, 61578, 61682, 61785, 61888, 61991, 62094,
+    62196, 62299, 62401, 62503, 62605, 62707, 62808, 62910, 63011, 63112,
+    63213, 63314, 63414, 63515, 63615, 63715, 63815, 63915, 64015, 64114,
+    64214, 64313
+};
+
+uint16_t lightbulb_color_temp(const uint16_t mired) {
+    if (mired >= LIGHTBULB_COLOR_TEMP_MAX - 5) {
+        return LIGHTBULB_PWM_SCALE;
+    }
+
+    if (mired > LIGHTBULB_COLOR_TEMP_MIN + 1) {
+        return lightbulb_color_temp_lut[mired - LIGHTBULB_COLOR_TEMP_MIN - 2];
+    }
+
+    return 0;
+}
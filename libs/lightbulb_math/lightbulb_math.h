@@ -0,0 +1,77 @@
+/*
+ * Lightbulb Math
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Integer math of HAA lightbulbs, without hardware access, so it is
+ * checked on host by libs/lightbulb_math/test. ESP8266 has no FPU.
+ */
+
+#ifndef __LIGHTBULB_MATH_H__
+#define __LIGHTBULB_MATH_H__
+
+#include <stdint.h>
+
+#define LIGHTBULB_PWM_SCALE         (UINT16_MAX - 1)
+#define LIGHTBULB_FACTOR_ONE        (1 << 16)   // Factors and ratios are Q16
+
+#define LIGHTBULB_COLOR_TEMP_MIN    71          // Mired
+#define LIGHTBULB_COLOR_TEMP_MAX    400
+
+// White LEDs as RGB
+#define LIGHTBULB_CW_RED            52200
+#define LIGHTBULB_CW_GREEN          56000
+#define LIGHTBULB_CW_BLUE           LIGHTBULB_PWM_SCALE
+#define LIGHTBULB_WW_RED            LIGHTBULB_PWM_SCALE
+#define LIGHTBULB_WW_GREEN          40400
+#define LIGHTBULB_WW_BLUE           15600
+
+#define LIGHTBULB_FADE_LINEAR       0
+#define LIGHTBULB_FADE_EASE_IN_OUT  1
+#define LIGHTBULB_FADE_EASE_IN      2
+#define LIGHTBULB_FADE_EASE_OUT     3
+#define LIGHTBULB_FADE_ONE          (1 << 16)
+
+// Gamma 2.2 of a level from 0 to LIGHTBULB_PWM_SCALE, both ends are kept
+uint16_t lightbulb_gamma(const uint16_t level);
+
+// Progress and result go from 0 to LIGHTBULB_FADE_ONE, result never goes back while progress grows
+uint32_t lightbulb_fade_ease(const uint8_t curve, const uint32_t progress);
+
+typedef struct _lightbulb_rgbw {
+    uint16_t r;
+    uint16_t g;
+    uint16_t b;
+    uint16_t w;
+    uint16_t cw;
+    uint16_t ww;
+} lightbulb_rgbw_t;
+
+// Value scaled by a Q16 factor, limited to LIGHTBULB_PWM_SCALE
+uint16_t lightbulb_factor_scale(const uint32_t factor, const uint32_t value);
+
+// Q16 amount, up to LIGHTBULB_FACTOR_ONE, of white LED w_r, w_g, w_b inside r, g, b
+uint32_t lightbulb_white_factor(const uint32_t r, const uint32_t g, const uint32_t b, const uint32_t w_r, const uint32_t w_g, const uint32_t w_b, const uint32_t rgb_min, const uint32_t rgb_max);
+
+// Hue 0 to 359, saturation and brightness 0 to 100, to all channels from 0 to LIGHTBULB_PWM_SCALE
+void lightbulb_hsi2rgbw(uint16_t h, const uint16_t s, const uint16_t v, lightbulb_rgbw_t *rgbw);
+
+// Ratio from 0 to LIGHTBULB_PWM_SCALE of a color temperature in mired, growing with it, @seritos curve
+uint16_t lightbulb_color_temp(const uint16_t mired);
+
+#endif  // __LIGHTBULB_MATH_H__
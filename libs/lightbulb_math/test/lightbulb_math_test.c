@@ -0,0 +1,370 @@
+/*
+ * Lightbulb Math host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks gamma and fade curves on every input: ends, monotonicity and
+ * distance to float formulas. Color conversion is checked against float
+ * code it replaced, on every hue, saturation and brightness, and both are
+ * timed on host. There is no ESP8266 timing here, where float is emulated
+ * by software and gap is much bigger.
+ *
+ *   make -C libs/lightbulb_math/test
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "lightbulb_math.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES()      __rdtsc()
+#else
+#define BENCH_CYCLES()      0
+#endif
+
+#define GAMMA_MAX_ERROR     8       // PWM LSBs from pow(x, 2.2), table has 65 entries
+#define COLOR_MAX_ERROR     1       // PWM LSBs from float code
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void check_gamma() {
+    CHECK(lightbulb_gamma(0) == 0, "gamma(0) = %u", lightbulb_gamma(0));
+    CHECK(lightbulb_gamma(LIGHTBULB_PWM_SCALE) == LIGHTBULB_PWM_SCALE, "gamma(max) = %u", lightbulb_gamma(LIGHTBULB_PWM_SCALE));
+    CHECK(lightbulb_gamma(UINT16_MAX) == LIGHTBULB_PWM_SCALE, "gamma(65535) = %u", lightbulb_gamma(UINT16_MAX));
+
+    uint16_t last = 0;
+    uint32_t max_error = 0;
+    for (uint32_t level = 0; level <= LIGHTBULB_PWM_SCALE; level++) {
+        const uint16_t duty = lightbulb_gamma(level);
+        CHECK(duty >= last, "gamma(%u) = %u < gamma(%u) = %u", level, duty, level - 1, last);
+        CHECK(duty <= level, "gamma(%u) = %u above linear", level, duty);
+        last = duty;
+
+        const double reference = pow((double) level / LIGHTBULB_PWM_SCALE, 2.2) * LIGHTBULB_PWM_SCALE;
+        const uint32_t error = fabs(duty - reference) + 0.5;
+        if (error > max_error) {
+            max_error = error;
+        }
+    }
+
+    CHECK(max_error <= GAMMA_MAX_ERROR, "gamma error %u LSB", max_error);
+    printf("gamma: max error %u LSB from pow(x, 2.2)\n", max_error);
+}
+
+static void check_fade_ease() {
+    const char *names[] = { "linear", "ease in out", "ease in", "ease out" };
+
+    for (uint8_t curve = LIGHTBULB_FADE_LINEAR; curve <= LIGHTBULB_FADE_EASE_OUT; curve++) {
+        CHECK(lightbulb_fade_ease(curve, 0) == 0, "%s starts at %u", names[curve], lightbulb_fade_ease(curve, 0));
+        CHECK(lightbulb_fade_ease(curve, LIGHTBULB_FADE_ONE) == LIGHTBULB_FADE_ONE, "%s ends at %u",
+              names[curve], lightbulb_fade_ease(curve, LIGHTBULB_FADE_ONE));
+
+        uint32_t last = 0;
+        for (uint32_t progress = 0; progress <= LIGHTBULB_FADE_ONE; progress++) {
+            const uint32_t eased = lightbulb_fade_ease(curve, progress);
+            if (eased < last || eased > LIGHTBULB_FADE_ONE) {
+                CHECK(false, "%s(%u) = %u after %u", names[curve], progress, eased, last);
+                break;
+            }
+            last = eased;
+        }
+    }
+
+    // Ease in and ease out mirror each other, smoothstep mirrors itself
+    uint32_t max_error = 0;
+    for (uint32_t progress = 0; progress <= LIGHTBULB_FADE_ONE; progress++) {
+        const uint32_t in = lightbulb_fade_ease(LIGHTBULB_FADE_EASE_IN, progress);
+        const uint32_t out = lightbulb_fade_ease(LIGHTBULB_FADE_EASE_OUT, LIGHTBULB_FADE_ONE - progress);
+        const uint32_t in_out = lightbulb_fade_ease(LIGHTBULB_FADE_EASE_IN_OUT, progress);
+        const uint32_t in_out_mirror = lightbulb_fade_ease(LIGHTBULB_FADE_EASE_IN_OUT, LIGHTBULB_FADE_ONE - progress);
+
+        CHECK(in + out == LIGHTBULB_FADE_ONE, "ease in(%u) %u + ease out %u", progress, in, out);
+        const uint32_t error = abs((int32_t) (in_out + in_out_mirror) - LIGHTBULB_FADE_ONE);
+        if (error > max_error) {
+            max_error = error;
+        }
+    }
+
+    CHECK(max_error <= 1, "smoothstep not symmetric by %u", max_error);
+    CHECK(lightbulb_fade_ease(LIGHTBULB_FADE_EASE_IN_OUT, LIGHTBULB_FADE_ONE / 2) == LIGHTBULB_FADE_ONE / 2, "smoothstep middle");
+}
+
+static void check_factor_scale() {
+    const uint32_t factors[] = { 0, LIGHTBULB_FACTOR_ONE / 4, LIGHTBULB_FACTOR_ONE / 2, 49807, LIGHTBULB_FACTOR_ONE, 98304, 2 * LIGHTBULB_FACTOR_ONE };
+
+    for (uint8_t f = 0; f < sizeof(factors) / sizeof(factors[0]); f++) {
+        const double factor = (double) factors[f] / LIGHTBULB_FACTOR_ONE;
+        for (uint32_t value = 0; value <= LIGHTBULB_PWM_SCALE; value++) {
+            double reference = factor * value;
+            if (reference > LIGHTBULB_PWM_SCALE) {
+                reference = LIGHTBULB_PWM_SCALE;
+            }
+
+            const uint16_t scaled = lightbulb_factor_scale(factors[f], value);
+            if (scaled != (uint16_t) reference) {
+                CHECK(false, "factor %f * %u = %u, float %f", factor, value, scaled, reference);
+                break;
+            }
+        }
+    }
+}
+
+// Float code replaced by lightbulb_white_factor(), with its clamps
+static double reference_white_factor(const double r, const double g, const double b, const double w_r, const double w_g, const double w_b, const double rgb_min, const double rgb_max) {
+    double r_f = 1;
+    double g_f = 1;
+    double b_f = 1;
+    double w_f = 0;
+
+    if (rgb_max >= 1) {
+        const double w_min = fmin(fmin(w_r, w_g), w_b);
+
+        if (w_r > w_min) {
+            r_f = (r - rgb_min) / (w_g - w_min);
+        }
+
+        if (w_g > w_min) {
+            g_f = (g - rgb_min) / (w_g - w_min);
+        }
+
+        if (w_b > w_min) {
+            b_f = (b - rgb_min) / (w_b - w_min);
+        }
+
+        w_f = fmin(fmax(0, fmin(fmin(r_f, g_f), b_f)), 1);
+    }
+
+    if (w_r > 0) {
+        r_f = r / w_r;
+    }
+
+    if (w_g > 0) {
+        g_f = g / w_g;
+    }
+
+    if (w_b > 0) {
+        b_f = b / w_b;
+    }
+
+    return fmin(fmax(0, fmin(fmin(fmin(r_f, g_f), b_f), w_f)), 1);
+}
+
+// Float code replaced by lightbulb_hsi2rgbw(), RGB steps were already truncated to integer there
+static void reference_hsi2rgbw(uint16_t h, const uint16_t s, const uint16_t v, lightbulb_rgbw_t *rgbw) {
+    h %= 360;
+    const uint32_t rgb_max = v * (double) LIGHTBULB_PWM_SCALE / 100;
+    const uint32_t rgb_min = rgb_max * (100 - s) / 100.0;
+
+    const uint32_t i = h / 60;
+    const uint32_t diff = h % 60;
+
+    const uint32_t rgb_adj = (rgb_max - rgb_min) * diff / 60;
+
+    uint32_t r, g, b;
+
+    switch (i) {
+        case 0:
+            r = rgb_max;
+            g = rgb_min + rgb_adj;
+            b = rgb_min;
+            break;
+        case 1:
+            r = rgb_max - rgb_adj;
+            g = rgb_max;
+            b = rgb_min;
+            break;
+        case 2:
+            r = rgb_min;
+            g = rgb_max;
+            b = rgb_min + rgb_adj;
+            break;
+        case 3:
+            r = rgb_min;
+            g = rgb_max - rgb_adj;
+            b = rgb_max;
+            break;
+        case 4:
+            r = rgb_min + rgb_adj;
+            g = rgb_min;
+            b = rgb_max;
+            break;
+        default:
+            r = rgb_max;
+            g = rgb_min;
+            b = rgb_max - rgb_adj;
+            break;
+    }
+
+    double cw_f = reference_white_factor(r, g, b, LIGHTBULB_CW_RED, LIGHTBULB_CW_GREEN, LIGHTBULB_CW_BLUE, rgb_min, rgb_max);
+    double ww_f = reference_white_factor(r, g, b, LIGHTBULB_WW_RED, LIGHTBULB_WW_GREEN, LIGHTBULB_WW_BLUE, rgb_min, rgb_max);
+
+    const double white_f = ww_f - cw_f;
+    if (white_f > 1) {
+        cw_f /= white_f;
+        ww_f /= white_f;
+    }
+
+    const uint32_t cw = cw_f * LIGHTBULB_PWM_SCALE;
+    const uint32_t ww = ww_f * LIGHTBULB_PWM_SCALE;
+
+    rgbw->r  = ((r  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : r);
+    rgbw->g  = ((g  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : g);
+    rgbw->b  = ((b  > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : b);
+    rgbw->w  = ((rgb_min > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : rgb_min);
+    rgbw->cw = ((cw > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : cw);
+    rgbw->ww = ((ww > LIGHTBULB_PWM_SCALE) ? LIGHTBULB_PWM_SCALE : ww);
+}
+
+static uint32_t channel_error(const uint16_t a, const uint16_t b) {
+    return (a > b) ? a - b : b - a;
+}
+
+static void check_hsi2rgbw() {
+    const char *names[] = { "r", "g", "b", "w", "cw", "ww" };
+    uint32_t max_error[6] = { 0 };
+
+    for (uint16_t h = 0; h < 360; h++) {
+        for (uint16_t s = 0; s <= 100; s++) {
+            for (uint16_t v = 0; v <= 100; v++) {
+                lightbulb_rgbw_t rgbw, reference;
+                lightbulb_hsi2rgbw(h, s, v, &rgbw);
+                reference_hsi2rgbw(h, s, v, &reference);
+
+                const uint32_t error[6] = {
+                    channel_error(rgbw.r, reference.r),
+                    channel_error(rgbw.g, reference.g),
+                    channel_error(rgbw.b, reference.b),
+                    channel_error(rgbw.w, reference.w),
+                    channel_error(rgbw.cw, reference.cw),
+                    channel_error(rgbw.ww, reference.ww)
+                };
+
+                for (uint8_t c = 0; c < 6; c++) {
+                    if (error[c] > max_error[c]) {
+                        max_error[c] = error[c];
+                        CHECK(error[c] <= COLOR_MAX_ERROR, "hsi(%u, %u, %u) %s error %u LSB", h, s, v, names[c], error[c]);
+                    }
+                }
+            }
+        }
+    }
+
+    printf("hsi2rgbw: max error r %u, g %u, b %u, w %u, cw %u, ww %u LSB from float\n",
+           max_error[0], max_error[1], max_error[2], max_error[3], max_error[4], max_error[5]);
+
+    // Hue wraps
+    lightbulb_rgbw_t rgbw, wrapped;
+    lightbulb_hsi2rgbw(30, 80, 70, &rgbw);
+    lightbulb_hsi2rgbw(390, 80, 70, &wrapped);
+    CHECK(rgbw.r == wrapped.r && rgbw.g == wrapped.g && rgbw.b == wrapped.b && rgbw.cw == wrapped.cw, "hue 390 is not 30");
+
+    // Off is all off, white is full W
+    lightbulb_hsi2rgbw(0, 0, 0, &rgbw);
+    CHECK(rgbw.r == 0 && rgbw.g == 0 && rgbw.b == 0 && rgbw.w == 0 && rgbw.cw == 0 && rgbw.ww == 0, "off is not off");
+    lightbulb_hsi2rgbw(0, 0, 100, &rgbw);
+    CHECK(rgbw.w == LIGHTBULB_PWM_SCALE && rgbw.r == LIGHTBULB_PWM_SCALE, "white w %u, r %u", rgbw.w, rgbw.r);
+}
+
+static void check_color_temp() {
+    CHECK(lightbulb_color_temp(0) == 0, "color temp 0");
+    CHECK(lightbulb_color_temp(LIGHTBULB_COLOR_TEMP_MIN) == 0, "color temp min %u", lightbulb_color_temp(LIGHTBULB_COLOR_TEMP_MIN));
+    CHECK(lightbulb_color_temp(LIGHTBULB_COLOR_TEMP_MAX) == LIGHTBULB_PWM_SCALE, "color temp max %u", lightbulb_color_temp(LIGHTBULB_COLOR_TEMP_MAX));
+    CHECK(lightbulb_color_temp(UINT16_MAX) == LIGHTBULB_PWM_SCALE, "color temp 65535");
+
+    uint16_t last = 0;
+    uint32_t max_error = 0;
+    for (uint16_t mired = LIGHTBULB_COLOR_TEMP_MIN; mired <= LIGHTBULB_COLOR_TEMP_MAX; mired++) {
+        const uint16_t ratio = lightbulb_color_temp(mired);
+        CHECK(ratio >= last, "color temp %u = %u < %u", mired, ratio, last);
+        last = ratio;
+
+        if (mired > LIGHTBULB_COLOR_TEMP_MIN + 1 && mired < LIGHTBULB_COLOR_TEMP_MAX - 5) {
+            const uint16_t reference = LIGHTBULB_PWM_SCALE * (((0.09 + sqrt(0.18 + (0.1352 * (mired - LIGHTBULB_COLOR_TEMP_MIN - 1)))) / 0.0676) - 1) / 100;
+            const uint32_t error = channel_error(ratio, reference);
+            if (error > max_error) {
+                max_error = error;
+            }
+        }
+    }
+
+    CHECK(max_error <= COLOR_MAX_ERROR, "color temp error %u LSB", max_error);
+    printf("color temp: max error %u LSB from float\n", max_error);
+}
+
+static uint64_t bench_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Host CPU only, it has FPU, so it tells nothing about ESP8266
+static void bench_hsi2rgbw(const char *name, void (*convert)(uint16_t, const uint16_t, const uint16_t, lightbulb_rgbw_t *)) {
+    volatile uint32_t sink = 0;
+    uint32_t calls = 0;
+
+    const uint64_t start_ns = bench_ns();
+    const uint64_t start_cycles = BENCH_CYCLES();
+
+    for (uint16_t h = 0; h < 360; h++) {
+        for (uint16_t s = 0; s <= 100; s++) {
+            for (uint16_t v = 0; v <= 100; v++) {
+                lightbulb_rgbw_t rgbw;
+                convert(h, s, v, &rgbw);
+                sink += rgbw.cw + rgbw.ww;
+                calls++;
+            }
+        }
+    }
+
+    const uint64_t cycles = BENCH_CYCLES() - start_cycles;
+    const uint64_t ns = bench_ns() - start_ns;
+
+    printf("bench %s: %.1f ns, %.1f TSC cycles per call on host\n", name, (double) ns / calls, (double) cycles / calls);
+}
+
+int main() {
+    check_gamma();
+    check_fade_ease();
+    check_factor_scale();
+    check_hsi2rgbw();
+    check_color_temp();
+
+    bench_hsi2rgbw("hsi2rgbw integer", lightbulb_hsi2rgbw);
+    bench_hsi2rgbw("hsi2rgbw float in double", reference_hsi2rgbw);
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("lightbulb_math: all checks passed\n");
+    return 0;
+}
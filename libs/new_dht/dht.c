@@ -8,14 +8,28 @@
 #include "dht.h"
 #include "FreeRTOS.h"
 #include "string.h"
+#include "stdlib.h"
 #include "task.h"
 #include "esp/gpio.h"
 
+#include <etstimer.h>
+#include <esplibs/libmain.h>
 #include <espressif/esp_misc.h> // sdk_os_delay_us
 
-// DHT timer precision in microseconds
-#define DHT_TIMER_INTERVAL 2
-#define DHT_DATA_BITS 40
+// Release, phases C and D, and 40 bits with 2 edges each, with margin for glitches
+#define DHT_MAX_EDGES 96
+
+// Timers are rounded to ticks and first one can fire almost at once,
+// so they get one tick more than needed, and never less than one tick
+#define DHT_TIMER_MS(ms) ((((ms) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS + 1) * portTICK_PERIOD_MS)
+
+// Phase A for DHT11 and DHT22, SI7021 one is too short for a timer.
+// DHT11 needs at least 18 ms low
+#define DHT_START_MS DHT_TIMER_MS(30)
+#define DHT_SI7021_START_US 500
+
+// 40 bits take 5.4 ms at most
+#define DHT_CAPTURE_MS DHT_TIMER_MS(8)
 
 // #define DEBUG_DHT
 #ifdef DEBUG_DHT
@@ -60,128 +74,131 @@
 */
 
 
-/**
- * Wait specified time for pin to go to a specified state.
- * If timeout is reached and pin doesn't go to a requested state
- * false is returned.
- * The elapsed time is returned in pointer 'duration' if it is not NULL.
- */
-static bool dht_await_pin_state(uint8_t pin, uint32_t timeout,
-        bool expected_pin_state, uint32_t *duration)
+typedef struct
 {
-    for (uint32_t i = 0; i < timeout; i += DHT_TIMER_INTERVAL) {
-        // need to wait at least a single interval to prevent reading a jitter
-        sdk_os_delay_us(DHT_TIMER_INTERVAL);
-        if (gpio_read(pin) == expected_pin_state) {
-            if (duration) {
-                *duration = i;
-            }
-            return true;
-        }
-    }
+    ETSTimer timer;
+    dht_sensor_type_t sensor_type;
+    uint8_t pin;
+    volatile uint8_t edge_count;
+    dht_edge_t edges[DHT_MAX_EDGES];
+    dht_read_callback_fn callback;
+    void *args;
+} dht_read_t;
+
+static dht_read_t *dht_reads[16];
+
+static IRAM void dht_interrupt(const uint8_t gpio)
+{
+    dht_read_t *read = dht_reads[gpio];
 
-    return false;
+    if (read && read->edge_count < DHT_MAX_EDGES) {
+        dht_edge_t *edge = &read->edges[read->edge_count];
+        edge->time = sdk_system_get_time();
+        edge->level = gpio_read(gpio);
+        read->edge_count++;
+    }
 }
 
-/**
- * Request data from DHT and read raw bit stream.
- * The function call should be protected from task switching.
- * Return false if error occurred.
- */
-static inline bool dht_fetch_data(dht_sensor_type_t sensor_type, uint8_t pin, bool bits[DHT_DATA_BITS])
+static void dht_capture_done(void *args)
 {
-    uint32_t low_duration;
-    uint32_t high_duration;
+    dht_read_t *read = args;
+    int16_t humidity = 0;
+    int16_t temperature = 0;
 
-    // Phase 'A' pulling signal low to initiate read sequence
-    gpio_write(pin, 0);
-    sdk_os_delay_us(sensor_type == DHT_TYPE_SI7021 ? 500 : 20000);
-    gpio_write(pin, 1);
+    gpio_set_interrupt(read->pin, GPIO_INTTYPE_NONE, NULL);
 
-    // Step through Phase 'B', 200us
-    if (!dht_await_pin_state(pin, sensor_type == DHT_TYPE_SI7021 ? 200 : 40, false, NULL)) {
-        debug("Initialization error, problem in phase 'B'\n");
-        return false;
+    const bool result = dht_decode_edges(read->sensor_type, read->edges, read->edge_count, &humidity, &temperature);
+    if (!result) {
+        debug("No valid data, %i edges\n", read->edge_count);
     }
 
-    // Step through Phase 'C', 88us
-    if (!dht_await_pin_state(pin, 88, true, NULL)) {
-        debug("Initialization error, problem in phase 'C'\n");
+    dht_reads[read->pin] = NULL;
+    read->callback(result, humidity, temperature, read->args);
+    free(read);
+}
+
+// End of phase A. Sensor answer is captured from here
+static void dht_release(void *args)
+{
+    dht_read_t *read = args;
+
+    read->edge_count = 0;
+    gpio_set_interrupt(read->pin, GPIO_INTTYPE_EDGE_ANY, dht_interrupt);
+    gpio_write(read->pin, 1);
+
+    sdk_os_timer_setfn(&read->timer, dht_capture_done, read);
+    sdk_os_timer_arm(&read->timer, DHT_CAPTURE_MS, false);
+}
+
+bool dht_read_async(dht_sensor_type_t sensor_type, uint8_t pin, dht_read_callback_fn callback, void *args)
+{
+    if (pin > 15 || dht_reads[pin]) {
         return false;
     }
 
-    // Step through Phase 'D', 88us
-    if (!dht_await_pin_state(pin, 88, false, NULL)) {
-        debug("Initialization error, problem in phase 'D'\n");
+    dht_read_t *read = malloc(sizeof(dht_read_t));
+    if (!read) {
         return false;
     }
 
-    // Read in each of the 40 bits of data...
-    for (int i = 0; i < DHT_DATA_BITS; i++) {
-        if (!dht_await_pin_state(pin, 65, true, &low_duration)) {
-            debug("LOW bit timeout\n");
-            return false;
-        }
-        if (!dht_await_pin_state(pin, 75, false, &high_duration)) {
-            debug("HIGHT bit timeout\n");
-            return false;
-        }
-        bits[i] = high_duration > low_duration;
+    memset(read, 0, sizeof(*read));
+    read->sensor_type = sensor_type;
+    read->pin = pin;
+    read->callback = callback;
+    read->args = args;
+    dht_reads[pin] = read;
+
+    // Phase 'A' pulling signal low to initiate read sequence
+    gpio_enable(pin, GPIO_OUT_OPEN_DRAIN);
+    gpio_write(pin, 0);
+
+    if (sensor_type == DHT_TYPE_SI7021) {
+        sdk_os_delay_us(DHT_SI7021_START_US);
+        dht_release(read);
+    } else {
+        sdk_os_timer_setfn(&read->timer, dht_release, read);
+        sdk_os_timer_arm(&read->timer, DHT_START_MS, false);
     }
+
     return true;
 }
 
-/**
- * Pack two data bytes into single value and take into account sign bit.
- */
-static inline int16_t dht_convert_data(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb)
+typedef struct
 {
-    int16_t data;
-
-    if (sensor_type == DHT_TYPE_DHT22 || sensor_type == DHT_TYPE_SI7021) {
-        data = msb & 0x7F;
-        data <<= 8;
-        data |= lsb;
-        if (msb & BIT(7)) {
-            data = 0 - data;       // convert it to negative
-        }
-    }
-    else {
-        data = msb * 10;
-    }
+    volatile bool done;
+    bool result;
+    int16_t humidity;
+    int16_t temperature;
+} dht_read_wait_t;
 
-    return data;
+static void dht_read_wait_callback(bool result, int16_t humidity, int16_t temperature, void *args)
+{
+    dht_read_wait_t *wait = args;
+    wait->result = result;
+    wait->humidity = humidity;
+    wait->temperature = temperature;
+    wait->done = true;
 }
 
 bool dht_read_data(dht_sensor_type_t sensor_type, uint8_t pin, int16_t *humidity, int16_t *temperature)
 {
-    bool bits[DHT_DATA_BITS];
-    uint8_t data[DHT_DATA_BITS/8] = {0};
-    bool result;
+    dht_read_wait_t wait;
+    memset(&wait, 0, sizeof(wait));
 
-    gpio_enable(pin, GPIO_OUT_OPEN_DRAIN);
-
-    taskENTER_CRITICAL();
-    result = dht_fetch_data(sensor_type, pin, bits);
-    taskEXIT_CRITICAL();
-
-    if (!result) {
+    if (!dht_read_async(sensor_type, pin, dht_read_wait_callback, &wait)) {
         return false;
     }
 
-    for (uint8_t i = 0; i < DHT_DATA_BITS; i++) {
-        // Read each bit into 'result' byte array...
-        data[i/8] <<= 1;
-        data[i/8] |= bits[i];
+    while (!wait.done) {
+        vTaskDelay(1);
     }
 
-    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
-        debug("Checksum failed, invalid data received from sensor\n");
+    if (!wait.result) {
         return false;
     }
 
-    *humidity = dht_convert_data(sensor_type, data[0], data[1]);
-    *temperature = dht_convert_data(sensor_type, data[2], data[3]);
+    *humidity = wait.humidity;
+    *temperature = wait.temperature;
 
     debug("Sensor data: humidity=%d, temp=%d\n", *humidity, *temperature);
 
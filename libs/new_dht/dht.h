@@ -25,6 +25,38 @@ typedef enum
     DHT_TYPE_SI7021     //!< Itead SI7021
 } dht_sensor_type_t;
 
+/**
+ * Edge captured by GPIO interrupt while sensor sends data.
+ */
+typedef struct
+{
+    uint32_t time;      //!< Microseconds
+    bool level;         //!< Pin level after edge
+} dht_edge_t;
+
+/**
+ * Called from timer task context when an asynchronous read ends.
+ */
+typedef void (*dht_read_callback_fn)(bool result, int16_t humidity, int16_t temperature, void *args);
+
+/**
+ * Start reading sensor on specified pin without blocking.
+ *
+ * Start pulse is timed with a timer and data bits are captured by GPIO edge
+ * interrupts with microsecond timestamps, so interrupts are never disabled.
+ * Bits are decoded in timer task context about 30 ms later and callback is
+ * called with the result. Only one read per pin can be running.
+ *
+ * Returns false if read could not be started.
+ */
+bool dht_read_async(dht_sensor_type_t sensor_type, uint8_t pin, dht_read_callback_fn callback, void *args);
+
+/**
+ * Decode captured edges into humidity and temperature, checksum included.
+ * It does not access hardware.
+ */
+bool dht_decode_edges(dht_sensor_type_t sensor_type, const dht_edge_t *edges, uint8_t edge_count, int16_t *humidity, int16_t *temperature);
+
 /**
  * Read data from sensor on specified pin.
  *
@@ -32,6 +64,7 @@ typedef enum
  * For example: humidity=625 is 62.5 %
  *              temperature=24.4 is 24.4 degrees Celsius
  *
+ * It uses dht_read_async() and waits for result, so it must be called from a task.
  */
 bool dht_read_data(dht_sensor_type_t sensor_type, uint8_t pin, int16_t *humidity, int16_t *temperature);
 
@@ -0,0 +1,83 @@
+/*
+ * Part of esp-open-rtos
+ * Copyright (C) 2016 Jonathan Hartsuiker (https://github.com/jsuiker)
+ * BSD Licensed as described in the file LICENSE
+ *
+ */
+
+#include "dht.h"
+
+#define DHT_DATA_BITS 40
+
+/*
+ *  Each data bit is a ~50us low level followed by a high level, shorter than
+ *  the low one for a logic '0' and longer for a logic '1'. Last falling edge
+ *  ends the 40th bit, and then sensor releases the line once more.
+ *
+ *  Edges before data (MCU release of the line and phases C and D) are not
+ *  needed: data bits are the last 40 high levels ended by a falling edge,
+ *  and they must be contiguous so a lost edge is not hidden by preamble ones.
+ */
+
+/**
+ * Pack two data bytes into single value and take into account sign bit.
+ */
+static int16_t dht_convert_data(dht_sensor_type_t sensor_type, uint8_t msb, uint8_t lsb)
+{
+    int16_t data;
+
+    if (sensor_type == DHT_TYPE_DHT22 || sensor_type == DHT_TYPE_SI7021) {
+        data = msb & 0x7F;
+        data <<= 8;
+        data |= lsb;
+        if (msb & 0x80) {
+            data = 0 - data;       // convert it to negative
+        }
+    }
+    else {
+        data = msb * 10;
+    }
+
+    return data;
+}
+
+bool dht_decode_edges(dht_sensor_type_t sensor_type, const dht_edge_t *edges, uint8_t edge_count, int16_t *humidity, int16_t *temperature)
+{
+    uint8_t data[DHT_DATA_BITS/8] = {0};
+    uint8_t bit_count = 0;
+
+    // Walk backwards from last falling edge, each high level and its previous low level is a bit
+    for (int16_t i = edge_count - 1; i >= 2 && bit_count < DHT_DATA_BITS; i--) {
+        if (edges[i].level || !edges[i - 1].level || edges[i - 2].level) {
+            if (bit_count > 0) {
+                // Missed edge inside data bits
+                return false;
+            }
+            continue;
+        }
+
+        const uint32_t high_duration = edges[i].time - edges[i - 1].time;
+        const uint32_t low_duration = edges[i - 1].time - edges[i - 2].time;
+
+        const uint8_t bit = DHT_DATA_BITS - 1 - bit_count;
+        if (high_duration > low_duration) {
+            data[bit / 8] |= 0x80 >> (bit % 8);
+        }
+
+        bit_count++;
+        i--;
+    }
+
+    if (bit_count < DHT_DATA_BITS) {
+        return false;
+    }
+
+    if (data[4] != ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
+        return false;
+    }
+
+    *humidity = dht_convert_data(sensor_type, data[0], data[1]);
+    *temperature = dht_convert_data(sensor_type, data[2], data[3]);
+
+    return true;
+}
@@ -0,0 +1,209 @@
+/*
+ * Part of esp-open-rtos
+ * Copyright (C) 2016 Jonathan Hartsuiker (https://github.com/jsuiker)
+ * BSD Licensed as described in the file LICENSE
+ *
+ */
+
+/*
+ *  Host checks for dht_decode_edges(), run with: make -C libs/new_dht/test
+ *
+ *  Frames are edge arrays in the format dht_interrupt() captures them: MCU
+ *  release of the line, sensor response (phases C and D), 40 data bits and
+ *  final release. Timing follows DHT22 datasheet with +-2 us jitter.
+ */
+
+#include <stdio.h>
+
+#include "dht.h"
+
+// DHT22, 65.2 %, 25.1 C
+static const dht_edge_t dht22_frame[] = {
+    { 18432007, 1 }, { 18432036, 0 }, { 18432117, 1 }, { 18432195, 0 }, { 18432245, 1 }, { 18432268, 0 },
+    { 18432318, 1 }, { 18432344, 0 }, { 18432390, 1 }, { 18432417, 0 }, { 18432464, 1 }, { 18432489, 0 },
+    { 18432538, 1 }, { 18432563, 0 }, { 18432614, 1 }, { 18432639, 0 }, { 18432692, 1 }, { 18432759, 0 },
+    { 18432809, 1 }, { 18432833, 0 }, { 18432883, 1 }, { 18432953, 0 }, { 18433005, 1 }, { 18433031, 0 },
+    { 18433081, 1 }, { 18433107, 0 }, { 18433155, 1 }, { 18433180, 0 }, { 18433230, 1 }, { 18433301, 0 },
+    { 18433354, 1 }, { 18433425, 0 }, { 18433478, 1 }, { 18433504, 0 }, { 18433553, 1 }, { 18433576, 0 },
+    { 18433626, 1 }, { 18433653, 0 }, { 18433704, 1 }, { 18433733, 0 }, { 18433785, 1 }, { 18433806, 0 },
+    { 18433859, 1 }, { 18433883, 0 }, { 18433933, 1 }, { 18433957, 0 }, { 18434008, 1 }, { 18434037, 0 },
+    { 18434091, 1 }, { 18434116, 0 }, { 18434169, 1 }, { 18434197, 0 }, { 18434243, 1 }, { 18434314, 0 },
+    { 18434365, 1 }, { 18434433, 0 }, { 18434488, 1 }, { 18434559, 0 }, { 18434613, 1 }, { 18434681, 0 },
+    { 18434732, 1 }, { 18434803, 0 }, { 18434852, 1 }, { 18434874, 0 }, { 18434928, 1 }, { 18434996, 0 },
+    { 18435048, 1 }, { 18435117, 0 }, { 18435167, 1 }, { 18435240, 0 }, { 18435289, 1 }, { 18435317, 0 },
+    { 18435368, 1 }, { 18435394, 0 }, { 18435442, 1 }, { 18435464, 0 }, { 18435512, 1 }, { 18435579, 0 },
+    { 18435632, 1 }, { 18435656, 0 }, { 18435704, 1 }, { 18435729, 0 }, { 18435781, 1 }, { 18435855, 0 },
+    { 18435905, 1 },
+};
+
+// DHT22, 45.0 %, -10.1 C, timestamps wrap around
+static const dht_edge_t dht22_negative_frame[] = {
+    { 4294967039, 1 }, { 4294967071, 0 }, { 4294967153, 1 }, { 4294967231, 0 }, { 4294967284, 1 }, { 15, 0 },
+    { 67, 1 }, { 91, 0 }, { 145, 1 }, { 167, 0 }, { 214, 1 }, { 239, 0 },
+    { 287, 1 }, { 312, 0 }, { 358, 1 }, { 384, 0 }, { 434, 1 }, { 461, 0 },
+    { 507, 1 }, { 578, 0 }, { 628, 1 }, { 698, 0 }, { 750, 1 }, { 819, 0 },
+    { 868, 1 }, { 895, 0 }, { 946, 1 }, { 968, 0 }, { 1016, 1 }, { 1044, 0 },
+    { 1094, 1 }, { 1119, 0 }, { 1170, 1 }, { 1239, 0 }, { 1294, 1 }, { 1319, 0 },
+    { 1367, 1 }, { 1439, 0 }, { 1488, 1 }, { 1512, 0 }, { 1566, 1 }, { 1593, 0 },
+    { 1645, 1 }, { 1671, 0 }, { 1724, 1 }, { 1749, 0 }, { 1800, 1 }, { 1826, 0 },
+    { 1877, 1 }, { 1900, 0 }, { 1951, 1 }, { 1977, 0 }, { 2028, 1 }, { 2056, 0 },
+    { 2104, 1 }, { 2171, 0 }, { 2221, 1 }, { 2290, 0 }, { 2340, 1 }, { 2369, 0 },
+    { 2421, 1 }, { 2447, 0 }, { 2499, 1 }, { 2568, 0 }, { 2621, 1 }, { 2646, 0 },
+    { 2697, 1 }, { 2766, 0 }, { 2818, 1 }, { 2885, 0 }, { 2933, 1 }, { 2955, 0 },
+    { 3008, 1 }, { 3079, 0 }, { 3135, 1 }, { 3161, 0 }, { 3212, 1 }, { 3283, 0 },
+    { 3329, 1 }, { 3355, 0 }, { 3406, 1 }, { 3431, 0 }, { 3484, 1 }, { 3507, 0 },
+    { 3556, 1 },
+};
+
+// DHT11, 42 %, 23 C
+static const dht_edge_t dht11_frame[] = {
+    { 5230118, 1 }, { 5230150, 0 }, { 5230229, 1 }, { 5230311, 0 }, { 5230361, 1 }, { 5230389, 0 },
+    { 5230442, 1 }, { 5230465, 0 }, { 5230518, 1 }, { 5230591, 0 }, { 5230647, 1 }, { 5230673, 0 },
+    { 5230724, 1 }, { 5230794, 0 }, { 5230849, 1 }, { 5230875, 0 }, { 5230922, 1 }, { 5230990, 0 },
+    { 5231043, 1 }, { 5231069, 0 }, { 5231119, 1 }, { 5231146, 0 }, { 5231200, 1 }, { 5231224, 0 },
+    { 5231274, 1 }, { 5231297, 0 }, { 5231345, 1 }, { 5231370, 0 }, { 5231423, 1 }, { 5231444, 0 },
+    { 5231495, 1 }, { 5231524, 0 }, { 5231578, 1 }, { 5231602, 0 }, { 5231655, 1 }, { 5231683, 0 },
+    { 5231734, 1 }, { 5231764, 0 }, { 5231816, 1 }, { 5231841, 0 }, { 5231891, 1 }, { 5231915, 0 },
+    { 5231966, 1 }, { 5232033, 0 }, { 5232082, 1 }, { 5232106, 0 }, { 5232158, 1 }, { 5232227, 0 },
+    { 5232276, 1 }, { 5232346, 0 }, { 5232393, 1 }, { 5232465, 0 }, { 5232513, 1 }, { 5232538, 0 },
+    { 5232591, 1 }, { 5232617, 0 }, { 5232666, 1 }, { 5232689, 0 }, { 5232742, 1 }, { 5232765, 0 },
+    { 5232818, 1 }, { 5232842, 0 }, { 5232893, 1 }, { 5232922, 0 }, { 5232974, 1 }, { 5232995, 0 },
+    { 5233048, 1 }, { 5233069, 0 }, { 5233119, 1 }, { 5233141, 0 }, { 5233190, 1 }, { 5233261, 0 },
+    { 5233311, 1 }, { 5233340, 0 }, { 5233393, 1 }, { 5233421, 0 }, { 5233469, 1 }, { 5233491, 0 },
+    { 5233540, 1 }, { 5233563, 0 }, { 5233614, 1 }, { 5233637, 0 }, { 5233688, 1 }, { 5233756, 0 },
+    { 5233804, 1 },
+};
+
+// DHT22, 65.2 %, 25.1 C with checksum 0x88 instead of 0x89
+static const dht_edge_t dht22_bad_checksum_frame[] = {
+    { 9100412, 1 }, { 9100440, 0 }, { 9100520, 1 }, { 9100602, 0 }, { 9100653, 1 }, { 9100679, 0 },
+    { 9100729, 1 }, { 9100756, 0 }, { 9100803, 1 }, { 9100826, 0 }, { 9100874, 1 }, { 9100899, 0 },
+    { 9100950, 1 }, { 9100976, 0 }, { 9101027, 1 }, { 9101052, 0 }, { 9101104, 1 }, { 9101172, 0 },
+    { 9101218, 1 }, { 9101248, 0 }, { 9101299, 1 }, { 9101372, 0 }, { 9101422, 1 }, { 9101446, 0 },
+    { 9101500, 1 }, { 9101528, 0 }, { 9101580, 1 }, { 9101607, 0 }, { 9101656, 1 }, { 9101724, 0 },
+    { 9101775, 1 }, { 9101842, 0 }, { 9101888, 1 }, { 9101916, 0 }, { 9101966, 1 }, { 9101987, 0 },
+    { 9102041, 1 }, { 9102068, 0 }, { 9102119, 1 }, { 9102147, 0 }, { 9102196, 1 }, { 9102219, 0 },
+    { 9102270, 1 }, { 9102293, 0 }, { 9102343, 1 }, { 9102370, 0 }, { 9102417, 1 }, { 9102441, 0 },
+    { 9102490, 1 }, { 9102513, 0 }, { 9102562, 1 }, { 9102588, 0 }, { 9102639, 1 }, { 9102710, 0 },
+    { 9102762, 1 }, { 9102830, 0 }, { 9102882, 1 }, { 9102952, 0 }, { 9103002, 1 }, { 9103071, 0 },
+    { 9103121, 1 }, { 9103188, 0 }, { 9103242, 1 }, { 9103268, 0 }, { 9103319, 1 }, { 9103389, 0 },
+    { 9103441, 1 }, { 9103508, 0 }, { 9103564, 1 }, { 9103637, 0 }, { 9103688, 1 }, { 9103717, 0 },
+    { 9103769, 1 }, { 9103799, 0 }, { 9103852, 1 }, { 9103873, 0 }, { 9103920, 1 }, { 9103988, 0 },
+    { 9104040, 1 }, { 9104065, 0 }, { 9104116, 1 }, { 9104146, 0 }, { 9104198, 1 }, { 9104224, 0 },
+    { 9104272, 1 },
+};
+
+// DHT22 frame with falling edge of 19th bit lost
+static const dht_edge_t dht22_lost_edge_frame[] = {
+    { 7700220, 1 }, { 7700248, 0 }, { 7700330, 1 }, { 7700412, 0 }, { 7700462, 1 }, { 7700486, 0 },
+    { 7700534, 1 }, { 7700558, 0 }, { 7700610, 1 }, { 7700635, 0 }, { 7700687, 1 }, { 7700711, 0 },
+    { 7700764, 1 }, { 7700789, 0 }, { 7700841, 1 }, { 7700866, 0 }, { 7700915, 1 }, { 7700985, 0 },
+    { 7701039, 1 }, { 7701061, 0 }, { 7701110, 1 }, { 7701181, 0 }, { 7701232, 1 }, { 7701259, 0 },
+    { 7701313, 1 }, { 7701340, 0 }, { 7701391, 1 }, { 7701418, 0 }, { 7701470, 1 }, { 7701541, 0 },
+    { 7701589, 1 }, { 7701658, 0 }, { 7701709, 1 }, { 7701734, 0 }, { 7701785, 1 }, { 7701810, 0 },
+    { 7701857, 1 }, { 7701882, 0 }, { 7701933, 1 }, { 7701958, 0 }, { 7702039, 0 }, { 7702087, 1 },
+    { 7702115, 0 }, { 7702165, 1 }, { 7702192, 0 }, { 7702239, 1 }, { 7702263, 0 }, { 7702317, 1 },
+    { 7702343, 0 }, { 7702395, 1 }, { 7702421, 0 }, { 7702472, 1 }, { 7702540, 0 }, { 7702588, 1 },
+    { 7702659, 0 }, { 7702706, 1 }, { 7702774, 0 }, { 7702824, 1 }, { 7702893, 0 }, { 7702946, 1 },
+    { 7703014, 0 }, { 7703065, 1 }, { 7703088, 0 }, { 7703134, 1 }, { 7703203, 0 }, { 7703252, 1 },
+    { 7703325, 0 }, { 7703374, 1 }, { 7703445, 0 }, { 7703494, 1 }, { 7703523, 0 }, { 7703570, 1 },
+    { 7703594, 0 }, { 7703647, 1 }, { 7703671, 0 }, { 7703720, 1 }, { 7703791, 0 }, { 7703841, 1 },
+    { 7703867, 0 }, { 7703917, 1 }, { 7703942, 0 }, { 7703992, 1 }, { 7704063, 0 }, { 7704115, 1 },
+};
+
+// DHT22 frame with a 2 us low glitch inside a high level of data
+static const dht_edge_t dht22_glitch_frame[] = {
+    { 3300108, 1 }, { 3300136, 0 }, { 3300215, 1 }, { 3300294, 0 }, { 3300341, 1 }, { 3300369, 0 },
+    { 3300420, 1 }, { 3300446, 0 }, { 3300501, 1 }, { 3300526, 0 }, { 3300577, 1 }, { 3300599, 0 },
+    { 3300648, 1 }, { 3300673, 0 }, { 3300722, 1 }, { 3300747, 0 }, { 3300803, 1 }, { 3300870, 0 },
+    { 3300924, 1 }, { 3300951, 0 }, { 3301006, 1 }, { 3301076, 0 }, { 3301126, 1 }, { 3301150, 0 },
+    { 3301202, 1 }, { 3301226, 0 }, { 3301281, 1 }, { 3301307, 0 }, { 3301355, 1 }, { 3301425, 0 },
+    { 3301477, 1 }, { 3301548, 0 }, { 3301600, 1 }, { 3301622, 0 }, { 3301674, 1 }, { 3301702, 0 },
+    { 3301748, 1 }, { 3301776, 0 }, { 3301831, 1 }, { 3301856, 0 }, { 3301908, 1 }, { 3301931, 0 },
+    { 3301982, 1 }, { 3302008, 0 }, { 3302063, 1 }, { 3302088, 0 }, { 3302140, 1 }, { 3302162, 0 },
+    { 3302213, 1 }, { 3302236, 0 }, { 3302285, 1 }, { 3302313, 0 }, { 3302364, 1 }, { 3302430, 0 },
+    { 3302482, 1 }, { 3302553, 0 }, { 3302604, 1 }, { 3302675, 0 }, { 3302721, 1 }, { 3302793, 0 },
+    { 3302844, 1 }, { 3302852, 0 }, { 3302854, 1 }, { 3302913, 0 }, { 3302966, 1 }, { 3302992, 0 },
+    { 3303039, 1 }, { 3303110, 0 }, { 3303156, 1 }, { 3303226, 0 }, { 3303280, 1 }, { 3303348, 0 },
+    { 3303398, 1 }, { 3303422, 0 }, { 3303471, 1 }, { 3303499, 0 }, { 3303553, 1 }, { 3303579, 0 },
+    { 3303626, 1 }, { 3303698, 0 }, { 3303745, 1 }, { 3303770, 0 }, { 3303819, 1 }, { 3303844, 0 },
+    { 3303893, 1 }, { 3303961, 0 }, { 3304013, 1 },
+};
+
+// DHT22 frame ended by capture timeout after 28 bits
+static const dht_edge_t dht22_truncated_frame[] = {
+    { 1200004, 1 }, { 1200036, 0 }, { 1200115, 1 }, { 1200194, 0 }, { 1200246, 1 }, { 1200272, 0 },
+    { 1200323, 1 }, { 1200347, 0 }, { 1200394, 1 }, { 1200420, 0 }, { 1200469, 1 }, { 1200495, 0 },
+    { 1200545, 1 }, { 1200571, 0 }, { 1200622, 1 }, { 1200644, 0 }, { 1200693, 1 }, { 1200764, 0 },
+    { 1200818, 1 }, { 1200841, 0 }, { 1200895, 1 }, { 1200965, 0 }, { 1201015, 1 }, { 1201036, 0 },
+    { 1201084, 1 }, { 1201107, 0 }, { 1201156, 1 }, { 1201182, 0 }, { 1201233, 1 }, { 1201304, 0 },
+    { 1201350, 1 }, { 1201420, 0 }, { 1201472, 1 }, { 1201497, 0 }, { 1201547, 1 }, { 1201576, 0 },
+    { 1201625, 1 }, { 1201650, 0 }, { 1201699, 1 }, { 1201723, 0 }, { 1201769, 1 }, { 1201793, 0 },
+    { 1201844, 1 }, { 1201871, 0 }, { 1201921, 1 }, { 1201948, 0 }, { 1201996, 1 }, { 1202024, 0 },
+    { 1202074, 1 }, { 1202099, 0 }, { 1202151, 1 }, { 1202173, 0 }, { 1202222, 1 }, { 1202294, 0 },
+    { 1202348, 1 }, { 1202420, 0 }, { 1202470, 1 }, { 1202537, 0 }, { 1202591, 1 }, { 1202662, 0 },
+};
+
+// DHT22 frame with an extra edge of same level, read after pin settled
+static const dht_edge_t dht22_extra_edge_frame[] = {
+    { 6600043, 1 }, { 6600075, 0 }, { 6600156, 1 }, { 6600237, 0 }, { 6600291, 1 }, { 6600314, 0 },
+    { 6600370, 1 }, { 6600398, 0 }, { 6600451, 1 }, { 6600475, 0 }, { 6600524, 1 }, { 6600549, 0 },
+    { 6600601, 1 }, { 6600629, 0 }, { 6600682, 1 }, { 6600709, 0 }, { 6600759, 1 }, { 6600829, 0 },
+    { 6600875, 1 }, { 6600898, 0 }, { 6600948, 1 }, { 6601019, 0 }, { 6601072, 1 }, { 6601098, 0 },
+    { 6601147, 1 }, { 6601171, 0 }, { 6601222, 1 }, { 6601248, 0 }, { 6601301, 1 }, { 6601369, 0 },
+    { 6601418, 1 }, { 6601419, 1 }, { 6601490, 0 }, { 6601536, 1 }, { 6601561, 0 }, { 6601610, 1 },
+    { 6601636, 0 }, { 6601682, 1 }, { 6601708, 0 }, { 6601756, 1 }, { 6601780, 0 }, { 6601832, 1 },
+    { 6601856, 0 }, { 6601907, 1 }, { 6601935, 0 }, { 6601983, 1 }, { 6602008, 0 }, { 6602057, 1 },
+    { 6602079, 0 }, { 6602126, 1 }, { 6602147, 0 }, { 6602199, 1 }, { 6602225, 0 }, { 6602275, 1 },
+    { 6602346, 0 }, { 6602398, 1 }, { 6602470, 0 }, { 6602519, 1 }, { 6602589, 0 }, { 6602637, 1 },
+    { 6602709, 0 }, { 6602756, 1 }, { 6602826, 0 }, { 6602882, 1 }, { 6602912, 0 }, { 6602958, 1 },
+    { 6603026, 0 }, { 6603077, 1 }, { 6603147, 0 }, { 6603197, 1 }, { 6603266, 0 }, { 6603312, 1 },
+    { 6603338, 0 }, { 6603390, 1 }, { 6603415, 0 }, { 6603465, 1 }, { 6603493, 0 }, { 6603544, 1 },
+    { 6603617, 0 }, { 6603667, 1 }, { 6603690, 0 }, { 6603739, 1 }, { 6603765, 0 }, { 6603817, 1 },
+    { 6603888, 0 }, { 6603937, 1 },
+};
+
+#define FRAME(x) x, sizeof(x) / sizeof(x[0])
+
+static int failures = 0;
+
+static void check_frame(const char *name, dht_sensor_type_t sensor_type, const dht_edge_t *edges, uint8_t edge_count, bool result, int16_t humidity, int16_t temperature)
+{
+    int16_t decoded_humidity = 0;
+    int16_t decoded_temperature = 0;
+
+    const bool decoded = dht_decode_edges(sensor_type, edges, edge_count, &decoded_humidity, &decoded_temperature);
+    if (decoded != result) {
+        printf("FAIL %s: decode returned %d\n", name, decoded);
+        failures++;
+    } else if (result && (decoded_humidity != humidity || decoded_temperature != temperature)) {
+        printf("FAIL %s: %d %d, expected %d %d\n", name, decoded_humidity, decoded_temperature, humidity, temperature);
+        failures++;
+    }
+}
+
+int main()
+{
+    check_frame("dht22", DHT_TYPE_DHT22, FRAME(dht22_frame), true, 652, 251);
+    check_frame("dht22 negative", DHT_TYPE_DHT22, FRAME(dht22_negative_frame), true, 450, -101);
+    check_frame("si7021", DHT_TYPE_SI7021, FRAME(dht22_frame), true, 652, 251);
+    check_frame("dht11", DHT_TYPE_DHT11, FRAME(dht11_frame), true, 420, 230);
+
+    // Preamble edges are not needed
+    check_frame("dht22 without preamble", DHT_TYPE_DHT22, dht22_frame + 3, sizeof(dht22_frame) / sizeof(dht22_frame[0]) - 3, true, 652, 251);
+
+    check_frame("bad checksum", DHT_TYPE_DHT22, FRAME(dht22_bad_checksum_frame), false, 0, 0);
+    check_frame("lost edge", DHT_TYPE_DHT22, FRAME(dht22_lost_edge_frame), false, 0, 0);
+    check_frame("extra edge", DHT_TYPE_DHT22, FRAME(dht22_extra_edge_frame), false, 0, 0);
+    check_frame("glitch", DHT_TYPE_DHT22, FRAME(dht22_glitch_frame), false, 0, 0);
+    check_frame("truncated", DHT_TYPE_DHT22, FRAME(dht22_truncated_frame), false, 0, 0);
+    check_frame("empty", DHT_TYPE_DHT22, dht22_frame, 0, false, 0, 0);
+
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("new_dht: all checks passed\n");
+    return 0;
+}
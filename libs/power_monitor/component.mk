@@ -0,0 +1,8 @@
+# Component makefile for power_monitor
+
+INC_DIRS += $(power_monitor_ROOT)
+
+power_monitor_INC_DIR = $(power_monitor_ROOT)
+power_monitor_SRC_DIR = $(power_monitor_ROOT)
+
+$(eval $(call component_compile_rules,power_monitor))
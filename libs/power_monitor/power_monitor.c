@@ -0,0 +1,261 @@
+/*
+ * Power Monitor Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <etstimer.h>
+#include <esplibs/libmain.h>
+#include <esp/gpio.h>
+#include <esp/uart.h>
+
+#include "power_monitor.h"
+
+struct _power_monitor {
+    uint8_t type;
+    uint8_t cf_gpio;
+    uint8_t cf1_gpio;
+    uint8_t sel_gpio;
+    uint8_t uart;
+    bool sel_current_level;
+    bool cf1_is_current;
+
+    power_monitor_factors_t factors;
+
+    // HLW8012 and BL0937
+    volatile power_monitor_pulses_t cf;
+    volatile power_monitor_pulses_t cf1;
+    volatile uint32_t cf_total;
+    uint32_t cf_total_last;
+    float power_frequency;
+    float voltage_frequency;
+    float current_frequency;
+
+    // CSE7766
+    ETSTimer timer;
+    cse7766_parser_t parser;
+    cse7766_data_t data;
+    uint32_t last_frame_ms;
+    bool has_frame;
+
+    uint64_t energy;        // mWs
+};
+
+static power_monitor_t *power_monitor_gpios[16];
+
+static inline void power_monitor_pulse(volatile power_monitor_pulses_t *pulses, const uint32_t now) {
+    if (pulses->count == 0) {
+        pulses->first_us = now;
+    }
+
+    pulses->last_us = now;
+    pulses->count++;
+}
+
+static IRAM void power_monitor_interrupt(const uint8_t gpio) {
+    power_monitor_t *power_monitor = power_monitor_gpios[gpio];
+    if (!power_monitor) {
+        return;
+    }
+
+    const uint32_t now = sdk_system_get_time();
+
+    if (gpio == power_monitor->cf_gpio) {
+        power_monitor_pulse(&power_monitor->cf, now);
+        power_monitor->cf_total++;
+    } else {
+        power_monitor_pulse(&power_monitor->cf1, now);
+    }
+}
+
+static void power_monitor_set_defaults(power_monitor_t *power_monitor, const power_monitor_factors_t *factors, const float voltage, const float current, const float power) {
+    power_monitor->factors = *factors;
+
+    if (power_monitor->factors.voltage == 0) {
+        power_monitor->factors.voltage = voltage;
+    }
+
+    if (power_monitor->factors.current == 0) {
+        power_monitor->factors.current = current;
+    }
+
+    if (power_monitor->factors.power == 0) {
+        power_monitor->factors.power = power;
+    }
+}
+
+static void power_monitor_set_sel(power_monitor_t *power_monitor) {
+    gpio_write(power_monitor->sel_gpio, power_monitor->cf1_is_current ? power_monitor->sel_current_level : !power_monitor->sel_current_level);
+}
+
+power_monitor_t *power_monitor_hlw8012_new(const uint8_t type, const uint8_t cf_gpio, const uint8_t cf1_gpio, const uint8_t sel_gpio, const bool sel_inverted, const power_monitor_factors_t *factors) {
+    if (cf_gpio > 15 || cf1_gpio > 15 || power_monitor_gpios[cf_gpio] || power_monitor_gpios[cf1_gpio]) {
+        return NULL;
+    }
+
+    power_monitor_t *power_monitor = malloc(sizeof(power_monitor_t));
+    if (!power_monitor) {
+        return NULL;
+    }
+
+    memset(power_monitor, 0, sizeof(*power_monitor));
+    power_monitor->type = type;
+    power_monitor->cf_gpio = cf_gpio;
+    power_monitor->cf1_gpio = cf1_gpio;
+    power_monitor->sel_gpio = sel_gpio;
+    power_monitor->sel_current_level = sel_inverted;
+    power_monitor->cf1_is_current = true;
+
+    if (type == POWER_MONITOR_TYPE_BL0937) {
+        power_monitor_set_defaults(power_monitor, factors, BL0937_VOLTAGE_FACTOR, BL0937_CURRENT_FACTOR, BL0937_POWER_FACTOR);
+    } else {
+        power_monitor_set_defaults(power_monitor, factors, HLW8012_VOLTAGE_FACTOR, HLW8012_CURRENT_FACTOR, HLW8012_POWER_FACTOR);
+    }
+
+    gpio_enable(sel_gpio, GPIO_OUTPUT);
+    power_monitor_set_sel(power_monitor);
+
+    power_monitor_gpios[cf_gpio] = power_monitor;
+    power_monitor_gpios[cf1_gpio] = power_monitor;
+
+    gpio_enable(cf_gpio, GPIO_INPUT);
+    gpio_enable(cf1_gpio, GPIO_INPUT);
+    gpio_set_interrupt(cf_gpio, GPIO_INTTYPE_EDGE_NEG, power_monitor_interrupt);
+    gpio_set_interrupt(cf1_gpio, GPIO_INTTYPE_EDGE_NEG, power_monitor_interrupt);
+
+    return power_monitor;
+}
+
+static void cse7766_timer_worker(void *args) {
+    power_monitor_t *power_monitor = args;
+    int byte;
+
+    while ((byte = uart_getc_nowait(power_monitor->uart)) >= 0) {
+        if (cse7766_parse_byte(&power_monitor->parser, byte, &power_monitor->data)) {
+            const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+            if (power_monitor->has_frame) {
+                const uint32_t gap_ms = now_ms - power_monitor->last_frame_ms;
+                if (gap_ms < CSE7766_MAX_FRAME_GAP_MS) {
+                    const float power = power_monitor_scale(power_monitor->data.power, power_monitor->factors.power, power_monitor->factors.power_offset);
+                    power_monitor->energy += power_monitor_power_energy(power, gap_ms);
+                }
+            }
+
+            power_monitor->last_frame_ms = now_ms;
+            power_monitor->has_frame = true;
+        }
+    }
+}
+
+power_monitor_t *power_monitor_cse7766_new(const uint8_t uart, const power_monitor_factors_t *factors) {
+    if (uart != 0) {
+        return NULL;
+    }
+
+    power_monitor_t *power_monitor = malloc(sizeof(power_monitor_t));
+    if (!power_monitor) {
+        return NULL;
+    }
+
+    memset(power_monitor, 0, sizeof(*power_monitor));
+    power_monitor->type = POWER_MONITOR_TYPE_CSE7766;
+    power_monitor->uart = uart;
+
+    // Values are already calibrated by chip
+    power_monitor_set_defaults(power_monitor, factors, 1, 1, 1);
+
+    uart_set_baud(uart, CSE7766_BAUD_RATE);
+    uart_set_parity_enabled(uart, true);
+    uart_set_parity(uart, UART_PARITY_EVEN);
+    uart_flush_rxfifo(uart);
+
+    sdk_os_timer_setfn(&power_monitor->timer, cse7766_timer_worker, power_monitor);
+    sdk_os_timer_arm(&power_monitor->timer, CSE7766_READ_PERIOD_MS, true);
+
+    return power_monitor;
+}
+
+// Returns window pulses and starts a new window
+static void power_monitor_take_pulses(volatile power_monitor_pulses_t *pulses, power_monitor_pulses_t *window, const bool keep_last) {
+    taskENTER_CRITICAL();
+    window->count = pulses->count;
+    window->first_us = pulses->first_us;
+    window->last_us = pulses->last_us;
+
+    if (keep_last && pulses->count > 0) {
+        // Last pulse is first one of next window, so slow pulses are not lost
+        pulses->count = 1;
+        pulses->first_us = pulses->last_us;
+    } else {
+        pulses->count = 0;
+    }
+    taskEXIT_CRITICAL();
+}
+
+bool power_monitor_read(power_monitor_t *power_monitor, power_monitor_values_t *values) {
+    const power_monitor_factors_t *factors = &power_monitor->factors;
+
+    if (power_monitor->type == POWER_MONITOR_TYPE_CSE7766) {
+        const uint32_t now_ms = xTaskGetTickCount() * portTICK_PERIOD_MS;
+        if (!power_monitor->has_frame || (now_ms - power_monitor->last_frame_ms) > CSE7766_FRAME_TIMEOUT_MS) {
+            return false;
+        }
+
+        values->voltage = power_monitor_scale(power_monitor->data.voltage, factors->voltage, factors->voltage_offset);
+        values->current = power_monitor_scale(power_monitor->data.current, factors->current, factors->current_offset);
+        values->power = power_monitor_scale(power_monitor->data.power, factors->power, factors->power_offset);
+        values->energy = power_monitor->energy;
+
+        return true;
+    }
+
+    const uint32_t now_us = sdk_system_get_time();
+    power_monitor_pulses_t window;
+
+    power_monitor_take_pulses(&power_monitor->cf, &window, true);
+    power_monitor->power_frequency = power_monitor_frequency(&window, now_us, power_monitor->power_frequency);
+
+    // Window started with last SEL switch, so all its CF1 pulses are in current mode
+    power_monitor_take_pulses(&power_monitor->cf1, &window, false);
+    if (power_monitor->cf1_is_current) {
+        power_monitor->current_frequency = power_monitor_frequency(&window, now_us, power_monitor->current_frequency);
+    } else {
+        power_monitor->voltage_frequency = power_monitor_frequency(&window, now_us, power_monitor->voltage_frequency);
+    }
+
+    power_monitor->cf1_is_current = !power_monitor->cf1_is_current;
+    power_monitor_set_sel(power_monitor);
+
+    const uint32_t cf_total = power_monitor->cf_total;
+    power_monitor->energy += power_monitor_pulses_energy(cf_total - power_monitor->cf_total_last, factors->power);
+    power_monitor->cf_total_last = cf_total;
+
+    values->voltage = power_monitor_scale(power_monitor->voltage_frequency, factors->voltage, factors->voltage_offset);
+    values->current = power_monitor_scale(power_monitor->current_frequency, factors->current, factors->current_offset);
+    values->power = power_monitor_scale(power_monitor->power_frequency, factors->power, factors->power_offset);
+    values->energy = power_monitor->energy;
+
+    return true;
+}
+
+void power_monitor_set_energy(power_monitor_t *power_monitor, const uint64_t energy) {
+    power_monitor->energy = energy;
+}
@@ -0,0 +1,132 @@
+/*
+ * Power Monitor Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Voltage, current, power and energy from HLW8012, BL0937 and CSE7766 chips.
+ *
+ * HLW8012 and BL0937 output pulses with frequency proportional to active
+ * power (CF pin) and to current or voltage (CF1 pin, selected by SEL pin).
+ * Falling edges are timestamped by GPIO interrupt, and frequency is number of
+ * periods between first and last pulse of each read window. SEL is switched on
+ * every read, so current and voltage are updated every two reads. Energy comes
+ * from total CF pulses.
+ *
+ * CSE7766 sends a 24 bytes frame every 50 ms at 4800 8E1 with coefficients
+ * and cycles calibrated in factory. UART RX FIFO is drained by a timer and
+ * energy is power integrated over time between frames.
+ *
+ * Energy is kept as integer mWs, so small additions are not lost when total is
+ * large. Frequency and energy math and frame parser do not access hardware, so
+ * they can be built and checked on host with test/power_monitor_test.c.
+ */
+
+#ifndef __POWER_MONITOR_H__
+#define __POWER_MONITOR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define POWER_MONITOR_TYPE_HLW8012      0
+#define POWER_MONITOR_TYPE_BL0937       1
+#define POWER_MONITOR_TYPE_CSE7766      2
+
+#define POWER_MONITOR_PULSE_TIMEOUT_US  10000000    // Slower than 0.1 Hz is 0
+
+// Units per Hz for reference designs, 1 mOhm shunt and 5 x 470k + 1k voltage divider
+#define HLW8012_VOLTAGE_FACTOR          0.4086f
+#define HLW8012_CURRENT_FACTOR          0.01448f
+#define HLW8012_POWER_FACTOR            10.34f
+#define BL0937_VOLTAGE_FACTOR           0.1860f
+#define BL0937_CURRENT_FACTOR           0.01287f
+#define BL0937_POWER_FACTOR             2.026f
+
+#define CSE7766_FRAME_SIZE              24
+#define CSE7766_BAUD_RATE               4800
+#define CSE7766_READ_PERIOD_MS          100     // 48 bytes, RX FIFO is 128
+#define CSE7766_FRAME_TIMEOUT_MS        2000
+#define CSE7766_MAX_FRAME_GAP_MS        1000    // Longer gaps are not added to energy
+
+#define POWER_MONITOR_MWS_PER_WH        3600000
+
+typedef struct _power_monitor power_monitor_t;
+
+typedef struct _power_monitor_factors {
+    float voltage;
+    float voltage_offset;
+    float current;
+    float current_offset;
+    float power;
+    float power_offset;
+} power_monitor_factors_t;
+
+typedef struct _power_monitor_values {
+    float voltage;
+    float current;
+    float power;
+    uint64_t energy;        // mWs, integer so small additions are not lost in a large total
+} power_monitor_values_t;
+
+// Pulses of a read window
+typedef struct _power_monitor_pulses {
+    uint32_t count;
+    uint32_t first_us;
+    uint32_t last_us;
+} power_monitor_pulses_t;
+
+typedef struct _cse7766_data {
+    float voltage;
+    float current;
+    float power;
+} cse7766_data_t;
+
+typedef struct _cse7766_parser {
+    uint8_t len;
+    uint8_t frame[CSE7766_FRAME_SIZE];
+} cse7766_parser_t;
+
+// Hz. With only one pulse, previous frequency is kept while time since it allows it
+float power_monitor_frequency(const power_monitor_pulses_t *pulses, const uint32_t now_us, const float previous);
+
+// Applies factor and offset, never negative. 0 stays 0
+float power_monitor_scale(const float raw, const float factor, const float offset);
+
+// Energy in mWs of CF pulses, each one is power factor Ws
+uint64_t power_monitor_pulses_energy(const uint32_t pulses, const float power_factor);
+
+// Energy in mWs of a power kept for some time
+uint64_t power_monitor_power_energy(const float power, const uint32_t time_ms);
+
+// Returns true if frame is valid. Only values updated by chip are written
+bool cse7766_decode_frame(const uint8_t *frame, cse7766_data_t *data);
+
+// Returns true when byte completes a valid frame
+bool cse7766_parse_byte(cse7766_parser_t *parser, const uint8_t byte, cse7766_data_t *data);
+
+// Factors of 0 use chip defaults. SEL inverted means CF1 outputs current with SEL high
+power_monitor_t *power_monitor_hlw8012_new(const uint8_t type, const uint8_t cf_gpio, const uint8_t cf1_gpio, const uint8_t sel_gpio, const bool sel_inverted, const power_monitor_factors_t *factors);
+// Only UART0 has RX
+power_monitor_t *power_monitor_cse7766_new(const uint8_t uart, const power_monitor_factors_t *factors);
+
+// Returns false if chip does not send data
+bool power_monitor_read(power_monitor_t *power_monitor, power_monitor_values_t *values);
+
+// Energy counter in mWs
+void power_monitor_set_energy(power_monitor_t *power_monitor, const uint64_t energy);
+
+#endif  // __POWER_MONITOR_H__
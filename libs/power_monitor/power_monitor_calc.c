@@ -0,0 +1,165 @@
+/*
+ * Power Monitor Driver
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "power_monitor.h"
+
+#define CSE7766_HEADER_NORMAL           0x55
+#define CSE7766_HEADER_CHECK            0x5A
+#define CSE7766_HEADER_CALIBRATION_ERR  0xAA
+#define CSE7766_HEADER_FLAGS            0xF0    // Normal frame with status bits
+#define CSE7766_FLAG_VOLTAGE_OVERFLOW   0x08
+#define CSE7766_FLAG_CURRENT_OVERFLOW   0x04    // Cycle too long, no load
+#define CSE7766_FLAG_POWER_OVERFLOW     0x02    // Cycle too long, no load
+#define CSE7766_FLAG_COEFFICIENT_ERR    0x01
+#define CSE7766_ADJ_VOLTAGE             0x40
+#define CSE7766_ADJ_CURRENT             0x20
+#define CSE7766_ADJ_POWER               0x10
+
+float power_monitor_frequency(const power_monitor_pulses_t *pulses, const uint32_t now_us, const float previous) {
+    if (pulses->count >= 2) {
+        const uint32_t period = pulses->last_us - pulses->first_us;
+        if (period > 0) {
+            return (pulses->count - 1) * 1000000.f / period;
+        }
+    }
+
+    if (pulses->count == 0) {
+        return 0;
+    }
+
+    const uint32_t since_last = now_us - pulses->last_us;
+    if (since_last >= POWER_MONITOR_PULSE_TIMEOUT_US) {
+        return 0;
+    }
+
+    // Next pulse has not arrived yet, so frequency is lower than this
+    if (since_last > 0) {
+        const float max_frequency = 1000000.f / since_last;
+        if (previous > max_frequency) {
+            return max_frequency;
+        }
+    }
+
+    return previous;
+}
+
+float power_monitor_scale(const float raw, const float factor, const float offset) {
+    if (raw == 0) {
+        return 0;
+    }
+
+    const float value = (raw * factor) + offset;
+    if (value < 0) {
+        return 0;
+    }
+
+    return value;
+}
+
+static uint32_t cse7766_u24(const uint8_t *data) {
+    return (data[0] << 16) | (data[1] << 8) | data[2];
+}
+
+static bool cse7766_is_header(const uint8_t byte) {
+    return (byte == CSE7766_HEADER_NORMAL || (byte & 0xF0) == CSE7766_HEADER_FLAGS);
+}
+
+uint64_t power_monitor_pulses_energy(const uint32_t pulses, const float power_factor) {
+    return (uint64_t) ((pulses * power_factor * 1000) + 0.5f);
+}
+
+uint64_t power_monitor_power_energy(const float power, const uint32_t time_ms) {
+    // W * ms is mWs
+    return (uint64_t) ((power * time_ms) + 0.5f);
+}
+
+bool cse7766_decode_frame(const uint8_t *frame, cse7766_data_t *data) {
+    const uint8_t header = frame[0];
+
+    if (frame[1] != CSE7766_HEADER_CHECK || !cse7766_is_header(header)) {
+        return false;
+    }
+
+    uint8_t checksum = 0;
+    for (uint8_t i = 2; i < CSE7766_FRAME_SIZE - 1; i++) {
+        checksum += frame[i];
+    }
+
+    if (checksum != frame[CSE7766_FRAME_SIZE - 1]) {
+        return false;
+    }
+
+    const bool has_flags = (header & 0xF0) == CSE7766_HEADER_FLAGS;
+    if (has_flags && (header & CSE7766_FLAG_COEFFICIENT_ERR)) {
+        return false;
+    }
+
+    const uint32_t voltage_coefficient = cse7766_u24(&frame[2]);
+    const uint32_t voltage_cycle = cse7766_u24(&frame[5]);
+    const uint32_t current_coefficient = cse7766_u24(&frame[8]);
+    const uint32_t current_cycle = cse7766_u24(&frame[11]);
+    const uint32_t power_coefficient = cse7766_u24(&frame[14]);
+    const uint32_t power_cycle = cse7766_u24(&frame[17]);
+    const uint8_t adj = frame[20];
+
+    if ((adj & CSE7766_ADJ_VOLTAGE) && voltage_cycle > 0) {
+        if (has_flags && (header & CSE7766_FLAG_VOLTAGE_OVERFLOW)) {
+            data->voltage = 0;
+        } else {
+            data->voltage = (float) voltage_coefficient / voltage_cycle;
+        }
+    }
+
+    if (has_flags && (header & CSE7766_FLAG_CURRENT_OVERFLOW)) {
+        data->current = 0;
+    } else if ((adj & CSE7766_ADJ_CURRENT) && current_cycle > 0) {
+        data->current = (float) current_coefficient / current_cycle;
+    }
+
+    if (has_flags && (header & CSE7766_FLAG_POWER_OVERFLOW)) {
+        data->power = 0;
+    } else if ((adj & CSE7766_ADJ_POWER) && power_cycle > 0) {
+        data->power = (float) power_coefficient / power_cycle;
+    }
+
+    return true;
+}
+
+bool cse7766_parse_byte(cse7766_parser_t *parser, const uint8_t byte, cse7766_data_t *data) {
+    if (parser->len == 0 && !cse7766_is_header(byte)) {
+        return false;
+    }
+
+    if (parser->len == 1 && byte != CSE7766_HEADER_CHECK) {
+        // Byte can be start of next frame
+        parser->len = 0;
+        return cse7766_parse_byte(parser, byte, data);
+    }
+
+    parser->frame[parser->len] = byte;
+    parser->len++;
+
+    if (parser->len < CSE7766_FRAME_SIZE) {
+        return false;
+    }
+
+    parser->len = 0;
+
+    return cse7766_decode_frame(parser->frame, data);
+}
@@ -0,0 +1,189 @@
+/*
+ * Power Monitor Driver host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks frequency math, CSE7766 frame decoding and parsing, and energy
+ * accumulation with large totals.
+ *
+ *   make -C libs/power_monitor/test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "power_monitor.h"
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void put_u24(uint8_t *data, const uint32_t value) {
+    data[0] = value >> 16;
+    data[1] = value >> 8;
+    data[2] = value;
+}
+
+static void cse7766_frame(uint8_t *frame, const uint8_t header, const uint32_t voltage_coef, const uint32_t voltage_cycle,
+                          const uint32_t current_coef, const uint32_t current_cycle, const uint32_t power_coef, const uint32_t power_cycle, const uint8_t adj) {
+    memset(frame, 0, CSE7766_FRAME_SIZE);
+    frame[0] = header;
+    frame[1] = 0x5A;
+    put_u24(frame + 2, voltage_coef);
+    put_u24(frame + 5, voltage_cycle);
+    put_u24(frame + 8, current_coef);
+    put_u24(frame + 11, current_cycle);
+    put_u24(frame + 14, power_coef);
+    put_u24(frame + 17, power_cycle);
+    frame[20] = adj;
+    frame[21] = 0x12;
+    frame[22] = 0x34;
+
+    uint8_t checksum = 0;
+    for (uint8_t i = 2; i < CSE7766_FRAME_SIZE - 1; i++) {
+        checksum += frame[i];
+    }
+    frame[CSE7766_FRAME_SIZE - 1] = checksum;
+}
+
+static void check_frequency() {
+    power_monitor_pulses_t pulses = { 11, 1000, 1001000 };
+    float frequency = power_monitor_frequency(&pulses, 1002000, 0);
+    CHECK(fabsf(frequency - 10) < 0.0001f, "10 periods in 1 s gave %f Hz", frequency);
+
+    // Only one pulse: frequency is limited by time since last one
+    pulses.count = 1;
+    pulses.first_us = 1000000;
+    pulses.last_us = 1000000;
+    frequency = power_monitor_frequency(&pulses, 1500000, 10);
+    CHECK(frequency == 2, "1 pulse 0.5 s ago after 10 Hz gave %f Hz", frequency);
+
+    frequency = power_monitor_frequency(&pulses, 1100000, 1);
+    CHECK(frequency == 1, "1 pulse 0.1 s ago after 1 Hz gave %f Hz", frequency);
+
+    frequency = power_monitor_frequency(&pulses, 1000000 + POWER_MONITOR_PULSE_TIMEOUT_US, 1);
+    CHECK(frequency == 0, "timed out pulse gave %f Hz", frequency);
+
+    pulses.count = 0;
+    frequency = power_monitor_frequency(&pulses, 0, 5);
+    CHECK(frequency == 0, "no pulses gave %f Hz", frequency);
+}
+
+static void check_scale() {
+    const float voltage = power_monitor_scale(230 / HLW8012_VOLTAGE_FACTOR, HLW8012_VOLTAGE_FACTOR, 0);
+    CHECK(fabsf(voltage - 230) < 0.01f, "HLW8012 230 V read as %f V", voltage);
+    CHECK(power_monitor_scale(0, 1, 5) == 0, "0 with offset is not 0");
+    CHECK(power_monitor_scale(1, 1, -5) == 0, "negative value not clamped");
+}
+
+static void check_cse7766() {
+    uint8_t frame[CSE7766_FRAME_SIZE];
+    cse7766_data_t data = { 0, 0, 0 };
+
+    // Sonoff POW R2 like coefficients, 230 V, 0.5 A, 460 W
+    cse7766_frame(frame, 0x55, 190000, 826, 16000, 32000, 5000000, 5000000 / 460, 0x70);
+    CHECK(cse7766_decode_frame(frame, &data), "valid frame rejected");
+    CHECK(fabsf(data.voltage - 230.02f) < 0.05f, "voltage %f", data.voltage);
+    CHECK(fabsf(data.current - 0.5f) < 0.0001f, "current %f", data.current);
+    CHECK(fabsf(data.power - 460) < 0.2f, "power %f", data.power);
+
+    frame[CSE7766_FRAME_SIZE - 1] ^= 1;
+    CHECK(!cse7766_decode_frame(frame, &data), "bad checksum accepted");
+
+    // No load: current and power cycles overflow, voltage is still valid
+    cse7766_data_t no_load = data;
+    cse7766_frame(frame, 0xF6, 190000, 826, 16000, 0xFFFFFF, 5000000, 0xFFFFFF, 0x40);
+    CHECK(cse7766_decode_frame(frame, &no_load), "no load frame rejected");
+    CHECK(no_load.current == 0 && no_load.power == 0, "no load gave %f A, %f W", no_load.current, no_load.power);
+    CHECK(fabsf(no_load.voltage - 230.02f) < 0.05f, "no load voltage %f", no_load.voltage);
+
+    cse7766_frame(frame, 0xF1, 1, 1, 1, 1, 1, 1, 0x70);
+    CHECK(!cse7766_decode_frame(frame, &no_load), "coefficient error frame accepted");
+
+    cse7766_frame(frame, 0xAA, 1, 1, 1, 1, 1, 1, 0x70);
+    CHECK(!cse7766_decode_frame(frame, &no_load), "calibration error frame accepted");
+
+    // Byte stream with garbage and false headers between frames
+    cse7766_parser_t parser;
+    memset(&parser, 0, sizeof(parser));
+    cse7766_frame(frame, 0x55, 190000, 826, 16000, 32000, 5000000, 5000000 / 460, 0x70);
+    const uint8_t junk[] = { 0x00, 0x55, 0x55, 0x13 };
+    uint8_t frames = 0;
+
+    for (uint8_t n = 0; n < 5; n++) {
+        for (uint8_t i = 0; i < sizeof(junk); i++) {
+            frames += cse7766_parse_byte(&parser, junk[i], &data);
+        }
+
+        for (uint8_t i = 0; i < CSE7766_FRAME_SIZE; i++) {
+            frames += cse7766_parse_byte(&parser, frame[i], &data);
+        }
+    }
+    CHECK(frames == 5, "%u frames parsed from stream, expected 5", frames);
+}
+
+// One hour at 5 W must add 5 Wh whatever the total is
+static void check_energy() {
+    const uint64_t starts_wh[] = { 0, 20000, 40000, 1000000 };
+
+    for (uint8_t i = 0; i < sizeof(starts_wh) / sizeof(starts_wh[0]); i++) {
+        const uint64_t start = starts_wh[i] * POWER_MONITOR_MWS_PER_WH;
+
+        // CSE7766, 50 ms between frames
+        uint64_t energy = start;
+        for (uint32_t frame = 0; frame < 3600 * 20; frame++) {
+            energy += power_monitor_power_energy(5, 50);
+        }
+        double added = (double) (energy - start) / POWER_MONITOR_MWS_PER_WH;
+        CHECK(fabs(added - 5) < 0.001, "CSE7766 from %llu Wh added %f Wh", (unsigned long long) starts_wh[i], added);
+
+        // HLW8012, 5 W is 5 / HLW8012_POWER_FACTOR Hz, read every second
+        energy = start;
+        const float frequency = 5 / HLW8012_POWER_FACTOR;
+        uint32_t pulses_total = 0;
+        for (uint32_t second = 1; second <= 3600; second++) {
+            const uint32_t pulses = (uint32_t) (second * frequency) - pulses_total;
+            pulses_total += pulses;
+            energy += power_monitor_pulses_energy(pulses, HLW8012_POWER_FACTOR);
+        }
+        added = (double) (energy - start) / POWER_MONITOR_MWS_PER_WH;
+        CHECK(fabs(added - 5) < HLW8012_POWER_FACTOR / 3600, "HLW8012 from %llu Wh added %f Wh", (unsigned long long) starts_wh[i], added);
+    }
+}
+
+int main() {
+    check_frequency();
+    check_scale();
+    check_cse7766();
+    check_energy();
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("power_monitor: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Component makefile for profiler
+
+INC_DIRS += $(profiler_ROOT)
+
+profiler_INC_DIR = $(profiler_ROOT)
+profiler_SRC_DIR = $(profiler_ROOT)
+
+$(eval $(call component_compile_rules,profiler))
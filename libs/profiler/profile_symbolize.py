@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+#
+# Sampling Profiler symbolizer
+#
+# Copyright 2020 José A. Jiménez (@RavenSystem)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Reads "PROF" lines sent by libs/profiler from a file or stdin, other lines
+# are ignored, and prints a flat profile by function using the firmware ELF.
+#
+#   nc -kulnw0 45678 | python3 profile_symbolize.py --elf build/haamain.out
+#   python3 profile_symbolize.py --elf build/haamain.out serial.log
+
+import argparse
+import bisect
+import subprocess
+import sys
+
+# ESP8266 memory map, used for addresses without symbol
+REGIONS = [
+    (0x40000000, 0x40010000, "[rom]"),
+    (0x40100000, 0x40108000, "[iram]"),
+    (0x40200000, 0x40300000, "[flash]"),
+]
+
+
+def load_symbols(elf, nm):
+    output = subprocess.run([nm, "--defined-only", "--numeric-sort", "--print-size", elf],
+                            check=True, stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+    symbols = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 4:
+            address, size, kind, name = fields
+            size = int(size, 16)
+        elif len(fields) == 3:
+            address, kind, name = fields
+            size = 0
+        else:
+            continue
+
+        # Code symbols, absolute ones are ROM functions from linker scripts
+        if kind not in "tTwWaA":
+            continue
+
+        symbols.append((int(address, 16), size, name))
+
+    symbols.sort()
+    return symbols
+
+
+def region(pc):
+    for start, end, name in REGIONS:
+        if start <= pc < end:
+            return name
+
+    return "[unknown]"
+
+
+def symbolize(symbols, addresses, pc):
+    i = bisect.bisect_right(addresses, pc) - 1
+    if i >= 0:
+        address, size, name = symbols[i]
+        # Symbols without size reach up to next one, but not into another region
+        if pc < address + size or (size == 0 and region(address) == region(pc)):
+            return name
+
+    return region(pc)
+
+
+def read_profile(stream):
+    # Only last complete profile is used
+    profile = None
+    current = None
+    header = ""
+
+    for line in stream:
+        fields = line.split()
+        if len(fields) < 2 or fields[0] != "PROF":
+            continue
+
+        if fields[1] == "begin":
+            current = {}
+            header = " ".join(fields[2:])
+        elif fields[1] == "end":
+            if current is not None:
+                profile = (header, current)
+                current = None
+                break
+        elif current is not None and len(fields) == 3:
+            try:
+                pc = int(fields[1], 16)
+                current[pc] = current.get(pc, 0) + int(fields[2])
+            except ValueError:
+                pass
+
+    if profile is None and current is not None:
+        # Lost end line
+        profile = (header, current)
+
+    return profile
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Flat profile from libs/profiler histogram")
+    parser.add_argument("--elf", required=True, help="Firmware ELF, like devices/HAA/build/haamain.out")
+    parser.add_argument("--nm", default="xtensa-lx106-elf-nm", help="nm for the firmware toolchain")
+    parser.add_argument("--top", type=int, default=40, help="Functions to show, 0 for all")
+    parser.add_argument("input", nargs="?", help="Captured output, stdin if not set")
+    args = parser.parse_args()
+
+    stream = open(args.input, errors="replace") if args.input else sys.stdin
+    profile = read_profile(stream)
+    if profile is None:
+        sys.exit("No profile found")
+
+    header, histogram = profile
+
+    symbols = load_symbols(args.elf, args.nm)
+    addresses = [symbol[0] for symbol in symbols]
+
+    functions = {}
+    for pc, count in histogram.items():
+        name = symbolize(symbols, addresses, pc)
+        functions[name] = functions.get(name, 0) + count
+
+    total = sum(functions.values())
+    if total == 0:
+        sys.exit("Empty profile")
+
+    print("# %s" % header)
+    print("# %d samples in %d functions" % (total, len(functions)))
+    print("%7s %7s %8s  %s" % ("self%", "cumul%", "samples", "function"))
+
+    cumulative = 0
+    ordered = sorted(functions.items(), key=lambda item: item[1], reverse=True)
+    if args.top > 0:
+        ordered = ordered[:args.top]
+
+    for name, count in ordered:
+        cumulative += count
+        print("%6.2f%% %6.2f%% %8d  %s" % (100.0 * count / total, 100.0 * cumulative / total, count, name))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,175 @@
+/*
+ * Sampling Profiler Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef PROFILER
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <common_macros.h>
+#include <xtensa_ops.h>
+#include <esp/timer.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <lwip/sockets.h>
+
+#include "profiler_histogram.h"
+
+static profiler_histogram_t histogram = { 0 };
+static volatile bool running = false;
+
+static IRAM void profiler_isr(void *arg) {
+    uint32_t pc;
+    RSR(pc, epc1);
+
+    profiler_histogram_add(&histogram, pc);
+}
+
+int profiler_start(const uint16_t hz) {
+    if (running) {
+        return -1;
+    }
+
+    profiler_free();
+
+    histogram.keys = calloc(PROFILER_SLOTS, sizeof(uint32_t) + sizeof(uint16_t));
+    if (!histogram.keys) {
+        return -2;
+    }
+    histogram.counts = (uint16_t *) (histogram.keys + PROFILER_SLOTS);
+
+    histogram.hz = hz;
+    histogram.entries = 0;
+    histogram.samples = 0;
+    histogram.dropped = 0;
+
+    // FRC1 running means it is owned by adv_pwm or ir_tx
+    taskENTER_CRITICAL();
+    if (timer_get_run(FRC1)) {
+        taskEXIT_CRITICAL();
+        profiler_free();
+        return -3;
+    }
+
+    timer_set_interrupts(FRC1, false);
+
+    _xt_isr_attach(INUM_TIMER_FRC1, profiler_isr, NULL);
+    timer_set_frequency(FRC1, hz);
+
+    running = true;
+
+    timer_set_interrupts(FRC1, true);
+    timer_set_run(FRC1, true);
+    taskEXIT_CRITICAL();
+
+    return 0;
+}
+
+void profiler_stop() {
+    if (running) {
+        timer_set_interrupts(FRC1, false);
+        timer_set_run(FRC1, false);
+
+        running = false;
+    }
+}
+
+void profiler_free() {
+    profiler_stop();
+
+    if (histogram.keys) {
+        free(histogram.keys);
+        histogram.keys = NULL;
+        histogram.counts = NULL;
+    }
+}
+
+void profiler_get_info(profiler_info_t *info) {
+    info->running = running;
+    info->hz = histogram.hz;
+    info->entries = histogram.entries;
+    info->samples = histogram.samples;
+    info->dropped = histogram.dropped;
+}
+
+static bool profiler_print_line(const char *line, const int len, void *arg) {
+    printf("%s", line);
+    return true;
+}
+
+void profiler_print() {
+    profiler_histogram_lines(&histogram, profiler_print_line, NULL);
+}
+
+typedef struct _profiler_udp {
+    int socket;
+    struct sockaddr_in dest_addr;
+} profiler_udp_t;
+
+static bool profiler_udp_send(const char *data, const uint16_t len, void *arg) {
+    profiler_udp_t *udp = arg;
+
+    if (lwip_sendto(udp->socket, data, len, 0, (struct sockaddr *) &udp->dest_addr, sizeof(udp->dest_addr)) < 0) {
+        return false;
+    }
+
+    // Let receiver and lwip buffers keep up
+    vTaskDelay(1);
+
+    return true;
+}
+
+int profiler_send() {
+    profiler_udp_t udp;
+    profiler_packet_t packet;
+    memset(&udp, 0, sizeof(udp));
+    memset(&packet, 0, sizeof(packet));
+
+    packet.buffer = malloc(PROFILER_PACKET_SIZE);
+    if (!packet.buffer) {
+        return -1;
+    }
+
+    udp.socket = lwip_socket(AF_INET, SOCK_DGRAM, 0);
+    if (udp.socket < 0) {
+        free(packet.buffer);
+        return -1;
+    }
+
+    udp.dest_addr.sin_family = AF_INET;
+    udp.dest_addr.sin_len = sizeof(udp.dest_addr);
+    udp.dest_addr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+    udp.dest_addr.sin_port = htons(PROFILER_UDP_PORT);
+
+    packet.send_fn = profiler_udp_send;
+    packet.send_arg = &udp;
+
+    int result = -1;
+    if (profiler_histogram_lines(&histogram, profiler_packet_line, &packet) && profiler_packet_flush(&packet)) {
+        // Begin and end lines are not entries
+        result = packet.lines - 2;
+    }
+
+    lwip_close(udp.socket);
+    free(packet.buffer);
+
+    return result;
+}
+
+#endif  // PROFILER
@@ -0,0 +1,75 @@
+/*
+ * Sampling Profiler Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Statistical PC sampling. Only built with -DPROFILER.
+ *
+ * FRC1 timer interrupt reads the interrupted PC (EPC1) and counts it in a
+ * small open addressing hash table. FRC1 is also used by adv_pwm and ir_tx,
+ * none of them can run at the same time. Code running with interrupts
+ * disabled is counted at the instruction that enables them again.
+ *
+ * profiler_send() streams the histogram as text lines to UDP broadcast port
+ * PROFILER_UDP_PORT, same as HAA_OTA udplogger:
+ *
+ *   PROF begin hz=1000 samples=12345 entries=210 dropped=0
+ *   PROF 4020a1c4 87
+ *   PROF end
+ *
+ * Collect with: nc -kulnw0 45678 | python3 profile_symbolize.py --elf build/haamain.out
+ */
+
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef PROFILER_SLOTS_BITS
+#define PROFILER_SLOTS_BITS         8       // 256 slots, 6 bytes each
+#endif
+
+#ifndef PROFILER_PC_SHIFT
+#define PROFILER_PC_SHIFT           2       // Histogram resolution, 4 bytes
+#endif
+
+#define PROFILER_DEFAULT_HZ         997     // Not multiple of FreeRTOS tick rate
+#define PROFILER_UDP_PORT           45678
+
+typedef struct _profiler_info {
+    bool running;
+    uint16_t hz;
+    uint16_t entries;       // Used slots
+    uint32_t samples;
+    uint32_t dropped;       // Samples not counted because hash table was full
+} profiler_info_t;
+
+// Returns 0 if started, -1 if it is already running, -2 if no memory, -3 if FRC1 is busy
+int profiler_start(const uint16_t hz);
+void profiler_stop();
+
+// Histogram is kept after profiler_stop() until next profiler_start() or profiler_free()
+void profiler_free();
+
+void profiler_get_info(profiler_info_t *info);
+
+// Returns number of entries sent, or -1 on error
+int profiler_send();
+void profiler_print();
+
+#endif  // __PROFILER_H__
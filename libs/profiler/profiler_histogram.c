@@ -0,0 +1,76 @@
+/*
+ * Sampling Profiler Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef PROFILER
+
+#include <stdio.h>
+#include <string.h>
+
+#include "profiler_histogram.h"
+
+bool profiler_histogram_lines(const profiler_histogram_t *histogram, profiler_line_fn line_fn, void *arg) {
+    char line[64];
+    int len = snprintf(line, sizeof(line), "PROF begin hz=%u samples=%u entries=%u dropped=%u\n",
+                       histogram->hz, histogram->samples, histogram->entries, histogram->dropped);
+    if (!line_fn(line, len, arg)) {
+        return false;
+    }
+
+    if (histogram->keys) {
+        for (uint16_t slot = 0; slot < PROFILER_SLOTS; slot++) {
+            // Counts can change while running, a sample more or less does not matter
+            const uint32_t key = histogram->keys[slot];
+            if (key != 0) {
+                len = snprintf(line, sizeof(line), "PROF %08x %u\n", key << PROFILER_PC_SHIFT, histogram->counts[slot]);
+                if (!line_fn(line, len, arg)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return line_fn("PROF end\n", 9, arg);
+}
+
+bool profiler_packet_flush(profiler_packet_t *packet) {
+    if (packet->len > 0) {
+        if (!packet->send_fn(packet->buffer, packet->len, packet->send_arg)) {
+            return false;
+        }
+
+        packet->len = 0;
+    }
+
+    return true;
+}
+
+bool profiler_packet_line(const char *line, const int len, void *arg) {
+    profiler_packet_t *packet = arg;
+
+    if (packet->len + len > PROFILER_PACKET_SIZE && !profiler_packet_flush(packet)) {
+        return false;
+    }
+
+    memcpy(packet->buffer + packet->len, line, len);
+    packet->len += len;
+    packet->lines++;
+
+    return true;
+}
+
+#endif  // PROFILER
@@ -0,0 +1,93 @@
+/*
+ * Sampling Profiler Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * PC histogram and its text output, without hardware access, so they are
+ * checked on host by libs/profiler/test.
+ */
+
+#ifndef __PROFILER_HISTOGRAM_H__
+#define __PROFILER_HISTOGRAM_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "profiler.h"
+
+#define PROFILER_SLOTS              (1 << PROFILER_SLOTS_BITS)
+#define PROFILER_SLOTS_MASK         (PROFILER_SLOTS - 1)
+#define PROFILER_MAX_PROBES         8
+#define PROFILER_PACKET_SIZE        1024
+
+typedef struct _profiler_histogram {
+    // Keys are PC >> PROFILER_PC_SHIFT, 0 means free slot. Both arrays in one allocation
+    uint32_t *keys;
+    uint16_t *counts;
+    uint16_t hz;
+    volatile uint16_t entries;
+    volatile uint32_t samples;
+    volatile uint32_t dropped;  // Not counted because probe limit was reached
+} profiler_histogram_t;
+
+// Counts a sample. Inline, so profiler ISR does not call out of IRAM
+static inline void profiler_histogram_add(profiler_histogram_t *histogram, const uint32_t pc) {
+    histogram->samples++;
+
+    const uint32_t key = pc >> PROFILER_PC_SHIFT;
+    uint16_t slot = ((uint32_t) (key * 2654435761U)) >> (32 - PROFILER_SLOTS_BITS);
+
+    for (uint8_t probe = 0; probe < PROFILER_MAX_PROBES; probe++) {
+        if (histogram->keys[slot] == key) {
+            if (histogram->counts[slot] < UINT16_MAX) {
+                histogram->counts[slot]++;
+            }
+            return;
+        }
+
+        if (histogram->keys[slot] == 0) {
+            histogram->keys[slot] = key;
+            histogram->counts[slot] = 1;
+            histogram->entries++;
+            return;
+        }
+
+        slot = (slot + 1) & PROFILER_SLOTS_MASK;
+    }
+
+    histogram->dropped++;
+}
+
+typedef bool (*profiler_line_fn)(const char *line, const int len, void *arg);
+
+// Calls line_fn with each histogram line, first and last ones included
+bool profiler_histogram_lines(const profiler_histogram_t *histogram, profiler_line_fn line_fn, void *arg);
+
+// Joins lines into datagrams of up to PROFILER_PACKET_SIZE bytes, never splitting a line
+typedef struct _profiler_packet {
+    bool (*send_fn)(const char *data, const uint16_t len, void *arg);
+    void *send_arg;
+    char *buffer;
+    uint16_t len;
+    uint16_t lines;
+} profiler_packet_t;
+
+// profiler_line_fn for profiler_histogram_lines(), arg is a profiler_packet_t
+bool profiler_packet_line(const char *line, const int len, void *arg);
+bool profiler_packet_flush(profiler_packet_t *packet);
+
+#endif  // __PROFILER_HISTOGRAM_H__
@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+#
+# Sampling Profiler symbolizer host check
+#
+# Copyright 2020 José A. Jiménez (@RavenSystem)
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Runs profile_symbolize.py on the profile written by profiler_test, with a
+# fake nm for the synthetic firmware, and checks samples per function.
+# Layout must match profiler_test.c.
+#
+#   python3 profile_symbolize_test.py profiler_test.prof
+
+import os
+import stat
+import subprocess
+import sys
+import tempfile
+
+FUNCTION_COUNT = 20
+FUNCTION_BASE = 0x40201000
+FUNCTION_SIZE = 0x80
+IRAM_SAMPLES = 5
+
+SCRIPT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "profile_symbolize.py")
+
+failures = 0
+
+
+def check(cond, message):
+    global failures
+    if not cond:
+        print("FAIL %s" % message)
+        failures += 1
+
+
+def fake_nm(directory):
+    lines = ["%08x %08x T func_%02d" % (FUNCTION_BASE + f * FUNCTION_SIZE, FUNCTION_SIZE, f)
+             for f in range(FUNCTION_COUNT)]
+    # Data and sizeless symbols, first must be ignored and second must not hide [iram]
+    lines.append("3ffe8000 00000100 D some_data")
+    lines.append("40000100 T rom_function")
+
+    path = os.path.join(directory, "nm")
+    with open(path, "w") as nm:
+        nm.write("#!/bin/sh\ncat <<EOF\n%s\nEOF\n" % "\n".join(lines))
+    os.chmod(path, os.stat(path).st_mode | stat.S_IEXEC)
+    return path
+
+
+def symbolize(nm, profile_file=None, stdin=None):
+    args = [sys.executable, SCRIPT, "--elf", "haamain.out", "--nm", nm, "--top", "0"]
+    if profile_file:
+        args.append(profile_file)
+
+    output = subprocess.run(args, input=stdin, check=True, stdout=subprocess.PIPE,
+                            universal_newlines=True).stdout
+
+    header = []
+    functions = {}
+    for line in output.splitlines():
+        if line.startswith("#"):
+            header.append(line)
+        elif "%" in line:
+            fields = line.split()
+            if len(fields) == 4 and fields[0] != "self%":
+                functions[fields[3]] = int(fields[2])
+
+    return header, functions
+
+
+def main():
+    profile_file = sys.argv[1]
+
+    expected = {"func_%02d" % f: (f % 4 + 1) * (f + 1) for f in range(FUNCTION_COUNT)}
+    expected["[iram]"] = IRAM_SAMPLES
+    samples = sum(expected.values())
+    entries = sum(f % 4 + 1 for f in range(FUNCTION_COUNT)) + 1
+
+    with tempfile.TemporaryDirectory() as directory:
+        nm = fake_nm(directory)
+
+        header, functions = symbolize(nm, profile_file)
+        check(header[0] == "# hz=997 samples=%d entries=%d dropped=0" % (samples, entries), "header %s" % header[0])
+        check(header[1] == "# %d samples in %d functions" % (samples, len(expected)), "summary %s" % header[1])
+        check(functions == expected, "functions %s" % functions)
+
+        # Capture cut before end line, from stdin
+        with open(profile_file) as profile:
+            text = profile.read()
+        truncated = text[:text.index("PROF end")]
+        header, functions = symbolize(nm, stdin=truncated)
+        check(functions == expected, "truncated functions %s" % functions)
+
+    if failures > 0:
+        print("%d checks failed" % failures)
+        sys.exit(1)
+
+    print("profile_symbolize: all checks passed")
+
+
+if __name__ == "__main__":
+    main()
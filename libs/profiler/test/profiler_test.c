@@ -0,0 +1,253 @@
+/*
+ * Sampling Profiler host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Feeds PCs to the histogram like profiler ISR does, and checks its counts,
+ * the UDP packets built from it, and, with a file argument, writes a profile
+ * for profile_symbolize_test.py. Layout of that profile must match
+ * profile_symbolize_test.py.
+ *
+ *   make -C libs/profiler/test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profiler_histogram.h"
+
+// Synthetic firmware, see profile_symbolize_test.py
+#define FUNCTION_COUNT      20
+#define FUNCTION_BASE       0x40201000
+#define FUNCTION_SIZE       0x80
+#define IRAM_PC             0x40100010
+#define IRAM_SAMPLES        5
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void histogram_init(profiler_histogram_t *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->keys = calloc(PROFILER_SLOTS, sizeof(uint32_t) + sizeof(uint16_t));
+    histogram->counts = (uint16_t *) (histogram->keys + PROFILER_SLOTS);
+    histogram->hz = PROFILER_DEFAULT_HZ;
+}
+
+static uint32_t histogram_count(const profiler_histogram_t *histogram, const uint32_t pc) {
+    for (uint16_t slot = 0; slot < PROFILER_SLOTS; slot++) {
+        if (histogram->keys[slot] == pc >> PROFILER_PC_SHIFT) {
+            return histogram->counts[slot];
+        }
+    }
+
+    return 0;
+}
+
+static uint32_t histogram_total(const profiler_histogram_t *histogram) {
+    uint32_t total = 0;
+    uint16_t used = 0;
+    for (uint16_t slot = 0; slot < PROFILER_SLOTS; slot++) {
+        if (histogram->keys[slot] != 0) {
+            total += histogram->counts[slot];
+            used++;
+        }
+    }
+
+    CHECK(used == histogram->entries, "used slots %u, entries %u", used, histogram->entries);
+
+    return total;
+}
+
+static void fill_functions(profiler_histogram_t *histogram) {
+    for (uint8_t f = 0; f < FUNCTION_COUNT; f++) {
+        for (uint8_t pc = 0; pc <= f % 4; pc++) {
+            for (uint8_t n = 0; n <= f; n++) {
+                // Both PCs inside one histogram bucket
+                profiler_histogram_add(histogram, FUNCTION_BASE + f * FUNCTION_SIZE + pc * 4 + (n & 1));
+            }
+        }
+    }
+
+    for (uint8_t n = 0; n < IRAM_SAMPLES; n++) {
+        profiler_histogram_add(histogram, IRAM_PC);
+    }
+}
+
+static void check_histogram() {
+    profiler_histogram_t histogram;
+    histogram_init(&histogram);
+
+    fill_functions(&histogram);
+
+    uint32_t samples = IRAM_SAMPLES;
+    uint16_t entries = 1;
+    for (uint8_t f = 0; f < FUNCTION_COUNT; f++) {
+        samples += (f % 4 + 1) * (f + 1);
+        entries += f % 4 + 1;
+        CHECK(histogram_count(&histogram, FUNCTION_BASE + f * FUNCTION_SIZE) == f + 1u,
+              "function %u count %u", f, histogram_count(&histogram, FUNCTION_BASE + f * FUNCTION_SIZE));
+    }
+
+    CHECK(histogram.samples == samples && histogram.entries == entries && histogram.dropped == 0,
+          "samples %u/%u, entries %u/%u, dropped %u", histogram.samples, samples, histogram.entries, entries, histogram.dropped);
+    CHECK(histogram_total(&histogram) == samples, "counted %u of %u", histogram_total(&histogram), samples);
+
+    // Count saturates instead of wrapping
+    for (uint32_t n = 0; n < UINT16_MAX + 10; n++) {
+        profiler_histogram_add(&histogram, IRAM_PC);
+    }
+    CHECK(histogram_count(&histogram, IRAM_PC) == UINT16_MAX, "saturated count %u", histogram_count(&histogram, IRAM_PC));
+
+    free(histogram.keys);
+
+    // More distinct PCs than slots, every sample is either counted or dropped
+    histogram_init(&histogram);
+    srand(1);
+    for (uint32_t n = 0; n < PROFILER_SLOTS * 4; n++) {
+        profiler_histogram_add(&histogram, 0x40200000 + (rand() % (PROFILER_SLOTS * 2)) * 4);
+    }
+
+    CHECK(histogram.dropped > 0 && histogram.entries <= PROFILER_SLOTS, "full table entries %u, dropped %u",
+          histogram.entries, histogram.dropped);
+    CHECK(histogram_total(&histogram) + histogram.dropped == histogram.samples, "full table counted %u + dropped %u of %u",
+          histogram_total(&histogram), histogram.dropped, histogram.samples);
+
+    free(histogram.keys);
+}
+
+typedef struct _text {
+    char *data;
+    size_t len;
+    uint16_t packets;
+    uint16_t fail_at;       // Packet number that fails to send, 0 never
+} text_t;
+
+static bool text_line(const char *line, const int len, void *arg) {
+    text_t *text = arg;
+    text->data = realloc(text->data, text->len + len + 1);
+    memcpy(text->data + text->len, line, len);
+    text->len += len;
+    text->data[text->len] = 0;
+
+    return true;
+}
+
+static bool text_packet(const char *data, const uint16_t len, void *arg) {
+    text_t *text = arg;
+    text->packets++;
+    if (text->packets == text->fail_at) {
+        return false;
+    }
+
+    CHECK(len > 0 && len <= PROFILER_PACKET_SIZE, "packet %u size %u", text->packets, len);
+    CHECK(data[len - 1] == '\n' && strncmp(data, "PROF ", 5) == 0, "packet %u splits a line", text->packets);
+
+    return text_line(data, len, arg);
+}
+
+static bool send_all(const profiler_histogram_t *histogram, text_t *text, uint16_t *lines) {
+    profiler_packet_t packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.buffer = malloc(PROFILER_PACKET_SIZE);
+    packet.send_fn = text_packet;
+    packet.send_arg = text;
+
+    const bool result = profiler_histogram_lines(histogram, profiler_packet_line, &packet) && profiler_packet_flush(&packet);
+    *lines = packet.lines;
+
+    free(packet.buffer);
+    return result;
+}
+
+static void check_packets(const char *profile_file) {
+    profiler_histogram_t histogram;
+    histogram_init(&histogram);
+
+    // Empty histogram is still a begin and end pair
+    text_t direct = { 0 };
+    text_t packets = { 0 };
+    uint16_t lines;
+    CHECK(send_all(&histogram, &packets, &lines) && lines == 2 && packets.packets == 1, "empty: %u lines, %u packets", lines, packets.packets);
+    CHECK(strcmp(packets.data, "PROF begin hz=997 samples=0 entries=0 dropped=0\nPROF end\n") == 0, "empty: %s", packets.data);
+    free(packets.data);
+
+    // Big enough for several packets
+    fill_functions(&histogram);
+    for (uint16_t n = 0; n < 150; n++) {
+        profiler_histogram_add(&histogram, 0x40220000 + n * 64);
+    }
+
+    memset(&packets, 0, sizeof(packets));
+    CHECK(profiler_histogram_lines(&histogram, text_line, &direct), "direct lines");
+    CHECK(send_all(&histogram, &packets, &lines), "send");
+    CHECK(lines == histogram.entries + 2, "%u lines for %u entries", lines, histogram.entries);
+    CHECK(packets.packets == (direct.len + PROFILER_PACKET_SIZE - 1) / PROFILER_PACKET_SIZE
+          || packets.packets == (direct.len + PROFILER_PACKET_SIZE - 1) / PROFILER_PACKET_SIZE + 1,
+          "%u packets for %zu bytes", packets.packets, direct.len);
+    CHECK(packets.len == direct.len && memcmp(packets.data, direct.data, direct.len) == 0, "packets differ from lines");
+    free(packets.data);
+
+    // Send error stops output
+    memset(&packets, 0, sizeof(packets));
+    packets.fail_at = 2;
+    CHECK(!send_all(&histogram, &packets, &lines) && packets.packets == 2, "send error after %u packets", packets.packets);
+    free(packets.data);
+    free(direct.data);
+    free(histogram.keys);
+
+    if (profile_file) {
+        histogram_init(&histogram);
+        fill_functions(&histogram);
+
+        FILE *file = fopen(profile_file, "w");
+        if (!file) {
+            CHECK(false, "can not write %s", profile_file);
+        } else {
+            memset(&packets, 0, sizeof(packets));
+            send_all(&histogram, &packets, &lines);
+
+            // Serial log noise around it must be ignored
+            fprintf(file, "HAA boot\nPROF junk\n%s>>> other log\n", packets.data);
+            fclose(file);
+            free(packets.data);
+        }
+
+        free(histogram.keys);
+    }
+}
+
+int main(int argc, char **argv) {
+    check_histogram();
+    check_packets(argc > 1 ? argv[1] : NULL);
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("profiler: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Component makefile for sensor_filter
+
+INC_DIRS += $(sensor_filter_ROOT)
+
+sensor_filter_INC_DIR = $(sensor_filter_ROOT)
+sensor_filter_SRC_DIR = $(sensor_filter_ROOT)
+
+$(eval $(call component_compile_rules,sensor_filter))
@@ -0,0 +1,144 @@
+/*
+ * Sensor Value Filter
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "sensor_filter.h"
+
+static uint8_t sensor_filter_window_size(const uint8_t size) {
+    if (size > SENSOR_FILTER_MAX_WINDOW) {
+        return SENSOR_FILTER_MAX_WINDOW;
+    }
+
+    return size;
+}
+
+bool sensor_filter_init(sensor_filter_t *sensor_filter, uint8_t median_size, uint8_t average_size, const float step, const float min_delta, const uint32_t min_interval_ms) {
+    memset(sensor_filter, 0, sizeof(*sensor_filter));
+
+    median_size = sensor_filter_window_size(median_size);
+    average_size = sensor_filter_window_size(average_size);
+
+    if (median_size > 1) {
+        sensor_filter->median_window = malloc(median_size * sizeof(float));
+        if (!sensor_filter->median_window) {
+            return false;
+        }
+        sensor_filter->median_size = median_size;
+    }
+
+    if (average_size > 1) {
+        sensor_filter->average_window = malloc(average_size * sizeof(float));
+        if (!sensor_filter->average_window) {
+            free(sensor_filter->median_window);
+            sensor_filter->median_window = NULL;
+            sensor_filter->median_size = 0;
+            return false;
+        }
+        sensor_filter->average_size = average_size;
+    }
+
+    sensor_filter->step = step;
+    sensor_filter->min_delta = min_delta;
+    sensor_filter->min_interval_ms = min_interval_ms;
+
+    return true;
+}
+
+// Adds value to ring window and returns number of valid entries
+static uint8_t sensor_filter_push(float *window, const uint8_t size, uint8_t *count, uint8_t *pos, const float value) {
+    window[*pos] = value;
+    *pos = (*pos + 1) % size;
+    if (*count < size) {
+        (*count)++;
+    }
+
+    return *count;
+}
+
+static float sensor_filter_median(const float *window, const uint8_t count) {
+    float sorted[SENSOR_FILTER_MAX_WINDOW];
+    for (uint8_t i = 0; i < count; i++) {
+        const float value = window[i];
+        uint8_t j = i;
+        while (j > 0 && sorted[j - 1] > value) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = value;
+    }
+
+    if ((count & 1) == 0) {
+        return (sorted[(count >> 1) - 1] + sorted[count >> 1]) * 0.5f;
+    }
+
+    return sorted[count >> 1];
+}
+
+bool sensor_filter_process(sensor_filter_t *sensor_filter, float value, const uint32_t now_ms, float *result) {
+    if (sensor_filter->median_size > 1) {
+        const uint8_t count = sensor_filter_push(sensor_filter->median_window, sensor_filter->median_size,
+                                                 &sensor_filter->median_count, &sensor_filter->median_pos, value);
+        value = sensor_filter_median(sensor_filter->median_window, count);
+    }
+
+    if (sensor_filter->average_size > 1) {
+        const uint8_t count = sensor_filter_push(sensor_filter->average_window, sensor_filter->average_size,
+                                                 &sensor_filter->average_count, &sensor_filter->average_pos, value);
+        float sum = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            sum += sensor_filter->average_window[i];
+        }
+        value = sum / count;
+    }
+
+    if (sensor_filter->step > 0) {
+        value = roundf(value / sensor_filter->step) * sensor_filter->step;
+    }
+
+    if (sensor_filter->has_value) {
+        if ((uint32_t) (now_ms - sensor_filter->last_ms) < sensor_filter->min_interval_ms) {
+            return false;
+        }
+
+        // Rounded values are not exact, so a delta equal to min_delta can be a bit smaller
+        const float delta = fabsf(value - sensor_filter->value);
+        if (delta == 0 || delta < sensor_filter->min_delta * 0.999f) {
+            return false;
+        }
+    }
+
+    sensor_filter->value = value;
+    sensor_filter->last_ms = now_ms;
+    sensor_filter->has_value = true;
+
+    *result = value;
+
+    return true;
+}
+
+void sensor_filter_reset(sensor_filter_t *sensor_filter) {
+    sensor_filter->median_count = 0;
+    sensor_filter->median_pos = 0;
+    sensor_filter->average_count = 0;
+    sensor_filter->average_pos = 0;
+    sensor_filter->has_value = false;
+}
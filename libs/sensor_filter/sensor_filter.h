@@ -0,0 +1,70 @@
+/*
+ * Sensor Value Filter
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Smoothing and change thresholds for sensor values before publishing them.
+ *
+ * Each new value goes through, when enabled:
+ *   1. Median of last N values, to remove spikes
+ *   2. Moving average of last N medians
+ *   3. Rounding to a step, like HomeKit 0.1 degrees
+ *   4. Minimum interval since last published value
+ *   5. Minimum difference with last published value
+ *
+ * Values held by 4 or 5 are not lost, they are checked again with next value.
+ */
+
+#ifndef __SENSOR_FILTER_H__
+#define __SENSOR_FILTER_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SENSOR_FILTER_MAX_WINDOW    16
+
+typedef struct _sensor_filter {
+    uint8_t median_size;
+    uint8_t average_size;
+    uint8_t median_count;
+    uint8_t average_count;
+    uint8_t median_pos;
+    uint8_t average_pos;
+    bool has_value;
+
+    float step;
+    float min_delta;
+    uint32_t min_interval_ms;
+
+    float value;                // Last published
+    uint32_t last_ms;
+
+    float *median_window;
+    float *average_window;
+} sensor_filter_t;
+
+// Windows of 0 or 1 disable stages. Returns false if there is no memory
+bool sensor_filter_init(sensor_filter_t *sensor_filter, uint8_t median_size, uint8_t average_size, const float step, const float min_delta, const uint32_t min_interval_ms);
+
+// Returns true and result if value must be published
+bool sensor_filter_process(sensor_filter_t *sensor_filter, float value, const uint32_t now_ms, float *result);
+
+// Next value is published without thresholds, like after a sensor error
+void sensor_filter_reset(sensor_filter_t *sensor_filter);
+
+#endif  // __SENSOR_FILTER_H__
@@ -0,0 +1,248 @@
+/*
+ * Sensor Value Filter host checks
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Checks median, moving average, step, interval and delta stages, reset,
+ * and windows of 1 and SENSOR_FILTER_MAX_WINDOW. It is included with
+ * counted malloc and free, so failed allocations can be checked for leaks.
+ *
+ *   make -C libs/sensor_filter/test
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int allocations = 0;
+static int fail_allocation = 0;     // Allocation number that fails, 0 never
+
+static void *test_malloc(size_t size) {
+    if (++allocations == fail_allocation) {
+        allocations--;
+        return NULL;
+    }
+
+    return malloc(size);
+}
+
+static void test_free(void *ptr) {
+    if (ptr) {
+        allocations--;
+    }
+
+    free(ptr);
+}
+
+#define malloc test_malloc
+#define free test_free
+#include "sensor_filter.c"
+#undef malloc
+#undef free
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static void filter_free(sensor_filter_t *sensor_filter) {
+    test_free(sensor_filter->median_window);
+    test_free(sensor_filter->average_window);
+    memset(sensor_filter, 0, sizeof(*sensor_filter));
+}
+
+// Feeds values one per second and returns how many were published, with last one
+static uint8_t feed(sensor_filter_t *sensor_filter, const float *values, const uint8_t count, uint32_t *now_ms, float *published) {
+    uint8_t publish_count = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        float result;
+        if (sensor_filter_process(sensor_filter, values[i], *now_ms, &result)) {
+            *published = result;
+            publish_count++;
+        }
+        *now_ms += 1000;
+    }
+
+    return publish_count;
+}
+
+static void check_init() {
+    sensor_filter_t sensor_filter;
+
+    // Windows of 0 and 1 allocate nothing and pass values through
+    for (uint8_t size = 0; size <= 1; size++) {
+        CHECK(sensor_filter_init(&sensor_filter, size, size, 0, 0, 0), "window %u", size);
+        CHECK(sensor_filter.median_window == NULL && sensor_filter.average_window == NULL && allocations == 0, "window %u allocates", size);
+
+        float result = 0;
+        CHECK(sensor_filter_process(&sensor_filter, 21.37f, 0, &result) && result == 21.37f, "window %u value %f", size, result);
+        CHECK(sensor_filter_process(&sensor_filter, -3.5f, 1, &result) && result == -3.5f, "window %u value %f", size, result);
+        filter_free(&sensor_filter);
+    }
+
+    // Windows over max are limited
+    CHECK(sensor_filter_init(&sensor_filter, 200, SENSOR_FILTER_MAX_WINDOW + 1, 0, 0, 0), "big windows");
+    CHECK(sensor_filter.median_size == SENSOR_FILTER_MAX_WINDOW && sensor_filter.average_size == SENSOR_FILTER_MAX_WINDOW,
+          "windows %u and %u", sensor_filter.median_size, sensor_filter.average_size);
+    filter_free(&sensor_filter);
+
+    // Failed allocations leave nothing allocated
+    for (fail_allocation = 1; fail_allocation <= 2; fail_allocation++) {
+        allocations = 0;
+        CHECK(!sensor_filter_init(&sensor_filter, 5, 5, 0, 0, 0), "allocation %i failed but init did not", fail_allocation);
+        CHECK(allocations == 0, "allocation %i failed, %i blocks leaked", fail_allocation, allocations);
+        CHECK(sensor_filter.median_window == NULL && sensor_filter.median_size == 0 && sensor_filter.average_size == 0,
+              "allocation %i failed, stages left enabled", fail_allocation);
+    }
+    fail_allocation = 0;
+    allocations = 0;
+}
+
+static void check_median() {
+    sensor_filter_t sensor_filter;
+    CHECK(sensor_filter_init(&sensor_filter, 5, 0, 0, 0, 0), "median init");
+
+    // Spike is removed, median of partial window is used until it is full. Unchanged values are not published
+    const float values[] = { 20, 21, 80, 22, 23, -40, 24 };
+    const float medians[] = { 20, 20.5f, 21, 21.5f, 22, 22, 23 };
+    float result = 0;
+    for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        const bool published = sensor_filter_process(&sensor_filter, values[i], i, &result);
+        CHECK(published == (i == 0 || medians[i] != medians[i - 1]) && result == medians[i],
+              "median %u: %f, expected %f", i, result, medians[i]);
+    }
+    filter_free(&sensor_filter);
+
+    // Max window, ring overwrites oldest values
+    CHECK(sensor_filter_init(&sensor_filter, SENSOR_FILTER_MAX_WINDOW, 0, 0, 0, 0), "max median init");
+    for (uint8_t i = 0; i < SENSOR_FILTER_MAX_WINDOW * 3; i++) {
+        sensor_filter_process(&sensor_filter, i, i, &result);
+    }
+    const float expected = SENSOR_FILTER_MAX_WINDOW * 3 - 1 - (SENSOR_FILTER_MAX_WINDOW - 1) * 0.5f;
+    CHECK(result == expected, "max window median %f, expected %f", result, expected);
+    CHECK(sensor_filter.median_count == SENSOR_FILTER_MAX_WINDOW, "max window count %u", sensor_filter.median_count);
+    filter_free(&sensor_filter);
+}
+
+static void check_average() {
+    sensor_filter_t sensor_filter;
+    CHECK(sensor_filter_init(&sensor_filter, 0, 4, 0, 0, 0), "average init");
+
+    const float values[] = { 10, 20, 30, 40, 50, 10 };
+    const float averages[] = { 10, 15, 20, 25, 35, 32.5f };
+    uint32_t now_ms = 0;
+    for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+        float result = 0;
+        sensor_filter_process(&sensor_filter, values[i], now_ms, &result);
+        CHECK(fabsf(result - averages[i]) < 0.0001f, "average %u: %f, expected %f", i, result, averages[i]);
+    }
+    filter_free(&sensor_filter);
+
+    // Median then average, at max windows, a constant input stays exact and is published once
+    CHECK(sensor_filter_init(&sensor_filter, SENSOR_FILTER_MAX_WINDOW, SENSOR_FILTER_MAX_WINDOW, 0, 0, 0), "max windows init");
+    uint8_t publish_count = 0;
+    for (uint8_t i = 0; i < SENSOR_FILTER_MAX_WINDOW * 2; i++) {
+        float result = 0;
+        if (sensor_filter_process(&sensor_filter, 18.25f, i, &result)) {
+            publish_count++;
+            CHECK(result == 18.25f, "constant input %u: %f", i, result);
+        }
+    }
+    CHECK(publish_count == 1 && sensor_filter.value == 18.25f, "constant input published %u times", publish_count);
+    filter_free(&sensor_filter);
+}
+
+static void check_thresholds() {
+    sensor_filter_t sensor_filter;
+    CHECK(sensor_filter_init(&sensor_filter, 0, 0, 0.1f, 0.2f, 5000), "thresholds init");
+
+    uint32_t now_ms = 0;
+    float published = 0;
+
+    // First value always, rounded to step
+    const float first[] = { 21.04f };
+    CHECK(feed(&sensor_filter, first, 1, &now_ms, &published) == 1 && fabsf(published - 21.0f) < 0.0001f, "first %f", published);
+
+    // Big change inside min interval is held, and published by next value after it
+    const float held[] = { 25, 25, 25, 25, 25 };
+    CHECK(feed(&sensor_filter, held, 4, &now_ms, &published) == 0, "published inside interval");
+    CHECK(feed(&sensor_filter, held, 1, &now_ms, &published) == 1 && fabsf(published - 25) < 0.0001f, "held value %f", published);
+
+    // Changes under min delta are not published, equal to it are
+    now_ms += 10000;
+    const float small[] = { 25.14f };
+    CHECK(feed(&sensor_filter, small, 1, &now_ms, &published) == 0, "change under min delta published");
+    const float exact[] = { 25.2f };
+    CHECK(feed(&sensor_filter, exact, 1, &now_ms, &published) == 1 && fabsf(published - 25.2f) < 0.0001f, "min delta %f", published);
+
+    // Reset publishes next value at once
+    sensor_filter_reset(&sensor_filter);
+    const float after_reset[] = { 25.2f };
+    CHECK(feed(&sensor_filter, after_reset, 1, &now_ms, &published) == 1, "value after reset not published");
+
+    // Interval wraps with millisecond counter
+    sensor_filter_reset(&sensor_filter);
+    now_ms = UINT32_MAX - 1000;
+    const float wrap[] = { 10, 20, 20, 20, 20, 20, 20 };
+    CHECK(feed(&sensor_filter, wrap, 1, &now_ms, &published) == 1, "value before wrap");
+    CHECK(feed(&sensor_filter, wrap + 1, 4, &now_ms, &published) == 0, "published inside interval across wrap");
+    CHECK(feed(&sensor_filter, wrap + 1, 1, &now_ms, &published) == 1, "not published after interval across wrap");
+
+    filter_free(&sensor_filter);
+}
+
+static void check_reset() {
+    sensor_filter_t sensor_filter;
+    CHECK(sensor_filter_init(&sensor_filter, 3, 3, 0, 0, 0), "reset init");
+
+    float result = 0;
+    for (uint8_t i = 0; i < 6; i++) {
+        sensor_filter_process(&sensor_filter, 100, i, &result);
+    }
+
+    // Old values are forgotten, first one after reset is taken as is
+    sensor_filter_reset(&sensor_filter);
+    CHECK(sensor_filter.median_count == 0 && sensor_filter.average_count == 0 && !sensor_filter.has_value, "reset state");
+    CHECK(sensor_filter_process(&sensor_filter, 5, 10, &result) && result == 5, "first after reset %f", result);
+
+    filter_free(&sensor_filter);
+}
+
+int main() {
+    check_init();
+    check_median();
+    check_average();
+    check_thresholds();
+    check_reset();
+
+    CHECK(allocations == 0, "%i blocks leaked", allocations);
+
+    if (failures > 0) {
+        printf("%i checks failed\n", failures);
+        return 1;
+    }
+
+    printf("sensor_filter: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,8 @@
+# Component makefile for task_stats
+
+INC_DIRS += $(task_stats_ROOT)
+
+task_stats_INC_DIR = $(task_stats_ROOT)
+task_stats_SRC_DIR = $(task_stats_ROOT)
+
+$(eval $(call component_compile_rules,task_stats))
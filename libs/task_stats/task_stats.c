@@ -0,0 +1,232 @@
+/*
+ * Task Stats Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifdef TASK_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include "task_stats.h"
+
+#if configUSE_TRACE_FACILITY != 1 || configGENERATE_RUN_TIME_STATS != 1
+#error "TASK_STATS needs configUSE_TRACE_FACILITY and configGENERATE_RUN_TIME_STATS"
+#endif
+
+#define TASK_STATS_TASK_SIZE        (configMINIMAL_STACK_SIZE * 2)
+#define TASK_STATS_TASK_PRIORITY    (tskIDLE_PRIORITY + 0)
+
+// Run time counter of each task in previous update. Task numbers are never
+// reused, unlike handles of deleted tasks
+typedef struct _task_stats_run_time {
+    UBaseType_t number;
+    uint32_t run_time;
+} task_stats_run_time_t;
+
+static task_stats_entry_t entries[TASK_STATS_MAX_TASKS];
+static uint8_t entry_count = 0;
+static uint8_t untracked = 0;
+
+static task_stats_run_time_t last_run_times[TASK_STATS_MAX_TASKS];
+static uint8_t last_run_time_count = 0;
+
+static TaskHandle_t stats_task = NULL;
+static uint32_t stats_period_ms = TASK_STATS_PERIOD_MS;
+
+// Entries are only changed with scheduler suspended
+static task_stats_entry_t *task_stats_entry(const char *name) {
+    for (uint8_t i = 0; i < entry_count; i++) {
+        if (strncmp(entries[i].name, name, TASK_STATS_NAME_SIZE) == 0) {
+            return &entries[i];
+        }
+    }
+
+    if (entry_count == TASK_STATS_MAX_TASKS) {
+        return NULL;
+    }
+
+    task_stats_entry_t *entry = &entries[entry_count];
+    entry_count++;
+
+    memset(entry, 0, sizeof(*entry));
+    strncpy(entry->name, name, TASK_STATS_NAME_SIZE - 1);
+    entry->stack_free_min = UINT16_MAX;
+
+    return entry;
+}
+
+// Returns true when entry gets flagged
+static bool task_stats_stack(task_stats_entry_t *entry, const uint32_t stack_free) {
+    if (stack_free < entry->stack_free_min) {
+        entry->stack_free_min = stack_free;
+
+        if (!entry->stack_low && stack_free < TASK_STATS_STACK_LOW) {
+            entry->stack_low = true;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void task_stats_warning(const char *name, const uint16_t stack_free) {
+    printf("! Task %s stack free %u bytes\n", name, stack_free);
+}
+
+void task_stats_update() {
+    UBaseType_t task_count = uxTaskGetNumberOfTasks() + 2;
+    TaskStatus_t *status = malloc(sizeof(TaskStatus_t) * task_count);
+    if (!status) {
+        return;
+    }
+
+    task_count = uxTaskGetSystemState(status, task_count, NULL);
+
+    uint32_t deltas[TASK_STATS_MAX_TASKS];
+    memset(deltas, 0, sizeof(deltas));
+    uint64_t total = 0;
+    uint32_t flagged = 0;
+
+    vTaskSuspendAll();
+
+    for (uint8_t i = 0; i < entry_count; i++) {
+        entries[i].running = 0;
+    }
+    untracked = 0;
+
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        // New tasks count all their run time since they were created
+        uint32_t delta = status[i].ulRunTimeCounter;
+        for (uint8_t j = 0; j < last_run_time_count; j++) {
+            if (last_run_times[j].number == status[i].xTaskNumber) {
+                delta -= last_run_times[j].run_time;
+                break;
+            }
+        }
+        total += delta;
+
+        task_stats_entry_t *entry = task_stats_entry(status[i].pcTaskName);
+        if (!entry) {
+            untracked++;
+            continue;
+        }
+
+        const uint8_t index = entry - entries;
+        deltas[index] += delta;
+
+        if (entry->running < UINT8_MAX) {
+            entry->running++;
+        }
+
+        if (task_stats_stack(entry, status[i].usStackHighWaterMark * sizeof(StackType_t))) {
+            flagged |= 1 << index;
+        }
+    }
+
+    last_run_time_count = 0;
+    for (UBaseType_t i = 0; i < task_count && i < TASK_STATS_MAX_TASKS; i++) {
+        last_run_times[i].number = status[i].xTaskNumber;
+        last_run_times[i].run_time = status[i].ulRunTimeCounter;
+        last_run_time_count++;
+    }
+
+    for (uint8_t i = 0; i < entry_count; i++) {
+        entries[i].cpu_permille = total > 0 ? (deltas[i] * 1000ULL) / total : 0;
+    }
+
+    xTaskResumeAll();
+
+    free(status);
+
+    for (uint8_t i = 0; flagged != 0; i++, flagged >>= 1) {
+        if (flagged & 1) {
+            task_stats_warning(entries[i].name, entries[i].stack_free_min);
+        }
+    }
+}
+
+void task_stats_record(TaskHandle_t task) {
+    const uint32_t stack_free = uxTaskGetStackHighWaterMark(task) * sizeof(StackType_t);
+    const char *name = pcTaskGetName(task);
+
+    vTaskSuspendAll();
+    task_stats_entry_t *entry = task_stats_entry(name);
+    const bool flagged = entry && task_stats_stack(entry, stack_free);
+    xTaskResumeAll();
+
+    if (flagged) {
+        task_stats_warning(name, stack_free);
+    }
+}
+
+void task_stats_task_delete(TaskHandle_t task) {
+    task_stats_record(task);
+    vTaskDelete(task);
+}
+
+bool task_stats_get(const uint8_t index, task_stats_entry_t *entry) {
+    bool found = false;
+
+    vTaskSuspendAll();
+    if (index < entry_count) {
+        *entry = entries[index];
+        found = true;
+    }
+    xTaskResumeAll();
+
+    return found;
+}
+
+uint8_t task_stats_untracked() {
+    return untracked;
+}
+
+void task_stats_print() {
+    printf("Tasks: period %u ms, %u untracked\n", stats_period_ms, untracked);
+
+    task_stats_entry_t entry;
+    for (uint8_t i = 0; task_stats_get(i, &entry); i++) {
+        printf("Task %-16s %2u running, cpu %3u.%u%%, stack free min %5u%s\n",
+               entry.name, entry.running, entry.cpu_permille / 10, entry.cpu_permille % 10,
+               entry.stack_free_min, entry.stack_low ? " !" : "");
+    }
+}
+
+static void task_stats_task(void *args) {
+    for (;;) {
+        vTaskDelay(stats_period_ms / portTICK_PERIOD_MS);
+
+        task_stats_update();
+        task_stats_print();
+    }
+}
+
+bool task_stats_start(const uint32_t period_ms) {
+    if (stats_task) {
+        return true;
+    }
+
+    stats_period_ms = period_ms;
+
+    return xTaskCreate(task_stats_task, "task_stats", TASK_STATS_TASK_SIZE, NULL, TASK_STATS_TASK_PRIORITY, &stats_task) == pdPASS;
+}
+
+#endif  // TASK_STATS
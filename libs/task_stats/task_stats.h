@@ -0,0 +1,83 @@
+/*
+ * Task Stats Library
+ *
+ * Copyright 2020 José A. Jiménez (@RavenSystem)
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Per task CPU usage and stack high water mark. Only built with -DTASK_STATS.
+ *
+ * A low priority task calls uxTaskGetSystemState() every period and keeps a
+ * table by task name, so short lived tasks with same name share one entry.
+ * CPU usage is the share of CPU cycle counter time each task got during
+ * last period. Run time stats must be enabled in FreeRTOSConfig.h, see
+ * devices/HAA/FreeRTOSConfig.h.
+ *
+ * Tasks deleted between two updates are not seen by the periodic update. A
+ * source file defines TASK_STATS_HOOK_DELETE and includes this header after
+ * all other headers, so its vTaskDelete() calls record stack high water mark
+ * of the deleted task first.
+ */
+
+#ifndef __TASK_STATS_H__
+#define __TASK_STATS_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+#ifndef TASK_STATS_MAX_TASKS
+#define TASK_STATS_MAX_TASKS        24
+#endif
+
+#ifndef TASK_STATS_PERIOD_MS
+#define TASK_STATS_PERIOD_MS        20000   // Cycle counter per task must not wrap in a period
+#endif
+
+#ifndef TASK_STATS_STACK_LOW
+#define TASK_STATS_STACK_LOW        128     // Free stack bytes to flag a task
+#endif
+
+#define TASK_STATS_NAME_SIZE        (configMAX_TASK_NAME_LEN)
+
+typedef struct _task_stats_entry {
+    char name[TASK_STATS_NAME_SIZE];
+    uint16_t stack_free_min;        // Lowest free stack ever seen, bytes
+    uint16_t cpu_permille;          // Last period
+    uint8_t running;                // Tasks with this name in last update
+    bool stack_low;                 // stack_free_min < TASK_STATS_STACK_LOW
+} task_stats_entry_t;
+
+// Starts periodic update task. Returns false if it could not be created
+bool task_stats_start(const uint32_t period_ms);
+
+void task_stats_update();
+
+// Records current stack high water mark of task, NULL for calling task
+void task_stats_record(TaskHandle_t task);
+void task_stats_task_delete(TaskHandle_t task);
+
+// Copies entry at index, returns false past last one
+bool task_stats_get(const uint8_t index, task_stats_entry_t *entry);
+uint8_t task_stats_untracked();     // Tasks in last update without entry because table was full
+
+void task_stats_print();
+
+#ifdef TASK_STATS_HOOK_DELETE
+#define vTaskDelete(task)           task_stats_task_delete(task)
+#endif  // TASK_STATS_HOOK_DELETE
+
+#endif  // __TASK_STATS_H__